@@ -16,30 +16,279 @@ extern "C" {
 typedef bool (* rkv_encode_operation )( net_buff buffer, const void * src, utils_map codecs );
 typedef bool (* rkv_decode_operation )( void * dest, net_buff buffer, utils_map codecs );
 typedef void (* rkv_release_operation)( void * data, utils_map codecs );
+typedef bool (* rkv_bind_operation   )( utils_map codecs );
 
+// One field of a plain data type: width is 1, 2, 4 or 8 bytes, integer or floating point, count is 1 or the length
+// of an array, a fixed-size string is an array of width 1.
+typedef struct {
+   size_t   offset;
+   unsigned width;
+   size_t   count;
+} rkv_field;
+
+// A codec without encoder nor factory describes a plain data type of payload_size bytes. Each field of layout is
+// encoded in little-endian order, so the encoding is a bulk copy of the contiguous fields on a little-endian host.
+// Without layout, the wire format is the memory format and the whole value is copied as is, between hosts of the
+// same architecture only. The values are decoded in place into a pooled block, without factory nor malloc.
 typedef struct {
    unsigned              type;
    rkv_encode_operation  encoder;
    rkv_decode_operation  factory;
    rkv_release_operation releaser;
+   size_t                payload_size; // when not 0, the factory decodes into a block of this size taken from a per-type
+                                       // pool, *dest is never NULL and the block returns to the pool instead of calling releaser
+   rkv_bind_operation    binder;       // optional, called once by rkv_new() when all the codecs are registered, so that
+                                       // a nested codec resolves its sub-codecs once instead of on every call
+   const rkv_field *     layout;       // plain data codecs only, see above
+   size_t                layout_count;
 } rkv_codec;
 
-extern const rkv_codec rkv_codec_Zero;
+DLL_PUBLIC extern const rkv_codec rkv_codec_Zero;
+
+typedef struct {
+   size_t   recv_batch_size;       // datagrams drained per recvmmsg() call, 1 means one recvfrom() per datagram
+   size_t   mtu;                   // transactions are split into fragments which fit in one IPv4 datagram of this size
+   size_t   recv_buffer_bytes;     // when not 0, SO_RCVBUF of the socket: the kernel queue must absorb the fragments of
+                                   // a large transaction sent in one burst, it is capped by net.core.rmem_max
+   size_t   reassembly_bytes_max;  // memory bound of incomplete transactions, the oldest ones are evicted first, and of
+                                   // the datagrams received ahead of lost ones
+   unsigned reassembly_timeout_ms; // incomplete transactions older than this are dropped, and so are the datagrams lost
+                                   // for that long in spite of retransmission requests
+   size_t   pool_slab_objects;     // received ids and pooled payloads are allocated by slabs of this many objects
+   size_t   payload_recycle_max;   // when not 0, replaced payloads of non-pooled types are kept, up to this many per type,
+                                   // and handed back to the factory in *dest: updates of existing keys allocate nothing
+   bool     publish_changes_only;  // rkv_publish() skips the entries whose encoded value is the one it sent last time
+   unsigned full_publish_period;   // with publish_changes_only, every Nth rkv_publish() sends all its entries so that
+                                   // late receivers converge, 0 means never
+   size_t   replay_datagrams;      // datagrams kept by the publisher to answer the retransmission requests of receivers
+                                   // which detected a loss, 0 disables retransmission. The publisher also announces its
+                                   // last datagram once a burst ends, so that the loss of the last one is detected
+   bool     bootstrap_server;      // streams the current state over TCP to the caches which start, see below
+   unsigned bootstrap_timeout_ms;  // when not 0, rkv_new() asks the group for the current state and waits this long for
+                                   // a bootstrap server to offer it, the updates received meanwhile are applied on top
+                                   // by the next rkv_refresh()
+   const char * journal_directory; // when not NULL, every complete transaction received is appended to a journal in
+                                   // this existing directory, see rkv_journal_replay()
+   size_t   journal_segment_bytes; // a journal segment file is closed and the next one created beyond this size
+   size_t   journal_retain_bytes;  // when not 0, retention by size: each time a segment is closed, the oldest segments
+                                   // of the directory are deleted so that the closed ones kept total at most this size;
+                                   // rkv_journal_replay() then rebuilds only this recent history, save a snapshot with
+                                   // rkv_snapshot_save() more often than this volume is received. 0 keeps every segment
+   size_t   journal_commit_bytes;  // the journal is synced to disk once per this many bytes or per journal_commit_ms,
+   unsigned journal_commit_ms;     // whichever comes first, by a dedicated thread
+   bool     subscribe;             // false: the cache publishes and answers retransmission requests but joins no group,
+                                   // it receives nothing from the others, see rkv_new_sharded()
+   size_t   decode_workers;        // when not 0, the receive thread only drains the socket, orders and reassembles, and
+                                   // this many threads decode the transactions in parallel; they are merged in the
+                                   // order of reception, so the updates of each publisher stay ordered. Worth it only
+                                   // when decoding is costly, nested types for instance, and cores are spare: a cheap
+                                   // decode costs less than the hand-off, and on one core the workers decode no faster,
+                                   // they only keep the socket drained while decode_queue_depth transactions wait
+   size_t   decode_queue_depth;    // transactions received and not yet decoded, beyond that the receive thread waits
+   bool     listener_thread;       // true: the listeners are called by a dedicated thread, false: by rkv_dispatch(),
+                                   // from the thread of the application; either way, the receptions which occur
+                                   // before the listeners are called are notified once
+   unsigned auto_publish_ms;       // see rkv_auto_put(): the pending entries are published this long after the first one,
+   size_t   auto_publish_entries;  // or as soon as this many distinct keys are pending, 0 and 0 disable auto publishing
+   size_t   pacing_bytes_per_s;    // when not 0, the auto publisher sends no faster than this, on average, so as not to
+   size_t   pacing_burst_bytes;    // overrun the socket buffers of the receivers, and no more than this in a burst
+   unsigned tombstone_ms;          // for this long after its removal, a removed key ignores the late updates, those
+                                   // sent before the removal by the same publisher, see rkv_remove()
+   unsigned compaction_ms;         // period of the background thread which drops the expired tombstones and shrinks
+                                   // the storage of the keys when most of them are removed, 0 disables it
+   unsigned heartbeat_ms;          // period of the heartbeats which tell the receivers that this process is alive,
+                                   // 0, the default, disables them: set it when the receivers use publisher_timeout_ms
+   unsigned publisher_timeout_ms;  // when not 0, the keys made by a process, see rkv_key_make(), are dropped when its
+                                   // heartbeats stop for this long and reported as RKV_EXPIRED; a process is tracked
+                                   // from its first heartbeat on. The thread which expires the keys only runs with a
+                                   // publisher timeout or once a TTL is set, see rkv_set_type_ttl()
+} rkv_options;
+
+DLL_PUBLIC extern const rkv_options rkv_options_Default;
+
+// Encoding and decoding of plain data values, for the codecs which nest them.
+DLL_PUBLIC bool rkv_plain_encode( net_buff buffer, const void * src, const rkv_codec * codec );
+DLL_PUBLIC bool rkv_plain_decode( void * dest, net_buff buffer, const rkv_codec * codec );
+
+typedef struct {
+   unsigned long datagrams_received;
+   unsigned long receive_calls;       // which returned at least one datagram
+   unsigned long datagrams_truncated; // longer than the receive buffer, dropped
+   size_t        reassembly_pending;
+   size_t        reassembly_bytes;
+   unsigned long versions_retired; // read_only_data versions still pinned by a reader, or not yet reclaimed
+   size_t        ids_in_use;       // distinct received ids held by the cache
+   size_t        ids_allocated;    // received ids held or free in the pool
+   size_t        payloads_in_use;  // payloads of all pooled types, see rkv_codec.payload_size
+   size_t        payloads_allocated;
+   size_t        payloads_recycled; // replaced payloads waiting to be decoded into, see payload_recycle_max
+   unsigned long payloads_reused;
+   unsigned long entries_sent;       // by rkv_publish()
+   unsigned long entries_suppressed; // unchanged entries not sent, see publish_changes_only
+   size_t        datagrams_held;     // received ahead of a lost one, waiting for its retransmission
+   unsigned long datagrams_lost;     // never received, even after retransmission requests
+   unsigned long nacks_sent;         // retransmission requests sent to publishers
+   unsigned long datagrams_resent;   // by this publisher, on request
+   size_t        bootstrap_entries;  // received from a peer by rkv_new(), see bootstrap_timeout_ms
+   unsigned long snapshots_served;   // to the caches which started, see bootstrap_server
+   size_t        snapshot_entries;   // loaded by rkv_snapshot_load()
+   unsigned long snapshot_decoded;   // loaded values decoded so far, on their first read
+   unsigned long journal_records;    // transactions written to the journal, see journal_directory
+   unsigned long journal_commits;    // journal syncs, each one covers all the records appended meanwhile
+   unsigned long journal_pruned;     // journal segments deleted, see journal_retain_bytes
+   size_t        journal_replayed;   // transactions read back by rkv_journal_replay()
+   unsigned long notifications;      // calls of the listeners, each one covers all the receptions since the previous
+   unsigned long notifications_coalesced; // receptions notified by a call already pending
+   unsigned long entries_skipped;    // received and not decoded, see rkv_subscribe_types(), or without codec
+   unsigned long entries_conflated;  // replaced by rkv_auto_put() before being published
+   unsigned long datagrams_paced;    // delayed by the auto publisher, see pacing_bytes_per_s
+   unsigned long entries_removed;    // keys removed by the received tombstones, see rkv_remove()
+   unsigned long updates_shadowed;   // received for a removed key, older than its removal and ignored, see tombstone_ms
+   size_t        tombstones;         // held to shadow late updates
+   size_t        slots_allocated;    // capacity of the storage of the keys, see compaction_ms
+   unsigned long compactions;        // storage shrinks
+   unsigned long heartbeats_sent;    // see heartbeat_ms
+   size_t        publishers_alive;   // processes heard within publisher_timeout_ms
+   unsigned long publishers_expired; // processes whose heartbeats stopped
+   unsigned long entries_expired;    // dropped by the cache itself, see RKV_EXPIRED
+} rkv_stats;
+
+typedef struct {
+   size_t sent;
+   size_t suppressed;
+   bool   full;       // all the entries were sent, see full_publish_period
+} rkv_publish_stats;
 
 typedef struct { unsigned unused; } * rkv;
+typedef struct { unsigned unused; } * rkv_txn;
 typedef const void * rkv_value;
 
+// RKV_EXPIRED: dropped by the cache itself, because the process which made the key stopped sending heartbeats, see
+// publisher_timeout_ms, or because the TTL of its type elapsed, see rkv_set_type_ttl().
+typedef enum {
+   RKV_ADDED,
+   RKV_UPDATED,
+   RKV_REMOVED,
+   RKV_EXPIRED
+} rkv_change_kind;
+
+// The id belongs to the cache, as those of rkv_foreach(), type is the one of the new value, or of the removed one. The
+// id of a removed key stays valid until the next rkv_refresh().
+typedef struct {
+   rkv_id          id;
+   unsigned        type;
+   rkv_change_kind kind;
+} rkv_change;
+
+// The changes applied by one rkv_refresh(), in the order of their merge, one per key. The storage is kept from one
+// refresh to the next.
+typedef struct { unsigned unused; } * rkv_changes;
+
 typedef void (* rkv_change_callback )( rkv cache, void * user_context );
+typedef void (* rkv_changes_callback )( rkv cache, rkv_changes changes, void * user_context );
 typedef bool (* rkv_iterator )( size_t index, const rkv_id id, unsigned type, rkv_value data, void * user_context );
 
 DLL_PUBLIC bool rkv_new         ( rkv * cache, const char * group, unsigned short port, const rkv_codec * const codecs[], size_t count );
+DLL_PUBLIC bool rkv_new_with_options( rkv * cache, const char * group, unsigned short port, const rkv_codec * const codecs[], size_t count,
+                                      const rkv_options * options );
+// A sharded cache spreads the keys over shard_count groups by their hash: shard i is a whole cache of its own on
+// groups[i] and port + i, with its own socket and receive thread, so decoding scales with the cores. It subscribes
+// to the shards for which subscribed[i] is true, to all of them when subscribed is NULL, and publishes in all of
+// them. It reads as one cache: rkv_get(), rkv_foreach() and the others route by key or span the shards, the
+// listeners receive the sharded cache. The snapshots and the journal are per shard, see rkv_get_shard(), the shards
+// belong to the sharded cache and are deleted with it. A transaction which spans several shards is published as one
+// transaction per shard: each part is applied whole, but a receiver may apply a part before the others, or without
+// them when it misses one or does not subscribe to its shard. When the publication fails, only the parts not sent are
+// kept in the transaction, see rkv_txn_publish().
+DLL_PUBLIC bool rkv_new_sharded ( rkv * cache, const char * const groups[], unsigned short port, size_t shard_count,
+                                  const bool subscribed[], const rkv_codec * const codecs[], size_t count,
+                                  const rkv_options * options );
+DLL_PUBLIC bool rkv_get_shard_count( rkv cache, size_t * count );
+DLL_PUBLIC bool rkv_get_shard_of( rkv   cache, const rkv_key * key, size_t * index );
+DLL_PUBLIC bool rkv_get_shard   ( rkv   cache, size_t index, rkv * shard );
+// The listeners are called after the received updates have been merged, see rkv_options.listener_thread; they
+// call rkv_refresh() to apply them. Once rkv_remove_listener() has returned, a listener is not called any more and
+// its calls already started have ended. Called from a listener, it does not wait: a call started by another thread
+// may still be running.
 DLL_PUBLIC bool rkv_add_listener( rkv   cache, rkv_change_callback callback, void * user_context );
+DLL_PUBLIC bool rkv_remove_listener( rkv cache, rkv_change_callback callback, void * user_context );
+// The changes listeners are called by rkv_refresh(), from its thread, once the new version is published and only if
+// something changed. They get what the refresh applied, of one shard at a time for a sharded cache, and must not
+// refresh the cache themselves.
+DLL_PUBLIC bool rkv_add_changes_listener( rkv cache, rkv_changes_callback callback, void * user_context );
+DLL_PUBLIC bool rkv_remove_changes_listener( rkv cache, rkv_changes_callback callback, void * user_context );
+// Without listener_thread, calls the listeners if a reception occurred since the previous call, *notified says so.
+DLL_PUBLIC bool rkv_dispatch    ( rkv   cache, bool * notified );
+// Only the received entries of these types are decoded, the others are skipped without allocating anything, as are
+// the entries of a type without codec. count 0 subscribes to all the types. The entries already received stay.
+DLL_PUBLIC bool rkv_subscribe_types( rkv cache, const unsigned types[], size_t count );
+// Likewise, only the keys made by the same processes as origins are decoded: only their host and process count, see
+// rkv_key_make(). count 0 subscribes to all the origins.
+DLL_PUBLIC bool rkv_subscribe_origins( rkv cache, const rkv_key origins[], size_t count );
+// The values of this type expire ttl_ms after their last update merged by rkv_refresh(), which drops them and reports
+// them as RKV_EXPIRED: the listeners are notified when it is due. The deadlines are kept in a timer wheel, the cost
+// is that of the expired values, never a scan of the cache. 0 removes the TTL of the type. The values merged before
+// the call are not concerned until their next update.
+DLL_PUBLIC bool rkv_set_type_ttl( rkv cache, unsigned type, unsigned ttl_ms );
+// A transaction handle belongs to the thread which fills it: rkv_txn_put() takes no lock and several threads may each
+// build their own transaction on the same cache. capacity is the number of entries expected, 0 for a default, the
+// storage grows as needed. The values are not copied and must stay valid until the transaction is published or
+// aborted. When a key is put several times, the last value is published. A published or aborted transaction is empty
+// and may be reused; when rkv_txn_publish() fails, it keeps its entries, those of the shards not published for a
+// sharded cache. rkv_txn_delete() frees the handle.
+DLL_PUBLIC bool rkv_txn_begin   ( rkv   cache, size_t capacity, rkv_txn * txn );
+DLL_PUBLIC bool rkv_txn_put     ( rkv_txn txn, const rkv_key * key, unsigned type, rkv_value data );
+DLL_PUBLIC bool rkv_txn_remove  ( rkv_txn txn, const rkv_key * key );
+DLL_PUBLIC bool rkv_txn_publish ( rkv_txn txn, rkv_publish_stats * stats );
+DLL_PUBLIC bool rkv_txn_abort   ( rkv_txn txn );
+DLL_PUBLIC bool rkv_txn_delete  ( rkv_txn * txn );
+// The named transactions are handles created by their first put and deleted by their publication.
+// With auto_publish_ms or auto_publish_entries, the value is encoded at once and replaces the one still pending for
+// the same key, if any. A background thread publishes the pending entries, packed in as few datagrams as possible,
+// each one a transaction of its own. rkv_delete() publishes the entries still pending.
+DLL_PUBLIC bool rkv_auto_put    ( rkv   cache, const rkv_key * key, unsigned type, rkv_value data );
 DLL_PUBLIC bool rkv_put         ( rkv   cache, const char * transaction, const rkv_id id, unsigned type, rkv_value data );
+DLL_PUBLIC bool rkv_put_key     ( rkv   cache, const char * transaction, const rkv_key * key, unsigned type, rkv_value data );
+// A removal is published in the transaction as a tombstone, which replaces the value put before for the same key, if
+// any. The receivers drop the key and release its value on their next rkv_refresh(), which reports it as RKV_REMOVED,
+// then ignore for tombstone_ms the updates of this key sent before the removal by the same publisher. An update sent
+// after the removal, or by another publisher, puts the key back. The types from 0xFFFFFFF0 on are reserved,
+// 0xFFFFFFFF for the tombstones.
+DLL_PUBLIC bool rkv_remove      ( rkv   cache, const char * transaction, const rkv_id id );
+DLL_PUBLIC bool rkv_remove_key  ( rkv   cache, const char * transaction, const rkv_key * key );
 DLL_PUBLIC bool rkv_publish     ( rkv   cache, const char * transaction );
+DLL_PUBLIC bool rkv_publish_with_stats( rkv cache, const char * transaction, rkv_publish_stats * stats );
 DLL_PUBLIC bool rkv_refresh     ( rkv   cache );
+// As rkv_refresh(), and changes receives what it applied: the keys added or updated, and removed.
+DLL_PUBLIC bool rkv_refresh_with_changes( rkv cache, rkv_changes changes );
+DLL_PUBLIC bool rkv_changes_new      ( rkv_changes * changes );
+DLL_PUBLIC bool rkv_changes_get_count( rkv_changes   changes, size_t * count );
+DLL_PUBLIC bool rkv_changes_get      ( rkv_changes   changes, size_t index, rkv_change * change );
+DLL_PUBLIC bool rkv_changes_delete   ( rkv_changes * changes );
+// Between rkv_read_begin() and rkv_read_end(), the calling thread reads one immutable version of the cache without
+// any lock, and the values it gets stay valid whatever the concurrent rkv_refresh(). Outside, they are valid until
+// the next rkv_refresh().
+DLL_PUBLIC bool rkv_read_begin  ( rkv   cache );
+DLL_PUBLIC bool rkv_read_end    ( rkv   cache );
 DLL_PUBLIC bool rkv_get         ( rkv   cache, const rkv_id id, rkv_value * data );
+DLL_PUBLIC bool rkv_get_key     ( rkv   cache, const rkv_key * key, rkv_value * data );
+// The ids given by rkv_get_ids() and rkv_foreach() belong to the cache. There is only one per key: as long as
+// the key stays in the cache, its id keeps the same address and may be compared by pointer.
 DLL_PUBLIC bool rkv_get_ids     ( rkv   cache, rkv_id target[], size_t * target_size );
 DLL_PUBLIC bool rkv_foreach     ( rkv   cache, rkv_iterator iterator, void * user_context );
+// Only the entries of one type, in the order of their arrival: the cost is the number of entries of this type,
+// whatever the size of the cache.
+DLL_PUBLIC bool rkv_foreach_type( rkv   cache, unsigned type, rkv_iterator iterator, void * user_context );
+DLL_PUBLIC bool rkv_count_type  ( rkv   cache, unsigned type, size_t * count );
+// The whole read only state goes to a versioned file, written under a temporary name then renamed. Loading maps the
+// file in memory and decodes each value on its first read only, from a copy of its bytes, the loaded entries replace
+// the existing ones. A value whose key or type is not the one of the index is not decoded and its read fails.
+DLL_PUBLIC bool rkv_snapshot_save( rkv cache, const char * path );
+DLL_PUBLIC bool rkv_snapshot_load( rkv cache, const char * path );
+// Rebuilds the state from the transactions journaled in directory, in the order of reception, and merges it as
+// rkv_refresh() does. The journal of the cache itself, if it writes in the same directory, is not read.
+DLL_PUBLIC bool rkv_journal_replay( rkv cache, const char * directory );
+DLL_PUBLIC bool rkv_get_stats   ( rkv   cache, rkv_stats * stats );
 DLL_PUBLIC bool rkv_delete      ( rkv * cache );
 
 #ifdef __cplusplus
@@ -2,12 +2,35 @@
 
 #include <net/net_buff.h>
 
+#include <stdint.h>
+
 typedef struct { unsigned unused; } * rkv_id;
 
+// Identifier by value: 16 bytes, no allocation. Keys may be stored in arrays and structures, copied by assignment,
+// compared and hashed without branch nor pointer dereference. reserved is always 0.
+typedef struct {
+   uint32_t host;
+   uint32_t process;
+   uint32_t instance;
+   uint32_t reserved;
+} rkv_key;
+
 // 0000000001/0000021314@007f0101
 #define ID_AS_STRING_LENGTH_MAX (10+1+10+1+8)
 
+DLL_PUBLIC bool rkv_key_make     ( rkv_key * key );
+DLL_PUBLIC bool rkv_key_encode   ( const rkv_key * key, net_buff buffer );
+DLL_PUBLIC bool rkv_key_decode   ( rkv_key * key, net_buff buffer );
+DLL_PUBLIC bool rkv_key_to_string( const rkv_key * key, char * dest, size_t dest_size );
+DLL_PUBLIC bool rkv_key_equals   ( const rkv_key * left, const rkv_key * right );
+DLL_PUBLIC uint32_t rkv_key_hash ( const rkv_key * key );
+
+DLL_PUBLIC int  rkv_key_compare( const void * l, const void * r );
+
+// The pointer API is a thin layer over rkv_key: an rkv_id points to an rkv_key allocated on the heap.
 DLL_PUBLIC bool rkv_id_new      ( rkv_id * id );
+DLL_PUBLIC bool rkv_id_from_key ( rkv_id * id, const rkv_key * key );
+DLL_PUBLIC bool rkv_id_get_key  ( const rkv_id id, rkv_key * key );
 DLL_PUBLIC bool rkv_id_encode   ( const rkv_id id, net_buff buffer );
 DLL_PUBLIC bool rkv_id_decode   ( rkv_id * id, net_buff buffer );
 DLL_PUBLIC bool rkv_id_to_string( const rkv_id id, char * dest, size_t dest_size );
@@ -1,14 +1,39 @@
+#define _GNU_SOURCE // recvmmsg
+
 #include <rkv.h>
 
+#include "rkv_batch.h"
+#include "rkv_bootstrap.h"
+#include "rkv_changes.h"
+#include "rkv_codecs.h"
+#include "rkv_conflation.h"
+#include "rkv_epoch.h"
+#include "rkv_fingerprints.h"
+#include "rkv_intern.h"
+#include "rkv_journal.h"
+#include "rkv_pool.h"
+#include "rkv_protocol.h"
+#include "rkv_queue.h"
+#include "rkv_reassembly.h"
+#include "rkv_sequencer.h"
+#include "rkv_snapshot.h"
+#include "rkv_store.h"
+#include "rkv_timers.h"
+#include "rkv_tombstones.h"
+
 #include <net/net_buff.h>
 #include <utils/utils_map.h>
 
+#include <errno.h>
 #include <ifaddrs.h>
 #include <limits.h>
 #include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <netinet/ip.h>
@@ -26,23 +51,192 @@
 #define MCAST_MAX             11
 #define PAYLOAD_MAX           (64*1024)
 #define NET_ID_MAX            (10+1+15)
+#define RECV_BATCH_MAX        1024
+#define TRANSACTION_MAX       (64*1024*1024)
+#define TIMERS_TICK_MS        10
+#define TAIL_ANNOUNCES        3
 #define RKV_DBG               false
 #define RKV_DBG_DUMP_RECV     false
 #define RKV_DBG_MEMORY        false
 
-const rkv_codec rkv_codec_Zero = { 0U, NULL, NULL, NULL };
+const rkv_codec rkv_codec_Zero = { 0U, NULL, NULL, NULL, 0U, NULL, NULL, 0U };
+
+const rkv_options rkv_options_Default = {
+   .recv_batch_size       = 64,
+   .mtu                   = 1500,
+   .recv_buffer_bytes     = 4*1024*1024,
+   .reassembly_bytes_max  = 16*1024*1024,
+   .reassembly_timeout_ms = 2000,
+   .pool_slab_objects     = 256,
+   .payload_recycle_max   = 0,
+   .publish_changes_only  = false,
+   .full_publish_period   = 0,
+   .replay_datagrams      = 512,
+   .bootstrap_server      = false,
+   .bootstrap_timeout_ms  = 0,
+   .journal_directory     = NULL,
+   .journal_segment_bytes = 64*1024*1024,
+   .journal_retain_bytes  = 0,
+   .journal_commit_bytes  = 1024*1024,
+   .journal_commit_ms     = 10,
+   .subscribe             = true,
+   .decode_workers        = 0,
+   .decode_queue_depth    = 1024,
+   .listener_thread       = true,
+   .auto_publish_ms       = 0,
+   .auto_publish_entries  = 0,
+   .pacing_bytes_per_s    = 0,
+   .pacing_burst_bytes    = 64*1024,
+   .tombstone_ms          = 10000,
+   .compaction_ms         = 1000,
+   .heartbeat_ms          = 0,
+   .publisher_timeout_ms  = 0,
+};
+
+static atomic_uint publisher_instance_allocator = 1;
+
+/**
+ * Empreinte d'une entrée encodée, enregistrée seulement une fois la transaction émise. Celle
+ * d'une clé retirée est oubliée.
+ */
+typedef struct {
+   rkv_key  key;
+   uint64_t fingerprint;
+   bool     removed;
+} sent_fingerprint;
+
+/**
+ * Datagramme émis, gardé pour répondre aux demandes de réémission. Un emplacement n'est
+ * valide, used, qu'une fois son datagramme émis : l'anneau alloué par calloc() porte le
+ * numéro 0 partout sans rien contenir.
+ */
+typedef struct {
+   bool     used;
+   uint32_t datagram;
+   net_buff data;
+} replay_slot;
+
+/**
+ * Valeur d'un instantané chargé, décodée à sa première lecture : entry pointe dans le fichier
+ * projeté en mémoire, qui reste ouvert tant qu'un holder référence une de ses valeurs.
+ */
+typedef struct loaded_snapshot_s loaded_snapshot;
+
+typedef struct {
+   const byte *         entry;
+   size_t               size;
+   const void * _Atomic decoded;
+   loaded_snapshot *    snapshot;
+} lazy_value;
+
+struct loaded_snapshot_s {
+   rkv_snapshot_file file;
+   lazy_value *      values;
+   atomic_size_t     references;
+};
+
+/**
+ * Émetteur et numéro de la transaction dont viennent les holders décodés. Le rang de l'émetteur,
+ * à partir de 1, est donné par publisher_rank() ; il vaut 0 pour ce qui ne vient pas du
+ * multicast : rien ne l'ordonne face à une pierre tombale.
+ */
+typedef struct {
+   uint32_t publisher_rank;
+   uint32_t sequence;
+} received_order;
+
+static const received_order unordered = { 0, 0 };
+
+/**
+ * Transaction complète confiée aux threads de décodage. Le ticket fixe l'ordre dans lequel
+ * elles rejoignent received_data, celui de leur livraison par le sequencer. copy reçoit les
+ * transactions d'un seul datagramme, dont l'anneau de réception réutilise aussitôt l'espace.
+ */
+typedef struct {
+   uint64_t       ticket;
+   received_order order;
+   net_buff       copy;
+   net_buff       transaction;
+   rkv_batch      batch;
+} decode_job;
+
+/**
+ * Durée de vie des valeurs d'un type, voir rkv_set_type_ttl().
+ */
+typedef struct {
+   unsigned type;
+   unsigned ttl_ms;
+} type_ttl;
+
+/**
+ * Clé échue relevée par le thread expirer : type est RKV_EXPIRED_TYPE pour une clé, dont la
+ * durée de vie est passée, ou RKV_ORPHANED_TYPE pour une origine morte.
+ */
+typedef struct {
+   rkv_key  key;
+   unsigned type;
+} expired_key;
+
+/**
+ * Un listener de changements n'a que on_changes, les autres que callback.
+ */
+typedef struct {
+   rkv_change_callback  callback;
+   rkv_changes_callback on_changes;
+   void *               user_context;
+} rkv_listener;
 
+/**
+ * Entrée d'une transaction en cours : la clé est recopiée, la valeur reste à l'appelant jusqu'à
+ * la publication. order départage les écritures successives d'une même clé, shard la range
+ * avec les autres entrées de son cache dans un cache réparti.
+ */
 typedef struct {
-   rkv_id       id;
+   rkv_key      key;
    unsigned     type;
+   size_t       shard;
+   size_t       order;
    const void * payload;
-} rkv_data_holder;
+} txn_entry;
+
+/**
+ * Transaction en cours, propre au thread qui la remplit : les entrées sont rangées à la suite,
+ * sans verrou, dans un tableau qui double quand il est plein et resservira à la suivante.
+ */
+typedef struct rkv_private_s rkv_private;
+
+typedef struct {
+   rkv_private * cache;
+   txn_entry *   entries;
+   size_t        count;
+   size_t        capacity;
+} rkv_txn_private;
+
+/**
+ * Filtre de réception immuable, publié comme l'ensemble des listeners. Les deux tableaux sont
+ * triés, un tableau vide laisse tout passer. Une origine est une clé dont seuls host et process
+ * comptent : ils désignent le processus qui a créé les clés, voir rkv_key_make().
+ */
+typedef struct {
+   unsigned * types;
+   size_t     type_count;
+   rkv_key *  origins;
+   size_t     origin_count;
+} subscription;
+
+/**
+ * Ensemble immuable des listeners : un ajout ou un retrait en publie une copie.
+ */
+typedef struct {
+   size_t       count;
+   rkv_listener listeners[];
+} listener_set;
 
-typedef struct rkv_listener_s {
-   rkv_change_callback callback;
-   void *              user_context;
-   struct rkv_listener_s * next;
-} * rkv_listener;
+/**
+ * Appels de listeners en cours sur ce thread : un listener qui en retire un autre, ou se
+ * retire lui-même, ne peut pas attendre la fin des appels en cours, dont le sien.
+ */
+static _Thread_local unsigned listener_calls;
 
 /**
  * Cette classe contient plusieurs caches :
@@ -55,25 +249,210 @@ typedef struct rkv_listener_s {
  *
  * Le cache de réception est mergé dans le cache courant, en lecture seule,
  * sur demande explicite de l'application, par un appel à refresh().
+ *
+ * Les rkv_id reçus sont uniques et partagés, voir rkv_intern, les valeurs des types de taille fixe
+ * dans celle de leur codec. Le cache de réception est double : refresh() échange
+ * received_data et received_spare, vide le premier après l'avoir mergé et le garde pour
+ * l'échange suivant. Les valeurs remplacées des autres types sont recyclées, voir
+ * rkv_options.payload_recycle_max. Une fois le régime établi, la réception n'alloue plus rien.
+ *
+ * Une transaction est un rkv_txn, que le thread qui le remplit est seul à toucher : plusieurs
+ * threads construisent chacun la leur sans se synchroniser. Les transactions nommées de
+ * rkv_put() sont des rkv_txn rangés par nom dans transactions, sous transactions_lock.
+ * publish_lock sérialise l'encodage et l'émission, qui partagent txn_buff et les numéros.
+ *
+ * Avec rkv_options.publish_changes_only, fingerprints retient l'empreinte de la dernière valeur
+ * émise de chaque clé : publish() n'émet que les entrées dont l'encodage a changé.
+ *
+ * Chaque datagramme émis porte un numéro propre à l'émetteur et reste dans l'anneau replay
+ * jusqu'à ce que replay_datagrams autres le remplacent. Le sequencer livre dans l'ordre les
+ * datagrammes reçus de chaque émetteur et lui réclame ceux qui manquent, l'émetteur les
+ * réémet sur le groupe.
+ *
+ * Un cache qui démarre avec bootstrap_timeout_ms demande l'état courant au groupe. Le premier
+ * pair qui a un bootstrap_server lui indique son port TCP et lui transmet read_only_data,
+ * qui est fusionné avant le retour de rkv_new(). Les mises à jour reçues entre-temps restent
+ * dans received_data et s'appliquent par-dessus au rafraîchissement suivant.
+ *
+ * Avec rkv_options.journal_directory, chaque transaction complète reçue est confiée au journal
+ * avant d'être décodée, rkv_journal_replay() les décode de nouveau au démarrage suivant.
+ *
+ * Avec rkv_options.decode_workers, le thread de réception ne fait plus que vider la socket,
+ * remettre les datagrammes dans l'ordre et réassembler : les transactions complètes passent
+ * par decode_queue à des threads de décodage, qui les fusionnent dans received_data dans
+ * l'ordre de leurs tickets. L'ordre de chaque émetteur est donc préservé.
+ *
+ * Un cache réparti, voir rkv_new_sharded(), n'a ni socket ni thread : il possède shard_count
+ * caches complets, un par groupe, et leur confie chaque clé selon son hachage. Chacun décode
+ * dans son propre thread de réception, leurs notifications portent le cache réparti, parent.
+ * Une transaction qui touche plusieurs caches en publie une par cache, voir publish_shards().
+ *
+ * La réception ne fait que lever notify_pending, seul le passage de faux à vrai réveille le
+ * thread dispatcher : les réceptions qui surviennent avant son passage sont notifiées une
+ * seule fois. Sans rkv_options.listener_thread, c'est rkv_dispatch() qui le remplace. Il lit
+ * l'ensemble des listeners publié sans verrou, sous la protection de listeners_epoch ;
+ * listeners_lock ne sérialise que les ajouts et les retraits, un retrait attend la sortie des
+ * lecteurs de l'ensemble retiré. Les listeners de changements sont appelés par rkv_refresh(),
+ * avec changes, que la fusion remplit quand quelqu'un les attend.
+ *
+ * Chaque entrée d'une transaction est préfixée par la taille de sa valeur : celles que le filtre
+ * subscription écarte, ou dont le type n'a pas de codec, sont sautées sans que leur identifiant
+ * soit internalisé ni leur valeur décodée.
+ *
+ * Avec rkv_options.auto_publish_ms ou auto_publish_entries, rkv_auto_put() encode aussitôt la
+ * valeur dans conflating, où elle remplace celle de la même clé encore en attente. Quand la
+ * publication est due, le thread auto_publisher échange conflating et flushing puis range les
+ * entrées de flushing, sans tenir conflation_lock, dans le moins de datagrammes possible.
+ * pace() limite son débit selon pacing_bytes_per_s, l'attente se fait hors de publish_lock.
+ *
+ * Une entrée de type RKV_TOMBSTONE_TYPE, sans valeur, retire sa clé. La fusion la retire de
+ * read_only_data et pose dans tombstones une pierre tombale qui écarte, pendant tombstone_ms,
+ * les mises à jour de la clé envoyées avant le retrait par le même émetteur et arrivées en
+ * retard ; une mise à jour postérieure recrée la clé. Chaque holder reçu porte pour cela le
+ * rang de son émetteur et le numéro de sa transaction, voir received_order. Chaque
+ * rafraîchissement ouvre une génération : les changements qu'il a rendus restent lisibles
+ * jusqu'au suivant, une pierre tombale ne part donc qu'échue et posée par une génération
+ * antérieure. Le thread compactor les purge et réduit read_only_data tous les compaction_ms,
+ * sous refresh_lock.
+ *
+ * Le thread de réception émet un battement de cœur tous les heartbeat_ms, s'il n'est pas nul.
+ * Battements et annonces de fin de rafale, voir send_tail(), portent le numéro du dernier
+ * datagramme émis : le sequencer des récepteurs réclame ceux qu'aucun datagramme suivant ne
+ * leur aurait signalés perdus.
+ * Avec publisher_timeout_ms, chaque battement reçu repousse l'échéance de son origine dans
+ * publisher_timers ; une valeur d'un type de ttls arme celle de sa clé dans key_timers à chaque
+ * fusion. Le thread expirer, démarré par publisher_timeout_ms ou par le premier TTL, dort
+ * jusqu'à la prochaine échéance des deux roues, puis range dans received_data une marque par
+ * clé échue ou par origine morte et notifie les listeners : le rafraîchissement suivant retire
+ * les clés, celles d'une origine par sa liste dans read_only_data, et les rend comme
+ * RKV_EXPIRED. Une marque démentie entre-temps, clé mise à jour ou origine revenue, est
+ * ignorée.
  */
-typedef struct {
+struct rkv_private_s {
    int                sckt;
    struct sockaddr_in recv_addr;
    struct sockaddr_in send_addr;
    struct ip_mreq     imr;
    bool               is_alive;
    char               localID[NET_ID_MAX];
-   net_buff           recv_buff;
-   net_buff           send_buff;
+   rkv_options        options;
+   net_buff *         recv_ring;
+   struct mmsghdr *   recv_msgs;
+   struct iovec *     recv_iovs;
+   struct sockaddr_in * recv_from;
+   rkv_reassembly     reassembly;
+   rkv_sequencer      sequencer;
+   rkv_publisher *    publishers;   // thread de réception seulement, voir publisher_rank()
+   size_t             publisher_count;
+   net_buff           control_buff; // datagrammes de contrôle émis par le thread de réception
+   rkv_publisher      publisher;
+   uint32_t           transaction_sequence;
+   uint32_t           datagram_sequence;
+   net_buff           txn_buff;
+   replay_slot *      replay;
+   size_t             replay_size;
+   pthread_mutex_t    replay_lock;
+   int                bootstrap_listener;
+   unsigned short     bootstrap_port;
+   bool               bootstrap_serving;
+   pthread_t          bootstrap_thread;
+   int                bootstrap_connection; // en cours de transfert, sous bootstrap_lock
+   bool               bootstrap_stopping;
+   pthread_mutex_t    bootstrap_lock;
+   pthread_cond_t     bootstrap_offered;
+   bool               bootstrap_waiting;
+   bool               bootstrap_has_peer;
+   struct sockaddr_in bootstrap_peer;
+   rkv_fingerprints   fingerprints;
+   rkv_journal        journal;
+   rkv_queue          decode_queue;
+   rkv_queue          free_jobs;
+   decode_job *       jobs;
+   pthread_t *        workers;
+   size_t             worker_count;
+   uint64_t           next_ticket;  // thread de réception seulement
+   uint64_t           next_commit;  // protégé par received_data_lock
+   pthread_cond_t     committed;
+   sent_fingerprint * pending;     // empreintes de la transaction en cours d'encodage
+   size_t             pending_count;
+   size_t             pending_capacity;
+   unsigned long      publish_count;
    pthread_t          thread;
-   utils_map          codecs;
-   utils_map          read_only_data;
-   utils_map          transactions;
+   rkv_codecs         codecs;
+   utils_map          codec_map; // passée aux opérations des codecs
+   rkv_store          read_only_data;
+   utils_map          transactions; // nom -> rkv_txn, voir rkv_put()
+   pthread_mutex_t    transactions_lock;
+   pthread_mutex_t    publish_lock;
+   pthread_mutex_t    refresh_lock;
+   rkv_changes        changes;      // protégé par refresh_lock
    pthread_mutex_t    received_data_lock;
    pthread_mutex_t    listeners_lock;
-   utils_map          received_data;
-   rkv_listener       listeners;
-} rkv_private;
+   rkv_intern         ids;
+   rkv_batch          batch;
+   rkv_batch          received_data;
+   rkv_batch          received_spare;
+   rkv_stats          stats;
+   void * _Atomic     listeners;   // listener_set
+   rkv_epoch          listeners_epoch;
+   atomic_bool        notify_pending;
+   atomic_ulong       notifications;
+   atomic_ulong       notifications_coalesced;
+   pthread_mutex_t    notify_lock;
+   pthread_cond_t     notify_wakeup;
+   bool               dispatching;  // protégé par notify_lock
+   pthread_t          dispatcher;
+   void * _Atomic     subscription; // subscription, NULL : tout est reçu
+   rkv_epoch          subscription_epoch;
+   pthread_mutex_t    subscription_lock;
+   atomic_ulong       entries_skipped;
+   rkv_conflation     conflating;   // protégée par conflation_lock
+   rkv_conflation     flushing;     // thread auto_publisher seulement
+   net_buff           auto_buff;    // protégé par conflation_lock
+   pthread_mutex_t    conflation_lock;
+   pthread_cond_t     conflation_ready;
+   struct timespec    conflating_since;
+   bool               auto_publishing; // protégé par conflation_lock
+   pthread_t          auto_publisher;
+   double             pacing_tokens;   // thread auto_publisher seulement
+   struct timespec    pacing_refill;
+   atomic_ulong       entries_conflated;
+   atomic_ulong       datagrams_paced;
+   rkv_tombstones     tombstones;   // protégées par refresh_lock
+   uint64_t           generation;   // protégée par refresh_lock
+   atomic_size_t      tombstone_count;
+   atomic_ulong       entries_removed;
+   atomic_ulong       updates_shadowed;
+   atomic_ulong       compactions;
+   pthread_mutex_t    compaction_lock;
+   pthread_cond_t     compaction_wakeup;
+   bool               compacting;   // protégé par compaction_lock
+   pthread_t          compactor;
+   uint64_t           heartbeat_due; // thread de réception seulement
+   atomic_ulong       heartbeats_sent;
+   unsigned long      tail_interval_ms;
+   uint64_t           tail_due;      // thread de réception seulement, comme tail_last et tail_repeats
+   uint32_t           tail_last;
+   unsigned           tail_repeats;
+   rkv_timers         key_timers;       // protégées par timers_lock
+   rkv_timers         publisher_timers; // protégées par timers_lock
+   pthread_mutex_t    timers_lock;
+   pthread_cond_t     timers_wakeup;
+   uint64_t           expirer_wake;  // protégé par timers_lock, échéance que le thread expirer attend
+   bool               expiring;      // protégé par timers_lock
+   pthread_t          expirer;
+   expired_key *      expired;       // thread expirer seulement
+   size_t             expired_count;
+   size_t             expired_capacity;
+   type_ttl *         ttls;          // triées par type, protégées par refresh_lock
+   size_t             ttl_count;
+   atomic_size_t      publishers_alive;
+   atomic_ulong       publishers_expired;
+   atomic_ulong       entries_expired;
+   rkv *              shards;
+   size_t             shard_count;
+   rkv                parent;
+};
 
 static bool get_multicast_interface_address( char * address ) {
    struct ifaddrs * ifaddr = NULL;
@@ -98,11 +477,10 @@ typedef struct {
    size_t dest_size;
 } string;
 
-static bool dump_one_id( size_t index, map_pair pair, void * user_context ) {
+static bool dump_one_id( size_t index, const rkv_data_holder * holder, void * user_context ) {
    string * str = user_context;
    char ids[ID_AS_STRING_LENGTH_MAX+1];
-   void * id = CONST_CAST( pair.key, void );
-   rkv_id_to_string( id, ids, sizeof( ids ));
+   rkv_id_to_string( holder->id, ids, sizeof( ids ));
    size_t len = strlen( str->dest );
    if( len &&( len+2 < str->dest_size )) {
       strcat( str->dest, ", " );
@@ -115,13 +493,13 @@ static bool dump_one_id( size_t index, map_pair pair, void * user_context ) {
    (void)index;
 }
 
-static void dump_all_ids( utils_map map, const char * title ) {
+static void dump_all_ids( rkv_batch batch, const char * title ) {
    size_t count = 0;
-   utils_map_get_size( map, &count );
+   rkv_batch_get_size( batch, &count );
    char buffer[count*(ID_AS_STRING_LENGTH_MAX+2)];
    string str = { .dest = buffer, .dest_size = sizeof( buffer )};
    memset( str.dest, 0, str.dest_size );
-   utils_map_foreach( map, dump_one_id, &str );
+   rkv_batch_foreach( batch, dump_one_id, &str );
    fprintf( stderr, "%s: %ld: %s\n", title, count, str.dest );
 }
 
@@ -133,456 +511,3809 @@ static bool is_alive( rkv_private * This ) {
    return is_alive;
 }
 
-static void * multicast_receive_thread( void * arg ) {
-   rkv_private * This = (rkv_private *)arg;
-   This->is_alive = true;
-   while( is_alive( This )) {
-      net_buff_clear( This->recv_buff );
-      if( net_buff_receive( This->recv_buff, This->sckt, &This->recv_addr )) {
-         size_t position = 0;
-         if(   net_buff_get_position( This->recv_buff, &position ) &&( position > 0 )
-            && net_buff_flip( This->recv_buff ))
-         {
-            if( RKV_DBG ) {
-               size_t limit = 0;
-               if( net_buff_get_limit( This->recv_buff, &limit )) {
-                  struct timeval tv;
-                  gettimeofday( &tv, NULL );
-                  fprintf( stderr, "%6ld.%06ld:DEBUG:%s:packet received, %ld bytes\n", tv.tv_sec, tv.tv_usec, __func__, limit );
-                  if( RKV_DBG_DUMP_RECV ) {
-                     char dump[20*80];
-                     if( net_buff_dump( This->recv_buff, dump, sizeof( dump ))) {
-                        fprintf( stderr, "%s|%s", __func__, dump );
-                     }
-                  }
-               }
-            }
-            utils_map received_data = NULL;
-            pthread_mutex_lock( &This->received_data_lock );
-            received_data = This->received_data;
-            pthread_mutex_unlock( &This->received_data_lock );
-            if( received_data == NULL ) {
-               utils_map_new( &received_data, rkv_id_compare, true, true );
-            }
-            rkv_id id = NULL;
-            size_t limit = 0;
-            position = 0;
-            while( net_buff_get_position( This->recv_buff, &position )
-               &&  net_buff_get_limit   ( This->recv_buff, &limit    )
-               &&( position < limit )
-               &&  rkv_id_decode( &id, This->recv_buff ))
-            {
-               unsigned type;
-               if( ! net_buff_decode_uint32( This->recv_buff, &type )) {
-                  char ids[ID_AS_STRING_LENGTH_MAX+1];
-                  rkv_id_to_string( id, ids, sizeof( ids ));
-                  fprintf( stderr, "%s: unable to decode type of %s of type %d, packet skipped", __func__, ids, type );
-                  break;
-               }
-               rkv_codec * codec = NULL;
-               if(( ! utils_map_get( This->codecs, &type, (map_value *)&codec ))||( codec == NULL )) {
-                  char ids[ID_AS_STRING_LENGTH_MAX+1];
-                  rkv_id_to_string( id, ids, sizeof( ids ));
-                  fprintf( stderr, "%s: no codec found for %s, packet skipped\n", __func__, ids );
-                  break;
-               }
-               rkv_data_holder * entry = malloc( sizeof( rkv_data_holder));
-               if( entry == NULL ) {
-                  perror( "malloc" );
-                  pthread_mutex_lock( &This->received_data_lock );
-                  This->is_alive = false;
-                  pthread_mutex_unlock( &This->received_data_lock );
-                  break;
-               }
-               entry->id   = id;
-               entry->type = type;
-               entry->payload = NULL;
-               if( ! codec->factory( &entry->payload, This->recv_buff, This->codecs )) {
-                  char ids[ID_AS_STRING_LENGTH_MAX+1];
-                  rkv_id_to_string( id, ids, sizeof( ids ));
-                  fprintf( stderr, "%s: unable to decode data %s of type %d, packet skipped\n", __func__, ids, type );
-                  break;
-               }
-               if( RKV_DBG_MEMORY ) {
-                  fprintf( stderr, "%s|utils_map_put( key = %p, value = %p )\n", __func__, (void *)id, (void *)entry );
-               }
-               if( ! utils_map_put( received_data, id, entry )) {
-                  char ids[ID_AS_STRING_LENGTH_MAX+1];
-                  rkv_id_to_string( id, ids, sizeof( ids ));
-                  fprintf( stderr, "%s: unable to store data %s of type %d\n", __func__, ids, type );
-               }
-            }
-            if( RKV_DBG ) {
-               struct timeval tv;
-               gettimeofday( &tv, NULL );
-               fprintf( stderr, "%6ld.%06ld:DEBUG:%s:", tv.tv_sec, tv.tv_usec, __func__ );
-               dump_all_ids( received_data, __func__ );
-            }
-            pthread_mutex_lock( &This->received_data_lock );
-            This->received_data = received_data;
-            pthread_mutex_unlock( &This->received_data_lock );
-            pthread_mutex_lock( &This->listeners_lock );
-            for( rkv_listener listener = This->listeners; listener; listener = listener->next ) {
-               listener->callback((rkv)This, listener->user_context );
-            }
-            pthread_mutex_unlock( &This->listeners_lock );
+static uint64_t monotonic_ms( void ) {
+   struct timespec now;
+   clock_gettime( CLOCK_MONOTONIC, &now );
+   return (uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_nsec / 1000000;
+}
+
+static void log_datagram( net_buff buffer ) {
+   size_t limit = 0;
+   if( net_buff_get_limit( buffer, &limit )) {
+      struct timeval tv;
+      gettimeofday( &tv, NULL );
+      fprintf( stderr, "%6ld.%06ld:DEBUG:multicast_receive_thread:packet received, %ld bytes\n", tv.tv_sec, tv.tv_usec, limit );
+      if( RKV_DBG_DUMP_RECV ) {
+         char dump[20*80];
+         if( net_buff_dump( buffer, dump, sizeof( dump ))) {
+            fprintf( stderr, "multicast_receive_thread|%s", dump );
          }
       }
    }
-   return NULL;
 }
 
-static int codec_id_compare( const void * l, const void * r ) {
-   const unsigned * const * pl    = (const unsigned * const *)l;
-   const unsigned * const * pr    = (const unsigned * const *)r;
-   const unsigned *         left  = *pl;
-   const unsigned *         right = *pr;
-   return (int)( *left - *right );
+static void release_payload( rkv_private * This, unsigned type, const void * payload ) {
+   rkv_codec_entry * codec = NULL;
+   if( payload && rkv_codecs_get( This->codecs, type, &codec )) {
+      if( codec->payloads ) {
+         rkv_pool_free( codec->payloads, CONST_CAST( payload, void ));
+      }
+      else if( rkv_codecs_recycle( codec, CONST_CAST( payload, void ))) {
+         return;
+      }
+      else if( codec->codec.releaser ) {
+         codec->codec.releaser( CONST_CAST( payload, void ), This->codec_map );
+      }
+   }
 }
 
-static int string_compare( const void * l, const void * r ) {
-   const char * const * pl    = (const char * const *)l;
-   const char * const * pr    = (const char * const *)r;
-   const char *         left  = *pl;
-   const char *         right = *pr;
-   return strcmp( left, right );
+/**
+ * Le dernier holder qui référence une valeur d'un instantané en ferme le fichier.
+ */
+static void release_snapshot( loaded_snapshot * snapshot ) {
+   if( atomic_fetch_sub( &snapshot->references, 1 ) == 1 ) {
+      rkv_snapshot_file_close( &snapshot->file );
+      free( snapshot->values );
+      free( snapshot );
+   }
 }
 
-bool rkv_new( rkv * cache, const char * group, unsigned short port, const rkv_codec * const codecs[], size_t codec_count ) {
-#ifdef _WIN32
-   WSADATA wsaData;
-   if( WSAStartup( 0x0101, &wsaData )) {
-      perror( "WSAStartup" );
-      return false;
+static bool release_holder( size_t index, const rkv_data_holder * holder, void * user_context ) {
+   rkv_private * This = (rkv_private *)user_context;
+   if( holder->lazy ) {
+      lazy_value * value   = CONST_CAST( holder->payload, lazy_value );
+      const void * decoded = atomic_load( &value->decoded );
+      if( decoded ) {
+         release_payload( This, holder->type, decoded );
+      }
+      release_snapshot( value->snapshot );
    }
-#endif
-   if(( cache == NULL )||( group == NULL )) {
-      fprintf( stderr, "%s: null argument\n", __func__ );
-      return false;
+   else {
+      release_payload( This, holder->type, holder->payload );
    }
-   *cache = NULL;
-   rkv_private * This = malloc( sizeof( rkv_private ));
-   if( This == NULL ) {
+   rkv_intern_release( This->ids, holder->id );
+   return true;
+   (void)index;
+}
+
+/**
+ * Une nouvelle valeur pour une clé déjà reçue remplace l'ancienne, qui est libérée ici.
+ */
+static bool put_received( rkv_private * This, rkv_batch received_data, const rkv_data_holder * holder ) {
+   rkv_data_holder replaced;
+   bool            has_replaced = false;
+   if( ! rkv_batch_put( received_data, holder, &replaced, &has_replaced )) {
+      char ids[ID_AS_STRING_LENGTH_MAX+1];
+      rkv_id_to_string( holder->id, ids, sizeof( ids ));
+      fprintf( stderr, "%s: unable to store data %s of type %d\n", __func__, ids, holder->type );
+      release_holder( 0, holder, This );
       return false;
    }
-   memset( This, 0, sizeof( rkv_private ));
-   This->sckt     = -1;
-   This->is_alive = false;
-   if( strlen( group ) < MCAST_MIN ) {
-      fprintf( stderr, "%s: multicast IP v4 address too short: %s, expected 239.0.0.[0..255]\n", __func__, group );
-      free( This );
-      return false;
+   if( has_replaced ) {
+      release_holder( 0, &replaced, This );
    }
-   if( strlen( group ) > MCAST_MAX ) {
-      fprintf( stderr, "%s: multicast IP v4 address too long: %s, expected 239.0.0.[0..255]\n", __func__, group );
-      free( This );
+   return true;
+}
+
+static bool move_received( size_t index, const rkv_data_holder * holder, void * user_context ) {
+   rkv_private * This = (rkv_private *)user_context;
+   put_received( This, This->received_data, holder );
+   return true;
+   (void)index;
+}
+
+/**
+ * Décode une valeur dans la réserve de son type, ou dans une valeur remplacée recyclée.
+ * *allocated est faux si la mémoire a manqué, sinon un échec est une erreur de décodage
+ * et la valeur a déjà été rendue.
+ */
+static bool decode_payload( rkv_private * This, rkv_codec_entry * codec, net_buff buffer, void ** payload, bool * allocated ) {
+   *payload   = NULL;
+   *allocated = codec->payloads
+      ? rkv_pool_alloc( codec->payloads, payload )
+      : rkv_codecs_reuse( codec, payload );
+   if( ! *allocated ) {
       return false;
    }
-   memset( &This->recv_addr, 0, sizeof( This->recv_addr ));
-   This->recv_addr.sin_family      = AF_INET;
-   This->recv_addr.sin_port        = htons( port );
-   This->recv_addr.sin_addr.s_addr = htonl( INADDR_ANY );
-   memset( &This->send_addr, 0, sizeof( This->send_addr ));
-   This->send_addr.sin_family      = AF_INET;
-   This->send_addr.sin_port        = htons( port );
-   This->send_addr.sin_addr.s_addr = inet_addr( group );
-   memset( &This->imr, 0, sizeof( This->imr ));
-   This->imr.imr_multiaddr.s_addr = inet_addr( group );
-   This->imr.imr_interface.s_addr = htonl( INADDR_ANY );
-   This->sckt = socket( PF_INET, SOCK_DGRAM, 0 );
-   if( This->sckt < 0 ) {
-      perror( "socket( PF_INET, SOCK_DGRAM )" );
-      free( This );
-      return false;
+   const bool decoded = codec->plain
+      ? rkv_plain_decode( *payload, buffer, &codec->codec )
+      : codec->codec.factory( payload, buffer, This->codec_map );
+   if(( ! decoded )&& *payload ) {
+      release_payload( This, codec->codec.type, *payload );
+      *payload = NULL;
    }
-   unsigned yes = 1;
-   if( setsockopt( This->sckt, SOL_SOCKET, SO_REUSEADDR, (char*) &yes, sizeof( yes )) < 0 ) {
-      perror( "setsockopt( SOL_SOCKET, SO_REUSEADDR )" );
-      close( This->sckt );
-      free( This );
-      return false;
+   return decoded;
+}
+
+static int type_compare( const void * l, const void * r ) {
+   const unsigned left  = *(const unsigned *)l;
+   const unsigned right = *(const unsigned *)r;
+   return ( left > right ) - ( left < right );
+}
+
+static int origin_compare( const void * l, const void * r ) {
+   const rkv_key * left  = (const rkv_key *)l;
+   const rkv_key * right = (const rkv_key *)r;
+   if( left->host != right->host ) {
+      return ( left->host > right->host ) - ( left->host < right->host );
    }
-   if( bind( This->sckt, (struct sockaddr*) &This->recv_addr, sizeof( This->recv_addr )) < 0 ) {
-      perror( "bind" );
-      close( This->sckt );
-      free( This );
-      return false;
+   return ( left->process > right->process ) - ( left->process < right->process );
+}
+
+static bool subscribed( const subscription * filter, const rkv_key * key, unsigned type ) {
+   if( filter == NULL ) {
+      return true;
    }
-   if( setsockopt( This->sckt, IPPROTO_IP, IP_ADD_MEMBERSHIP, &This->imr, sizeof( This->imr )) < 0 ) {
-      perror( "setsockopt( IP_ADD_MEMBERSHIP )" );
-      close( This->sckt );
-      free( This );
-      return false;
+   return (( filter->type_count == 0 )
+         ||( type == RKV_TOMBSTONE_TYPE )
+         || bsearch( &type, filter->types, filter->type_count, sizeof( unsigned ), type_compare ))
+      &&  (( filter->origin_count == 0 )
+         || bsearch( key, filter->origins, filter->origin_count, sizeof( rkv_key ), origin_compare ));
+}
+
+static void free_subscription( void * garbage, void * user_context ) {
+   subscription * filter = garbage;
+   if( filter ) {
+      free( filter->types );
+      free( filter->origins );
+      free( filter );
    }
-   const pid_t    pid    = getpid();
-   const long int hostid = gethostid();
-   char           ipv4[INET_ADDRSTRLEN];
-   if( ! get_multicast_interface_address( ipv4 )) {
+   (void)user_context;
+}
 
+/**
+ * Décode les entrées d'une transaction complète dans le lot courant. La limite du tampon est
+ * ramenée à la fin de chaque valeur, qu'un codec ne peut donc pas dépasser. Une entrée illisible
+ * est ignorée, une entrée tronquée met fin à la transaction. Retourne false uniquement en cas
+ * d'erreur fatale (mémoire épuisée).
+ */
+static bool decode_entries( rkv_private * This, net_buff buffer, rkv_batch batch, const subscription * filter,
+   const received_order * order )
+{
+   size_t        position = 0;
+   size_t        limit    = 0;
+   unsigned long skipped  = 0;
+   bool          ok       = true;
+   while( ok
+      &&  net_buff_get_position( buffer, &position )
+      &&  net_buff_get_limit   ( buffer, &limit    )
+      &&( position < limit ))
+   {
+      rkv_key  key;
+      unsigned type = 0;
+      unsigned size = 0;
+      if(   ! rkv_key_decode( &key, buffer )
+         || ! net_buff_decode_uint32( buffer, &type )
+         || ! net_buff_decode_uint32( buffer, &size )
+         || ! net_buff_get_position( buffer, &position )
+         ||( size > limit - position ))
+      {
+         fprintf( stderr, "%s: truncated entry, packet skipped\n", __func__ );
+         break;
+      }
+      const size_t      end       = position + size;
+      const bool        tombstone = ( type == RKV_TOMBSTONE_TYPE );
+      rkv_codec_entry * codec     = NULL;
+      if( ! subscribed( filter, &key, type )||( ! tombstone && ! rkv_codecs_get( This->codecs, type, &codec ))) {
+         skipped += 1;
+         net_buff_set_position( buffer, end );
+         continue;
+      }
+      rkv_id id = NULL;
+      if( ! rkv_intern_key( This->ids, &key, &id )) {
+         ok = false;
+         break;
+      }
+      if( tombstone ) {
+         const rkv_data_holder holder = {
+            .id             = id,
+            .type           = type,
+            .payload        = NULL,
+            .publisher_rank = order->publisher_rank,
+            .sequence       = order->sequence
+         };
+         net_buff_set_position( buffer, end );
+         put_received( This, batch, &holder );
+         continue;
+      }
+      void *     payload   = NULL;
+      bool       allocated = false;
+      const bool decoded   = net_buff_set_limit( buffer, end )
+         &&                  decode_payload( This, codec, buffer, &payload, &allocated );
+      net_buff_set_limit( buffer, limit );
+      net_buff_set_position( buffer, end );
+      if( ! decoded ) {
+         rkv_intern_release( This->ids, id );
+         if( ! allocated ) {
+            ok = false;
+            break;
+         }
+         char keys[ID_AS_STRING_LENGTH_MAX+1];
+         rkv_key_to_string( &key, keys, sizeof( keys ));
+         fprintf( stderr, "%s: unable to decode data %s of type %d, entry skipped\n", __func__, keys, type );
+         continue;
+      }
+      const rkv_data_holder holder = {
+         .id             = id,
+         .type           = type,
+         .payload        = payload,
+         .publisher_rank = order->publisher_rank,
+         .sequence       = order->sequence
+      };
+      put_received( This, batch, &holder );
    }
-   snprintf( This->localID, sizeof( This->localID ), "%d/%ld@%s:%d", pid, hostid, ipv4, This->recv_addr.sin_port );
-   if( ! net_buff_new( &This->recv_buff, PAYLOAD_MAX )) {
-      close( This->sckt );
-      free( This );
-      return false;
+   if( skipped ) {
+      atomic_fetch_add_explicit( &This->entries_skipped, skipped, memory_order_relaxed );
    }
-   if( ! net_buff_new( &This->send_buff, PAYLOAD_MAX )) {
-      close( This->sckt );
-      net_buff_delete( &This->recv_buff );
-      free( This );
+   return ok;
+}
+
+static bool decode_transaction( rkv_private * This, net_buff buffer, rkv_batch batch, const received_order * order ) {
+   void * pinned = NULL;
+   if( ! rkv_epoch_enter( This->subscription_epoch, &This->subscription, &pinned )) {
       return false;
    }
-   if( ! utils_map_new( &This->codecs, codec_id_compare, false, true )) {
-      close( This->sckt );
-      net_buff_delete( &This->recv_buff );
-      net_buff_delete( &This->send_buff );
-      free( This );
+   const bool ok = decode_entries( This, buffer, batch, pinned, order );
+   rkv_epoch_leave( This->subscription_epoch );
+   return ok;
+}
+
+/**
+ * Un journal qui n'écrit plus l'a signalé, la réception continue sans lui.
+ */
+static void journal_transaction( rkv_private * This, net_buff transaction ) {
+   size_t position = 0;
+   size_t limit    = 0;
+   byte * bytes    = NULL;
+   if(   net_buff_get_position( transaction, &position )
+      && net_buff_get_limit   ( transaction, &limit    )
+      && net_buff_get_bytes   ( transaction, &bytes    ))
+   {
+      rkv_journal_append( This->journal, bytes + position, limit - position );
+   }
+}
+
+/**
+ * Un émetteur configuré avec une plus grande MTU a droit à une copie à sa taille.
+ */
+static bool copy_transaction( decode_job * job, net_buff transaction ) {
+   size_t position = 0;
+   size_t limit    = 0;
+   size_t capacity = 0;
+   byte * bytes    = NULL;
+   job->transaction = NULL;
+   if(   ! net_buff_get_position( transaction, &position )
+      || ! net_buff_get_limit   ( transaction, &limit    )
+      || ! net_buff_get_bytes   ( transaction, &bytes    )
+      || ! net_buff_get_capacity( job->copy  , &capacity ))
+   {
       return false;
    }
-   for( size_t i = 0; i < codec_count; ++i ) {
-      const rkv_codec * const codec = codecs[i];
-      rkv_codec * value = malloc( sizeof( rkv_codec ));
-      if( value == NULL ) {
-         perror( "malloc rkv_codec" );
-         return false;
-      }
-      *value = *codec;
-      if( ! utils_map_put( This->codecs, &value->type, value )) {
-         free( value );
+   const size_t size = limit - position;
+   if( size <= capacity ) {
+      job->transaction = job->copy;
+      if( ! net_buff_clear( job->copy )) {
          return false;
       }
    }
-   if( ! utils_map_new( &This->read_only_data, rkv_id_compare, true, true )) {
-      close( This->sckt );
-      net_buff_delete( &This->recv_buff );
-      net_buff_delete( &This->send_buff );
-      utils_map_delete( &This->codecs );
-      free( This );
+   else if( ! net_buff_new( &job->transaction, size )) {
       return false;
    }
-//   utils_map_set_trace( This->read_only_data, UTILS_MAP_TRACE_FREE );
-   if( ! utils_map_new( &This->transactions, string_compare, false, false )) {
-      close( This->sckt );
-      net_buff_delete( &This->recv_buff );
-      net_buff_delete( &This->send_buff );
-      utils_map_delete( &This->codecs );
-      utils_map_delete( &This->read_only_data );
-      free( This );
-      return false;
+   if(   net_buff_encode_bytes( job->transaction, bytes + position, size )
+      && net_buff_flip( job->transaction ))
+   {
+      return true;
    }
-   pthread_mutex_init( &This->received_data_lock, NULL );
-   pthread_mutex_init( &This->listeners_lock, NULL );
-   if( pthread_create( &This->thread, NULL, multicast_receive_thread, This )) {
-      perror( "pthread_create" );
-      close( This->sckt );
-      net_buff_delete ( &This->recv_buff );
-      net_buff_delete ( &This->send_buff );
-      utils_map_delete( &This->codecs );
-      utils_map_delete( &This->read_only_data );
-      utils_map_delete( &This->transactions );
-      free( This );
-      return false;
+   if( job->transaction != job->copy ) {
+      net_buff_delete( &job->transaction );
    }
-   *cache = (rkv)This;
-   return true;
+   return false;
 }
 
-bool rkv_add_listener( rkv cache, rkv_change_callback callback, void * user_context ) {
-   if(( cache == NULL )||( callback == NULL )) {
-      fprintf( stderr, "%s: null argument\n", __func__ );
+/**
+ * Confie une transaction complète à un thread de décodage. Quand tous sont occupés et la file
+ * pleine, le thread de réception attend : c'est alors la file de la socket qui se remplit.
+ */
+static bool enqueue_transaction( rkv_private * This, net_buff transaction, bool owned, const received_order * order ) {
+   void * item = NULL;
+   if( ! rkv_queue_pop( This->free_jobs, &item )) {
       return false;
    }
-   rkv_listener listener = malloc( sizeof( struct rkv_listener_s ));
-   if( listener == NULL ) {
-      perror( "malloc" );
+   decode_job * job = (decode_job *)item;
+   job->transaction = transaction;
+   if(( ! owned )&& ! copy_transaction( job, transaction )) {
+      rkv_queue_push( This->free_jobs, job );
       return false;
    }
-   listener->callback     = callback;
-   listener->user_context = user_context;
-   rkv_private * This = (rkv_private *)cache;
-   pthread_mutex_lock( &This->listeners_lock );
-   listener->next = This->listeners;
-   This->listeners = listener;
-   pthread_mutex_unlock( &This->listeners_lock );
-   return true;
+   job->ticket = This->next_ticket++;
+   job->order  = *order;
+   return rkv_queue_push( This->decode_queue, job );
 }
 
-bool rkv_put( rkv cache, const char * name, const rkv_id id, unsigned type, const void * data ) {
-   if(( cache == NULL )||( name == NULL )||( id == NULL )||( data == NULL )) {
-      fprintf( stderr, "%s: null argument\n", __func__ );
-      return false;
+/**
+ * Une transaction complète est journalisée puis décodée, ici ou par un thread de décodage.
+ * owned : elle vient du réassemblage et appartient à l'appelant, qui la libère.
+ */
+static bool deliver_transaction( rkv_private * This, net_buff transaction, bool owned, rkv_batch batch,
+   const received_order * order )
+{
+   if( This->journal ) {
+      journal_transaction( This, transaction );
    }
-   rkv_private * This  = (rkv_private *)cache;
-   utils_map transaction = NULL;
-   if( ! utils_map_get( This->transactions, name, (map_value *)&transaction )) {
-      if( ! utils_map_new( &transaction, rkv_id_compare, false, true )) {
-         return false;
+   if( This->decode_queue ) {
+      if( enqueue_transaction( This, transaction, owned, order )) {
+         return true;
       }
-      if( ! utils_map_put( This->transactions, name, transaction )) {
-         return false;
+      fprintf( stderr, "%s: unable to queue a transaction, packet skipped\n", __func__ );
+      if( owned ) {
+         net_buff_delete( &transaction );
       }
+      return true;
    }
-   rkv_data_holder * entry = malloc( sizeof( rkv_data_holder ));
-   entry->id   = id;
-   entry->type = type;
-   entry->payload = data;
-   if( ! utils_map_put( transaction, id, entry )) {
-      free( entry );
-      return false;
+   const bool ok = decode_transaction( This, transaction, batch, order );
+   if( owned ) {
+      net_buff_delete( &transaction );
    }
-   return true;
+   return ok;
 }
 
-static bool rkv_data_encode( size_t index, map_pair pair, void * user_context ) {
-   rkv_private *    This  = (rkv_private *)user_context;
-   const rkv_data_holder * data  = pair.value;
-   rkv_codec *      codec = NULL;
-   if(   rkv_id_encode( data->id, This->send_buff )
-      && net_buff_encode_uint32( This->send_buff, data->type ))
-   {
-      if( ! utils_map_get( This->codecs, &data->type, (map_value *)&codec )) {
-         char ids[ID_AS_STRING_LENGTH_MAX+1];
-         rkv_id_to_string( data->id, ids, sizeof( ids ));
-         fprintf( stderr, "%s: unable to encode data %s of type %d (no codec found)\n", __func__, ids, data->type );
+/**
+ * Les émetteurs sont peu nombreux : la recherche est linéaire, comme celle du sequencer. Faute
+ * de mémoire, la transaction n'est pas ordonnée, elle ne sera jamais écartée.
+ */
+static uint32_t publisher_rank( rkv_private * This, const rkv_publisher * publisher ) {
+   for( size_t i = 0; i < This->publisher_count; ++i ) {
+      if( rkv_protocol_same_publisher( This->publishers + i, publisher )) {
+         return (uint32_t)( i + 1 );
       }
-      else if( ! codec->encoder( This->send_buff, data->payload, This->codecs )) {
-         char ids[ID_AS_STRING_LENGTH_MAX+1];
-         rkv_id_to_string( data->id, ids, sizeof( ids ));
-         fprintf( stderr, "%s: unable to encode data %s of type %d (encoder failed)\n", __func__, ids, data->type );
+   }
+   rkv_publisher * publishers = realloc( This->publishers, ( This->publisher_count + 1 ) * sizeof( rkv_publisher ));
+   if( publishers == NULL ) {
+      perror( "realloc" );
+      return 0;
+   }
+   This->publishers = publishers;
+   This->publishers[This->publisher_count++] = *publisher;
+   return (uint32_t)This->publisher_count;
+}
+
+/**
+ * Une transaction tenant dans un seul datagramme est décodée sur place, les autres
+ * sont confiées au réassemblage et décodées quand leur dernier fragment arrive.
+ */
+static bool decode_fragment( rkv_private * This, const rkv_fragment_header * header, net_buff buffer, rkv_batch batch ) {
+   if( header->count == 1 ) {
+      const received_order order = { publisher_rank( This, &header->publisher ), header->sequence };
+      return deliver_transaction( This, buffer, false, batch, &order );
+   }
+   net_buff transaction = NULL;
+   if( ! rkv_reassembly_add( This->reassembly, header, buffer, &transaction )||( transaction == NULL )) {
+      return true;
+   }
+   const received_order order = { publisher_rank( This, &header->publisher ), header->sequence };
+   return deliver_transaction( This, transaction, true, batch, &order );
+}
+
+/**
+ * Réémet sur le groupe les datagrammes réclamés encore présents dans l'anneau,
+ * les autres sont trop anciens : le récepteur finira par les tenir pour perdus.
+ */
+static bool resend_datagrams( rkv_private * This, const rkv_nack * nack ) {
+   if(( This->options.replay_datagrams == 0 )|| ! rkv_protocol_same_publisher( &nack->publisher, &This->publisher )) {
+      return true;
+   }
+   unsigned long resent = 0;
+   pthread_mutex_lock( &This->replay_lock );
+   for( uint16_t i = 0; i < nack->count; ++i ) {
+      const uint32_t datagram = nack->first + i;
+      replay_slot *  slot     = This->replay + ( datagram % This->replay_size );
+      if(   slot->used
+         &&( slot->datagram == datagram )
+         && net_buff_set_position( slot->data, 0 )
+         && net_buff_send( slot->data, This->sckt, &This->send_addr ))
+      {
+         ++resent;
+      }
+   }
+   pthread_mutex_unlock( &This->replay_lock );
+   pthread_mutex_lock( &This->received_data_lock );
+   This->stats.datagrams_resent += resent;
+   pthread_mutex_unlock( &This->received_data_lock );
+   return true;
+}
+
+static bool send_nack( const rkv_nack * nack, const struct sockaddr_in * publisher, void * user_context ) {
+   rkv_private * This = (rkv_private *)user_context;
+   return net_buff_clear( This->control_buff )
+      &&  rkv_protocol_encode_nack( This->control_buff, nack )
+      &&  net_buff_flip( This->control_buff )
+      &&  net_buff_send( This->control_buff, This->sckt, publisher );
+}
+
+/**
+ * Un pair qui démarre demande l'état courant : le port du serveur lui est indiqué par le groupe,
+ * pour que la réponse lui parvienne même s'il partage son port avec d'autres caches de l'hôte.
+ */
+static bool offer_snapshot( rkv_private * This, net_buff buffer ) {
+   rkv_snapshot_offer offer = { .port = This->bootstrap_port };
+   if( ! rkv_protocol_decode_snapshot_request( buffer, &offer.requester )) {
+      fprintf( stderr, "%s: malformed snapshot request, skipped\n", __func__ );
+      return true;
+   }
+   if(( This->bootstrap_listener < 0 )|| rkv_protocol_same_publisher( &offer.requester, &This->publisher )) {
+      return true;
+   }
+   if(   ! net_buff_clear( This->control_buff )
+      || ! rkv_protocol_encode_snapshot_offer( This->control_buff, &offer )
+      || ! net_buff_flip( This->control_buff )
+      || ! net_buff_send( This->control_buff, This->sckt, &This->send_addr ))
+   {
+      fprintf( stderr, "%s: unable to offer a snapshot\n", __func__ );
+   }
+   return true;
+}
+
+/**
+ * Seule la première offre est retenue, le serveur est à l'adresse d'où elle vient.
+ */
+static bool accept_snapshot_offer( rkv_private * This, net_buff buffer, const struct sockaddr_in * from ) {
+   rkv_snapshot_offer offer;
+   if( ! rkv_protocol_decode_snapshot_offer( buffer, &offer )) {
+      fprintf( stderr, "%s: malformed snapshot offer, skipped\n", __func__ );
+      return true;
+   }
+   if( ! rkv_protocol_same_publisher( &offer.requester, &This->publisher )) {
+      return true;
+   }
+   pthread_mutex_lock( &This->bootstrap_lock );
+   if( This->bootstrap_waiting && ! This->bootstrap_has_peer ) {
+      This->bootstrap_peer          = *from;
+      This->bootstrap_peer.sin_port = htons( offer.port );
+      This->bootstrap_has_peer      = true;
+      pthread_cond_signal( &This->bootstrap_offered );
+   }
+   pthread_mutex_unlock( &This->bootstrap_lock );
+   return true;
+}
+
+/**
+ * Arme ou repousse une échéance. Le thread expirer n'est réveillé que si elle tombe avant celle
+ * qu'il attend.
+ */
+static void arm_timer( rkv_private * This, rkv_timers timers, const rkv_key * key, uint64_t deadline ) {
+   size_t count = 0;
+   pthread_mutex_lock( &This->timers_lock );
+   if( ! rkv_timers_arm( timers, key, deadline )) {
+      fprintf( stderr, "%s: unable to arm a deadline, it will not expire\n", __func__ );
+   }
+   else if( deadline < This->expirer_wake ) {
+      pthread_cond_signal( &This->timers_wakeup );
+   }
+   if(( timers == This->publisher_timers )&& rkv_timers_get_count( timers, &count )) {
+      atomic_store_explicit( &This->publishers_alive, count, memory_order_relaxed );
+   }
+   pthread_mutex_unlock( &This->timers_lock );
+}
+
+static void cancel_timer( rkv_private * This, rkv_timers timers, const rkv_key * key ) {
+   pthread_mutex_lock( &This->timers_lock );
+   rkv_timers_cancel( timers, key );
+   pthread_mutex_unlock( &This->timers_lock );
+}
+
+static bool is_armed( rkv_private * This, rkv_timers timers, const rkv_key * key ) {
+   uint64_t deadline = 0;
+   pthread_mutex_lock( &This->timers_lock );
+   const bool armed = rkv_timers_get( timers, key, &deadline );
+   pthread_mutex_unlock( &This->timers_lock );
+   return armed;
+}
+
+/**
+ * L'origine d'un battement de cœur est celle des clés créées par son émetteur : une clé dont
+ * seuls host et process comptent, instance 0 n'étant jamais attribuée par rkv_key_make().
+ */
+static bool receive_heartbeat( rkv_private * This, net_buff buffer, const struct sockaddr_in * from, bool alive ) {
+   rkv_heartbeat heartbeat;
+   if( ! rkv_protocol_decode_heartbeat( buffer, &heartbeat )) {
+      fprintf( stderr, "%s: malformed heartbeat, skipped\n", __func__ );
+      return true;
+   }
+   if( heartbeat.last != 0 ) {
+      rkv_sequencer_announce( This->sequencer, &heartbeat.publisher, from, heartbeat.last );
+   }
+   if( alive && This->options.publisher_timeout_ms ) {
+      const rkv_key origin = { .host = (uint32_t)heartbeat.publisher.host, .process = (uint32_t)heartbeat.publisher.process };
+      arm_timer( This, This->publisher_timers, &origin, monotonic_ms() + This->options.publisher_timeout_ms );
+   }
+   return true;
+}
+
+static uint32_t last_datagram( rkv_private * This ) {
+   pthread_mutex_lock( &This->replay_lock );
+   const uint32_t last = This->datagram_sequence;
+   pthread_mutex_unlock( &This->replay_lock );
+   return last;
+}
+
+/**
+ * Par le thread de réception, qui se réveille au moins tous les heartbeat_ms, voir SO_RCVTIMEO.
+ */
+static void send_heartbeat( rkv_private * This ) {
+   const uint64_t now = monotonic_ms();
+   if(( This->options.heartbeat_ms == 0 )||( now < This->heartbeat_due )) {
+      return;
+   }
+   This->heartbeat_due = now + This->options.heartbeat_ms;
+   const rkv_heartbeat heartbeat = { .publisher = This->publisher, .last = last_datagram( This ) };
+   if(   net_buff_clear( This->control_buff )
+      && rkv_protocol_encode_heartbeat( This->control_buff, &heartbeat )
+      && net_buff_flip( This->control_buff )
+      && net_buff_send( This->control_buff, This->sckt, &This->send_addr ))
+   {
+      atomic_fetch_add_explicit( &This->heartbeats_sent, 1, memory_order_relaxed );
+   }
+}
+
+/**
+ * Un datagramme perdu n'est révélé que par le suivant, le dernier d'une rafale ne le serait
+ * jamais. Quand l'émetteur se tait depuis tail_interval_ms, le thread de réception annonce
+ * donc le numéro de son dernier datagramme, TAIL_ANNOUNCES fois à cet intervalle : le
+ * récepteur qui l'a perdu le réclame avant de l'abandonner. Sans anneau de réémission, une
+ * réclamation resterait sans réponse, rien n'est annoncé.
+ */
+static void send_tail( rkv_private * This ) {
+   const uint64_t now = monotonic_ms();
+   if(( This->options.replay_datagrams == 0 )||( now < This->tail_due )) {
+      return;
+   }
+   This->tail_due = now + This->tail_interval_ms;
+   const rkv_heartbeat tail = { .publisher = This->publisher, .last = last_datagram( This ) };
+   if( tail.last != This->tail_last ) {
+      // la rafale continue, l'annonce attend qu'elle finisse
+      This->tail_last    = tail.last;
+      This->tail_repeats = TAIL_ANNOUNCES;
+      return;
+   }
+   if( This->tail_repeats == 0 ) {
+      return;
+   }
+   This->tail_repeats -= 1;
+   if(   net_buff_clear( This->control_buff )
+      && rkv_protocol_encode_tail( This->control_buff, &tail )
+      && net_buff_flip( This->control_buff ))
+   {
+      net_buff_send( This->control_buff, This->sckt, &This->send_addr );
+   }
+}
+
+/**
+ * Les datagrammes de données passent par le sequencer, qui les livre dans leur ordre d'émission.
+ */
+static bool decode_datagram( rkv_private * This, net_buff buffer, const struct sockaddr_in * from, rkv_batch batch ) {
+   byte kind = 0;
+   if( ! rkv_protocol_decode_kind( buffer, &kind )) {
+      fprintf( stderr, "%s: empty datagram, skipped\n", __func__ );
+      return true;
+   }
+   if( kind == RKV_DATAGRAM_NACK ) {
+      rkv_nack nack;
+      if( ! rkv_protocol_decode_nack( buffer, &nack )) {
+         fprintf( stderr, "%s: malformed retransmission request, skipped\n", __func__ );
+         return true;
+      }
+      return resend_datagrams( This, &nack );
+   }
+   if( kind == RKV_DATAGRAM_SNAPSHOT_REQUEST ) {
+      return offer_snapshot( This, buffer );
+   }
+   if( kind == RKV_DATAGRAM_SNAPSHOT_OFFER ) {
+      return accept_snapshot_offer( This, buffer, from );
+   }
+   if(( kind == RKV_DATAGRAM_HEARTBEAT )||( kind == RKV_DATAGRAM_TAIL )) {
+      return receive_heartbeat( This, buffer, from, kind == RKV_DATAGRAM_HEARTBEAT );
+   }
+   rkv_fragment_header header;
+   if(( kind != RKV_DATAGRAM_FRAGMENT )|| ! rkv_protocol_decode_fragment_header( buffer, &header )) {
+      fprintf( stderr, "%s: malformed fragment header, packet skipped\n", __func__ );
+      return true;
+   }
+   bool deliver = false;
+   if( ! rkv_sequencer_add( This->sequencer, &header, from, buffer, &deliver )) {
+      return true;
+   }
+   return ( ! deliver )|| decode_fragment( This, &header, buffer, batch );
+}
+
+/**
+ * Décode les datagrammes mis de côté par le sequencer qui sont devenus livrables.
+ */
+static bool decode_held_datagrams( rkv_private * This, rkv_batch batch ) {
+   bool ok = true;
+   for(;;) {
+      net_buff datagram = NULL;
+      if( ! rkv_sequencer_next( This->sequencer, &datagram )||( datagram == NULL )) {
+         return ok;
+      }
+      byte                kind = 0;
+      rkv_fragment_header header;
+      if(   ok
+         && rkv_protocol_decode_kind( datagram, &kind )
+         && rkv_protocol_decode_fragment_header( datagram, &header ))
+      {
+         ok = decode_fragment( This, &header, datagram, batch );
+      }
+      net_buff_delete( &datagram );
+   }
+}
+
+/**
+ * Un datagramme plus grand que PAYLOAD_MAX a été coupé par le noyau : ce n'est plus un fragment
+ * valide, il est écarté. Les suivants reculent avec leur iovec et leur adresse, chaque
+ * descripteur de recvmmsg() désigne toujours les octets du net_buff de même rang. Les autres
+ * sont prêts à être décodés.
+ */
+static size_t frame_received( rkv_private * This, size_t count, size_t * truncated ) {
+   size_t kept = 0;
+   for( size_t i = 0; i < count; ++i ) {
+      if( This->recv_msgs[i].msg_hdr.msg_flags & MSG_TRUNC ) {
+         *truncated += 1;
+         continue;
+      }
+      if( kept < i ) {
+         const net_buff           buffer = This->recv_ring[kept];
+         const struct iovec       iov    = This->recv_iovs[kept];
+         const struct sockaddr_in from   = This->recv_from[kept];
+         This->recv_ring[kept] = This->recv_ring[i];
+         This->recv_iovs[kept] = This->recv_iovs[i];
+         This->recv_from[kept] = This->recv_from[i];
+         This->recv_ring[i]    = buffer;
+         This->recv_iovs[i]    = iov;
+         This->recv_from[i]    = from;
+         This->recv_msgs[kept].msg_len = This->recv_msgs[i].msg_len;
+      }
+      if(   ! net_buff_clear    ( This->recv_ring[kept] )
+         || ! net_buff_set_limit( This->recv_ring[kept], This->recv_msgs[kept].msg_len ))
+      {
+         break;
+      }
+      ++kept;
+   }
+   return kept;
+}
+
+/**
+ * Réception d'un seul datagramme par appel système, dans recv_ring[0]. recvmsg() plutôt que
+ * recvfrom() pour savoir s'il a été tronqué.
+ */
+static size_t receive_one( rkv_private * This, size_t * truncated ) {
+   This->recv_msgs[0].msg_hdr.msg_namelen = sizeof( struct sockaddr_in );
+   This->recv_msgs[0].msg_hdr.msg_flags   = 0;
+   pthread_setcancelstate( PTHREAD_CANCEL_ENABLE, NULL );
+   const ssize_t size = recvmsg( This->sckt, &This->recv_msgs[0].msg_hdr, 0 );
+   pthread_setcancelstate( PTHREAD_CANCEL_DISABLE, NULL );
+   if( size <= 0 ) {
+      return 0;
+   }
+   This->recv_msgs[0].msg_len = (unsigned)size;
+   return frame_received( This, 1, truncated );
+}
+
+/**
+ * Réception de jusqu'à recv_batch_size datagrammes par appel système : recvmmsg() bloque
+ * jusqu'au premier datagramme puis draine sans attendre ceux déjà présents dans la file du noyau.
+ * Les iovec pointent directement sur les octets des net_buff de l'anneau, il n'y a aucune copie.
+ */
+static size_t receive_batch( rkv_private * This, size_t * truncated ) {
+   const unsigned batch_size = (unsigned)This->options.recv_batch_size;
+   for( unsigned i = 0; i < batch_size; ++i ) {
+      This->recv_msgs[i].msg_len             = 0;
+      This->recv_msgs[i].msg_hdr.msg_namelen = sizeof( struct sockaddr_in );
+      This->recv_msgs[i].msg_hdr.msg_flags   = 0;
+   }
+   pthread_setcancelstate( PTHREAD_CANCEL_ENABLE, NULL );
+   int count = recvmmsg( This->sckt, This->recv_msgs, batch_size, MSG_WAITFORONE, NULL );
+   pthread_setcancelstate( PTHREAD_CANCEL_DISABLE, NULL );
+   if( count < 0 ) {
+      if(( errno != EINTR )&&( errno != EAGAIN )&&( errno != EWOULDBLOCK )) {
+         perror( "recvmmsg" );
+      }
+      return 0;
+   }
+   return frame_received( This, (size_t)count, truncated );
+}
+
+/**
+ * Seul le passage de notify_pending de faux à vrai réveille le dispatcher : il teste ce
+ * drapeau sous notify_lock avant d'attendre, le signal ne peut donc pas être perdu.
+ */
+static void notify_listeners( rkv_private * This ) {
+   if( atomic_exchange( &This->notify_pending, true )) {
+      atomic_fetch_add_explicit( &This->notifications_coalesced, 1, memory_order_relaxed );
+      return;
+   }
+   if( This->options.listener_thread ) {
+      pthread_mutex_lock( &This->notify_lock );
+      pthread_cond_signal( &This->notify_wakeup );
+      pthread_mutex_unlock( &This->notify_lock );
+   }
+}
+
+static void call_listeners( rkv_private * This ) {
+   void * pinned = NULL;
+   if( ! rkv_epoch_enter( This->listeners_epoch, &This->listeners, &pinned )) {
+      return;
+   }
+   const listener_set * set = pinned;
+   if( set ) {
+      const rkv cache = This->parent ? This->parent : (rkv)This;
+      listener_calls += 1;
+      for( size_t i = 0; i < set->count; ++i ) {
+         if( set->listeners[i].callback ) {
+            set->listeners[i].callback( cache, set->listeners[i].user_context );
+         }
+      }
+      listener_calls -= 1;
+   }
+   rkv_epoch_leave( This->listeners_epoch );
+   atomic_fetch_add_explicit( &This->notifications, 1, memory_order_relaxed );
+}
+
+static void * listener_dispatch_thread( void * arg ) {
+   rkv_private * This = (rkv_private *)arg;
+   pthread_mutex_lock( &This->notify_lock );
+   while( This->dispatching ) {
+      if( ! atomic_exchange( &This->notify_pending, false )) {
+         pthread_cond_wait( &This->notify_wakeup, &This->notify_lock );
+         continue;
+      }
+      pthread_mutex_unlock( &This->notify_lock );
+      call_listeners( This );
+      pthread_mutex_lock( &This->notify_lock );
+   }
+   pthread_mutex_unlock( &This->notify_lock );
+   return NULL;
+}
+
+/**
+ * Une notification encore en attente est abandonnée, le dispatcher termine celle en cours.
+ */
+static void stop_dispatcher( rkv_private * This ) {
+   pthread_mutex_lock( &This->notify_lock );
+   const bool dispatching = This->dispatching;
+   This->dispatching = false;
+   pthread_cond_signal( &This->notify_wakeup );
+   pthread_mutex_unlock( &This->notify_lock );
+   if( dispatching ) {
+      pthread_join( This->dispatcher, NULL );
+   }
+}
+
+static bool start_dispatcher( rkv_private * This ) {
+   if( ! This->options.listener_thread ) {
+      return true;
+   }
+   This->dispatching = true;
+   if( pthread_create( &This->dispatcher, NULL, listener_dispatch_thread, This )) {
+      perror( "pthread_create" );
+      This->dispatching = false;
+      return false;
+   }
+   return true;
+}
+
+static void * multicast_receive_thread( void * arg ) {
+   rkv_private * This = (rkv_private *)arg;
+   pthread_setcancelstate( PTHREAD_CANCEL_DISABLE, NULL );
+   while( is_alive( This )) {
+      send_heartbeat( This );
+      send_tail( This );
+      // SO_RCVTIMEO : même sans trafic, les trous sont réclamés de nouveau ou abandonnés
+      size_t       truncated = 0;
+      const size_t count     = ( This->options.recv_batch_size > 1 )
+         ? receive_batch( This, &truncated )
+         : receive_one( This, &truncated );
+      bool         fatal = false;
+      for( size_t i = 0; ( i < count )&& ! fatal; ++i ) {
+         if( RKV_DBG ) {
+            log_datagram( This->recv_ring[i] );
+         }
+         fatal = ! decode_datagram( This, This->recv_ring[i], This->recv_from + i, This->batch )
+            ||   ! decode_held_datagrams( This, This->batch );
+      }
+      rkv_sequencer_expire( This->sequencer );
+      fatal = fatal || ! decode_held_datagrams( This, This->batch );
+      size_t decoded = 0;
+      rkv_batch_get_size( This->batch, &decoded );
+      if(( count == 0 )&&( decoded == 0 )&&( truncated == 0 )&& ! fatal ) {
+         continue;
+      }
+      rkv_reassembly_expire( This->reassembly );
+      if( RKV_DBG ) {
+         struct timeval tv;
+         gettimeofday( &tv, NULL );
+         fprintf( stderr, "%6ld.%06ld:DEBUG:%s:", tv.tv_sec, tv.tv_usec, __func__ );
+         dump_all_ids( This->batch, __func__ );
+      }
+      pthread_mutex_lock( &This->received_data_lock );
+      This->stats.receive_calls      += ( count > 0 ) ? 1 : 0;
+      This->stats.datagrams_received += count;
+      This->stats.datagrams_truncated += truncated;
+      rkv_reassembly_get_pending( This->reassembly, &This->stats.reassembly_pending, &This->stats.reassembly_bytes );
+      rkv_sequencer_get_stats( This->sequencer, &This->stats.datagrams_held, &This->stats.nacks_sent, &This->stats.datagrams_lost );
+      rkv_batch_foreach( This->batch, move_received, This );
+      if( fatal ) {
+         This->is_alive = false;
+      }
+      pthread_mutex_unlock( &This->received_data_lock );
+      rkv_batch_clear( This->batch );
+      // un battement de cœur ou une demande de retransmission n'apporte rien aux listeners
+      if(( This->decode_queue == NULL )&&( decoded || fatal )) {
+         notify_listeners( This );
+      }
+   }
+   return NULL;
+}
+
+/**
+ * Décode les transactions dans l'ordre où elles sortent de la file, en parallèle, mais ne les
+ * fusionne dans received_data qu'à leur tour : aucun ticket antérieur ne reste en suspens, ils
+ * ont tous été pris par un thread de décodage.
+ */
+static void * decode_worker_thread( void * arg ) {
+   rkv_private * This = (rkv_private *)arg;
+   for(;;) {
+      void * item = NULL;
+      if( ! rkv_queue_pop( This->decode_queue, &item )||( item == NULL )) {
+         return NULL;
+      }
+      decode_job * job = (decode_job *)item;
+      const bool   ok  = decode_transaction( This, job->transaction, job->batch, &job->order );
+      if( job->transaction != job->copy ) {
+         net_buff_delete( &job->transaction );
+      }
+      pthread_mutex_lock( &This->received_data_lock );
+      while( job->ticket != This->next_commit ) {
+         pthread_cond_wait( &This->committed, &This->received_data_lock );
+      }
+      rkv_batch_foreach( job->batch, move_received, This );
+      This->next_commit += 1;
+      if( ! ok ) {
+         This->is_alive = false;
+      }
+      pthread_cond_broadcast( &This->committed );
+      pthread_mutex_unlock( &This->received_data_lock );
+      rkv_batch_clear( job->batch );
+      rkv_queue_push( This->free_jobs, job );
+      notify_listeners( This );
+   }
+}
+
+/**
+ * Une entrée nulle par thread de décodage les arrête, une fois la file vidée.
+ */
+static void stop_workers( rkv_private * This, size_t started ) {
+   for( size_t i = 0; i < started; ++i ) {
+      rkv_queue_push( This->decode_queue, NULL );
+   }
+   for( size_t i = 0; i < started; ++i ) {
+      pthread_join( This->workers[i], NULL );
+   }
+}
+
+static bool start_workers( rkv_private * This ) {
+   for( size_t i = 0; i < This->worker_count; ++i ) {
+      if( pthread_create( &This->workers[i], NULL, decode_worker_thread, This )) {
+         perror( "pthread_create" );
+         stop_workers( This, i );
+         return false;
+      }
+   }
+   return true;
+}
+
+static int string_compare( const void * l, const void * r ) {
+   const char * const * pl    = (const char * const *)l;
+   const char * const * pr    = (const char * const *)r;
+   const char *         left  = *pl;
+   const char *         right = *pr;
+   return strcmp( left, right );
+}
+
+static void delete_recv_ring( rkv_private * This ) {
+   if( This->recv_ring ) {
+      for( size_t i = 0; i < This->options.recv_batch_size; ++i ) {
+         net_buff_delete( &This->recv_ring[i] );
+      }
+   }
+   free( This->recv_ring );
+   free( This->recv_msgs );
+   free( This->recv_iovs );
+   free( This->recv_from );
+   This->recv_ring = NULL;
+   This->recv_msgs = NULL;
+   This->recv_iovs = NULL;
+   This->recv_from = NULL;
+}
+
+/**
+ * L'anneau de réception et les descripteurs de recvmmsg() sont alloués une fois pour toutes.
+ */
+static bool new_recv_ring( rkv_private * This ) {
+   const size_t batch_size = This->options.recv_batch_size;
+   This->recv_ring = calloc( batch_size, sizeof( net_buff ));
+   This->recv_msgs = calloc( batch_size, sizeof( struct mmsghdr ));
+   This->recv_iovs = calloc( batch_size, sizeof( struct iovec ));
+   This->recv_from = calloc( batch_size, sizeof( struct sockaddr_in ));
+   if(( This->recv_ring == NULL )||( This->recv_msgs == NULL )||( This->recv_iovs == NULL )||( This->recv_from == NULL )) {
+      perror( "calloc" );
+      delete_recv_ring( This );
+      return false;
+   }
+   for( size_t i = 0; i < batch_size; ++i ) {
+      byte * bytes = NULL;
+      if(   ! net_buff_new( &This->recv_ring[i], PAYLOAD_MAX )
+         || ! net_buff_get_bytes( This->recv_ring[i], &bytes ))
+      {
+         delete_recv_ring( This );
+         return false;
+      }
+      This->recv_iovs[i].iov_base           = bytes;
+      This->recv_iovs[i].iov_len            = PAYLOAD_MAX;
+      This->recv_msgs[i].msg_hdr.msg_iov     = &This->recv_iovs[i];
+      This->recv_msgs[i].msg_hdr.msg_iovlen  = 1;
+      This->recv_msgs[i].msg_hdr.msg_name    = &This->recv_from[i];
+      This->recv_msgs[i].msg_hdr.msg_namelen = sizeof( struct sockaddr_in );
+   }
+   return true;
+}
+
+static void delete_jobs( rkv_private * This ) {
+   if( This->jobs ) {
+      for( size_t i = 0; i < This->options.decode_queue_depth; ++i ) {
+         if( This->jobs[i].copy ) {
+            net_buff_delete( &This->jobs[i].copy );
+         }
+         if( This->jobs[i].batch ) {
+            rkv_batch_foreach( This->jobs[i].batch, release_holder, This );
+            rkv_batch_delete( &This->jobs[i].batch );
+         }
+      }
+      free( This->jobs );
+      This->jobs = NULL;
+   }
+   if( This->decode_queue ) {
+      rkv_queue_delete( &This->decode_queue );
+   }
+   if( This->free_jobs ) {
+      rkv_queue_delete( &This->free_jobs );
+   }
+   free( This->workers );
+   This->workers = NULL;
+}
+
+/**
+ * Les travaux de décodage sont alloués une fois pour toutes et circulent entre free_jobs
+ * et decode_queue, qui a aussi la place des entrées nulles d'arrêt des threads.
+ */
+static bool new_jobs( rkv_private * This ) {
+   const size_t depth = This->options.decode_queue_depth;
+   This->worker_count = This->options.decode_workers;
+   This->jobs         = calloc( depth, sizeof( decode_job ));
+   This->workers      = calloc( This->worker_count, sizeof( pthread_t ));
+   if(( This->jobs == NULL )||( This->workers == NULL )) {
+      perror( "calloc" );
+      delete_jobs( This );
+      return false;
+   }
+   if(   ! rkv_queue_new( &This->decode_queue, depth + This->worker_count )
+      || ! rkv_queue_new( &This->free_jobs, depth ))
+   {
+      delete_jobs( This );
+      return false;
+   }
+   for( size_t i = 0; i < depth; ++i ) {
+      if(   ! net_buff_new( &This->jobs[i].copy, This->options.mtu )
+         || ! rkv_batch_new( &This->jobs[i].batch )
+         || ! rkv_queue_push( This->free_jobs, This->jobs + i ))
+      {
+         delete_jobs( This );
+         return false;
+      }
+   }
+   return true;
+}
+
+static void delete_replay( rkv_private * This ) {
+   if( This->replay ) {
+      for( size_t i = 0; i < This->replay_size; ++i ) {
+         if( This->replay[i].data ) {
+            net_buff_delete( &This->replay[i].data );
+         }
+      }
+   }
+   free( This->replay );
+   This->replay = NULL;
+}
+
+/**
+ * L'anneau des datagrammes émis a au moins un emplacement, celui du datagramme en cours d'émission.
+ */
+static bool new_replay( rkv_private * This ) {
+   This->replay_size = ( This->options.replay_datagrams > 0 ) ? This->options.replay_datagrams : 1;
+   This->replay      = calloc( This->replay_size, sizeof( replay_slot ));
+   if( This->replay == NULL ) {
+      perror( "calloc" );
+      return false;
+   }
+   for( size_t i = 0; i < This->replay_size; ++i ) {
+      if( ! net_buff_new( &This->replay[i].data, This->options.mtu - RKV_IP_UDP_OVERHEAD )) {
+         delete_replay( This );
+         return false;
+      }
+   }
+   return true;
+}
+
+static bool delete_transaction( size_t index, map_pair pair, void * user_context );
+static void * bootstrap_server_thread( void * arg );
+static bool bootstrap( rkv_private * This );
+static bool start_auto_publisher( rkv_private * This );
+static void stop_auto_publisher( rkv_private * This );
+static void release_tombstone( rkv_id id, void * user_context );
+static bool start_compactor( rkv_private * This );
+static void stop_compactor( rkv_private * This );
+static bool start_expirer( rkv_private * This );
+static void stop_expirer( rkv_private * This );
+
+/**
+ * Libère tout ce qui a été alloué, y compris par un rkv_new() interrompu :
+ * les membres non encore alloués sont nuls.
+ */
+static void release_resources( rkv_private * This ) {
+   if( This->sckt >= 0 ) {
+      close( This->sckt );
+   }
+   if( This->bootstrap_listener >= 0 ) {
+      close( This->bootstrap_listener );
+   }
+   delete_recv_ring( This );
+   if( This->reassembly ) {
+      rkv_reassembly_delete( &This->reassembly );
+   }
+   if( This->txn_buff ) {
+      net_buff_delete( &This->txn_buff );
+   }
+   if( This->sequencer ) {
+      rkv_sequencer_delete( &This->sequencer );
+   }
+   free( This->publishers );
+   This->publishers = NULL;
+   if( This->control_buff ) {
+      net_buff_delete( &This->control_buff );
+   }
+   delete_replay( This );
+   if( This->fingerprints ) {
+      rkv_fingerprints_delete( &This->fingerprints );
+   }
+   if( This->journal ) {
+      rkv_journal_delete( &This->journal );
+   }
+   if( This->conflating ) {
+      rkv_conflation_delete( &This->conflating );
+   }
+   if( This->flushing ) {
+      rkv_conflation_delete( &This->flushing );
+   }
+   if( This->auto_buff ) {
+      net_buff_delete( &This->auto_buff );
+   }
+   free( This->pending );
+   if( This->changes ) {
+      rkv_changes_delete( &This->changes );
+   }
+   if( This->tombstones ) {
+      rkv_tombstones_purge( This->tombstones, UINT64_MAX, UINT64_MAX, release_tombstone, This );
+      rkv_tombstones_delete( &This->tombstones );
+   }
+   if( This->key_timers ) {
+      rkv_timers_delete( &This->key_timers );
+   }
+   if( This->publisher_timers ) {
+      rkv_timers_delete( &This->publisher_timers );
+   }
+   free( This->expired );
+   free( This->ttls );
+   // les valeurs retirées sont rendues aux réserves, détruites en dernier
+   if( This->read_only_data ) {
+      rkv_store_foreach( This->read_only_data, release_holder, This );
+      rkv_store_delete( &This->read_only_data );
+   }
+   if( This->transactions ) {
+      utils_map_foreach( This->transactions, delete_transaction, NULL );
+      utils_map_delete( &This->transactions );
+   }
+   delete_jobs( This );
+   if( This->batch ) {
+      rkv_batch_foreach( This->batch, release_holder, This );
+      rkv_batch_delete( &This->batch );
+   }
+   if( This->received_data ) {
+      rkv_batch_foreach( This->received_data, release_holder, This );
+      rkv_batch_delete( &This->received_data );
+   }
+   if( This->received_spare ) {
+      rkv_batch_delete( &This->received_spare );
+   }
+   if( This->codecs ) {
+      rkv_codecs_delete( &This->codecs );
+   }
+   if( This->ids ) {
+      rkv_intern_delete( &This->ids );
+   }
+   if( This->listeners_epoch ) {
+      rkv_epoch_delete( &This->listeners_epoch );
+   }
+   free( atomic_load( &This->listeners ));
+   if( This->subscription_epoch ) {
+      rkv_epoch_delete( &This->subscription_epoch );
+   }
+   free_subscription( atomic_load( &This->subscription ), NULL );
+   free( This );
+}
+
+bool rkv_new( rkv * cache, const char * group, unsigned short port, const rkv_codec * const codecs[], size_t codec_count ) {
+   return rkv_new_with_options( cache, group, port, codecs, codec_count, &rkv_options_Default );
+}
+
+bool rkv_new_with_options(
+   rkv *                   cache,
+   const char *            group,
+   unsigned short          port,
+   const rkv_codec * const codecs[],
+   size_t                  codec_count,
+   const rkv_options *     options )
+{
+#ifdef _WIN32
+   WSADATA wsaData;
+   if( WSAStartup( 0x0101, &wsaData )) {
+      perror( "WSAStartup" );
+      return false;
+   }
+#endif
+   if(( cache == NULL )||( group == NULL )||( options == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   *cache = NULL;
+   if(( options->recv_batch_size == 0 )||( options->recv_batch_size > RECV_BATCH_MAX )) {
+      fprintf( stderr, "%s: receive batch size out of range [1..%d]: %ld\n", __func__, RECV_BATCH_MAX, options->recv_batch_size );
+      return false;
+   }
+   if( options->pool_slab_objects == 0 ) {
+      fprintf( stderr, "%s: pool slab objects must be positive\n", __func__ );
+      return false;
+   }
+   if( options->decode_workers &&( options->decode_queue_depth == 0 )) {
+      fprintf( stderr, "%s: decode queue depth must be positive\n", __func__ );
+      return false;
+   }
+   if(( options->mtu < RKV_MTU_MIN )||( options->mtu > PAYLOAD_MAX + RKV_IP_UDP_OVERHEAD )) {
+      fprintf( stderr, "%s: MTU out of range [%d..%d]: %ld\n", __func__, RKV_MTU_MIN, PAYLOAD_MAX + RKV_IP_UDP_OVERHEAD, options->mtu );
+      return false;
+   }
+   if( options->recv_buffer_bytes > INT_MAX ) {
+      fprintf( stderr, "%s: receive buffer out of range [0..%d]: %ld\n", __func__, INT_MAX, options->recv_buffer_bytes );
+      return false;
+   }
+   rkv_private * This = malloc( sizeof( rkv_private ));
+   if( This == NULL ) {
+      return false;
+   }
+   memset( This, 0, sizeof( rkv_private ));
+   This->sckt                 = -1;
+   This->bootstrap_listener   = -1;
+   This->bootstrap_connection = -1;
+   This->is_alive             = false;
+   This->options              = *options;
+   if( strlen( group ) < MCAST_MIN ) {
+      fprintf( stderr, "%s: multicast IP v4 address too short: %s, expected 239.0.0.[0..255]\n", __func__, group );
+      free( This );
+      return false;
+   }
+   if( strlen( group ) > MCAST_MAX ) {
+      fprintf( stderr, "%s: multicast IP v4 address too long: %s, expected 239.0.0.[0..255]\n", __func__, group );
+      free( This );
+      return false;
+   }
+   memset( &This->recv_addr, 0, sizeof( This->recv_addr ));
+   This->recv_addr.sin_family      = AF_INET;
+   This->recv_addr.sin_port        = htons( port );
+   This->recv_addr.sin_addr.s_addr = htonl( INADDR_ANY );
+   memset( &This->send_addr, 0, sizeof( This->send_addr ));
+   This->send_addr.sin_family      = AF_INET;
+   This->send_addr.sin_port        = htons( port );
+   This->send_addr.sin_addr.s_addr = inet_addr( group );
+   memset( &This->imr, 0, sizeof( This->imr ));
+   This->imr.imr_multiaddr.s_addr = inet_addr( group );
+   This->imr.imr_interface.s_addr = htonl( INADDR_ANY );
+   This->sckt = socket( PF_INET, SOCK_DGRAM, 0 );
+   if( This->sckt < 0 ) {
+      perror( "socket( PF_INET, SOCK_DGRAM )" );
+      free( This );
+      return false;
+   }
+   unsigned yes = 1;
+   if( setsockopt( This->sckt, SOL_SOCKET, SO_REUSEADDR, (char*) &yes, sizeof( yes )) < 0 ) {
+      perror( "setsockopt( SOL_SOCKET, SO_REUSEADDR )" );
+      release_resources( This );
+      return false;
+   }
+   // une rafale de fragments déborde vite la file par défaut, rmem_default, si le thread de
+   // réception est en retard : un seul fragment perdu coûte toute la transaction
+   const int recv_buffer = (int)options->recv_buffer_bytes;
+   if( recv_buffer && setsockopt( This->sckt, SOL_SOCKET, SO_RCVBUF, &recv_buffer, sizeof( recv_buffer )) < 0 ) {
+      perror( "setsockopt( SOL_SOCKET, SO_RCVBUF )" );
+      release_resources( This );
+      return false;
+   }
+   if( bind( This->sckt, (struct sockaddr*) &This->recv_addr, sizeof( This->recv_addr )) < 0 ) {
+      perror( "bind" );
+      release_resources( This );
+      return false;
+   }
+   if( options->subscribe ) {
+      if( setsockopt( This->sckt, IPPROTO_IP, IP_ADD_MEMBERSHIP, &This->imr, sizeof( This->imr )) < 0 ) {
+         perror( "setsockopt( IP_ADD_MEMBERSHIP )" );
+         release_resources( This );
+         return false;
+      }
+   }
+#ifdef IP_MULTICAST_ALL
+   // sans abonnement, rien du trafic des groupes rejoints par d'autres sockets de l'hôte
+   else {
+      const int all = 0;
+      if( setsockopt( This->sckt, IPPROTO_IP, IP_MULTICAST_ALL, &all, sizeof( all )) < 0 ) {
+         perror( "setsockopt( IP_MULTICAST_ALL )" );
+         release_resources( This );
+         return false;
+      }
+   }
+#endif
+   const unsigned long  nack_interval_ms = ( options->reassembly_timeout_ms >= 4 ) ? options->reassembly_timeout_ms / 4 : 1;
+   const unsigned long  wakeup_ms        = ( options->heartbeat_ms &&( options->heartbeat_ms < nack_interval_ms ))
+      ? options->heartbeat_ms
+      : nack_interval_ms;
+   const struct timeval recv_timeout     = {
+      .tv_sec  = (time_t)( wakeup_ms / 1000 ),
+      .tv_usec = (suseconds_t)(( wakeup_ms % 1000 ) * 1000 )
+   };
+   This->tail_interval_ms = nack_interval_ms;
+   if( setsockopt( This->sckt, SOL_SOCKET, SO_RCVTIMEO, &recv_timeout, sizeof( recv_timeout )) < 0 ) {
+      perror( "setsockopt( SO_RCVTIMEO )" );
+      release_resources( This );
+      return false;
+   }
+   const pid_t    pid    = getpid();
+   const long int hostid = gethostid();
+   char           ipv4[INET_ADDRSTRLEN];
+   if( ! get_multicast_interface_address( ipv4 )) {
+
+   }
+   snprintf( This->localID, sizeof( This->localID ), "%d/%ld@%s:%d", pid, hostid, ipv4, This->recv_addr.sin_port );
+   This->publisher.host     = (int32_t)hostid;
+   This->publisher.process  = pid;
+   This->publisher.instance = atomic_fetch_add( &publisher_instance_allocator, 1 );
+   if(   ! new_recv_ring( This )
+      || ! rkv_reassembly_new( &This->reassembly, options->reassembly_bytes_max, options->reassembly_timeout_ms )
+      || ! net_buff_new( &This->txn_buff, PAYLOAD_MAX )
+      || ! new_replay( This )
+      || ! rkv_sequencer_new( &This->sequencer, options->reassembly_bytes_max, options->reassembly_timeout_ms, send_nack, This )
+      || ! net_buff_new( &This->control_buff, RKV_CONTROL_SIZE_MAX )
+      ||(   options->bootstrap_server
+         && ! rkv_bootstrap_listen( &This->bootstrap_listener, &This->bootstrap_port ))
+      || ! rkv_intern_new( &This->ids, options->pool_slab_objects )
+      || ! rkv_batch_new( &This->batch )
+      || ! rkv_batch_new( &This->received_data )
+      || ! rkv_batch_new( &This->received_spare )
+      || ! rkv_changes_new( &This->changes )
+      || ! rkv_tombstones_new( &This->tombstones )
+      || ! rkv_timers_new( &This->key_timers, TIMERS_TICK_MS, monotonic_ms())
+      || ! rkv_timers_new( &This->publisher_timers, TIMERS_TICK_MS, monotonic_ms())
+      || ! rkv_codecs_new( &This->codecs, codecs, codec_count, options->pool_slab_objects, options->payload_recycle_max )
+      || ! rkv_codecs_get_map( This->codecs, &This->codec_map )
+      ||(   options->publish_changes_only
+         && ! rkv_fingerprints_new( &This->fingerprints ))
+      ||(   options->journal_directory
+         && ! rkv_journal_new( &This->journal, options->journal_directory, options->journal_segment_bytes,
+               options->journal_retain_bytes, options->journal_commit_bytes, options->journal_commit_ms ))
+      ||(   options->decode_workers
+         && ! new_jobs( This ))
+      ||(( options->auto_publish_ms || options->auto_publish_entries )
+         &&(  ! rkv_conflation_new( &This->conflating )
+            || ! rkv_conflation_new( &This->flushing )
+            || ! net_buff_new( &This->auto_buff, PAYLOAD_MAX ))))
+   {
+      release_resources( This );
+      return false;
+   }
+   if( ! rkv_store_new( &This->read_only_data, 0 )) {
+      release_resources( This );
+      return false;
+   }
+   if( ! utils_map_new( &This->transactions, string_compare, false, false )
+      || ! rkv_epoch_new( &This->listeners_epoch )
+      || ! rkv_epoch_new( &This->subscription_epoch ))
+   {
+      release_resources( This );
+      return false;
+   }
+   pthread_mutex_init( &This->refresh_lock, NULL );
+   pthread_mutex_init( &This->received_data_lock, NULL );
+   pthread_mutex_init( &This->listeners_lock, NULL );
+   pthread_mutex_init( &This->replay_lock, NULL );
+   pthread_mutex_init( &This->bootstrap_lock, NULL );
+   pthread_cond_init( &This->bootstrap_offered, NULL );
+   pthread_cond_init( &This->committed, NULL );
+   pthread_mutex_init( &This->notify_lock, NULL );
+   pthread_mutex_init( &This->subscription_lock, NULL );
+   pthread_mutex_init( &This->transactions_lock, NULL );
+   pthread_mutex_init( &This->publish_lock, NULL );
+   pthread_cond_init( &This->notify_wakeup, NULL );
+   // l'échéance de auto_publish_ms ne doit pas bouger avec l'heure du système
+   pthread_condattr_t monotonic;
+   pthread_condattr_init( &monotonic );
+   pthread_condattr_setclock( &monotonic, CLOCK_MONOTONIC );
+   pthread_mutex_init( &This->conflation_lock, NULL );
+   pthread_cond_init( &This->conflation_ready, &monotonic );
+   pthread_condattr_destroy( &monotonic );
+   pthread_mutex_init( &This->compaction_lock, NULL );
+   pthread_cond_init( &This->compaction_wakeup, NULL );
+   pthread_mutex_init( &This->timers_lock, NULL );
+   pthread_cond_init( &This->timers_wakeup, NULL );
+   // vrai avant le démarrage du thread, sinon un rkv_delete() immédiat pourrait être ignoré
+   This->is_alive = true;
+   const bool dispatcher = start_dispatcher( This );
+   const bool workers    = dispatcher && start_workers( This );
+   if( ! workers || pthread_create( &This->thread, NULL, multicast_receive_thread, This )) {
+      if( workers ) {
+         perror( "pthread_create" );
+         stop_workers( This, This->worker_count );
+      }
+      stop_dispatcher( This );
+      pthread_cond_destroy( &This->committed );
+      pthread_mutex_destroy( &This->notify_lock );
+      pthread_mutex_destroy( &This->subscription_lock );
+      pthread_mutex_destroy( &This->transactions_lock );
+      pthread_mutex_destroy( &This->publish_lock );
+      pthread_cond_destroy( &This->notify_wakeup );
+      pthread_mutex_destroy( &This->conflation_lock );
+      pthread_cond_destroy( &This->conflation_ready );
+      pthread_mutex_destroy( &This->compaction_lock );
+      pthread_cond_destroy( &This->compaction_wakeup );
+      pthread_mutex_destroy( &This->timers_lock );
+      pthread_cond_destroy( &This->timers_wakeup );
+      pthread_mutex_destroy( &This->refresh_lock );
+      pthread_mutex_destroy( &This->received_data_lock );
+      pthread_mutex_destroy( &This->listeners_lock );
+      pthread_mutex_destroy( &This->replay_lock );
+      pthread_mutex_destroy( &This->bootstrap_lock );
+      pthread_cond_destroy( &This->bootstrap_offered );
+      release_resources( This );
+      return false;
+   }
+   *cache = (rkv)This;
+   if( options->bootstrap_server ) {
+      if( pthread_create( &This->bootstrap_thread, NULL, bootstrap_server_thread, This )) {
+         perror( "pthread_create" );
+         rkv_delete( cache );
+         return false;
+      }
+      This->bootstrap_serving = true;
+   }
+   if( This->conflating && ! start_auto_publisher( This )) {
+      rkv_delete( cache );
+      return false;
+   }
+   if( options->compaction_ms && ! start_compactor( This )) {
+      rkv_delete( cache );
+      return false;
+   }
+   if( options->publisher_timeout_ms && ! start_expirer( This )) {
+      rkv_delete( cache );
+      return false;
+   }
+   if( options->bootstrap_timeout_ms > 0 ) {
+      bootstrap( This ); // sans pair pour répondre, le cache démarre vide
+   }
+   return true;
+}
+
+static void delete_shards( rkv_private * This ) {
+   for( size_t i = 0; i < This->shard_count; ++i ) {
+      if( This->shards[i] ) {
+         rkv_delete( &This->shards[i] );
+      }
+   }
+   if( This->transactions ) {
+      utils_map_foreach( This->transactions, delete_transaction, NULL );
+      utils_map_delete( &This->transactions );
+   }
+   pthread_mutex_destroy( &This->transactions_lock );
+   free( This->shards );
+   free( This );
+}
+
+/**
+ * Le cache i rejoint groups[i] sur le port port + i : chaque groupe a son propre flux, même
+ * quand deux groupes ont la même adresse.
+ */
+DLL_PUBLIC bool rkv_new_sharded(
+   rkv *                   cache,
+   const char * const      groups[],
+   unsigned short          port,
+   size_t                  shard_count,
+   const bool              subscribed[],
+   const rkv_codec * const codecs[],
+   size_t                  codec_count,
+   const rkv_options *     options )
+{
+   if(( cache == NULL )||( groups == NULL )||( options == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   *cache = NULL;
+   if(( shard_count == 0 )||( port + shard_count - 1 > USHRT_MAX )) {
+      fprintf( stderr, "%s: shard count out of range [1..%d]: %ld\n", __func__, USHRT_MAX - port + 1, shard_count );
+      return false;
+   }
+   if( options->journal_directory ) {
+      fprintf( stderr, "%s: the journal of a sharded cache is not supported\n", __func__ );
+      return false;
+   }
+   rkv_private * This = calloc( 1, sizeof( rkv_private ));
+   if( This == NULL ) {
+      perror( "calloc" );
+      return false;
+   }
+   This->sckt               = -1;
+   This->bootstrap_listener = -1;
+   This->options            = *options;
+   This->shard_count        = shard_count;
+   This->shards             = calloc( shard_count, sizeof( rkv ));
+   pthread_mutex_init( &This->transactions_lock, NULL );
+   if( This->shards == NULL ) {
+      perror( "calloc" );
+      pthread_mutex_destroy( &This->transactions_lock );
+      free( This );
+      return false;
+   }
+   if( ! utils_map_new( &This->transactions, string_compare, false, false )) {
+      delete_shards( This );
+      return false;
+   }
+   rkv_options shard_options = *options;
+   for( size_t i = 0; i < shard_count; ++i ) {
+      shard_options.subscribe = options->subscribe &&(( subscribed == NULL )|| subscribed[i] );
+      if( ! rkv_new_with_options( &This->shards[i], groups[i], (unsigned short)( port + i ), codecs, codec_count, &shard_options )) {
+         delete_shards( This );
+         return false;
+      }
+      ((rkv_private *)This->shards[i])->parent = (rkv)This;
+   }
+   *cache = (rkv)This;
+   return true;
+}
+
+static rkv shard_of( const rkv_private * This, const rkv_key * key ) {
+   return This->shards[rkv_key_hash( key ) % This->shard_count];
+}
+
+DLL_PUBLIC bool rkv_get_shard_count( rkv cache, size_t * count ) {
+   if(( cache == NULL )||( count == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   const rkv_private * This = (const rkv_private *)cache;
+   *count = This->shards ? This->shard_count : 1;
+   return true;
+}
+
+DLL_PUBLIC bool rkv_get_shard_of( rkv cache, const rkv_key * key, size_t * index ) {
+   if(( cache == NULL )||( key == NULL )||( index == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   const rkv_private * This = (const rkv_private *)cache;
+   *index = This->shards ? rkv_key_hash( key ) % This->shard_count : 0;
+   return true;
+}
+
+DLL_PUBLIC bool rkv_get_shard( rkv cache, size_t index, rkv * shard ) {
+   if(( cache == NULL )||( shard == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   const rkv_private * This  = (const rkv_private *)cache;
+   const size_t        count = This->shards ? This->shard_count : 1;
+   if( index >= count ) {
+      fprintf( stderr, "%s: shard index out of range [0..%ld]: %ld\n", __func__, count - 1, index );
+      return false;
+   }
+   *shard = This->shards ? This->shards[index] : cache;
+   return true;
+}
+
+/**
+ * Un traitement sur l'état complet d'un cache réparti porte sur un de ses caches seulement.
+ */
+static bool not_sharded( const rkv_private * This, const char * function ) {
+   if( This->shards ) {
+      fprintf( stderr, "%s: not supported by a sharded cache, see rkv_get_shard()\n", function );
+      return false;
+   }
+   return true;
+}
+
+static void free_listener_set( void * garbage, void * user_context ) {
+   free( garbage );
+   (void)user_context;
+}
+
+/**
+ * Publie une copie de l'ensemble courant, privée de l'entrée removed si elle est valide, ou
+ * augmentée de added sinon. L'ancien ensemble est libéré quand plus aucun dispatch ne le lit.
+ */
+static bool update_listeners( rkv_private * This, const rkv_listener * added, size_t removed ) {
+   listener_set *       current = atomic_load( &This->listeners );
+   const size_t         count   = current ? current->count : 0;
+   const size_t         next    = added ? count + 1 : count - 1;
+   listener_set *       set     = malloc( sizeof( listener_set ) + next * sizeof( rkv_listener ));
+   if( set == NULL ) {
+      perror( "malloc" );
+      return false;
+   }
+   set->count = 0;
+   for( size_t i = 0; i < count; ++i ) {
+      if( added ||( i != removed )) {
+         set->listeners[set->count++] = current->listeners[i];
+      }
+   }
+   if( added ) {
+      set->listeners[set->count++] = *added;
+   }
+   atomic_store( &This->listeners, set );
+   return ( current == NULL )
+      ||   rkv_epoch_retire( This->listeners_epoch, current, free_listener_set, NULL );
+}
+
+static bool add_listener( rkv_private * This, const rkv_listener * listener ) {
+   if( This->shards ) {
+      bool ok = true;
+      for( size_t i = 0; i < This->shard_count; ++i ) {
+         ok = add_listener( (rkv_private *)This->shards[i], listener )&& ok;
+      }
+      return ok;
+   }
+   pthread_mutex_lock( &This->listeners_lock );
+   const bool ok = update_listeners( This, listener, 0 );
+   pthread_mutex_unlock( &This->listeners_lock );
+   return ok;
+}
+
+/**
+ * Retire la dernière inscription identique à listener, puis attend que les appels commencés
+ * avec l'ancien ensemble soient terminés, sauf depuis un listener.
+ */
+static bool remove_listener( rkv_private * This, const rkv_listener * listener, const char * function ) {
+   if( This->shards ) {
+      bool ok = true;
+      for( size_t i = 0; i < This->shard_count; ++i ) {
+         ok = remove_listener( (rkv_private *)This->shards[i], listener, function )&& ok;
+      }
+      return ok;
+   }
+   pthread_mutex_lock( &This->listeners_lock );
+   const listener_set * current = atomic_load( &This->listeners );
+   size_t               index   = current ? current->count : 0;
+   while(( index > 0 )
+      &&(( current->listeners[index-1].callback     != listener->callback )
+      ||(  current->listeners[index-1].on_changes   != listener->on_changes )
+      ||(  current->listeners[index-1].user_context != listener->user_context )))
+   {
+      --index;
+   }
+   const bool ok = ( index > 0 )&& update_listeners( This, NULL, index - 1 );
+   pthread_mutex_unlock( &This->listeners_lock );
+   if( index == 0 ) {
+      fprintf( stderr, "%s: listener not found\n", function );
+   }
+   return ok &&(( listener_calls > 0 )|| rkv_epoch_synchronize( This->listeners_epoch ));
+}
+
+bool rkv_add_listener( rkv cache, rkv_change_callback callback, void * user_context ) {
+   if(( cache == NULL )||( callback == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   const rkv_listener listener = { .callback = callback, .on_changes = NULL, .user_context = user_context };
+   return add_listener( (rkv_private *)cache, &listener );
+}
+
+DLL_PUBLIC bool rkv_remove_listener( rkv cache, rkv_change_callback callback, void * user_context ) {
+   if(( cache == NULL )||( callback == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   const rkv_listener listener = { .callback = callback, .on_changes = NULL, .user_context = user_context };
+   return remove_listener( (rkv_private *)cache, &listener, __func__ );
+}
+
+DLL_PUBLIC bool rkv_add_changes_listener( rkv cache, rkv_changes_callback callback, void * user_context ) {
+   if(( cache == NULL )||( callback == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   const rkv_listener listener = { .callback = NULL, .on_changes = callback, .user_context = user_context };
+   return add_listener( (rkv_private *)cache, &listener );
+}
+
+DLL_PUBLIC bool rkv_remove_changes_listener( rkv cache, rkv_changes_callback callback, void * user_context ) {
+   if(( cache == NULL )||( callback == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   const rkv_listener listener = { .callback = NULL, .on_changes = callback, .user_context = user_context };
+   return remove_listener( (rkv_private *)cache, &listener, __func__ );
+}
+
+DLL_PUBLIC bool rkv_dispatch( rkv cache, bool * notified ) {
+   if(( cache == NULL )||( notified == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_private * This = (rkv_private *)cache;
+   *notified = false;
+   if( This->shards ) {
+      for( size_t i = 0; i < This->shard_count; ++i ) {
+         bool shard = false;
+         if( ! rkv_dispatch( This->shards[i], &shard )) {
+            return false;
+         }
+         *notified = *notified || shard;
+      }
+      return true;
+   }
+   if( This->options.listener_thread ) {
+      fprintf( stderr, "%s: the listeners are called by a dedicated thread, see rkv_options.listener_thread\n", __func__ );
+      return false;
+   }
+   if( atomic_exchange( &This->notify_pending, false )) {
+      call_listeners( This );
+      *notified = true;
+   }
+   return true;
+}
+
+/**
+ * Publie un nouveau filtre, trié, à la place du courant, qui est libéré quand plus aucun
+ * décodage ne le lit. Un filtre vide est remplacé par NULL : tout est reçu.
+ */
+static bool publish_subscription( rkv_private * This, const unsigned types[], size_t type_count, const rkv_key origins[],
+   size_t origin_count )
+{
+   subscription * filter = NULL;
+   if( type_count || origin_count ) {
+      filter = calloc( 1, sizeof( subscription ));
+      if(( filter == NULL )
+         ||( type_count   &&(( filter->types   = malloc( type_count   * sizeof( unsigned ))) == NULL ))
+         ||( origin_count &&(( filter->origins = malloc( origin_count * sizeof( rkv_key  ))) == NULL )))
+      {
+         perror( "malloc" );
+         free_subscription( filter, NULL );
+         return false;
+      }
+      filter->type_count   = type_count;
+      filter->origin_count = origin_count;
+      for( size_t i = 0; i < type_count; ++i ) {
+         filter->types[i] = types[i];
+      }
+      for( size_t i = 0; i < origin_count; ++i ) {
+         filter->origins[i] = (rkv_key){ .host = origins[i].host, .process = origins[i].process };
+      }
+      qsort( filter->types  , type_count  , sizeof( unsigned ), type_compare );
+      qsort( filter->origins, origin_count, sizeof( rkv_key  ), origin_compare );
+   }
+   void * previous = atomic_exchange( &This->subscription, filter );
+   return ( previous == NULL )
+      ||   rkv_epoch_retire( This->subscription_epoch, previous, free_subscription, NULL );
+}
+
+DLL_PUBLIC bool rkv_subscribe_types( rkv cache, const unsigned types[], size_t count ) {
+   if(( cache == NULL )||(( types == NULL )&& count )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_private * This = (rkv_private *)cache;
+   if( This->shards ) {
+      bool ok = true;
+      for( size_t i = 0; i < This->shard_count; ++i ) {
+         ok = rkv_subscribe_types( This->shards[i], types, count )&& ok;
+      }
+      return ok;
+   }
+   pthread_mutex_lock( &This->subscription_lock );
+   const subscription * current = atomic_load( &This->subscription );
+   const bool           ok      = publish_subscription( This, types, count,
+      current ? current->origins : NULL, current ? current->origin_count : 0 );
+   pthread_mutex_unlock( &This->subscription_lock );
+   return ok;
+}
+
+DLL_PUBLIC bool rkv_subscribe_origins( rkv cache, const rkv_key origins[], size_t count ) {
+   if(( cache == NULL )||(( origins == NULL )&& count )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_private * This = (rkv_private *)cache;
+   if( This->shards ) {
+      bool ok = true;
+      for( size_t i = 0; i < This->shard_count; ++i ) {
+         ok = rkv_subscribe_origins( This->shards[i], origins, count )&& ok;
+      }
+      return ok;
+   }
+   pthread_mutex_lock( &This->subscription_lock );
+   const subscription * current = atomic_load( &This->subscription );
+   const bool           ok      = publish_subscription( This,
+      current ? current->types : NULL, current ? current->type_count : 0, origins, count );
+   pthread_mutex_unlock( &This->subscription_lock );
+   return ok;
+}
+
+static const type_ttl * find_ttl( const rkv_private * This, unsigned type ) {
+   size_t lo = 0;
+   size_t hi = This->ttl_count;
+   while( lo < hi ) {
+      const size_t mid = lo + ( hi - lo ) / 2;
+      if( This->ttls[mid].type < type ) {
+         lo = mid + 1;
+      }
+      else {
+         hi = mid;
+      }
+   }
+   return (( lo < This->ttl_count )&&( This->ttls[lo].type == type )) ? This->ttls + lo : NULL;
+}
+
+static unsigned ttl_of( const rkv_private * This, unsigned type ) {
+   const type_ttl * ttl = find_ttl( This, type );
+   return ttl ? ttl->ttl_ms : 0;
+}
+
+/**
+ * ttls reste trié par type pour find_ttl(), sous refresh_lock comme les fusions qui le lisent.
+ */
+DLL_PUBLIC bool rkv_set_type_ttl( rkv cache, unsigned type, unsigned ttl_ms ) {
+   if( cache == NULL ) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   if( type >= RKV_RESERVED_TYPES ) {
+      fprintf( stderr, "%s: type %u is reserved\n", __func__, type );
+      return false;
+   }
+   rkv_private * This = (rkv_private *)cache;
+   if( This->shards ) {
+      bool ok = true;
+      for( size_t i = 0; i < This->shard_count; ++i ) {
+         ok = rkv_set_type_ttl( This->shards[i], type, ttl_ms )&& ok;
+      }
+      return ok;
+   }
+   bool ok = true;
+   pthread_mutex_lock( &This->refresh_lock );
+   type_ttl * ttl = CONST_CAST( find_ttl( This, type ), type_ttl );
+   if( ttl && ttl_ms ) {
+      ttl->ttl_ms = ttl_ms;
+   }
+   else if( ttl ) {
+      const size_t at = (size_t)( ttl - This->ttls );
+      memmove( ttl, ttl + 1, ( This->ttl_count - at - 1 ) * sizeof( type_ttl ));
+      This->ttl_count -= 1;
+   }
+   else if( ttl_ms ) {
+      type_ttl * ttls = realloc( This->ttls, ( This->ttl_count + 1 ) * sizeof( type_ttl ));
+      if( ttls == NULL ) {
+         perror( "realloc" );
+         ok = false;
+      }
+      else {
+         size_t at = This->ttl_count;
+         while(( at > 0 )&&( ttls[at - 1].type > type )) {
+            ttls[at] = ttls[at - 1];
+            --at;
+         }
+         ttls[at].type   = type;
+         ttls[at].ttl_ms = ttl_ms;
+         This->ttls      = ttls;
+         This->ttl_count += 1;
+         ok = start_expirer( This );
+      }
+   }
+   pthread_mutex_unlock( &This->refresh_lock );
+   return ok;
+}
+
+#define TXN_CAPACITY_DEFAULT 16
+
+DLL_PUBLIC bool rkv_txn_begin( rkv cache, size_t capacity, rkv_txn * txn ) {
+   if(( cache == NULL )||( txn == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   *txn = NULL;
+   rkv_txn_private * This = calloc( 1, sizeof( rkv_txn_private ));
+   if( This == NULL ) {
+      perror( "calloc" );
+      return false;
+   }
+   This->cache    = (rkv_private *)cache;
+   This->capacity = capacity ? capacity : TXN_CAPACITY_DEFAULT;
+   This->entries  = malloc( This->capacity * sizeof( txn_entry ));
+   if( This->entries == NULL ) {
+      perror( "malloc" );
+      free( This );
+      return false;
+   }
+   *txn = (rkv_txn)This;
+   return true;
+}
+
+/**
+ * Une clé écrite plusieurs fois n'est dédoublonnée qu'à la publication. Un retrait est une
+ * écriture de type RKV_TOMBSTONE_TYPE, sans valeur.
+ */
+static bool txn_add( rkv_txn_private * This, const rkv_key * key, unsigned type, rkv_value data ) {
+   if( This->count == This->capacity ) {
+      txn_entry * entries = realloc( This->entries, 2 * This->capacity * sizeof( txn_entry ));
+      if( entries == NULL ) {
+         perror( "realloc" );
+         return false;
+      }
+      This->entries   = entries;
+      This->capacity *= 2;
+   }
+   const rkv_private * cache = This->cache;
+   txn_entry *         entry = This->entries + This->count;
+   entry->key     = *key;
+   entry->type    = type;
+   entry->shard   = cache->shards ? rkv_key_hash( key ) % cache->shard_count : 0;
+   entry->order   = This->count;
+   entry->payload = data;
+   This->count += 1;
+   return true;
+}
+
+DLL_PUBLIC bool rkv_txn_put( rkv_txn txn, const rkv_key * key, unsigned type, rkv_value data ) {
+   if(( txn == NULL )||( key == NULL )||( data == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   if( type >= RKV_RESERVED_TYPES ) {
+      fprintf( stderr, "%s: type %u is reserved\n", __func__, type );
+      return false;
+   }
+   return txn_add((rkv_txn_private *)txn, key, type, data );
+}
+
+DLL_PUBLIC bool rkv_txn_remove( rkv_txn txn, const rkv_key * key ) {
+   if(( txn == NULL )||( key == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   return txn_add((rkv_txn_private *)txn, key, RKV_TOMBSTONE_TYPE, NULL );
+}
+
+DLL_PUBLIC bool rkv_txn_abort( rkv_txn txn ) {
+   if( txn == NULL ) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   ((rkv_txn_private *)txn)->count = 0;
+   return true;
+}
+
+DLL_PUBLIC bool rkv_txn_delete( rkv_txn * txn ) {
+   if(( txn == NULL )||( *txn == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_txn_private * This = (rkv_txn_private *)*txn;
+   free( This->entries );
+   free( This );
+   *txn = NULL;
+   return true;
+}
+
+/**
+ * Les transactions nommées sont créées à leur première écriture et détruites par leur
+ * publication : c'est l'interface historique, les threads qui l'utilisent sont sérialisés.
+ * Sans valeur, la clé est retirée.
+ */
+static bool named_add( rkv cache, const char * name, const rkv_key * key, unsigned type, const void * data ) {
+   rkv_private * This = (rkv_private *)cache;
+   rkv_txn       txn  = NULL;
+   bool          ok   = true;
+   pthread_mutex_lock( &This->transactions_lock );
+   if( ! utils_map_get( This->transactions, name, (map_value *)&txn )) {
+      ok = rkv_txn_begin( cache, 0, &txn );
+      if( ok && ! utils_map_put( This->transactions, name, txn )) {
+         rkv_txn_delete( &txn );
+         ok = false;
+      }
+   }
+   ok = ok &&(( data == NULL ) ? rkv_txn_remove( txn, key ) : rkv_txn_put( txn, key, type, data ));
+   pthread_mutex_unlock( &This->transactions_lock );
+   return ok;
+}
+
+DLL_PUBLIC bool rkv_put_key( rkv cache, const char * name, const rkv_key * key, unsigned type, const void * data ) {
+   if(( cache == NULL )||( name == NULL )||( key == NULL )||( data == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   return named_add( cache, name, key, type, data );
+}
+
+DLL_PUBLIC bool rkv_put( rkv cache, const char * name, const rkv_id id, unsigned type, const void * data ) {
+   if( id == NULL ) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   return rkv_put_key( cache, name, (const rkv_key *)id, type, data );
+}
+
+DLL_PUBLIC bool rkv_remove_key( rkv cache, const char * name, const rkv_key * key ) {
+   if(( cache == NULL )||( name == NULL )||( key == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   return named_add( cache, name, key, 0, NULL );
+}
+
+DLL_PUBLIC bool rkv_remove( rkv cache, const char * name, const rkv_id id ) {
+   if( id == NULL ) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   return rkv_remove_key( cache, name, (const rkv_key *)id );
+}
+
+typedef struct {
+   rkv_private *       This;
+   bool                failed;
+   bool                verbose;
+   rkv_publish_stats * stats;
+} encode_context;
+
+static bool pending_add( rkv_private * This, const rkv_key * key, uint64_t fingerprint, bool removed ) {
+   if( This->pending_count == This->pending_capacity ) {
+      const size_t       capacity = This->pending_capacity ? 2 * This->pending_capacity : 64;
+      sent_fingerprint * pending  = realloc( This->pending, capacity * sizeof( sent_fingerprint ));
+      if( pending == NULL ) {
+         perror( "realloc" );
+         return false;
+      }
+      This->pending          = pending;
+      This->pending_capacity = capacity;
+   }
+   This->pending[This->pending_count].key         = *key;
+   This->pending[This->pending_count].fingerprint = fingerprint;
+   This->pending[This->pending_count].removed     = removed;
+   This->pending_count += 1;
+   return true;
+}
+
+/**
+ * L'entrée qui vient d'être encodée à partir de start est retirée du tampon si son empreinte
+ * est celle de la dernière valeur émise, sauf lors d'une publication complète.
+ */
+static bool suppress_unchanged( encode_context * ctxt, const rkv_data_holder * data, size_t start ) {
+   rkv_private *   This  = ctxt->This;
+   const rkv_key * key   = (const rkv_key *)data->id;
+   size_t          end   = 0;
+   byte *          bytes = NULL;
+   if(   ! net_buff_get_position( This->txn_buff, &end )
+      || ! net_buff_get_bytes( This->txn_buff, &bytes ))
+   {
+      return false;
+   }
+   const uint64_t fingerprint = rkv_fingerprints_hash( bytes + start, end - start );
+   uint64_t       last        = 0;
+   if(  ( ! ctxt->stats->full )
+      && rkv_fingerprints_get( This->fingerprints, key, &last )
+      &&( last == fingerprint ))
+   {
+      ctxt->stats->suppressed += 1;
+      return net_buff_set_position( This->txn_buff, start );
+   }
+   ctxt->stats->sent += 1;
+   return pending_add( This, key, fingerprint, false );
+}
+
+/**
+ * Encode une entrée, comme dans une transaction : identifiant, type, taille puis valeur. La
+ * taille, inconnue avant l'encodage de la valeur, est écrite ensuite à sa place.
+ * Un tampon trop petit n'est signalé que si verbose.
+ */
+static bool encode_holder( rkv_private * This, net_buff buffer, const rkv_data_holder * data, const rkv_codec_entry * codec,
+   bool verbose )
+{
+   size_t start = 0;
+   size_t end   = 0;
+   if(   ! rkv_id_encode( data->id, buffer )
+      || ! net_buff_encode_uint32( buffer, data->type )
+      || ! net_buff_get_position( buffer, &start )
+      || ! net_buff_encode_uint32( buffer, 0 ))
+   {
+      if( verbose ) {
+         char ids[ID_AS_STRING_LENGTH_MAX+1];
+         rkv_id_to_string( data->id, ids, sizeof( ids ));
+         fprintf( stderr, "%s: unable to encode header of %s of type %d (rkv_id_encode failed)\n", __func__, ids, data->type );
+      }
+      return false;
+   }
+   const bool encoded = ( codec->plain
+      ? rkv_plain_encode( buffer, data->payload, &codec->codec )
+      : codec->codec.encoder( buffer, data->payload, This->codec_map ))
+      && net_buff_get_position ( buffer, &end )
+      && net_buff_set_position ( buffer, start )
+      && net_buff_encode_uint32( buffer, (uint32_t)( end - start - 4 ))
+      && net_buff_set_position ( buffer, end );
+   if(( ! encoded )&& verbose ) {
+      char ids[ID_AS_STRING_LENGTH_MAX+1];
+      rkv_id_to_string( data->id, ids, sizeof( ids ));
+      fprintf( stderr, "%s: unable to encode data %s of type %d (encoder failed)\n", __func__, ids, data->type );
+   }
+   return encoded;
+}
+
+/**
+ * Les valeurs d'un instantané pas encore décodées sont recopiées telles quelles.
+ */
+static bool encode_stored( rkv_private * This, net_buff buffer, const rkv_data_holder * holder, const rkv_codec_entry * codec,
+   bool verbose )
+{
+   if( holder->lazy ) {
+      const lazy_value * value = (const lazy_value *)holder->payload;
+      return net_buff_encode_bytes( buffer, value->entry, value->size );
+   }
+   return encode_holder( This, buffer, holder, codec, verbose );
+}
+
+/**
+ * Une pierre tombale n'a que l'identifiant et le type, sa taille est nulle. Elle est toujours
+ * émise et la clé quitte les empreintes : une nouvelle valeur sera émise quelle qu'elle soit.
+ */
+static bool encode_tombstone( encode_context * ctxt, const txn_entry * entry ) {
+   rkv_private * This = ctxt->This;
+   if(   ! rkv_key_encode( &entry->key, This->txn_buff )
+      || ! net_buff_encode_uint32( This->txn_buff, RKV_TOMBSTONE_TYPE )
+      || ! net_buff_encode_uint32( This->txn_buff, 0 ))
+   {
+      ctxt->failed = true;
+      return false;
+   }
+   ctxt->stats->sent += 1;
+   if(( This->fingerprints != NULL )&& ! pending_add( This, &entry->key, 0, true )) {
+      ctxt->failed  = true;
+      ctxt->verbose = true;
+      return false;
+   }
+   return true;
+}
+
+static bool encode_entry( encode_context * ctxt, const txn_entry * entry ) {
+   if( entry->type == RKV_TOMBSTONE_TYPE ) {
+      return encode_tombstone( ctxt, entry );
+   }
+   rkv_private *         This  = ctxt->This;
+   const rkv_data_holder data  = {
+      .id      = (rkv_id)CONST_CAST( &entry->key, void ),
+      .type    = entry->type,
+      .payload = entry->payload,
+      .lazy    = false
+   };
+   rkv_codec_entry *     codec = NULL;
+   size_t                start = 0;
+   if( ! rkv_codecs_get( This->codecs, data.type, &codec )) {
+      char keys[ID_AS_STRING_LENGTH_MAX+1];
+      rkv_key_to_string( &entry->key, keys, sizeof( keys ));
+      fprintf( stderr, "%s: unable to encode data %s of type %d (no codec found)\n", __func__, keys, data.type );
+      ctxt->failed  = true;
+      ctxt->verbose = true; // inutile d'agrandir le tampon
+      return false;
+   }
+   if(   ! net_buff_get_position( This->txn_buff, &start )
+      || ! encode_holder( This, This->txn_buff, &data, codec, ctxt->verbose ))
+   {
+      ctxt->failed = true;
+      return false;
+   }
+   if( This->fingerprints == NULL ) {
+      ctxt->stats->sent += 1;
+      return true;
+   }
+   if( ! suppress_unchanged( ctxt, &data, start )) {
+      ctxt->failed  = true;
+      ctxt->verbose = true;
+      return false;
+   }
+   return true;
+}
+
+/**
+ * La transaction est encodée d'un bloc dans txn_buff, qui double de taille tant que
+ * l'encodage échoue, jusqu'à TRANSACTION_MAX. Elle est ensuite découpée par send_fragments().
+ */
+static bool encode_transaction( rkv_private * This, const txn_entry entries[], size_t count, rkv_publish_stats * stats ) {
+   for(;;) {
+      size_t         capacity = 0;
+      encode_context ctxt     = { .This = This, .failed = false, .verbose = false, .stats = stats };
+      stats->sent         = 0;
+      stats->suppressed   = 0;
+      This->pending_count = 0;
+      if(   ! net_buff_get_capacity( This->txn_buff, &capacity )
+         || ! net_buff_clear( This->txn_buff ))
+      {
+         return false;
+      }
+      ctxt.verbose = ( capacity >= TRANSACTION_MAX );
+      for( size_t i = 0; ( i < count )&& encode_entry( &ctxt, entries + i ); ++i ) {
+      }
+      if( ! ctxt.failed ) {
+         return net_buff_flip( This->txn_buff );
+      }
+      if( ctxt.verbose ) {
+         return false;
+      }
+      net_buff larger = NULL;
+      if( ! net_buff_new( &larger, 2*capacity )) {
+         return false;
+      }
+      net_buff_delete( &This->txn_buff );
+      This->txn_buff = larger;
+   }
+}
+
+static bool send_fragments( rkv_private * This ) {
+   const size_t fragment_max = This->options.mtu - RKV_IP_UDP_OVERHEAD - RKV_FRAGMENT_HEADER_SIZE;
+   size_t size  = 0;
+   byte * bytes = NULL;
+   if(   ! net_buff_get_limit( This->txn_buff, &size  )
+      || ! net_buff_get_bytes( This->txn_buff, &bytes ))
+   {
+      return false;
+   }
+   const size_t count = ( size == 0 ) ? 1 : ( size + fragment_max - 1 ) / fragment_max;
+   if( count > UINT16_MAX ) {
+      fprintf( stderr, "%s: transaction of %ld bytes needs too many fragments: %ld\n", __func__, size, count );
+      return false;
+   }
+   rkv_fragment_header header = {
+      .publisher = This->publisher,
+      .datagram  = 0,
+      .sequence  = ++This->transaction_sequence,
+      .index     = 0,
+      .count     = (uint16_t)count,
+      .size      = (uint32_t)size,
+      .offset    = 0
+   };
+   // chaque fragment est encodé directement dans l'emplacement de l'anneau qu'il remplace
+   pthread_mutex_lock( &This->replay_lock );
+   for( size_t i = 0; i < count; ++i ) {
+      const size_t  offset = i * fragment_max;
+      const size_t  length = ( size - offset < fragment_max ) ? size - offset : fragment_max;
+      replay_slot * slot   = NULL;
+      header.datagram = ++This->datagram_sequence;
+      header.index    = (uint16_t)i;
+      header.offset   = (uint32_t)offset;
+      slot            = This->replay + ( header.datagram % This->replay_size );
+      slot->datagram  = header.datagram;
+      slot->used      = false;
+      if(   ! net_buff_clear( slot->data )
+         || ! rkv_protocol_encode_fragment_header( slot->data, &header )
+         || ! net_buff_encode_bytes( slot->data, bytes + offset, length )
+         || ! net_buff_flip( slot->data )
+         || ! net_buff_send( slot->data, This->sckt, &This->send_addr ))
+      {
+         fprintf( stderr, "%s: unable to send fragment %ld/%ld of transaction %u\n", __func__, i, count, header.sequence );
+         pthread_mutex_unlock( &This->replay_lock );
+         return false;
+      }
+      slot->used = true;
+   }
+   pthread_mutex_unlock( &This->replay_lock );
+   return true;
+}
+
+/**
+ * Les empreintes ne sont retenues qu'une fois la transaction émise : une publication
+ * en échec sera refaite en entier. Une transaction dont rien n'a changé n'est pas émise.
+ */
+static bool send_transaction( rkv_private * This, const rkv_publish_stats * stats ) {
+   if(( This->fingerprints != NULL )&&( stats->sent == 0 )) {
+      return true;
+   }
+   if( ! send_fragments( This )) {
+      return false;
+   }
+   for( size_t i = 0; i < This->pending_count; ++i ) {
+      const sent_fingerprint * sent = This->pending + i;
+      if( sent->removed
+         ? ! rkv_fingerprints_remove( This->fingerprints, &sent->key )
+         : ! rkv_fingerprints_put( This->fingerprints, &sent->key, sent->fingerprint ))
+      {
+         return false;
+      }
+   }
+   return true;
+}
+
+/**
+ * Entrées rangées par cache, puis par clé, puis par ordre d'écriture.
+ */
+static int txn_entry_compare( const void * l, const void * r ) {
+   const txn_entry * left  = (const txn_entry *)l;
+   const txn_entry * right = (const txn_entry *)r;
+   if( left->shard != right->shard ) {
+      return ( left->shard > right->shard ) - ( left->shard < right->shard );
+   }
+   const int cmp = rkv_key_compare( &left->key, &right->key );
+   if( cmp ) {
+      return cmp;
+   }
+   return ( left->order > right->order ) - ( left->order < right->order );
+}
+
+/**
+ * Trie les entrées et ne garde que la dernière écriture de chaque clé.
+ */
+static void txn_sort( rkv_txn_private * This ) {
+   qsort( This->entries, This->count, sizeof( txn_entry ), txn_entry_compare );
+   size_t kept = 0;
+   for( size_t i = 0; i < This->count; ++i ) {
+      if(( i + 1 < This->count )&& rkv_key_equals( &This->entries[i].key, &This->entries[i+1].key )) {
+         continue;
+      }
+      This->entries[kept++] = This->entries[i];
+   }
+   This->count = kept;
+}
+
+/**
+ * Compte une publication, sous publish_lock, et dit si elle doit être complète.
+ */
+static bool publish_full( rkv_private * This ) {
+   This->publish_count += 1;
+   return ( This->fingerprints == NULL )
+      ||(( This->options.full_publish_period > 0 )&&( This->publish_count % This->options.full_publish_period == 0 ));
+}
+
+static bool publish_entries( rkv_private * This, const txn_entry entries[], size_t count, rkv_publish_stats * stats ) {
+   pthread_mutex_lock( &This->publish_lock );
+   stats->full = publish_full( This );
+   const bool ok = encode_transaction( This, entries, count, stats )
+      &&           send_transaction( This, stats );
+   pthread_mutex_unlock( &This->publish_lock );
+   if( ! ok ) {
+      return false;
+   }
+   if( RKV_DBG ) {
+      struct timeval tv;
+      gettimeofday( &tv, NULL );
+      fprintf( stderr, "%6ld.%06ld:DEBUG:rkv_publish:%ld data sent\n", tv.tv_sec, tv.tv_usec, stats->sent );
+   }
+   pthread_mutex_lock( &This->received_data_lock );
+   This->stats.entries_sent       += stats->sent;
+   This->stats.entries_suppressed += stats->suppressed;
+   pthread_mutex_unlock( &This->received_data_lock );
+   return true;
+}
+
+/**
+ * Chaque cache publie la part de la transaction qui lui revient, s'il en a une, comme une
+ * transaction à part entière sur son groupe : un récepteur peut appliquer une part avant les
+ * autres, ou sans elles. Les parts publiées sont retirées de txn, seules les autres le seront
+ * de nouveau.
+ */
+static bool publish_shards( rkv_private * This, rkv_txn_private * txn, rkv_publish_stats * stats ) {
+   bool   ok   = true;
+   size_t kept = 0;
+   stats->full = true;
+   for( size_t first = 0, last = 0; first < txn->count; first = last ) {
+      rkv_publish_stats part;
+      memset( &part, 0, sizeof( part ));
+      while(( last < txn->count )&&( txn->entries[last].shard == txn->entries[first].shard )) {
+         ++last;
+      }
+      if( ! publish_entries( (rkv_private *)This->shards[txn->entries[first].shard], txn->entries + first, last - first, &part )) {
+         memmove( txn->entries + kept, txn->entries + first, ( last - first ) * sizeof( txn_entry ));
+         kept += last - first;
+         ok    = false;
+      }
+      stats->sent       += part.sent;
+      stats->suppressed += part.suppressed;
+      stats->full        = stats->full && part.full;
+   }
+   txn->count = kept;
+   return ok;
+}
+
+/**
+ * Une transaction publiée est vidée et peut resservir. En cas d'échec, elle reste entière pour
+ * être publiée de nouveau, sauf les parts déjà publiées d'un cache réparti.
+ */
+DLL_PUBLIC bool rkv_txn_publish( rkv_txn txn, rkv_publish_stats * stats ) {
+   if( txn == NULL ) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_txn_private * This = (rkv_txn_private *)txn;
+   rkv_publish_stats local;
+   if( stats == NULL ) {
+      stats = &local;
+   }
+   memset( stats, 0, sizeof( rkv_publish_stats ));
+   txn_sort( This );
+   const bool ok = This->cache->shards
+      ? publish_shards( This->cache, This, stats )
+      : publish_entries( This->cache, This->entries, This->count, stats );
+   if( ok ) {
+      This->count = 0;
+   }
+   return ok;
+}
+
+bool rkv_publish_with_stats( rkv cache, const char * name, rkv_publish_stats * stats ) {
+   if(( cache == NULL )||( name == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_private * This = (rkv_private *)cache;
+   rkv_txn       txn  = NULL;
+   pthread_mutex_lock( &This->transactions_lock );
+   bool ok = utils_map_get( This->transactions, name, (map_value *)&txn )
+      &&     rkv_txn_publish( txn, stats );
+   if( ok ) {
+      utils_map_remove( This->transactions, name );
+      rkv_txn_delete( &txn );
+   }
+   pthread_mutex_unlock( &This->transactions_lock );
+   return ok;
+}
+
+bool rkv_publish( rkv cache, const char * name ) {
+   return rkv_publish_with_stats( cache, name, NULL );
+}
+
+/**
+ * La valeur est encodée seule dans auto_buff, qui double tant qu'elle n'y tient pas.
+ */
+static bool encode_conflated( rkv_private * This, const rkv_data_holder * holder, const rkv_codec_entry * codec ) {
+   for(;;) {
+      size_t capacity = 0;
+      if(   ! net_buff_get_capacity( This->auto_buff, &capacity )
+         || ! net_buff_clear( This->auto_buff ))
+      {
+         return false;
+      }
+      if( encode_holder( This, This->auto_buff, holder, codec, capacity >= TRANSACTION_MAX )) {
+         return true;
+      }
+      net_buff larger = NULL;
+      if(( capacity >= TRANSACTION_MAX )|| ! net_buff_new( &larger, 2*capacity )) {
+         return false;
+      }
+      net_buff_delete( &This->auto_buff );
+      This->auto_buff = larger;
+   }
+}
+
+/**
+ * La première entrée en attente date la publication, le seuil auto_publish_entries l'avance.
+ */
+DLL_PUBLIC bool rkv_auto_put( rkv cache, const rkv_key * key, unsigned type, rkv_value data ) {
+   if(( cache == NULL )||( key == NULL )||( data == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_private * This = (rkv_private *)cache;
+   if( This->shards ) {
+      return rkv_auto_put( shard_of( This, key ), key, type, data );
+   }
+   // conflating est échangée par le thread auto_publisher, les options ne changent pas
+   if(( This->options.auto_publish_ms == 0 )&&( This->options.auto_publish_entries == 0 )) {
+      fprintf( stderr, "%s: auto publishing is disabled, see rkv_options.auto_publish_ms\n", __func__ );
+      return false;
+   }
+   rkv_codec_entry * codec = NULL;
+   if( ! rkv_codecs_get( This->codecs, type, &codec )) {
+      char keys[ID_AS_STRING_LENGTH_MAX+1];
+      rkv_key_to_string( key, keys, sizeof( keys ));
+      fprintf( stderr, "%s: unable to encode data %s of type %d (no codec found)\n", __func__, keys, type );
+      return false;
+   }
+   const rkv_data_holder holder   = {
+      .id      = (rkv_id)CONST_CAST( key, void ),
+      .type    = type,
+      .payload = data,
+      .lazy    = false
+   };
+   size_t                size     = 0;
+   byte *                bytes    = NULL;
+   bool                  replaced = false;
+   size_t                count    = 0;
+   pthread_mutex_lock( &This->conflation_lock );
+   const bool ok = encode_conflated( This, &holder, codec )
+      &&           net_buff_get_position( This->auto_buff, &size )
+      &&           net_buff_get_bytes( This->auto_buff, &bytes )
+      &&           rkv_conflation_put( This->conflating, key, bytes, size, &replaced )
+      &&           rkv_conflation_get_count( This->conflating, &count );
+   if( ok && replaced ) {
+      atomic_fetch_add_explicit( &This->entries_conflated, 1, memory_order_relaxed );
+   }
+   else if( ok &&( count == 1 )) {
+      clock_gettime( CLOCK_MONOTONIC, &This->conflating_since );
+      pthread_cond_signal( &This->conflation_ready );
+   }
+   else if( ok &&( count == This->options.auto_publish_entries )) {
+      pthread_cond_signal( &This->conflation_ready );
+   }
+   pthread_mutex_unlock( &This->conflation_lock );
+   return ok;
+}
+
+/**
+ * Seau de jetons : il se remplit de pacing_bytes_per_s par seconde, jusqu'à pacing_burst_bytes.
+ * Un datagramme qui n'y trouve pas assez de jetons fait attendre le suivant qu'il y en ait,
+ * le solde reste négatif jusqu'au suivant, qui tient compte de l'attente. Appelée sous
+ * publish_lock, elle rend l'attente en secondes, voir pace_wait().
+ */
+static double pace( rkv_private * This, size_t size ) {
+   const double    rate = (double)This->options.pacing_bytes_per_s;
+   struct timespec now;
+   clock_gettime( CLOCK_MONOTONIC, &now );
+   This->pacing_tokens += rate * (double)( now.tv_sec - This->pacing_refill.tv_sec )
+      +                   rate * (double)( now.tv_nsec - This->pacing_refill.tv_nsec ) / 1e9;
+   if( This->pacing_tokens > (double)This->options.pacing_burst_bytes ) {
+      This->pacing_tokens = (double)This->options.pacing_burst_bytes;
+   }
+   This->pacing_refill  = now;
+   This->pacing_tokens -= (double)size;
+   if( This->pacing_tokens < 0.0 ) {
+      atomic_fetch_add_explicit( &This->datagrams_paced, 1, memory_order_relaxed );
+      return -This->pacing_tokens / rate;
+   }
+   return 0.0;
+}
+
+typedef struct {
+   encode_context    ctxt;
+   rkv_publish_stats datagram;
+   size_t            payload_max;
+   double            wait_s;      // dû par pace() avant le prochain datagramme
+} flush_context;
+
+/**
+ * L'attente due par pace() se fait hors de publish_lock, entre deux datagrammes : txn_buff est
+ * alors vide et rkv_publish() ou rkv_txn_publish() peuvent s'en servir. Il est vidé de nouveau
+ * une fois le verrou repris.
+ */
+static bool pace_wait( flush_context * flush, bool locked ) {
+   if( flush->wait_s <= 0.0 ) {
+      return true;
+   }
+   rkv_private *         This  = flush->ctxt.This;
+   const struct timespec delay = {
+      .tv_sec  = (time_t)flush->wait_s,
+      .tv_nsec = (long)(( flush->wait_s - (double)(time_t)flush->wait_s ) * 1e9 )
+   };
+   flush->wait_s = 0.0;
+   if( locked ) {
+      pthread_mutex_unlock( &This->publish_lock );
+   }
+   nanosleep( &delay, NULL );
+   if( ! locked ) {
+      return true;
+   }
+   pthread_mutex_lock( &This->publish_lock );
+   This->pending_count = 0;
+   return net_buff_clear( This->txn_buff );
+}
+
+/**
+ * Émet les entrées rangées dans txn_buff, une transaction d'un seul datagramme, sauf si toutes
+ * ont été retirées par suppress_unchanged().
+ */
+static bool send_packed( flush_context * flush ) {
+   rkv_private * This = flush->ctxt.This;
+   size_t        size = 0;
+   if( ! net_buff_get_position( This->txn_buff, &size )) {
+      return false;
+   }
+   if( size > 0 ) {
+      if( ! net_buff_flip( This->txn_buff )) {
+         return false;
+      }
+      if( ! send_transaction( This, &flush->datagram )) {
+         return false;
+      }
+      if( This->options.pacing_bytes_per_s > 0 ) {
+         flush->wait_s = pace( This, size + RKV_FRAGMENT_HEADER_SIZE + RKV_IP_UDP_OVERHEAD );
+      }
+   }
+   flush->ctxt.stats->sent       += flush->datagram.sent;
+   flush->ctxt.stats->suppressed += flush->datagram.suppressed;
+   flush->datagram.sent       = 0;
+   flush->datagram.suppressed = 0;
+   This->pending_count        = 0;
+   return net_buff_clear( This->txn_buff );
+}
+
+/**
+ * Une entrée qui ne tient pas dans le datagramme en cours le fait partir. Une entrée plus
+ * grande qu'un datagramme part seule, fragmentée.
+ */
+static bool pack_entry( const rkv_key * key, const byte * entry, size_t size, void * user_context ) {
+   flush_context * flush    = (flush_context *)user_context;
+   rkv_private *   This     = flush->ctxt.This;
+   size_t          start    = 0;
+   size_t          capacity = 0;
+   if(   ! net_buff_get_position( This->txn_buff, &start )
+      ||(( start > 0 )&&( start + size > flush->payload_max )&& ! send_packed( flush ))
+      || ! pace_wait( flush, true )
+      || ! net_buff_get_position( This->txn_buff, &start )
+      || ! net_buff_get_capacity( This->txn_buff, &capacity ))
+   {
+      return false;
+   }
+   if( size > capacity ) {
+      net_buff larger = NULL;
+      if( ! net_buff_new( &larger, size )) {
+         return false;
+      }
+      net_buff_delete( &This->txn_buff );
+      This->txn_buff = larger;
+   }
+   if( ! net_buff_encode_bytes( This->txn_buff, entry, size )) {
+      return false;
+   }
+   if( This->fingerprints == NULL ) {
+      flush->datagram.sent += 1;
+      return true;
+   }
+   const rkv_data_holder data = { .id = (rkv_id)CONST_CAST( key, void ), .type = 0, .payload = NULL, .lazy = false };
+   return suppress_unchanged( &flush->ctxt, &data, start );
+}
+
+/**
+ * Publie les entrées de flushing, sous publish_lock comme une transaction, que pace_wait()
+ * relâche entre deux datagrammes.
+ */
+static bool auto_publish( rkv_private * This ) {
+   rkv_publish_stats stats;
+   memset( &stats, 0, sizeof( stats ));
+   flush_context flush = {
+      .ctxt        = { .This = This, .failed = false, .verbose = true, .stats = &stats },
+      .payload_max = This->options.mtu - RKV_IP_UDP_OVERHEAD - RKV_FRAGMENT_HEADER_SIZE,
+      .wait_s      = 0.0
+   };
+   memset( &flush.datagram, 0, sizeof( flush.datagram ));
+   pthread_mutex_lock( &This->publish_lock );
+   stats.full          = publish_full( This );
+   flush.datagram.full = stats.full;
+   This->pending_count = 0;
+   const bool ok = net_buff_clear( This->txn_buff )
+      &&           rkv_conflation_foreach( This->flushing, pack_entry, &flush )
+      &&           send_packed( &flush );
+   pthread_mutex_unlock( &This->publish_lock );
+   (void)pace_wait( &flush, false );
+   pthread_mutex_lock( &This->received_data_lock );
+   This->stats.entries_sent       += stats.sent;
+   This->stats.entries_suppressed += stats.suppressed;
+   pthread_mutex_unlock( &This->received_data_lock );
+   return ok;
+}
+
+static bool auto_publish_due( const rkv_private * This, size_t count ) {
+   if(( This->options.auto_publish_entries > 0 )&&( count >= This->options.auto_publish_entries )) {
+      return true;
+   }
+   if( This->options.auto_publish_ms == 0 ) {
+      return false;
+   }
+   struct timespec now;
+   clock_gettime( CLOCK_MONOTONIC, &now );
+   const long elapsed_ms = ( now.tv_sec - This->conflating_since.tv_sec ) * 1000
+      + ( now.tv_nsec - This->conflating_since.tv_nsec ) / 1000000;
+   return elapsed_ms >= (long)This->options.auto_publish_ms;
+}
+
+/**
+ * Comme l'écriture du journal : la première entrée en attente attend au plus auto_publish_ms,
+ * l'arrêt publie ce qui reste.
+ */
+static void * auto_publisher_thread( void * arg ) {
+   rkv_private * This  = (rkv_private *)arg;
+   size_t        count = 0;
+   pthread_mutex_lock( &This->conflation_lock );
+   for(;;) {
+      while( rkv_conflation_get_count( This->conflating, &count )&&( count == 0 )&& This->auto_publishing ) {
+         pthread_cond_wait( &This->conflation_ready, &This->conflation_lock );
+      }
+      if( count == 0 ) {
+         break;
+      }
+      while( This->auto_publishing && ! auto_publish_due( This, count )) {
+         if( This->options.auto_publish_ms == 0 ) {
+            pthread_cond_wait( &This->conflation_ready, &This->conflation_lock );
+         }
+         else {
+            struct timespec deadline = This->conflating_since;
+            deadline.tv_sec  += (time_t)( This->options.auto_publish_ms / 1000 );
+            deadline.tv_nsec += (long)( This->options.auto_publish_ms % 1000 ) * 1000000;
+            if( deadline.tv_nsec >= 1000000000 ) {
+               deadline.tv_sec  += 1;
+               deadline.tv_nsec -= 1000000000;
+            }
+            pthread_cond_timedwait( &This->conflation_ready, &This->conflation_lock, &deadline );
+         }
+         rkv_conflation_get_count( This->conflating, &count );
+      }
+      rkv_conflation published = This->conflating;
+      This->conflating = This->flushing;
+      This->flushing   = published;
+      pthread_mutex_unlock( &This->conflation_lock );
+      if( ! auto_publish( This )) {
+         fprintf( stderr, "%s: unable to publish %ld pending entries\n", __func__, count );
+      }
+      rkv_conflation_clear( This->flushing );
+      pthread_mutex_lock( &This->conflation_lock );
+   }
+   pthread_mutex_unlock( &This->conflation_lock );
+   return NULL;
+}
+
+static bool start_auto_publisher( rkv_private * This ) {
+   This->pacing_tokens = (double)This->options.pacing_burst_bytes;
+   clock_gettime( CLOCK_MONOTONIC, &This->pacing_refill );
+   This->auto_publishing = true;
+   if( pthread_create( &This->auto_publisher, NULL, auto_publisher_thread, This )) {
+      perror( "pthread_create" );
+      This->auto_publishing = false;
+      return false;
+   }
+   return true;
+}
+
+static void stop_auto_publisher( rkv_private * This ) {
+   pthread_mutex_lock( &This->conflation_lock );
+   const bool started = This->auto_publishing;
+   This->auto_publishing = false;
+   pthread_cond_signal( &This->conflation_ready );
+   pthread_mutex_unlock( &This->conflation_lock );
+   if( started ) {
+      pthread_join( This->auto_publisher, NULL );
+   }
+}
+
+static void log_refreshed( rkv_batch received_data ) {
+   if( RKV_DBG ) {
+      size_t card = 0;
+      struct timeval tv;
+      gettimeofday( &tv, NULL );
+      if( rkv_batch_get_size( received_data, &card )&&( card > 0 )) {
+         fprintf( stderr, "%6ld.%06ld:DEBUG:rkv_refresh:%ld data refreshed\n", tv.tv_sec, tv.tv_usec, card );
+      }
+      else {
+         fprintf( stderr, "%6ld.%06ld:DEBUG:rkv_refresh:no data refreshed\n", tv.tv_sec, tv.tv_usec );
+      }
+   }
+}
+
+static bool print_data_address( size_t index, const rkv_data_holder * holder, void * user_context ) {
+   fprintf( stderr, "rkv_refresh {key = %p, value = %p} moved from received cache to read_only_cache\n", (void *)holder->id, holder->payload );
+   return true;
+   (void)index;
+   (void)user_context;
+}
+
+/**
+ * Valeurs remplacées par un rafraîchissement : des lecteurs pouvant encore les lire
+ * dans la version précédente, elles ne sont libérées qu'une fois tous sortis.
+ */
+typedef struct {
+   rkv_private *     This;
+   rkv_data_holder * holders;
+   size_t            count;
+   size_t            capacity;
+} rkv_garbage;
+
+static bool garbage_add( rkv_garbage * garbage, const rkv_data_holder * holder ) {
+   if( garbage->count == garbage->capacity ) {
+      const size_t      capacity = garbage->capacity ? 2 * garbage->capacity : 64;
+      rkv_data_holder * holders  = realloc( garbage->holders, capacity * sizeof( rkv_data_holder ));
+      if( holders == NULL ) {
+         perror( "realloc" );
+         return false;
+      }
+      garbage->holders  = holders;
+      garbage->capacity = capacity;
+   }
+   garbage->holders[garbage->count++] = *holder;
+   return true;
+}
+
+static void garbage_reclaim( void * garbage_, void * user_context ) {
+   rkv_garbage * garbage = (rkv_garbage *)garbage_;
+   for( size_t i = 0; i < garbage->count; ++i ) {
+      release_holder( i, &garbage->holders[i], garbage->This );
+   }
+   free( garbage->holders );
+   free( garbage );
+   (void)user_context;
+}
+
+typedef struct {
+   rkv_garbage * garbage;
+   rkv_changes   changes;
+   uint64_t      now;     // ms, voir monotonic_ms()
+} merge_context;
+
+/**
+ * La clé id vient d'être retirée de la nouvelle version, sa valeur removed, s'il y en avait une,
+ * l'est comme une valeur remplacée. La pierre tombale garde une référence sur l'identifiant, qui
+ * reste ainsi valide pour les listeners de changements et pour l'appelant de
+ * rkv_refresh_with_changes(). Jusqu'à expiry, elle écarte les mises à jour que order précède.
+ */
+static void retire_removed( merge_context * ctxt, rkv_id id, uint64_t expiry, const received_order * order,
+   const rkv_data_holder * removed, rkv_change_kind kind )
+{
+   rkv_private * This  = ctxt->garbage->This;
+   bool          known = false;
+   if( ! rkv_tombstones_put( This->tombstones, id, expiry, This->generation, order->publisher_rank, order->sequence,
+         &known ))
+   {
+      fprintf( stderr, "%s: unable to keep the tombstone, late updates will not be shadowed\n", __func__ );
+      known = true;
+   }
+   if( known ) {
+      rkv_intern_release( This->ids, id ); // la pierre tombale déjà posée en a une
+   }
+   if( removed == NULL ) {
+      return;
+   }
+   if( ttl_of( This, removed->type )) {
+      cancel_timer( This, This->key_timers, (const rkv_key *)id );
+   }
+   atomic_fetch_add_explicit(( kind == RKV_EXPIRED ) ? &This->entries_expired : &This->entries_removed, 1,
+      memory_order_relaxed );
+   if( ! garbage_add( ctxt->garbage, removed )) {
+      fprintf( stderr, "%s: unable to retire removed data, leaked\n", __func__ );
+   }
+   if( ctxt->changes && ! rkv_changes_add( ctxt->changes, id, removed->type, kind )) {
+      fprintf( stderr, "%s: unable to record the change, lost\n", __func__ );
+   }
+}
+
+/**
+ * La pierre tombale reçue garde la référence de son holder sur l'identifiant.
+ */
+static void merge_tombstone( merge_context * ctxt, const rkv_data_holder * tombstone ) {
+   rkv_private *   This        = ctxt->garbage->This;
+   rkv_data_holder removed;
+   bool            has_removed = false;
+   if( ! rkv_store_remove( This->read_only_data, (const rkv_key *)tombstone->id, &removed, &has_removed )) {
+      release_holder( 0, tombstone, This );
+      return;
+   }
+   const received_order order = { tombstone->publisher_rank, tombstone->sequence };
+   retire_removed( ctxt, tombstone->id, ctxt->now + This->options.tombstone_ms, &order, has_removed ? &removed : NULL,
+      RKV_REMOVED );
+}
+
+/**
+ * Marque d'une clé dont la durée de vie est passée. Elle est démentie si la clé a été réarmée
+ * depuis, par une valeur plus récente, ou si son type n'a plus de durée de vie. La pierre tombale
+ * n'écarte rien, elle garde seulement l'identifiant valide jusqu'au rafraîchissement suivant.
+ */
+static void merge_expired( merge_context * ctxt, const rkv_data_holder * marker ) {
+   rkv_private *           This        = ctxt->garbage->This;
+   const rkv_key *         key         = (const rkv_key *)marker->id;
+   const rkv_data_holder * current     = NULL;
+   rkv_data_holder         removed;
+   bool                    has_removed = false;
+   if(   is_armed( This, This->key_timers, key )
+      || ! rkv_store_get( This->read_only_data, key, &current )
+      ||( ttl_of( This, current->type ) == 0 )
+      || ! rkv_store_remove( This->read_only_data, key, &removed, &has_removed )
+      || ! has_removed )
+   {
+      release_holder( 0, marker, This );
+      return;
+   }
+   retire_removed( ctxt, marker->id, ctxt->now, &unordered, &removed, RKV_EXPIRED );
+}
+
+static bool retire_orphan( size_t index, const rkv_data_holder * holder, void * user_context ) {
+   merge_context * ctxt = (merge_context *)user_context;
+   rkv_private *   This = ctxt->garbage->This;
+   rkv_id          id   = NULL;
+   // le holder retiré rend sa référence avec sa valeur, la pierre tombale en prend une autre
+   if( ! rkv_intern_key( This->ids, (const rkv_key *)holder->id, &id )) {
+      release_holder( index, holder, This );
+      return true;
+   }
+   retire_removed( ctxt, id, ctxt->now, &unordered, holder, RKV_EXPIRED );
+   return true;
+}
+
+/**
+ * Marque d'une origine dont les battements de cœur ont cessé : toutes ses clés sont retirées,
+ * sauf si elle s'est manifestée de nouveau depuis.
+ */
+static void merge_orphaned( merge_context * ctxt, const rkv_data_holder * marker ) {
+   rkv_private * This = ctxt->garbage->This;
+   if( ! is_armed( This, This->publisher_timers, (const rkv_key *)marker->id )) {
+      rkv_store_remove_origin( This->read_only_data, (const rkv_key *)marker->id, retire_orphan, ctxt );
+   }
+   release_holder( 0, marker, This );
+}
+
+/**
+ * Chaque valeur fusionnée d'un type à durée de vie repousse l'échéance de sa clé, celle qui
+ * change pour un type sans durée de vie la désarme.
+ */
+static void track_ttl( merge_context * ctxt, const rkv_data_holder * holder, const rkv_data_holder * replaced ) {
+   rkv_private *  This = ctxt->garbage->This;
+   const unsigned ttl  = ttl_of( This, holder->type );
+   if( ttl ) {
+      arm_timer( This, This->key_timers, (const rkv_key *)holder->id, ctxt->now + ttl );
+   }
+   else if( replaced && ttl_of( This, replaced->type )) {
+      cancel_timer( This, This->key_timers, (const rkv_key *)holder->id );
+   }
+}
+
+/**
+ * Le holder reçu est recopié dans la nouvelle version, la valeur qu'il remplace est retirée.
+ * Celui d'une clé retirée est écarté s'il vient du même émetteur que le retrait, par une
+ * transaction antérieure : il est en retard. Sinon il recrée la clé et neutralise la pierre
+ * tombale. Les émetteurs différents ne sont pas ordonnés, le dernier reçu l'emporte comme
+ * pour deux écritures.
+ */
+static bool merge_received( size_t index, const rkv_data_holder * holder, void * user_context ) {
+   merge_context *   ctxt     = (merge_context *)user_context;
+   rkv_private *     This     = ctxt->garbage->This;
+   rkv_data_holder   replaced;
+   bool              has_replaced = false;
+   uint32_t          removed_by   = 0;
+   uint32_t          removed_at   = 0;
+   if( holder->type == RKV_TOMBSTONE_TYPE ) {
+      merge_tombstone( ctxt, holder );
+      return true;
+   }
+   if( holder->type == RKV_EXPIRED_TYPE ) {
+      merge_expired( ctxt, holder );
+      return true;
+   }
+   if( holder->type == RKV_ORPHANED_TYPE ) {
+      merge_orphaned( ctxt, holder );
+      return true;
+   }
+   if( rkv_tombstones_get( This->tombstones, (const rkv_key *)holder->id, &removed_by, &removed_at )) {
+      if(( holder->publisher_rank == removed_by )&&( (int32_t)( holder->sequence - removed_at ) < 0 )) {
+         atomic_fetch_add_explicit( &This->updates_shadowed, 1, memory_order_relaxed );
+         release_holder( index, holder, This );
+         return true;
+      }
+      rkv_tombstones_clear( This->tombstones, (const rkv_key *)holder->id );
+   }
+   if( rkv_store_put( This->read_only_data, holder, &replaced, &has_replaced )) {
+      if( This->ttl_count ) {
+         track_ttl( ctxt, holder, has_replaced ? &replaced : NULL );
+      }
+      if( has_replaced && ! garbage_add( ctxt->garbage, &replaced )) {
+         fprintf( stderr, "%s: unable to retire replaced data, leaked\n", __func__ );
+      }
+      if(   ctxt->changes
+         && ! rkv_changes_add( ctxt->changes, holder->id, holder->type, has_replaced ? RKV_UPDATED : RKV_ADDED ))
+      {
+         fprintf( stderr, "%s: unable to record the change, lost\n", __func__ );
+      }
+   }
+   else {
+      release_holder( index, holder, This );
+   }
+   return true;
+}
+
+/**
+ * Publie une nouvelle version de read_only_data où les entrées de batch remplacent les
+ * précédentes, puis vide batch. L'appelant détient refresh_lock. changes, s'il n'est pas
+ * nul, reçoit les entrées appliquées.
+ */
+static bool merge_batch( rkv_private * This, rkv_batch batch, rkv_changes changes ) {
+   size_t card = 0;
+   if( ! rkv_batch_get_size( batch, &card )||( card == 0 )) {
+      return true;
+   }
+   rkv_garbage * garbage = calloc( 1, sizeof( rkv_garbage ));
+   bool          ok      = ( garbage != NULL )
+      && rkv_store_update_begin( This->read_only_data );
+   if( ok ) {
+      merge_context ctxt  = { .garbage = garbage, .changes = changes, .now = monotonic_ms() };
+      size_t        count = 0;
+      garbage->This = This;
+      rkv_batch_foreach( batch, merge_received, &ctxt );
+      ok = rkv_store_update_end( This->read_only_data, garbage, garbage_reclaim, NULL );
+      if( rkv_tombstones_get_count( This->tombstones, &count )) {
+         atomic_store_explicit( &This->tombstone_count, count, memory_order_relaxed );
+      }
+   }
+   else {
+      rkv_batch_foreach( batch, release_holder, This );
+      free( garbage );
+   }
+   if( RKV_DBG_MEMORY ) {
+      rkv_store_foreach( This->read_only_data, print_data_address, NULL );
+   }
+   return rkv_batch_clear( batch ) && ok;
+}
+
+/**
+ * Les listeners de changements reçoivent le cache réparti, parent, comme les autres.
+ */
+static void call_changes_listeners( rkv_private * This, const listener_set * set ) {
+   const rkv cache = This->parent ? This->parent : (rkv)This;
+   listener_calls += 1;
+   for( size_t i = 0; i < set->count; ++i ) {
+      if( set->listeners[i].on_changes ) {
+         set->listeners[i].on_changes( cache, This->changes, set->listeners[i].user_context );
+      }
+   }
+   listener_calls -= 1;
+}
+
+static bool has_changes_listener( const listener_set * set ) {
+   for( size_t i = 0; set &&( i < set->count ); ++i ) {
+      if( set->listeners[i].on_changes ) {
+         return true;
+      }
+   }
+   return false;
+}
+
+/**
+ * Publie une nouvelle version de read_only_data. Les lecteurs entrés par rkv_read_begin()
+ * continuent de lire la leur, sans verrou, jusqu'à rkv_read_end(). Les rafraîchissements
+ * concurrents sont sérialisés par refresh_lock.
+ *
+ * Les changements ne sont relevés que si changes n'est pas nul ou si un listener les attend,
+ * ils sont ajoutés à changes.
+ */
+static bool refresh( rkv_private * This, rkv_changes changes ) {
+   if( This->shards ) {
+      bool ok = true;
+      for( size_t i = 0; i < This->shard_count; ++i ) {
+         ok = refresh( (rkv_private *)This->shards[i], changes )&& ok;
+      }
+      return ok;
+   }
+   void * pinned = NULL;
+   if( ! rkv_epoch_enter( This->listeners_epoch, &This->listeners, &pinned )) {
+      return false;
+   }
+   const listener_set * set   = pinned;
+   const bool           track = ( changes != NULL )|| has_changes_listener( set );
+   size_t               count = 0;
+   pthread_mutex_lock( &This->refresh_lock );
+   pthread_mutex_lock( &This->received_data_lock );
+   rkv_batch received_data = This->received_data;
+   This->received_data     = This->received_spare;
+   This->received_spare    = NULL;
+   pthread_mutex_unlock( &This->received_data_lock );
+   log_refreshed( received_data );
+   This->generation += 1;
+   bool ok = rkv_changes_clear( This->changes )
+      &&     merge_batch( This, received_data, track ? This->changes : NULL );
+   // le cache vidé servira au prochain échange, refresh_lock le protège jusque-là
+   This->received_spare = received_data;
+   if( track && rkv_changes_get_count( This->changes, &count )&&( count > 0 )) {
+      ok = (( changes == NULL )|| rkv_changes_append( changes, This->changes ))&& ok;
+      if( set ) {
+         call_changes_listeners( This, set );
+      }
+   }
+   pthread_mutex_unlock( &This->refresh_lock );
+   rkv_epoch_leave( This->listeners_epoch );
+   return ok;
+}
+
+static void release_tombstone( rkv_id id, void * user_context ) {
+   rkv_intern_release(((rkv_private *)user_context)->ids, id );
+}
+
+/**
+ * Sous refresh_lock, comme une fusion : les pierres tombales échues partent, puis read_only_data
+ * est réduit s'il s'est vidé. Les valeurs ne bougent pas, seules les alvéoles sont recopiées.
+ */
+static void compact( rkv_private * This ) {
+   bool   compacted = false;
+   size_t count     = 0;
+   pthread_mutex_lock( &This->refresh_lock );
+   if(   rkv_tombstones_purge( This->tombstones, monotonic_ms(), This->generation, release_tombstone, This )
+      && rkv_tombstones_get_count( This->tombstones, &count ))
+   {
+      atomic_store_explicit( &This->tombstone_count, count, memory_order_relaxed );
+   }
+   if( rkv_store_compact( This->read_only_data, &compacted )&& compacted ) {
+      atomic_fetch_add_explicit( &This->compactions, 1, memory_order_relaxed );
+   }
+   pthread_mutex_unlock( &This->refresh_lock );
+}
+
+static void * compactor_thread( void * arg ) {
+   rkv_private * This = (rkv_private *)arg;
+   pthread_mutex_lock( &This->compaction_lock );
+   while( This->compacting ) {
+      struct timespec deadline;
+      clock_gettime( CLOCK_REALTIME, &deadline );
+      deadline.tv_sec  += (time_t)( This->options.compaction_ms / 1000 );
+      deadline.tv_nsec += (long)( This->options.compaction_ms % 1000 ) * 1000000;
+      if( deadline.tv_nsec >= 1000000000 ) {
+         deadline.tv_sec  += 1;
+         deadline.tv_nsec -= 1000000000;
+      }
+      pthread_cond_timedwait( &This->compaction_wakeup, &This->compaction_lock, &deadline );
+      if( This->compacting ) {
+         pthread_mutex_unlock( &This->compaction_lock );
+         compact( This );
+         pthread_mutex_lock( &This->compaction_lock );
+      }
+   }
+   pthread_mutex_unlock( &This->compaction_lock );
+   return NULL;
+}
+
+static bool start_compactor( rkv_private * This ) {
+   This->compacting = true;
+   if( pthread_create( &This->compactor, NULL, compactor_thread, This )) {
+      perror( "pthread_create" );
+      This->compacting = false;
+      return false;
+   }
+   return true;
+}
+
+static void stop_compactor( rkv_private * This ) {
+   pthread_mutex_lock( &This->compaction_lock );
+   const bool started = This->compacting;
+   This->compacting = false;
+   pthread_cond_signal( &This->compaction_wakeup );
+   pthread_mutex_unlock( &This->compaction_lock );
+   if( started ) {
+      pthread_join( This->compactor, NULL );
+   }
+}
+
+static void add_expiry( rkv_private * This, const rkv_key * key, unsigned type ) {
+   if( This->expired_count == This->expired_capacity ) {
+      const size_t capacity = This->expired_capacity ? 2 * This->expired_capacity : 64;
+      expired_key * expired = realloc( This->expired, capacity * sizeof( expired_key ));
+      if( expired == NULL ) {
+         perror( "realloc" );
+         return;
+      }
+      This->expired          = expired;
+      This->expired_capacity = capacity;
+   }
+   This->expired[This->expired_count].key  = *key;
+   This->expired[This->expired_count].type = type;
+   This->expired_count += 1;
+}
+
+static void key_expired( const rkv_key * key, void * user_context ) {
+   add_expiry( (rkv_private *)user_context, key, RKV_EXPIRED_TYPE );
+}
+
+static void publisher_expired( const rkv_key * key, void * user_context ) {
+   rkv_private * This = (rkv_private *)user_context;
+   atomic_fetch_add_explicit( &This->publishers_expired, 1, memory_order_relaxed );
+   add_expiry( This, key, RKV_ORPHANED_TYPE );
+}
+
+/**
+ * Les marques rejoignent received_data comme des valeurs reçues, hors de timers_lock. Une clé
+ * qui attend déjà une valeur plus récente n'en a pas besoin.
+ */
+static void deliver_expiries( rkv_private * This ) {
+   if( This->expired_count == 0 ) {
+      return;
+   }
+   pthread_mutex_lock( &This->received_data_lock );
+   for( size_t i = 0; i < This->expired_count; ++i ) {
+      const expired_key *     e       = This->expired + i;
+      const rkv_data_holder * pending = NULL;
+      rkv_data_holder         marker  = { .type = e->type };
+      if(( e->type == RKV_EXPIRED_TYPE )&& rkv_batch_get( This->received_data, &e->key, &pending )) {
+         continue;
+      }
+      if( rkv_intern_key( This->ids, &e->key, &marker.id )) {
+         put_received( This, This->received_data, &marker );
+      }
+   }
+   pthread_mutex_unlock( &This->received_data_lock );
+   This->expired_count = 0;
+   notify_listeners( This );
+}
+
+/**
+ * Dort jusqu'à la prochaine échéance des deux roues, ou jusqu'à ce qu'arm_timer() en arme une
+ * plus proche, puis les avance.
+ */
+static void * expirer_thread( void * arg ) {
+   rkv_private * This = (rkv_private *)arg;
+   pthread_mutex_lock( &This->timers_lock );
+   while( This->expiring ) {
+      uint64_t next_key       = UINT64_MAX;
+      uint64_t next_publisher = UINT64_MAX;
+      rkv_timers_next( This->key_timers, &next_key );
+      rkv_timers_next( This->publisher_timers, &next_publisher );
+      This->expirer_wake = ( next_key < next_publisher ) ? next_key : next_publisher;
+      const uint64_t now = monotonic_ms();
+      if( This->expirer_wake == UINT64_MAX ) {
+         pthread_cond_wait( &This->timers_wakeup, &This->timers_lock );
+      }
+      else if( This->expirer_wake > now ) {
+         const uint64_t  delay = This->expirer_wake - now;
+         struct timespec deadline;
+         clock_gettime( CLOCK_REALTIME, &deadline );
+         deadline.tv_sec  += (time_t)( delay / 1000 );
+         deadline.tv_nsec += (long)( delay % 1000 ) * 1000000;
+         if( deadline.tv_nsec >= 1000000000 ) {
+            deadline.tv_sec  += 1;
+            deadline.tv_nsec -= 1000000000;
+         }
+         pthread_cond_timedwait( &This->timers_wakeup, &This->timers_lock, &deadline );
       }
+      This->expirer_wake = 0; // éveillé : arm_timer() n'a pas à signaler
+      if( ! This->expiring ) {
+         break;
+      }
+      size_t alive = 0;
+      rkv_timers_advance( This->key_timers, monotonic_ms(), key_expired, This );
+      rkv_timers_advance( This->publisher_timers, monotonic_ms(), publisher_expired, This );
+      if( rkv_timers_get_count( This->publisher_timers, &alive )) {
+         atomic_store_explicit( &This->publishers_alive, alive, memory_order_relaxed );
+      }
+      pthread_mutex_unlock( &This->timers_lock );
+      deliver_expiries( This );
+      pthread_mutex_lock( &This->timers_lock );
    }
-   else {
-      char ids[ID_AS_STRING_LENGTH_MAX+1];
-      rkv_id_to_string( data->id, ids, sizeof( ids ));
-      fprintf( stderr, "%s: unable to encode header of %s of type %d (rkv_id_encode failed)\n", __func__, ids, data->type );
-   }
-   return true;
-   (void)index;
+   pthread_mutex_unlock( &This->timers_lock );
+   return NULL;
 }
 
-static bool clear_transaction( rkv_private * This, const char * name, utils_map transaction ) {
-   if( RKV_DBG ) {
-      size_t size;
-      if( utils_map_get_size( transaction, &size )) {
-         struct timeval tv;
-         gettimeofday( &tv, NULL );
-         fprintf( stderr, "%6ld.%06ld:DEBUG:rkv_publish:transaction '%s', %ld data sent\n", tv.tv_sec, tv.tv_usec, name, size );
+/**
+ * Le thread expirer ne démarre qu'avec une première échéance possible : publisher_timeout_ms
+ * ou le premier TTL. Un second appel ne fait rien.
+ */
+static bool start_expirer( rkv_private * This ) {
+   bool ok = true;
+   pthread_mutex_lock( &This->timers_lock );
+   if( ! This->expiring ) {
+      This->expiring = true;
+      if( pthread_create( &This->expirer, NULL, expirer_thread, This )) {
+         perror( "pthread_create" );
+         This->expiring = false;
+         ok = false;
       }
    }
-   utils_map_remove( This->transactions, name );
-   utils_map_delete( &transaction );
-   return true;
+   pthread_mutex_unlock( &This->timers_lock );
+   return ok;
 }
 
-bool rkv_publish( rkv cache, const char * name ) {
+static void stop_expirer( rkv_private * This ) {
+   pthread_mutex_lock( &This->timers_lock );
+   const bool started = This->expiring;
+   This->expiring = false;
+   pthread_cond_signal( &This->timers_wakeup );
+   pthread_mutex_unlock( &This->timers_lock );
+   if( started ) {
+      pthread_join( This->expirer, NULL );
+   }
+}
+
+DLL_PUBLIC bool rkv_refresh( rkv cache ) {
    if( cache == NULL ) {
       fprintf( stderr, "%s: null argument\n", __func__ );
       return false;
    }
-   rkv_private * This = (rkv_private *)cache;
-   utils_map transaction = NULL;
-   return utils_map_get( This->transactions, name, (map_value *)&transaction )
-      &&  net_buff_clear( This->send_buff )
-      &&  utils_map_foreach( transaction, rkv_data_encode, This )
-      &&  net_buff_flip( This->send_buff )
-      &&  net_buff_send( This->send_buff, This->sckt, &This->send_addr )
-      &&  clear_transaction( This, name, transaction );
+   return refresh( (rkv_private *)cache, NULL );
 }
 
-static void log_refreshed( utils_map received_data ) {
-   if( RKV_DBG ) {
-      size_t card;
-      utils_map_get_size( received_data, &card );
-      struct timeval tv;
-      gettimeofday( &tv, NULL );
-      if( received_data && utils_map_get_size( received_data, &card )) {
-         fprintf( stderr, "%6ld.%06ld:DEBUG:rkv_refresh:%ld data refreshed\n", tv.tv_sec, tv.tv_usec, card );
-      }
-      else {
-         fprintf( stderr, "%6ld.%06ld:DEBUG:rkv_refresh:no data refreshed\n", tv.tv_sec, tv.tv_usec );
-      }
+DLL_PUBLIC bool rkv_refresh_with_changes( rkv cache, rkv_changes changes ) {
+   if(( cache == NULL )||( changes == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
    }
+   return rkv_changes_clear( changes )
+      &&  refresh( (rkv_private *)cache, changes );
 }
 
-static bool print_data_address( size_t index, map_pair pair, void * user_context ) {
-   fprintf( stderr, "rkv_refresh {key = %p, value = %p} moved from received cache to read_only_cache\n", pair.key, pair.value );
+typedef struct {
+   rkv_private * This;
+   int           connection;
+   net_buff      chunk;
+   rkv_key       last;    // dernière clé traitée, le parcours reprend après elle
+   bool          started;
+   bool          full;    // le bloc est plein, il sera envoyé hors de la section de lecture
+   bool          ok;
+} snapshot_context;
+
+static bool flush_chunk( snapshot_context * ctxt ) {
+   ctxt->ok = net_buff_flip( ctxt->chunk )
+      &&      rkv_bootstrap_send_chunk( ctxt->connection, ctxt->chunk )
+      &&      net_buff_clear( ctxt->chunk );
+   return ctxt->ok;
+}
+
+static bool snapshot_encoded( snapshot_context * ctxt, const rkv_data_holder * holder ) {
+   ctxt->last    = *(const rkv_key *)holder->id;
+   ctxt->started = true;
    return true;
+}
+
+/**
+ * Les entrées sont accumulées dans un bloc, le parcours s'arrête quand la suivante n'y tient plus.
+ */
+static bool snapshot_encode( size_t index, const rkv_data_holder * holder, void * user_context ) {
+   snapshot_context * ctxt  = (snapshot_context *)user_context;
+   rkv_private *      This  = ctxt->This;
+   rkv_codec_entry *  codec = NULL;
+   size_t             start = 0;
+   if(   ! rkv_codecs_get( This->codecs, holder->type, &codec )
+      || ! net_buff_get_position( ctxt->chunk, &start ))
+   {
+      return snapshot_encoded( ctxt, holder );
+   }
+   if( encode_stored( This, ctxt->chunk, holder, codec, false )) {
+      return snapshot_encoded( ctxt, holder );
+   }
+   if( ! net_buff_set_position( ctxt->chunk, start )) {
+      ctxt->ok = false;
+      return false;
+   }
+   if( start == 0 ) {
+      encode_stored( This, ctxt->chunk, holder, codec, true ); // pour le diagnostic
+      fprintf( stderr, "%s: entry larger than a chunk, not transferred\n", __func__ );
+      ctxt->ok = net_buff_clear( ctxt->chunk );
+      return ctxt->ok && snapshot_encoded( ctxt, holder );
+   }
+   ctxt->full = true;
+   return false;
    (void)index;
-   (void)user_context;
 }
 
-DLL_PUBLIC bool rkv_refresh( rkv cache ) {
-   if( cache == NULL ) {
-      fprintf( stderr, "%s: null argument\n", __func__ );
+/**
+ * Transmet read_only_data bloc par bloc : chaque bloc est encodé dans une section de lecture
+ * et envoyé hors de celle-ci, le parcours reprend après sa dernière clé dans la version alors
+ * courante. Un pair lent ne retient ainsi aucune version retirée. Les mises à jour fusionnées
+ * pendant le transfert lui parviennent aussi par le groupe, qu'il a rejoint avant de demander.
+ */
+static bool serve_snapshot( rkv_private * This, int connection ) {
+   snapshot_context ctxt = { .This = This, .connection = connection, .chunk = NULL, .ok = true };
+   if( ! net_buff_new( &ctxt.chunk, RKV_BOOTSTRAP_CHUNK_MAX )) {
       return false;
    }
-   rkv_private * This  = (rkv_private *)cache;
+   bool ok = true;
+   do {
+      ctxt.full = false;
+      ok = ( ctxt.started
+            ? rkv_store_foreach_from( This->read_only_data, &ctxt.last, snapshot_encode, &ctxt )
+            : rkv_store_foreach     ( This->read_only_data,             snapshot_encode, &ctxt ))
+         && ctxt.ok
+         && flush_chunk( &ctxt );
+   } while( ok && ctxt.full );
+   net_buff_delete( &ctxt.chunk );
+   if( ! ok ) {
+      return false;
+   }
+   // compté avant la marque de fin, que le pair attend pour repartir
    pthread_mutex_lock( &This->received_data_lock );
-   utils_map received_data = This->received_data;
-   This->received_data     = NULL;
+   This->stats.snapshots_served += 1;
    pthread_mutex_unlock( &This->received_data_lock );
-   log_refreshed( received_data );
-   if( received_data ) {
-      if( ! utils_map_merge( This->read_only_data, received_data )) {
+   return rkv_bootstrap_send_end( connection );
+}
+
+/**
+ * Comme celui de réception, ce thread n'est annulable que pendant l'attente d'une connexion.
+ * La connexion en cours est publiée dans bootstrap_connection : rkv_delete() la ferme pour
+ * interrompre un transfert, que SO_SNDTIMEO borne par ailleurs.
+ */
+static void * bootstrap_server_thread( void * arg ) {
+   rkv_private * This = (rkv_private *)arg;
+   pthread_setcancelstate( PTHREAD_CANCEL_DISABLE, NULL );
+   for(;;) {
+      int connection = -1;
+      pthread_setcancelstate( PTHREAD_CANCEL_ENABLE, NULL );
+      const bool accepted = rkv_bootstrap_accept( This->bootstrap_listener, RKV_BOOTSTRAP_SEND_TIMEOUT_MS, &connection );
+      pthread_setcancelstate( PTHREAD_CANCEL_DISABLE, NULL );
+      if( ! accepted ) {
+         continue;
+      }
+      pthread_mutex_lock( &This->bootstrap_lock );
+      const bool stopping = This->bootstrap_stopping;
+      if( ! stopping ) {
+         This->bootstrap_connection = connection;
+      }
+      pthread_mutex_unlock( &This->bootstrap_lock );
+      if(( ! stopping )&& ! serve_snapshot( This, connection )) {
+         fprintf( stderr, "%s: snapshot transfer aborted\n", __func__ );
+      }
+      pthread_mutex_lock( &This->bootstrap_lock );
+      This->bootstrap_connection = -1;
+      pthread_mutex_unlock( &This->bootstrap_lock );
+      close( connection );
+   }
+   return NULL;
+}
+
+static bool wait_snapshot_offer( rkv_private * This, struct sockaddr_in * peer ) {
+   struct timespec deadline;
+   net_buff        request = NULL;
+   clock_gettime( CLOCK_REALTIME, &deadline );
+   deadline.tv_sec  += This->options.bootstrap_timeout_ms / 1000;
+   deadline.tv_nsec += (long)( This->options.bootstrap_timeout_ms % 1000 ) * 1000000L;
+   if( deadline.tv_nsec >= 1000000000L ) {
+      deadline.tv_sec  += 1;
+      deadline.tv_nsec -= 1000000000L;
+   }
+   pthread_mutex_lock( &This->bootstrap_lock );
+   This->bootstrap_waiting = true;
+   pthread_mutex_unlock( &This->bootstrap_lock );
+   bool ok = net_buff_new( &request, RKV_SNAPSHOT_OFFER_SIZE )
+      &&    rkv_protocol_encode_snapshot_request( request, &This->publisher )
+      &&    net_buff_flip( request )
+      &&    net_buff_send( request, This->sckt, &This->send_addr );
+   if( request ) {
+      net_buff_delete( &request );
+   }
+   pthread_mutex_lock( &This->bootstrap_lock );
+   while( ok && ! This->bootstrap_has_peer ) {
+      ok = ( pthread_cond_timedwait( &This->bootstrap_offered, &This->bootstrap_lock, &deadline ) == 0 );
+   }
+   ok                      = This->bootstrap_has_peer;
+   *peer                   = This->bootstrap_peer;
+   This->bootstrap_waiting = false;
+   pthread_mutex_unlock( &This->bootstrap_lock );
+   return ok;
+}
+
+/**
+ * Les blocs sont décodés au fil de leur réception, comme des transactions, puis
+ * fusionnés d'un coup dans read_only_data : un transfert interrompu n'y laisse rien.
+ */
+static bool bootstrap( rkv_private * This ) {
+   struct sockaddr_in peer;
+   int                connection = -1;
+   net_buff           chunk      = NULL;
+   rkv_batch          snapshot   = NULL;
+   bool               last       = false;
+   if( ! wait_snapshot_offer( This, &peer )) {
+      fprintf( stderr, "%s: no peer offered a snapshot within %u ms, starting empty\n", __func__,
+         This->options.bootstrap_timeout_ms );
+      return false;
+   }
+   bool ok = rkv_bootstrap_connect( &peer, This->options.bootstrap_timeout_ms, &connection )
+      &&    net_buff_new( &chunk, RKV_BOOTSTRAP_CHUNK_MAX )
+      &&    rkv_batch_new( &snapshot );
+   while( ok && ! last ) {
+      ok = rkv_bootstrap_receive_chunk( connection, chunk, &last )
+         &&( last || decode_transaction( This, chunk, snapshot, &unordered ));
+   }
+   if( snapshot ) {
+      size_t count = 0;
+      if( ok && rkv_batch_get_size( snapshot, &count )) {
+         pthread_mutex_lock( &This->refresh_lock );
+         ok = merge_batch( This, snapshot, NULL );
+         pthread_mutex_unlock( &This->refresh_lock );
+         pthread_mutex_lock( &This->received_data_lock );
+         This->stats.bootstrap_entries = count;
+         pthread_mutex_unlock( &This->received_data_lock );
+      }
+      else {
+         rkv_batch_foreach( snapshot, release_holder, This );
+         fprintf( stderr, "%s: snapshot transfer failed, starting empty\n", __func__ );
+      }
+      rkv_batch_delete( &snapshot );
+   }
+   if( chunk ) {
+      net_buff_delete( &chunk );
+   }
+   if( connection >= 0 ) {
+      close( connection );
+   }
+   return ok;
+}
+
+/**
+ * Une valeur chargée d'un instantané est décodée à sa première lecture. Des lecteurs concurrents
+ * peuvent la décoder chacun : le premier à publier la sienne l'emporte, les autres la rendent.
+ * L'entrée est copiée de la projection dans un net_buff, qui ne sait pas en envelopper une
+ * sans copie ; sa clé et son type doivent être ceux de l'index.
+ */
+static bool resolve_payload( rkv_private * This, const rkv_data_holder * holder, const void ** payload ) {
+   if( ! holder->lazy ) {
+      *payload = holder->payload;
+      return true;
+   }
+   lazy_value * value = CONST_CAST( holder->payload, lazy_value );
+   *payload = atomic_load( &value->decoded );
+   if( *payload ) {
+      return true;
+   }
+   rkv_codec_entry * codec     = NULL;
+   net_buff          buffer    = NULL;
+   rkv_id_private    key;
+   unsigned          type      = 0;
+   unsigned          size      = 0;
+   void *            decoded   = NULL;
+   bool              allocated = false;
+   const bool        ok        = rkv_codecs_get( This->codecs, holder->type, &codec )
+      && net_buff_new( &buffer, value->size )
+      && net_buff_encode_bytes( buffer, value->entry, value->size )
+      && net_buff_flip( buffer )
+      && rkv_id_decode_into( &key, buffer )
+      && net_buff_decode_uint32( buffer, &type )
+      && rkv_key_equals( &key, (const rkv_key *)holder->id )
+      &&( type == holder->type )
+      && net_buff_decode_uint32( buffer, &size )
+      && decode_payload( This, codec, buffer, &decoded, &allocated );
+   if( buffer ) {
+      net_buff_delete( &buffer );
+   }
+   if( ! ok ) {
+      char ids[ID_AS_STRING_LENGTH_MAX+1];
+      rkv_id_to_string( holder->id, ids, sizeof( ids ));
+      fprintf( stderr, "%s: unable to decode snapshot data %s of type %d\n", __func__, ids, holder->type );
+      return false;
+   }
+   const void * expected = NULL;
+   if( ! atomic_compare_exchange_strong( &value->decoded, &expected, decoded )) {
+      release_payload( This, holder->type, decoded );
+      *payload = expected;
+      return true;
+   }
+   pthread_mutex_lock( &This->received_data_lock );
+   This->stats.snapshot_decoded += 1;
+   pthread_mutex_unlock( &This->received_data_lock );
+   *payload = decoded;
+   return true;
+}
+
+typedef struct {
+   rkv_private *       This;
+   rkv_snapshot_writer writer;
+   net_buff            entry;
+   bool                ok;
+} save_context;
+
+/**
+ * Chaque entrée est encodée seule, dans un tampon qui double tant qu'elle n'y tient pas.
+ */
+static bool save_entry( size_t index, const rkv_data_holder * holder, void * user_context ) {
+   save_context *    ctxt  = (save_context *)user_context;
+   rkv_codec_entry * codec = NULL;
+   size_t            size  = 0;
+   byte *            bytes = NULL;
+   if( ! rkv_codecs_get( ctxt->This->codecs, holder->type, &codec )) {
+      return true;
+   }
+   for(;;) {
+      size_t capacity = 0;
+      if(   ! net_buff_get_capacity( ctxt->entry, &capacity )
+         || ! net_buff_clear( ctxt->entry ))
+      {
+         ctxt->ok = false;
          return false;
       }
-      if( RKV_DBG_MEMORY ) {
-         utils_map_foreach( This->read_only_data, print_data_address, NULL );
+      if( encode_stored( ctxt->This, ctxt->entry, holder, codec, capacity >= TRANSACTION_MAX )) {
+         break;
       }
-      if( ! utils_map_delete( &received_data )) {
+      net_buff larger = NULL;
+      if(( capacity >= TRANSACTION_MAX )|| ! net_buff_new( &larger, 2*capacity )) {
+         ctxt->ok = false;
          return false;
       }
+      net_buff_delete( &ctxt->entry );
+      ctxt->entry = larger;
    }
-   return true;
+   ctxt->ok = net_buff_get_position( ctxt->entry, &size )
+      &&      net_buff_get_bytes( ctxt->entry, &bytes )
+      &&      rkv_snapshot_writer_add( ctxt->writer, (const rkv_key *)holder->id, holder->type, bytes, size );
+   return ctxt->ok;
+   (void)index;
 }
 
-DLL_PUBLIC bool rkv_get( rkv cache, const rkv_id id, map_value * dest ) {
-   if(( cache == NULL )||( dest == NULL )) {
+DLL_PUBLIC bool rkv_snapshot_save( rkv cache, const char * path ) {
+   if(( cache == NULL )||( path == NULL )) {
       fprintf( stderr, "%s: null argument\n", __func__ );
       return false;
    }
-   rkv_private * This  = (rkv_private *)cache;
-   map_value     entry = NULL;
-   if( ! utils_map_get( This->read_only_data, id, &entry )) {
-      free( CONST_CAST( entry, void ));
+   save_context ctxt = { .This = (rkv_private *)cache, .writer = NULL, .entry = NULL, .ok = true };
+   if( ! not_sharded( ctxt.This, __func__ )|| ! net_buff_new( &ctxt.entry, PAYLOAD_MAX )) {
       return false;
    }
-   rkv_data_holder * data = CONST_CAST( entry, rkv_data_holder );
-   *dest = data->payload;
-   return true;
+   if( ! rkv_snapshot_writer_new( &ctxt.writer, path )) {
+      net_buff_delete( &ctxt.entry );
+      return false;
+   }
+   const bool ok = rkv_store_foreach( ctxt.This->read_only_data, save_entry, &ctxt )&& ctxt.ok;
+   net_buff_delete( &ctxt.entry );
+   return ok
+      ? rkv_snapshot_writer_commit( &ctxt.writer )
+      : ( rkv_snapshot_writer_abort( &ctxt.writer )&& false );
+}
+
+/**
+ * Le chargement ne décode que l'index : chaque entrée devient un holder dont la valeur
+ * est décodée par resolve_payload() à sa première lecture. Les entrées chargées remplacent
+ * celles du cache, comme un rafraîchissement.
+ */
+DLL_PUBLIC bool rkv_snapshot_load( rkv cache, const char * path ) {
+   if(( cache == NULL )||( path == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_private *     This     = (rkv_private *)cache;
+   rkv_batch         batch    = NULL;
+   size_t            count    = 0;
+   if( ! not_sharded( This, __func__ )) {
+      return false;
+   }
+   loaded_snapshot * snapshot = calloc( 1, sizeof( loaded_snapshot ));
+   if( snapshot == NULL ) {
+      perror( "calloc" );
+      return false;
+   }
+   if( ! rkv_snapshot_file_open( &snapshot->file, path, &count )) {
+      free( snapshot );
+      return false;
+   }
+   // une référence pour le chargement lui-même, rendue à la fin
+   atomic_init( &snapshot->references, 1 );
+   snapshot->values = calloc( count ? count : 1, sizeof( lazy_value ));
+   bool ok = ( snapshot->values != NULL )&& rkv_batch_new( &batch );
+   for( size_t i = 0; ok &&( i < count ); ++i ) {
+      rkv_key           key;
+      rkv_codec_entry * codec = NULL;
+      rkv_data_holder   holder;
+      lazy_value *      value = snapshot->values + i;
+      ok = rkv_snapshot_file_get_entry( snapshot->file, i, &key, &holder.type, &value->entry, &value->size );
+      if( ok && ! rkv_codecs_get( This->codecs, holder.type, &codec )) {
+         fprintf( stderr, "%s: no codec for type %u, entry %ld skipped\n", __func__, holder.type, i );
+         continue;
+      }
+      ok = ok && rkv_intern_key( This->ids, &key, &holder.id );
+      if( ok ) {
+         atomic_init( &value->decoded, NULL );
+         value->snapshot = snapshot;
+         holder.payload  = value;
+         holder.lazy     = true;
+         atomic_fetch_add( &snapshot->references, 1 );
+         ok = put_received( This, batch, &holder );
+      }
+   }
+   if( batch ) {
+      if( ok ) {
+         pthread_mutex_lock( &This->refresh_lock );
+         ok = merge_batch( This, batch, NULL );
+         pthread_mutex_unlock( &This->refresh_lock );
+         pthread_mutex_lock( &This->received_data_lock );
+         This->stats.snapshot_entries += count;
+         pthread_mutex_unlock( &This->received_data_lock );
+      }
+      else {
+         rkv_batch_foreach( batch, release_holder, This );
+      }
+      rkv_batch_delete( &batch );
+   }
+   release_snapshot( snapshot );
+   return ok;
+}
+
+typedef struct {
+   rkv_private * This;
+   net_buff      transaction;
+   rkv_batch     batch;
+} replay_context;
+
+static bool replay_transaction( const byte * record, size_t size, void * user_context ) {
+   replay_context * ctxt     = (replay_context *)user_context;
+   size_t           capacity = 0;
+   if( ! net_buff_get_capacity( ctxt->transaction, &capacity )) {
+      return false;
+   }
+   if( capacity < size ) {
+      net_buff larger = NULL;
+      if( ! net_buff_new( &larger, size )) {
+         return false;
+      }
+      net_buff_delete( &ctxt->transaction );
+      ctxt->transaction = larger;
+   }
+   return net_buff_clear( ctxt->transaction )
+      &&  net_buff_encode_bytes( ctxt->transaction, record, size )
+      &&  net_buff_flip( ctxt->transaction )
+      &&  decode_transaction( ctxt->This, ctxt->transaction, ctxt->batch, &unordered );
 }
 
-static bool remove_payloads( size_t index, map_pair pair, void * user_context ) {
-   const rkv_data_holder * holder = pair.value;
-   utils_map               codecs = (utils_map)user_context;
-   rkv_codec *             codec  = NULL;
-   if(   utils_map_get( codecs, &holder->type, (map_value *)&codec )
-      && codec
-      && codec->releaser )
+/**
+ * Les transactions du journal sont décodées dans l'ordre dans un lot où chaque clé ne garde
+ * que sa dernière valeur, fusionné une seule fois : sans réseau ni attente, le rejeu va aussi
+ * vite que le disque et le décodage. Le journal du cache lui-même, s'il est dans le même
+ * répertoire, n'est pas relu.
+ */
+DLL_PUBLIC bool rkv_journal_replay( rkv cache, const char * directory ) {
+   if(( cache == NULL )||( directory == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_private *  This    = (rkv_private *)cache;
+   replay_context ctxt    = { .This = This, .transaction = NULL, .batch = NULL };
+   uint64_t       limit   = UINT64_MAX;
+   size_t         records = 0;
+   if(   ! not_sharded( This, __func__ )
+      ||( This->journal && ! rkv_journal_get_limit( This->journal, directory, &limit ))
+      || ! net_buff_new( &ctxt.transaction, PAYLOAD_MAX ))
    {
-      codec->releaser( CONST_CAST( holder->payload, void), codecs );
+      return false;
    }
-   return true;
-   (void)index;
+   if( ! rkv_batch_new( &ctxt.batch )) {
+      net_buff_delete( &ctxt.transaction );
+      return false;
+   }
+   bool ok = rkv_journal_read( directory, limit, replay_transaction, &ctxt, &records );
+   if( ok ) {
+      pthread_mutex_lock( &This->refresh_lock );
+      ok = merge_batch( This, ctxt.batch, NULL );
+      pthread_mutex_unlock( &This->refresh_lock );
+      pthread_mutex_lock( &This->received_data_lock );
+      This->stats.journal_replayed += records;
+      pthread_mutex_unlock( &This->received_data_lock );
+   }
+   else {
+      rkv_batch_foreach( ctxt.batch, release_holder, This );
+   }
+   rkv_batch_delete( &ctxt.batch );
+   net_buff_delete( &ctxt.transaction );
+   return ok;
+}
+
+DLL_PUBLIC bool rkv_read_begin( rkv cache ) {
+   if( cache == NULL ) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   const rkv_private * This = (const rkv_private *)cache;
+   for( size_t i = 0; i < This->shard_count; ++i ) {
+      if( ! rkv_read_begin( This->shards[i] )) {
+         while( i > 0 ) {
+            rkv_read_end( This->shards[--i] );
+         }
+         return false;
+      }
+   }
+   return This->shards || rkv_store_read_begin( This->read_only_data );
+}
+
+DLL_PUBLIC bool rkv_read_end( rkv cache ) {
+   if( cache == NULL ) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   const rkv_private * This = (const rkv_private *)cache;
+   bool                ok   = true;
+   for( size_t i = 0; i < This->shard_count; ++i ) {
+      ok = rkv_read_end( This->shards[i] )&& ok;
+   }
+   return This->shards ? ok : rkv_store_read_end( This->read_only_data );
+}
+
+DLL_PUBLIC bool rkv_get_key( rkv cache, const rkv_key * key, rkv_value * dest ) {
+   if(( cache == NULL )||( key == NULL )||( dest == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_private *           This   = (rkv_private *)cache;
+   const rkv_data_holder * holder = NULL;
+   if( This->shards ) {
+      return rkv_get_key( shard_of( This, key ), key, dest );
+   }
+   // le compactor peut publier une version à tout moment : le holder est lu dans celle qui est épinglée
+   if( ! rkv_store_read_begin( This->read_only_data )) {
+      return false;
+   }
+   const bool ok = rkv_store_get( This->read_only_data, key, &holder )
+      &&           resolve_payload( This, holder, dest );
+   rkv_store_read_end( This->read_only_data );
+   return ok;
+}
+
+DLL_PUBLIC bool rkv_get( rkv cache, const rkv_id id, rkv_value * dest ) {
+   if( id == NULL ) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   return rkv_get_key( cache, (const rkv_key *)id, dest );
 }
 
 static bool delete_transaction( size_t index, map_pair pair, void * user_context ) {
-   void * map = CONST_CAST( pair.value, utils_map );
-   utils_map_delete((utils_map *)&map );
+   rkv_txn txn = (rkv_txn)CONST_CAST( pair.value, void );
+   rkv_txn_delete( &txn );
    return true;
    (void)index;
    (void)user_context;
 }
 
 typedef struct {
-   rkv_iterator iterator;
-   void *       user_context;
+   rkv_private * This;
+   rkv_iterator  iterator;
+   void *        user_context;
 } rkv_user_context;
 
-static bool rkv_for_one( size_t index, map_pair pair, void * user_context ) {
-   const rkv_data_holder * holder = pair.value;
-   rkv_user_context * rkvuc = (rkv_user_context *)user_context;
-   return rkvuc->iterator( index, holder->id, holder->type, holder->payload, rkvuc->user_context );
+static bool rkv_for_one( size_t index, const rkv_data_holder * holder, void * user_context ) {
+   rkv_user_context * rkvuc   = (rkv_user_context *)user_context;
+   const void *       payload = NULL;
+   if( ! resolve_payload( rkvuc->This, holder, &payload )) {
+      return true; // illisible, déjà signalée
+   }
+   return rkvuc->iterator( index, holder->id, holder->type, payload, rkvuc->user_context );
+}
+
+typedef struct {
+   rkv_id * target;
+} ids_context;
+
+static bool get_one_id( size_t index, const rkv_data_holder * holder, void * user_context ) {
+   ids_context * ctxt = (ids_context *)user_context;
+   ctxt->target[index] = holder->id;
+   return true;
+}
+
+/**
+ * Les identifiants des caches se suivent dans target. S'il est trop petit, *target_size
+ * reçoit quand même la taille nécessaire.
+ */
+static bool get_shards_ids( rkv_private * This, rkv_id target[], size_t * target_size ) {
+   size_t total = 0;
+   bool   ok    = true;
+   for( size_t i = 0; i < This->shard_count; ++i ) {
+      size_t room = ( ok && target &&( total <= *target_size )) ? *target_size - total : 0;
+      if( ok && target ) {
+         ok = rkv_get_ids( This->shards[i], target + total, &room );
+      }
+      else if( ! rkv_get_ids( This->shards[i], NULL, &room )) {
+         return false;
+      }
+      total += room;
+   }
+   *target_size = total;
+   return ok;
 }
 
 DLL_PUBLIC bool rkv_get_ids( rkv cache, rkv_id target[], size_t * target_size ) {
@@ -591,7 +4322,44 @@ DLL_PUBLIC bool rkv_get_ids( rkv cache, rkv_id target[], size_t * target_size )
       return false;
    }
    rkv_private * This = (rkv_private *)cache;
-   return utils_map_get_keys( This->read_only_data, (map_key *)target, target_size );
+   size_t        size = 0;
+   bool          ok   = false;
+   if( This->shards ) {
+      return get_shards_ids( This, target, target_size );
+   }
+   if( ! rkv_store_read_begin( This->read_only_data )) {
+      return false;
+   }
+   if( rkv_store_get_size( This->read_only_data, &size )) {
+      if( target == NULL ) {
+         ok = true;
+      }
+      else if( *target_size < size ) {
+         fprintf( stderr, "%s: target too small, %ld ids expected\n", __func__, size );
+      }
+      else {
+         ids_context ctxt = { .target = target };
+         ok = rkv_store_foreach( This->read_only_data, get_one_id, &ctxt );
+      }
+      *target_size = size;
+   }
+   rkv_store_read_end( This->read_only_data );
+   return ok;
+}
+
+/**
+ * Les entrées d'un cache réparti sont numérotées à la suite, d'un cache à l'autre.
+ */
+typedef struct {
+   rkv_iterator iterator;
+   void *       user_context;
+   size_t       index;
+} shards_context;
+
+static bool rkv_for_one_shard( size_t index, const rkv_id id, unsigned type, rkv_value data, void * user_context ) {
+   shards_context * ctxt = (shards_context *)user_context;
+   return ctxt->iterator( ctxt->index++, id, type, data, ctxt->user_context );
+   (void)index;
 }
 
 DLL_PUBLIC bool rkv_foreach( rkv cache, rkv_iterator iterator, void * user_context ) {
@@ -600,8 +4368,139 @@ DLL_PUBLIC bool rkv_foreach( rkv cache, rkv_iterator iterator, void * user_conte
       return false;
    }
    rkv_private *    This  = (rkv_private *)cache;
-   rkv_user_context rkvuc = { .iterator = iterator, .user_context = user_context };
-   return utils_map_foreach( This->read_only_data, rkv_for_one, &rkvuc );
+   rkv_user_context rkvuc = { .This = This, .iterator = iterator, .user_context = user_context };
+   if( This->shards ) {
+      shards_context ctxt = { .iterator = iterator, .user_context = user_context, .index = 0 };
+      bool           ok   = true;
+      for( size_t i = 0; ok &&( i < This->shard_count ); ++i ) {
+         ok = rkv_foreach( This->shards[i], rkv_for_one_shard, &ctxt );
+      }
+      return ok;
+   }
+   return rkv_store_foreach( This->read_only_data, rkv_for_one, &rkvuc );
+}
+
+DLL_PUBLIC bool rkv_foreach_type( rkv cache, unsigned type, rkv_iterator iterator, void * user_context ) {
+   if(( cache == NULL )||( iterator == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_private *    This  = (rkv_private *)cache;
+   rkv_user_context rkvuc = { .This = This, .iterator = iterator, .user_context = user_context };
+   if( This->shards ) {
+      shards_context ctxt = { .iterator = iterator, .user_context = user_context, .index = 0 };
+      bool           ok   = true;
+      for( size_t i = 0; ok &&( i < This->shard_count ); ++i ) {
+         ok = rkv_foreach_type( This->shards[i], type, rkv_for_one_shard, &ctxt );
+      }
+      return ok;
+   }
+   return rkv_store_foreach_type( This->read_only_data, type, rkv_for_one, &rkvuc );
+}
+
+DLL_PUBLIC bool rkv_count_type( rkv cache, unsigned type, size_t * count ) {
+   if(( cache == NULL )||( count == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_private * This = (rkv_private *)cache;
+   if( This->shards ) {
+      *count = 0;
+      for( size_t i = 0; i < This->shard_count; ++i ) {
+         size_t shard = 0;
+         if( ! rkv_count_type( This->shards[i], type, &shard )) {
+            return false;
+         }
+         *count += shard;
+      }
+      return true;
+   }
+   return rkv_store_count_type( This->read_only_data, type, count );
+}
+
+static void add_stats( rkv_stats * total, const rkv_stats * shard ) {
+   total->datagrams_received += shard->datagrams_received;
+   total->receive_calls      += shard->receive_calls;
+   total->datagrams_truncated += shard->datagrams_truncated;
+   total->reassembly_pending += shard->reassembly_pending;
+   total->reassembly_bytes   += shard->reassembly_bytes;
+   total->versions_retired   += shard->versions_retired;
+   total->ids_in_use         += shard->ids_in_use;
+   total->ids_allocated      += shard->ids_allocated;
+   total->payloads_in_use    += shard->payloads_in_use;
+   total->payloads_allocated += shard->payloads_allocated;
+   total->payloads_recycled  += shard->payloads_recycled;
+   total->payloads_reused    += shard->payloads_reused;
+   total->entries_sent       += shard->entries_sent;
+   total->entries_suppressed += shard->entries_suppressed;
+   total->datagrams_held     += shard->datagrams_held;
+   total->datagrams_lost     += shard->datagrams_lost;
+   total->nacks_sent         += shard->nacks_sent;
+   total->datagrams_resent   += shard->datagrams_resent;
+   total->bootstrap_entries  += shard->bootstrap_entries;
+   total->snapshots_served   += shard->snapshots_served;
+   total->snapshot_entries   += shard->snapshot_entries;
+   total->snapshot_decoded   += shard->snapshot_decoded;
+   total->journal_records    += shard->journal_records;
+   total->journal_commits    += shard->journal_commits;
+   total->journal_pruned     += shard->journal_pruned;
+   total->journal_replayed   += shard->journal_replayed;
+   total->notifications      += shard->notifications;
+   total->notifications_coalesced += shard->notifications_coalesced;
+   total->entries_skipped    += shard->entries_skipped;
+   total->entries_conflated  += shard->entries_conflated;
+   total->datagrams_paced    += shard->datagrams_paced;
+   total->entries_removed    += shard->entries_removed;
+   total->updates_shadowed   += shard->updates_shadowed;
+   total->tombstones         += shard->tombstones;
+   total->slots_allocated    += shard->slots_allocated;
+   total->compactions        += shard->compactions;
+   total->heartbeats_sent    += shard->heartbeats_sent;
+   total->publishers_alive   += shard->publishers_alive;
+   total->publishers_expired += shard->publishers_expired;
+   total->entries_expired    += shard->entries_expired;
+}
+
+DLL_PUBLIC bool rkv_get_stats( rkv cache, rkv_stats * stats ) {
+   if(( cache == NULL )||( stats == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_private * This = (rkv_private *)cache;
+   if( This->shards ) {
+      memset( stats, 0, sizeof( rkv_stats ));
+      for( size_t i = 0; i < This->shard_count; ++i ) {
+         rkv_stats shard;
+         if( ! rkv_get_stats( This->shards[i], &shard )) {
+            return false;
+         }
+         add_stats( stats, &shard );
+      }
+      return true;
+   }
+   pthread_mutex_lock( &This->received_data_lock );
+   *stats = This->stats;
+   pthread_mutex_unlock( &This->received_data_lock );
+   stats->notifications           = atomic_load_explicit( &This->notifications, memory_order_relaxed );
+   stats->notifications_coalesced = atomic_load_explicit( &This->notifications_coalesced, memory_order_relaxed );
+   stats->entries_skipped         = atomic_load_explicit( &This->entries_skipped, memory_order_relaxed );
+   stats->entries_conflated       = atomic_load_explicit( &This->entries_conflated, memory_order_relaxed );
+   stats->datagrams_paced         = atomic_load_explicit( &This->datagrams_paced, memory_order_relaxed );
+   stats->entries_removed         = atomic_load_explicit( &This->entries_removed, memory_order_relaxed );
+   stats->updates_shadowed        = atomic_load_explicit( &This->updates_shadowed, memory_order_relaxed );
+   stats->tombstones              = atomic_load_explicit( &This->tombstone_count, memory_order_relaxed );
+   stats->compactions             = atomic_load_explicit( &This->compactions, memory_order_relaxed );
+   stats->heartbeats_sent         = atomic_load_explicit( &This->heartbeats_sent, memory_order_relaxed );
+   stats->publishers_alive        = atomic_load_explicit( &This->publishers_alive, memory_order_relaxed );
+   stats->publishers_expired      = atomic_load_explicit( &This->publishers_expired, memory_order_relaxed );
+   stats->entries_expired         = atomic_load_explicit( &This->entries_expired, memory_order_relaxed );
+   return rkv_store_get_versions( This->read_only_data, &stats->versions_retired )
+      &&  rkv_store_get_capacity( This->read_only_data, &stats->slots_allocated )
+      &&(( This->journal == NULL )|| rkv_journal_get_stats( This->journal, &stats->journal_records, &stats->journal_commits,
+            &stats->journal_pruned ))
+      &&  rkv_intern_get_usage( This->ids, &stats->ids_in_use, &stats->ids_allocated )
+      &&  rkv_codecs_get_payloads_usage( This->codecs, &stats->payloads_in_use, &stats->payloads_allocated )
+      &&  rkv_codecs_get_recycling( This->codecs, &stats->payloads_recycled, &stats->payloads_reused );
 }
 
 DLL_PUBLIC bool rkv_delete( rkv * cache ) {
@@ -610,38 +4509,60 @@ DLL_PUBLIC bool rkv_delete( rkv * cache ) {
       return false;
    }
    rkv_private * This = *(rkv_private **)cache;
+   if( This->shards ) {
+      delete_shards( This );
+      *cache = NULL;
+      return true;
+   }
+   stop_auto_publisher( This ); // publie les entrées encore en attente
+   stop_compactor( This );
+   stop_expirer( This );
    pthread_mutex_lock( &This->received_data_lock );
    This->is_alive = false;
    pthread_mutex_unlock( &This->received_data_lock );
-   pthread_mutex_lock( &This->listeners_lock );
-   if( setsockopt( This->sckt, IPPROTO_IP, IP_DROP_MEMBERSHIP, &This->imr, sizeof( This->imr )) < 0 ) {
+   if(   This->options.subscribe
+      &&( setsockopt( This->sckt, IPPROTO_IP, IP_DROP_MEMBERSHIP, &This->imr, sizeof( This->imr )) < 0 ))
+   {
       perror( "setsockopt( IP_DROP_MEMBERSHIP )" );
       return false;
    }
+   // le thread de réception n'est annulable que pendant l'attente d'un datagramme,
+   // jamais quand il détient un verrou : aucun verrou ne doit être pris ici.
    pthread_cancel( This->thread );
    void * retVal = NULL;
    pthread_join( This->thread, &retVal );
-   close( This->sckt );
-   net_buff_delete ( &This->recv_buff );
-   net_buff_delete ( &This->send_buff );
-   utils_map_foreach( This->read_only_data, remove_payloads, This->codecs );
-   utils_map_delete( &This->read_only_data );
-   utils_map_foreach( This->transactions, delete_transaction, NULL );
-   utils_map_delete( &This->transactions );
-   if( This->received_data ) {
-      utils_map_delete( &This->received_data );
-   }
-   utils_map_delete( &This->codecs );
-   rkv_listener listener = This->listeners;
-   while( listener ) {
-      rkv_listener next = listener->next;
-      free( listener );
-      listener = next;
+   stop_workers( This, This->worker_count );
+   stop_dispatcher( This );
+   if( This->bootstrap_serving ) {
+      // un transfert en cours, annulation désactivée, est interrompu par la fermeture de sa connexion
+      pthread_mutex_lock( &This->bootstrap_lock );
+      This->bootstrap_stopping = true;
+      if( This->bootstrap_connection >= 0 ) {
+         shutdown( This->bootstrap_connection, SHUT_RDWR );
+      }
+      pthread_mutex_unlock( &This->bootstrap_lock );
+      pthread_cancel( This->bootstrap_thread );
+      pthread_join( This->bootstrap_thread, &retVal );
    }
-   pthread_mutex_unlock( &This->listeners_lock );
+   pthread_mutex_destroy( &This->refresh_lock );
    pthread_mutex_destroy( &This->received_data_lock );
    pthread_mutex_destroy( &This->listeners_lock );
-   free( This );
+   pthread_mutex_destroy( &This->replay_lock );
+   pthread_mutex_destroy( &This->bootstrap_lock );
+   pthread_cond_destroy( &This->bootstrap_offered );
+   pthread_cond_destroy( &This->committed );
+   pthread_mutex_destroy( &This->notify_lock );
+   pthread_mutex_destroy( &This->subscription_lock );
+   pthread_mutex_destroy( &This->transactions_lock );
+   pthread_mutex_destroy( &This->publish_lock );
+   pthread_cond_destroy( &This->notify_wakeup );
+   pthread_mutex_destroy( &This->conflation_lock );
+   pthread_cond_destroy( &This->conflation_ready );
+   pthread_mutex_destroy( &This->compaction_lock );
+   pthread_cond_destroy( &This->compaction_wakeup );
+   pthread_mutex_destroy( &This->timers_lock );
+   pthread_cond_destroy( &This->timers_wakeup );
+   release_resources( This );
    *cache = NULL;
    return true;
 }
@@ -0,0 +1,201 @@
+#include "rkv_batch.h"
+#include "rkv_id_private.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BATCH_CAPACITY_MIN   64
+// facteur de remplissage maximal de l'index : 7/10
+#define BATCH_LOAD_NUM       7
+#define BATCH_LOAD_DEN       10
+
+/**
+ * slot est la position de l'entrée dans l'index, pour le vider sans le parcourir.
+ */
+typedef struct {
+   uint64_t        origin;
+   uint32_t        instance;
+   uint32_t        slot;
+   rkv_data_holder holder;
+} entry;
+
+/**
+ * index[i] vaut 0 pour une position libre, le rang de l'entrée plus un sinon.
+ */
+typedef struct {
+   entry *    entries;
+   size_t     count;
+   size_t     entries_capacity;
+   uint32_t * index;
+   size_t     index_capacity; // puissance de 2
+} rkv_batch_private;
+
+bool rkv_batch_new( rkv_batch * batch ) {
+   if( batch == NULL ) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_batch_private * This = malloc( sizeof( rkv_batch_private ));
+   if( This == NULL ) {
+      perror( "malloc" );
+      return false;
+   }
+   This->entries          = malloc( BATCH_CAPACITY_MIN * sizeof( entry ));
+   This->index            = calloc( 2 * BATCH_CAPACITY_MIN, sizeof( uint32_t ));
+   This->count            = 0;
+   This->entries_capacity = BATCH_CAPACITY_MIN;
+   This->index_capacity   = 2 * BATCH_CAPACITY_MIN;
+   if(( This->entries == NULL )||( This->index == NULL )) {
+      perror( "malloc" );
+      free( This->entries );
+      free( This->index );
+      free( This );
+      return false;
+   }
+   *batch = (rkv_batch)This;
+   return true;
+}
+
+static size_t find_slot( const rkv_batch_private * This, uint64_t origin, uint32_t instance ) {
+   const size_t mask = This->index_capacity - 1;
+   for( size_t i = rkv_id_hash( origin, instance ) & mask;; i = ( i + 1 ) & mask ) {
+      const uint32_t rank = This->index[i];
+      if( rank == 0 ) {
+         return i;
+      }
+      const entry * e = This->entries + rank - 1;
+      if(( e->origin == origin )&&( e->instance == instance )) {
+         return i;
+      }
+   }
+}
+
+static bool grow_index( rkv_batch_private * This ) {
+   const size_t capacity = 2 * This->index_capacity;
+   uint32_t *   index    = calloc( capacity, sizeof( uint32_t ));
+   if( index == NULL ) {
+      perror( "calloc" );
+      return false;
+   }
+   free( This->index );
+   This->index          = index;
+   This->index_capacity = capacity;
+   for( size_t i = 0; i < This->count; ++i ) {
+      entry * e = This->entries + i;
+      e->slot = (uint32_t)find_slot( This, e->origin, e->instance );
+      This->index[e->slot] = (uint32_t)( i + 1 );
+   }
+   return true;
+}
+
+static bool grow_entries( rkv_batch_private * This ) {
+   const size_t capacity = 2 * This->entries_capacity;
+   entry *      entries  = realloc( This->entries, capacity * sizeof( entry ));
+   if( entries == NULL ) {
+      perror( "realloc" );
+      return false;
+   }
+   This->entries          = entries;
+   This->entries_capacity = capacity;
+   return true;
+}
+
+bool rkv_batch_put( rkv_batch batch, const rkv_data_holder * holder, rkv_data_holder * replaced, bool * has_replaced ) {
+   if(( batch == NULL )||( holder == NULL )||( holder->id == NULL )||( replaced == NULL )||( has_replaced == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_batch_private *    This     = (rkv_batch_private *)batch;
+   const rkv_id_private * key      = (const rkv_id_private *)holder->id;
+   const uint64_t         origin   = rkv_id_origin( key );
+   const uint32_t         instance = key->instance;
+   size_t                 slot     = find_slot( This, origin, instance );
+   *has_replaced = false;
+   if( This->index[slot] ) {
+      entry * e = This->entries + This->index[slot] - 1;
+      *replaced     = e->holder;
+      *has_replaced = true;
+      e->holder     = *holder;
+      return true;
+   }
+   if(( This->count + 1 ) * BATCH_LOAD_DEN > This->index_capacity * BATCH_LOAD_NUM ) {
+      if( ! grow_index( This )) {
+         return false;
+      }
+      slot = find_slot( This, origin, instance );
+   }
+   if(( This->count == This->entries_capacity )&& ! grow_entries( This )) {
+      return false;
+   }
+   entry * e = This->entries + This->count;
+   e->origin   = origin;
+   e->instance = instance;
+   e->slot     = (uint32_t)slot;
+   e->holder   = *holder;
+   This->index[slot] = (uint32_t)++This->count;
+   return true;
+}
+
+bool rkv_batch_get( rkv_batch batch, const rkv_key * key, const rkv_data_holder ** holder ) {
+   if(( batch == NULL )||( key == NULL )||( holder == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   const rkv_batch_private * This   = (const rkv_batch_private *)batch;
+   const uint64_t            origin = rkv_id_origin( key );
+   const uint32_t            rank   = This->index[find_slot( This, origin, key->instance )];
+   if( rank ) {
+      *holder = &This->entries[rank - 1].holder;
+   }
+   return rank != 0;
+}
+
+bool rkv_batch_get_size( rkv_batch batch, size_t * size ) {
+   if(( batch == NULL )||( size == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   *size = ((rkv_batch_private *)batch)->count;
+   return true;
+}
+
+bool rkv_batch_foreach( rkv_batch batch, rkv_store_iterator iterator, void * user_context ) {
+   if(( batch == NULL )||( iterator == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_batch_private * This = (rkv_batch_private *)batch;
+   for( size_t i = 0; i < This->count; ++i ) {
+      if( ! iterator( i, &This->entries[i].holder, user_context )) {
+         break;
+      }
+   }
+   return true;
+}
+
+bool rkv_batch_clear( rkv_batch batch ) {
+   if( batch == NULL ) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_batch_private * This = (rkv_batch_private *)batch;
+   for( size_t i = 0; i < This->count; ++i ) {
+      This->index[This->entries[i].slot] = 0;
+   }
+   This->count = 0;
+   return true;
+}
+
+bool rkv_batch_delete( rkv_batch * batch ) {
+   if(( batch == NULL )||( *batch == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_batch_private * This = (rkv_batch_private *)*batch;
+   free( This->entries );
+   free( This->index );
+   free( This );
+   *batch = NULL;
+   return true;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "rkv_store.h"
+
+/**
+ * Valeurs reçues en attente du prochain rafraîchissement, une seule par rkv_id : la dernière
+ * reçue remplace les précédentes. Les holders sont rangés dans un tableau dense, dans l'ordre
+ * de leur première réception, et indexés par une table de hachage à adressage ouvert.
+ *
+ * rkv_batch_clear() vide la table sans rendre sa mémoire, qui resservira au lot suivant.
+ * La table n'est pas protégée contre les accès concurrents.
+ */
+typedef struct { unsigned unused; } * rkv_batch;
+
+bool rkv_batch_new     ( rkv_batch * This );
+bool rkv_batch_put     ( rkv_batch   This, const rkv_data_holder * holder, rkv_data_holder * replaced, bool * has_replaced );
+bool rkv_batch_get     ( rkv_batch   This, const rkv_key * key, const rkv_data_holder ** holder );
+bool rkv_batch_get_size( rkv_batch   This, size_t * size );
+bool rkv_batch_foreach ( rkv_batch   This, rkv_store_iterator iterator, void * user_context );
+bool rkv_batch_clear   ( rkv_batch   This );
+bool rkv_batch_delete  ( rkv_batch * This );
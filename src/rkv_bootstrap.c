@@ -0,0 +1,194 @@
+#include "rkv_bootstrap.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+static bool send_all( int connection, const byte * bytes, size_t size ) {
+   while( size > 0 ) {
+      const ssize_t sent = send( connection, bytes, size, MSG_NOSIGNAL );
+      if( sent < 0 ) {
+         if( errno == EINTR ) {
+            continue;
+         }
+         perror( "send" );
+         return false;
+      }
+      bytes += sent;
+      size  -= (size_t)sent;
+   }
+   return true;
+}
+
+static bool receive_all( int connection, byte * bytes, size_t size ) {
+   while( size > 0 ) {
+      const ssize_t received = recv( connection, bytes, size, MSG_WAITALL );
+      if( received == 0 ) {
+         fprintf( stderr, "rkv_bootstrap: connection closed by peer\n" );
+         return false;
+      }
+      if( received < 0 ) {
+         if( errno == EINTR ) {
+            continue;
+         }
+         perror( "recv" );
+         return false;
+      }
+      bytes += received;
+      size  -= (size_t)received;
+   }
+   return true;
+}
+
+/**
+ * Écoute sur un port TCP choisi par le système, retourné dans *port.
+ */
+bool rkv_bootstrap_listen( int * listener, unsigned short * port ) {
+   if(( listener == NULL )||( port == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   struct sockaddr_in addr;
+   socklen_t          length = sizeof( addr );
+   memset( &addr, 0, sizeof( addr ));
+   addr.sin_family      = AF_INET;
+   addr.sin_port        = 0;
+   addr.sin_addr.s_addr = htonl( INADDR_ANY );
+   *listener = socket( PF_INET, SOCK_STREAM, 0 );
+   if( *listener < 0 ) {
+      perror( "socket( PF_INET, SOCK_STREAM )" );
+      return false;
+   }
+   if(   ( bind( *listener, (struct sockaddr *)&addr, sizeof( addr )) < 0 )
+      ||( listen( *listener, 4 ) < 0 )
+      ||( getsockname( *listener, (struct sockaddr *)&addr, &length ) < 0 ))
+   {
+      perror( "rkv_bootstrap_listen" );
+      close( *listener );
+      *listener = -1;
+      return false;
+   }
+   *port = ntohs( addr.sin_port );
+   return true;
+}
+
+/**
+ * Les réceptions sur la connexion échouent après timeout_ms d'inactivité du pair.
+ */
+bool rkv_bootstrap_connect( const struct sockaddr_in * peer, unsigned timeout_ms, int * connection ) {
+   if(( peer == NULL )||( connection == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   const struct timeval timeout = {
+      .tv_sec  = (time_t)( timeout_ms / 1000 ),
+      .tv_usec = (suseconds_t)(( timeout_ms % 1000 ) * 1000 )
+   };
+   *connection = socket( PF_INET, SOCK_STREAM, 0 );
+   if( *connection < 0 ) {
+      perror( "socket( PF_INET, SOCK_STREAM )" );
+      return false;
+   }
+   if(   ( setsockopt( *connection, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof( timeout )) < 0 )
+      ||( connect( *connection, (const struct sockaddr *)peer, sizeof( *peer )) < 0 ))
+   {
+      perror( "rkv_bootstrap_connect" );
+      close( *connection );
+      *connection = -1;
+      return false;
+   }
+   return true;
+}
+
+/**
+ * Les envois sur la connexion acceptée échouent quand le pair ne lit plus pendant timeout_ms :
+ * un pair arrêté ne bloque pas le serveur indéfiniment.
+ */
+bool rkv_bootstrap_accept( int listener, unsigned timeout_ms, int * connection ) {
+   if( connection == NULL ) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   const struct timeval timeout = {
+      .tv_sec  = (time_t)( timeout_ms / 1000 ),
+      .tv_usec = (suseconds_t)(( timeout_ms % 1000 ) * 1000 )
+   };
+   *connection = accept( listener, NULL, NULL );
+   if( *connection < 0 ) {
+      if( errno != EINTR ) {
+         perror( "accept" );
+      }
+      return false;
+   }
+   if( setsockopt( *connection, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof( timeout )) < 0 ) {
+      perror( "setsockopt( SOL_SOCKET, SO_SNDTIMEO )" );
+      close( *connection );
+      *connection = -1;
+      return false;
+   }
+   return true;
+}
+
+/**
+ * Envoie les octets de chunk compris entre sa position et sa limite.
+ */
+bool rkv_bootstrap_send_chunk( int connection, net_buff chunk ) {
+   if( chunk == NULL ) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   size_t position = 0;
+   size_t limit    = 0;
+   byte * bytes    = NULL;
+   if(   ! net_buff_get_position( chunk, &position )
+      || ! net_buff_get_limit   ( chunk, &limit    )
+      || ! net_buff_get_bytes   ( chunk, &bytes    ))
+   {
+      return false;
+   }
+   if( position == limit ) {
+      return true; // un bloc vide marquerait la fin
+   }
+   const uint32_t size = htonl((uint32_t)( limit - position ));
+   return send_all( connection, (const byte *)&size, sizeof( size ))
+      &&  send_all( connection, bytes + position, limit - position );
+}
+
+bool rkv_bootstrap_send_end( int connection ) {
+   const uint32_t size = 0;
+   return send_all( connection, (const byte *)&size, sizeof( size ));
+}
+
+/**
+ * Reçoit le bloc suivant dans chunk, prêt à être décodé. *last est vrai quand
+ * le pair a signalé la fin du transfert, chunk est alors vide.
+ */
+bool rkv_bootstrap_receive_chunk( int connection, net_buff chunk, bool * last ) {
+   if(( chunk == NULL )||( last == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   uint32_t size     = 0;
+   size_t   capacity = 0;
+   byte *   bytes    = NULL;
+   if(   ! receive_all( connection, (byte *)&size, sizeof( size ))
+      || ! net_buff_get_capacity( chunk, &capacity )
+      || ! net_buff_get_bytes( chunk, &bytes )
+      || ! net_buff_clear( chunk ))
+   {
+      return false;
+   }
+   size  = ntohl( size );
+   *last = ( size == 0 );
+   if( size > capacity ) {
+      fprintf( stderr, "%s: chunk of %u bytes exceeds %ld bytes\n", __func__, size, capacity );
+      return false;
+   }
+   return receive_all( connection, bytes, size )
+      &&  net_buff_set_limit( chunk, size );
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <net/net_buff.h>
+
+#include <netinet/in.h>
+
+/**
+ * Transfert de l'état initial d'un cache par une connexion TCP : une suite de blocs préfixés
+ * par leur taille sur 32 bits, un bloc vide marque la fin. Chaque bloc contient des entrées
+ * encodées comme celles d'une transaction.
+ */
+#define RKV_BOOTSTRAP_CHUNK_MAX (256*1024)
+// un pair qui ne lit plus rien pendant cette durée est abandonné par le serveur
+#define RKV_BOOTSTRAP_SEND_TIMEOUT_MS 5000
+
+bool rkv_bootstrap_listen       ( int * listener, unsigned short * port );
+bool rkv_bootstrap_connect      ( const struct sockaddr_in * peer, unsigned timeout_ms, int * connection );
+bool rkv_bootstrap_accept       ( int listener, unsigned timeout_ms, int * connection );
+bool rkv_bootstrap_send_chunk   ( int connection, net_buff chunk );
+bool rkv_bootstrap_send_end     ( int connection );
+bool rkv_bootstrap_receive_chunk( int connection, net_buff chunk, bool * last );
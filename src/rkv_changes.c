@@ -0,0 +1,122 @@
+#include "rkv_changes.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CHANGES_CAPACITY_MIN 64
+
+typedef struct {
+   rkv_change * changes;
+   size_t       count;
+   size_t       capacity;
+} rkv_changes_private;
+
+DLL_PUBLIC bool rkv_changes_new( rkv_changes * changes ) {
+   if( changes == NULL ) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_changes_private * This = calloc( 1, sizeof( rkv_changes_private ));
+   if( This == NULL ) {
+      perror( "calloc" );
+      return false;
+   }
+   *changes = (rkv_changes)This;
+   return true;
+}
+
+static bool reserve( rkv_changes_private * This, size_t count ) {
+   if( count <= This->capacity ) {
+      return true;
+   }
+   size_t capacity = This->capacity ? This->capacity : CHANGES_CAPACITY_MIN;
+   while( capacity < count ) {
+      capacity *= 2;
+   }
+   rkv_change * changes = realloc( This->changes, capacity * sizeof( rkv_change ));
+   if( changes == NULL ) {
+      perror( "realloc" );
+      return false;
+   }
+   This->changes  = changes;
+   This->capacity = capacity;
+   return true;
+}
+
+bool rkv_changes_add( rkv_changes changes, const rkv_id id, unsigned type, rkv_change_kind kind ) {
+   if(( changes == NULL )||( id == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_changes_private * This = (rkv_changes_private *)changes;
+   if( ! reserve( This, This->count + 1 )) {
+      return false;
+   }
+   This->changes[This->count].id   = id;
+   This->changes[This->count].type = type;
+   This->changes[This->count].kind = kind;
+   This->count += 1;
+   return true;
+}
+
+bool rkv_changes_append( rkv_changes changes, rkv_changes other ) {
+   if(( changes == NULL )||( other == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_changes_private *       This  = (rkv_changes_private *)changes;
+   const rkv_changes_private * added = (const rkv_changes_private *)other;
+   if( ! reserve( This, This->count + added->count )) {
+      return false;
+   }
+   if( added->count > 0 ) {
+      memcpy( This->changes + This->count, added->changes, added->count * sizeof( rkv_change ));
+   }
+   This->count += added->count;
+   return true;
+}
+
+bool rkv_changes_clear( rkv_changes changes ) {
+   if( changes == NULL ) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   ((rkv_changes_private *)changes)->count = 0;
+   return true;
+}
+
+DLL_PUBLIC bool rkv_changes_get_count( rkv_changes changes, size_t * count ) {
+   if(( changes == NULL )||( count == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   *count = ((const rkv_changes_private *)changes)->count;
+   return true;
+}
+
+DLL_PUBLIC bool rkv_changes_get( rkv_changes changes, size_t index, rkv_change * change ) {
+   if(( changes == NULL )||( change == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   const rkv_changes_private * This = (const rkv_changes_private *)changes;
+   if( index >= This->count ) {
+      fprintf( stderr, "%s: index out of range: %ld\n", __func__, index );
+      return false;
+   }
+   *change = This->changes[index];
+   return true;
+}
+
+DLL_PUBLIC bool rkv_changes_delete( rkv_changes * changes ) {
+   if(( changes == NULL )||( *changes == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_changes_private * This = (rkv_changes_private *)*changes;
+   free( This->changes );
+   free( This );
+   *changes = NULL;
+   return true;
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <rkv.h>
+
+/**
+ * Changements appliqués par un rafraîchissement, dans l'ordre de leur fusion. Le tableau
+ * double quand il est plein et garde sa mémoire d'un rafraîchissement à l'autre.
+ *
+ * La table n'est pas protégée contre les accès concurrents.
+ */
+bool rkv_changes_add   ( rkv_changes This, const rkv_id id, unsigned type, rkv_change_kind kind );
+bool rkv_changes_append( rkv_changes This, rkv_changes other );
+bool rkv_changes_clear ( rkv_changes This );
@@ -0,0 +1,317 @@
+#include "rkv_codecs.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+// un tableau dense est choisi s'il est petit, moins de DENSE_TYPE_MAX types, ou assez rempli,
+// au moins un codec pour DENSE_RATIO types
+#define DENSE_TYPE_MAX  4096
+#define DENSE_RATIO     16
+
+typedef struct {
+   unsigned          type;
+   rkv_codec_entry * entry;
+} hashed;
+
+/**
+ * entries possède les codecs, map et dense ou hashed ne font que les référencer.
+ */
+typedef struct {
+   rkv_codec_entry *  entries;
+   size_t             count;
+   utils_map          map;
+   rkv_codec_entry ** dense;
+   size_t             dense_size;
+   hashed *           hashed;
+   size_t             hashed_mask;
+} rkv_codecs_private;
+
+static int type_compare( const void * l, const void * r ) {
+   const unsigned * const * pl = (const unsigned * const *)l;
+   const unsigned * const * pr = (const unsigned * const *)r;
+   return ( **pl > **pr ) - ( **pl < **pr );
+}
+
+static inline size_t type_hash( unsigned type ) {
+   return (size_t)((uint32_t)type * 0x9E3779B1U );
+}
+
+static bool check_codec( rkv_codec_entry * entry ) {
+   const rkv_codec * codec = &entry->codec;
+   entry->plain = ( codec->encoder == NULL )&&( codec->factory == NULL );
+   if( ! entry->plain ) {
+      if(( codec->encoder == NULL )||( codec->factory == NULL )) {
+         fprintf( stderr, "%s: codec of type %u needs both an encoder and a factory\n", __func__, codec->type );
+         return false;
+      }
+      return true;
+   }
+   if( codec->payload_size == 0 ) {
+      fprintf( stderr, "%s: plain data codec of type %u has no size\n", __func__, codec->type );
+      return false;
+   }
+   for( size_t i = 0; i < codec->layout_count; ++i ) {
+      const rkv_field * field = &codec->layout[i];
+      const bool width_ok = ( field->width == 1 )||( field->width == 2 )||( field->width == 4 )||( field->width == 8 );
+      if( ! width_ok
+         ||( field->count == 0 )
+         ||( field->offset + field->width * field->count > codec->payload_size ))
+      {
+         fprintf( stderr, "%s: plain data codec of type %u, field %ld is invalid\n", __func__, codec->type, i );
+         return false;
+      }
+   }
+   return true;
+}
+
+static bool build_dense( rkv_codecs_private * This, unsigned type_max ) {
+   This->dense_size = (size_t)type_max + 1;
+   This->dense      = calloc( This->dense_size, sizeof( rkv_codec_entry * ));
+   if( This->dense == NULL ) {
+      perror( "calloc" );
+      return false;
+   }
+   for( size_t i = 0; i < This->count; ++i ) {
+      This->dense[This->entries[i].codec.type] = &This->entries[i];
+   }
+   return true;
+}
+
+static bool build_hashed( rkv_codecs_private * This ) {
+   size_t capacity = 8;
+   while( capacity < 2 * This->count ) {
+      capacity *= 2;
+   }
+   This->hashed      = calloc( capacity, sizeof( hashed ));
+   This->hashed_mask = capacity - 1;
+   if( This->hashed == NULL ) {
+      perror( "calloc" );
+      return false;
+   }
+   for( size_t i = 0; i < This->count; ++i ) {
+      const unsigned type = This->entries[i].codec.type;
+      size_t         slot = type_hash( type ) & This->hashed_mask;
+      while( This->hashed[slot].entry ) {
+         slot = ( slot + 1 ) & This->hashed_mask;
+      }
+      This->hashed[slot].type  = type;
+      This->hashed[slot].entry = &This->entries[i];
+   }
+   return true;
+}
+
+bool rkv_codecs_new(
+   rkv_codecs *            codecs,
+   const rkv_codec * const codec_array[],
+   size_t                  count,
+   size_t                  pool_slab_objects,
+   size_t                  recycle_max )
+{
+   if(( codecs == NULL )||(( codec_array == NULL )&&( count > 0 ))) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_codecs_private * This = calloc( 1, sizeof( rkv_codecs_private ));
+   if( This == NULL ) {
+      perror( "calloc" );
+      return false;
+   }
+   *codecs = (rkv_codecs)This;
+   This->entries = calloc( count ? count : 1, sizeof( rkv_codec_entry ));
+   if( This->entries == NULL ) {
+      perror( "calloc" );
+      rkv_codecs_delete( codecs );
+      return false;
+   }
+   if( ! utils_map_new( &This->map, type_compare, false, false )) {
+      rkv_codecs_delete( codecs );
+      return false;
+   }
+   unsigned type_max = 0;
+   for( size_t i = 0; i < count; ++i ) {
+      rkv_codec_entry * entry = &This->entries[i];
+      entry->codec = *codec_array[i];
+      pthread_mutex_init( &entry->recycle_lock, NULL );
+      This->count += 1;
+      if( ! check_codec( entry )) {
+         rkv_codecs_delete( codecs );
+         return false;
+      }
+      if(( recycle_max > 0 )&&( entry->codec.payload_size == 0 )) {
+         entry->recycled     = calloc( recycle_max, sizeof( void * ));
+         entry->recycled_max = recycle_max;
+         if( entry->recycled == NULL ) {
+            perror( "calloc" );
+            rkv_codecs_delete( codecs );
+            return false;
+         }
+      }
+      if(( entry->codec.payload_size > 0 )
+         && ! rkv_pool_new( &entry->payloads, entry->codec.payload_size, pool_slab_objects ))
+      {
+         rkv_codecs_delete( codecs );
+         return false;
+      }
+      rkv_codec_entry * registered = NULL;
+      if( utils_map_get( This->map, &entry->codec.type, (map_value *)&registered )) {
+         fprintf( stderr, "%s: type %u registered twice\n", __func__, entry->codec.type );
+         rkv_codecs_delete( codecs );
+         return false;
+      }
+      if( ! utils_map_put( This->map, &entry->codec.type, entry )) {
+         rkv_codecs_delete( codecs );
+         return false;
+      }
+      type_max = ( entry->codec.type > type_max ) ? entry->codec.type : type_max;
+   }
+   const bool dense = ( type_max < DENSE_TYPE_MAX )||( type_max < DENSE_RATIO * count );
+   if( ! ( dense ? build_dense( This, type_max ) : build_hashed( This ))) {
+      rkv_codecs_delete( codecs );
+      return false;
+   }
+   for( size_t i = 0; i < count; ++i ) {
+      const rkv_codec * codec = &This->entries[i].codec;
+      if( codec->binder && ! codec->binder( This->map )) {
+         fprintf( stderr, "%s: unable to bind codec of type %u\n", __func__, codec->type );
+         rkv_codecs_delete( codecs );
+         return false;
+      }
+   }
+   return true;
+}
+
+bool rkv_codecs_get( rkv_codecs codecs, unsigned type, rkv_codec_entry ** entry ) {
+   if(( codecs == NULL )||( entry == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   const rkv_codecs_private * This = (const rkv_codecs_private *)codecs;
+   if( This->dense ) {
+      *entry = ( type < This->dense_size ) ? This->dense[type] : NULL;
+      return *entry != NULL;
+   }
+   for( size_t slot = type_hash( type ) & This->hashed_mask;; slot = ( slot + 1 ) & This->hashed_mask ) {
+      const hashed * h = &This->hashed[slot];
+      if(( h->entry == NULL )||( h->type == type )) {
+         *entry = h->entry;
+         return *entry != NULL;
+      }
+   }
+}
+
+/**
+ * Retourne false si la valeur n'est pas recyclable, recyclage désactivé ou liste pleine :
+ * l'appelant la libère alors lui-même.
+ */
+bool rkv_codecs_recycle( rkv_codec_entry * entry, void * payload ) {
+   if(( entry == NULL )||( payload == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   bool recycled = false;
+   pthread_mutex_lock( &entry->recycle_lock );
+   if( entry->recycled_count < entry->recycled_max ) {
+      entry->recycled[entry->recycled_count++] = payload;
+      recycled = true;
+   }
+   pthread_mutex_unlock( &entry->recycle_lock );
+   return recycled;
+}
+
+/**
+ * *payload reste nul s'il n'y a rien à recycler.
+ */
+bool rkv_codecs_reuse( rkv_codec_entry * entry, void ** payload ) {
+   if(( entry == NULL )||( payload == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   *payload = NULL;
+   if( entry->recycled_max == 0 ) {
+      return true;
+   }
+   pthread_mutex_lock( &entry->recycle_lock );
+   if( entry->recycled_count > 0 ) {
+      *payload = entry->recycled[--entry->recycled_count];
+      entry->reused += 1;
+   }
+   pthread_mutex_unlock( &entry->recycle_lock );
+   return true;
+}
+
+bool rkv_codecs_get_map( rkv_codecs codecs, utils_map * map ) {
+   if(( codecs == NULL )||( map == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   *map = ((rkv_codecs_private *)codecs)->map;
+   return true;
+}
+
+bool rkv_codecs_get_payloads_usage( rkv_codecs codecs, size_t * in_use, size_t * allocated ) {
+   if(( codecs == NULL )||( in_use == NULL )||( allocated == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   const rkv_codecs_private * This = (const rkv_codecs_private *)codecs;
+   *in_use    = 0;
+   *allocated = 0;
+   for( size_t i = 0; i < This->count; ++i ) {
+      size_t pool_in_use    = 0;
+      size_t pool_allocated = 0;
+      if( This->entries[i].payloads && rkv_pool_get_usage( This->entries[i].payloads, &pool_in_use, &pool_allocated )) {
+         *in_use    += pool_in_use;
+         *allocated += pool_allocated;
+      }
+   }
+   return true;
+}
+
+bool rkv_codecs_get_recycling( rkv_codecs codecs, size_t * recycled, unsigned long * reused ) {
+   if(( codecs == NULL )||( recycled == NULL )||( reused == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_codecs_private * This = (rkv_codecs_private *)codecs;
+   *recycled = 0;
+   *reused   = 0;
+   for( size_t i = 0; i < This->count; ++i ) {
+      rkv_codec_entry * entry = &This->entries[i];
+      pthread_mutex_lock( &entry->recycle_lock );
+      *recycled += entry->recycled_count;
+      *reused   += entry->reused;
+      pthread_mutex_unlock( &entry->recycle_lock );
+   }
+   return true;
+}
+
+bool rkv_codecs_delete( rkv_codecs * codecs ) {
+   if(( codecs == NULL )||( *codecs == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_codecs_private * This = (rkv_codecs_private *)*codecs;
+   for( size_t i = 0; i < This->count; ++i ) {
+      rkv_codec_entry * entry = &This->entries[i];
+      if( entry->payloads ) {
+         rkv_pool_delete( &entry->payloads );
+      }
+      for( size_t j = 0; j < entry->recycled_count; ++j ) {
+         if( entry->codec.releaser ) {
+            entry->codec.releaser( entry->recycled[j], This->map );
+         }
+      }
+      free( entry->recycled );
+      pthread_mutex_destroy( &entry->recycle_lock );
+   }
+   if( This->map ) {
+      utils_map_delete( &This->map );
+   }
+   free( This->entries );
+   free( This->dense );
+   free( This->hashed );
+   free( This );
+   *codecs = NULL;
+   return true;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <rkv.h>
+
+#include "rkv_pool.h"
+
+#include <pthread.h>
+
+/**
+ * Le codec est le premier membre : les codecs imbriqués, qui cherchent leurs sous-codecs dans
+ * la table passée à leurs opérations, y voient un rkv_codec.
+ */
+typedef struct {
+   rkv_codec       codec;
+   rkv_pool        payloads; // NULL si codec.payload_size est nul
+   bool            plain;    // ni encoder ni factory, voir rkv_plain_encode() et rkv_plain_decode()
+   pthread_mutex_t recycle_lock;
+   void **         recycled; // valeurs libérées, redonnées à la factory pour y décoder sur place
+   size_t          recycled_count;
+   size_t          recycled_max;
+   unsigned long   reused;
+} rkv_codec_entry;
+
+/**
+ * Codecs d'un cache, indexés par type dans un tableau dense quand les types sont assez
+ * serrés, dans une table de hachage à adressage ouvert sinon. La utils_map des codecs
+ * n'est plus consultée que par les codecs imbriqués qui n'ont pas de binder.
+ *
+ * La table est immuable après sa construction et peut être lue par plusieurs threads.
+ *
+ * Les valeurs des types qui n'ont pas de réserve peuvent être recyclées : au lieu d'être
+ * rendues au releaser, elles sont gardées, jusqu'à recycle_max par type, et le décodage
+ * suivant d'une valeur du même type les passe à la factory dans *dest.
+ */
+typedef struct { unsigned unused; } * rkv_codecs;
+
+bool rkv_codecs_new    ( rkv_codecs * This, const rkv_codec * const codecs[], size_t count, size_t pool_slab_objects,
+                         size_t recycle_max );
+bool rkv_codecs_get    ( rkv_codecs   This, unsigned type, rkv_codec_entry ** entry );
+bool rkv_codecs_get_map( rkv_codecs   This, utils_map * map );
+bool rkv_codecs_recycle( rkv_codec_entry * entry, void * payload );
+bool rkv_codecs_reuse  ( rkv_codec_entry * entry, void ** payload );
+bool rkv_codecs_get_payloads_usage( rkv_codecs This, size_t * in_use, size_t * allocated );
+bool rkv_codecs_get_recycling( rkv_codecs This, size_t * recycled, unsigned long * reused );
+bool rkv_codecs_delete ( rkv_codecs * This );
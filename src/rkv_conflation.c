@@ -0,0 +1,177 @@
+#include "rkv_conflation.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CONFLATION_SLOTS_MIN 64
+
+typedef struct {
+   rkv_key key;
+   byte *  bytes;
+   size_t  size;
+   size_t  capacity;
+} conflated;
+
+/**
+ * slots est une table à adressage ouvert de capacité puissance de 2, remplie au plus à moitié :
+ * chaque case vaut 0 si elle est libre, sinon l'indice de l'entrée plus un. Les entrées au-delà
+ * de count, vidées, gardent leur tampon pour les clés suivantes.
+ */
+typedef struct {
+   conflated * entries;
+   size_t      count;
+   size_t      allocated;
+   size_t *    slots;
+   size_t      mask;
+} rkv_conflation_private;
+
+bool rkv_conflation_new( rkv_conflation * conflation ) {
+   if( conflation == NULL ) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_conflation_private * This = calloc( 1, sizeof( rkv_conflation_private ));
+   if( This == NULL ) {
+      perror( "calloc" );
+      return false;
+   }
+   This->slots = calloc( CONFLATION_SLOTS_MIN, sizeof( size_t ));
+   if( This->slots == NULL ) {
+      perror( "calloc" );
+      free( This );
+      return false;
+   }
+   This->mask  = CONFLATION_SLOTS_MIN - 1;
+   *conflation = (rkv_conflation)This;
+   return true;
+}
+
+static size_t * find_slot( const rkv_conflation_private * This, const rkv_key * key ) {
+   size_t i = rkv_key_hash( key ) & This->mask;
+   while( This->slots[i] && ! rkv_key_equals( &This->entries[This->slots[i] - 1].key, key )) {
+      i = ( i + 1 ) & This->mask;
+   }
+   return This->slots + i;
+}
+
+static bool grow_slots( rkv_conflation_private * This ) {
+   const size_t capacity = 2 * ( This->mask + 1 );
+   size_t *     slots    = calloc( capacity, sizeof( size_t ));
+   if( slots == NULL ) {
+      perror( "calloc" );
+      return false;
+   }
+   free( This->slots );
+   This->slots = slots;
+   This->mask  = capacity - 1;
+   for( size_t e = 0; e < This->count; ++e ) {
+      *find_slot( This, &This->entries[e].key ) = e + 1;
+   }
+   return true;
+}
+
+static bool add_entry( rkv_conflation_private * This ) {
+   if( This->count < This->allocated ) {
+      return true;
+   }
+   const size_t allocated = This->allocated ? 2 * This->allocated : CONFLATION_SLOTS_MIN / 2;
+   conflated *  entries   = realloc( This->entries, allocated * sizeof( conflated ));
+   if( entries == NULL ) {
+      perror( "realloc" );
+      return false;
+   }
+   memset( entries + This->allocated, 0, ( allocated - This->allocated ) * sizeof( conflated ));
+   This->entries   = entries;
+   This->allocated = allocated;
+   return true;
+}
+
+bool rkv_conflation_put( rkv_conflation conflation, const rkv_key * key, const byte * entry, size_t size, bool * replaced ) {
+   if(( conflation == NULL )||( key == NULL )||( entry == NULL )||( replaced == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_conflation_private * This = (rkv_conflation_private *)conflation;
+   if(( 2 *( This->count + 1 ) > This->mask + 1 )&& ! grow_slots( This )) {
+      return false;
+   }
+   size_t * slot = find_slot( This, key );
+   *replaced = ( *slot != 0 );
+   if( ! *replaced ) {
+      if( ! add_entry( This )) {
+         return false;
+      }
+      This->entries[This->count].key  = *key;
+      This->entries[This->count].size = 0;
+      This->count += 1;
+      *slot = This->count;
+   }
+   conflated * e = This->entries + *slot - 1;
+   if( size > e->capacity ) {
+      byte * bytes = realloc( e->bytes, size );
+      if( bytes == NULL ) {
+         perror( "realloc" );
+         if( ! *replaced ) { // la case vient d'être prise en bout de chaîne, elle peut être rendue
+            This->count -= 1;
+            *slot = 0;
+         }
+         return false;
+      }
+      e->bytes    = bytes;
+      e->capacity = size;
+   }
+   memcpy( e->bytes, entry, size );
+   e->size = size;
+   return true;
+}
+
+bool rkv_conflation_get_count( rkv_conflation conflation, size_t * count ) {
+   if(( conflation == NULL )||( count == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   *count = ((const rkv_conflation_private *)conflation)->count;
+   return true;
+}
+
+bool rkv_conflation_foreach( rkv_conflation conflation, rkv_conflation_iterator iterator, void * user_context ) {
+   if(( conflation == NULL )||( iterator == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   const rkv_conflation_private * This = (const rkv_conflation_private *)conflation;
+   for( size_t i = 0; i < This->count; ++i ) {
+      if( ! iterator( &This->entries[i].key, This->entries[i].bytes, This->entries[i].size, user_context )) {
+         return false;
+      }
+   }
+   return true;
+}
+
+bool rkv_conflation_clear( rkv_conflation conflation ) {
+   if( conflation == NULL ) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_conflation_private * This = (rkv_conflation_private *)conflation;
+   memset( This->slots, 0, ( This->mask + 1 ) * sizeof( size_t ));
+   This->count = 0;
+   return true;
+}
+
+bool rkv_conflation_delete( rkv_conflation * conflation ) {
+   if(( conflation == NULL )||( *conflation == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_conflation_private * This = (rkv_conflation_private *)*conflation;
+   for( size_t i = 0; i < This->allocated; ++i ) {
+      free( This->entries[i].bytes );
+   }
+   free( This->entries );
+   free( This->slots );
+   free( This );
+   *conflation = NULL;
+   return true;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <rkv_id.h>
+
+#include <net/net_buff.h>
+
+/**
+ * Dernier encodage de chaque clé écrite depuis le dernier vidage : une nouvelle écriture d'une
+ * clé remplace la précédente. Les entrées sont rangées à la suite, dans l'ordre de leur première
+ * écriture, et gardent leur tampon d'un vidage à l'autre : une fois le régime établi, rien
+ * n'est plus alloué.
+ *
+ * La table n'est pas protégée contre les accès concurrents.
+ */
+typedef struct { unsigned unused; } * rkv_conflation;
+
+typedef bool (* rkv_conflation_iterator )( const rkv_key * key, const byte * entry, size_t size, void * user_context );
+
+bool rkv_conflation_new      ( rkv_conflation * This );
+bool rkv_conflation_put      ( rkv_conflation   This, const rkv_key * key, const byte * entry, size_t size, bool * replaced );
+bool rkv_conflation_get_count( rkv_conflation   This, size_t * count );
+bool rkv_conflation_foreach  ( rkv_conflation   This, rkv_conflation_iterator iterator, void * user_context );
+bool rkv_conflation_clear    ( rkv_conflation   This );
+bool rkv_conflation_delete   ( rkv_conflation * This );
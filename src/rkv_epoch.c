@@ -0,0 +1,299 @@
+#include "rkv_epoch.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * Un enregistrement par thread lecteur, retrouvé par pthread_getspecific().
+ * Seul epoch est lu par les autres threads, l'écrivain en l'occurrence.
+ * Un enregistrement libéré par la fin de son thread est réutilisé par un autre.
+ */
+typedef struct record_s {
+   _Atomic uint64_t  epoch;   // 0 : hors section critique
+   atomic_bool       in_use;
+   unsigned          nesting;
+   void *            pinned;
+   struct record_s * next;
+} record;
+
+typedef struct garbage_s {
+   uint64_t           epoch;
+   void *             garbage;
+   rkv_epoch_reclaim  reclaim;
+   void *             user_context;
+   struct garbage_s * next;
+} garbage;
+
+typedef struct {
+   _Atomic uint64_t  global;
+   pthread_key_t     key;
+   _Atomic(record *) records;
+   pthread_mutex_t   retired_lock;
+   garbage *         oldest;
+   garbage *         newest;
+   unsigned long     retired_count;
+} rkv_epoch_private;
+
+static void on_thread_exit( void * arg ) {
+   record * r = (record *)arg;
+   r->nesting = 0;
+   r->pinned  = NULL;
+   atomic_store( &r->epoch, 0 );
+   atomic_store( &r->in_use, false );
+}
+
+static record * get_record( rkv_epoch_private * This ) {
+   record * r = pthread_getspecific( This->key );
+   if( r ) {
+      return r;
+   }
+   for( r = atomic_load( &This->records ); r; r = r->next ) {
+      bool expected = false;
+      if( atomic_compare_exchange_strong( &r->in_use, &expected, true )) {
+         break;
+      }
+   }
+   if( r == NULL ) {
+      r = malloc( sizeof( record ));
+      if( r == NULL ) {
+         perror( "malloc" );
+         return NULL;
+      }
+      memset( r, 0, sizeof( record ));
+      atomic_init( &r->epoch , 0 );
+      atomic_init( &r->in_use, true );
+      record * head = atomic_load( &This->records );
+      do {
+         r->next = head;
+      } while( ! atomic_compare_exchange_weak( &This->records, &head, r ));
+   }
+   if( pthread_setspecific( This->key, r )) {
+      perror( "pthread_setspecific" );
+      atomic_store( &r->in_use, false );
+      return NULL;
+   }
+   return r;
+}
+
+bool rkv_epoch_new( rkv_epoch * epoch ) {
+   if( epoch == NULL ) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_epoch_private * This = malloc( sizeof( rkv_epoch_private ));
+   if( This == NULL ) {
+      perror( "malloc" );
+      return false;
+   }
+   memset( This, 0, sizeof( rkv_epoch_private ));
+   atomic_init( &This->global , 1 );
+   atomic_init( &This->records, NULL );
+   if( pthread_key_create( &This->key, on_thread_exit )) {
+      perror( "pthread_key_create" );
+      free( This );
+      return false;
+   }
+   pthread_mutex_init( &This->retired_lock, NULL );
+   *epoch = (rkv_epoch)This;
+   return true;
+}
+
+/**
+ * Entre en section critique, de façon réentrante, et épingle la version publiée :
+ * le thread la conserve jusqu'à la sortie de la section critique la plus externe.
+ */
+bool rkv_epoch_enter( rkv_epoch epoch, void * _Atomic const * published, void ** pinned ) {
+   if(( epoch == NULL )||( published == NULL )||( pinned == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_epoch_private * This = (rkv_epoch_private *)epoch;
+   record *            r    = get_record( This );
+   if( r == NULL ) {
+      return false;
+   }
+   if( r->nesting++ == 0 ) {
+      atomic_store( &r->epoch, atomic_load( &This->global ));
+      r->pinned = atomic_load( published );
+   }
+   *pinned = r->pinned;
+   return true;
+}
+
+bool rkv_epoch_get_pinned( rkv_epoch epoch, void ** pinned ) {
+   if(( epoch == NULL )||( pinned == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_epoch_private * This = (rkv_epoch_private *)epoch;
+   record *            r    = pthread_getspecific( This->key );
+   if(( r == NULL )||( r->nesting == 0 )) {
+      return false;
+   }
+   *pinned = r->pinned;
+   return true;
+}
+
+bool rkv_epoch_leave( rkv_epoch epoch ) {
+   if( epoch == NULL ) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_epoch_private * This = (rkv_epoch_private *)epoch;
+   record *            r    = pthread_getspecific( This->key );
+   if(( r == NULL )||( r->nesting == 0 )) {
+      fprintf( stderr, "%s: not inside a read section\n", __func__ );
+      return false;
+   }
+   if( --r->nesting == 0 ) {
+      r->pinned = NULL;
+      atomic_store( &r->epoch, 0 );
+   }
+   return true;
+}
+
+/**
+ * À appeler après avoir publié la nouvelle version : les lecteurs qui entreront à partir
+ * de maintenant ne peuvent plus atteindre garbage, qui sera libéré par rkv_epoch_collect().
+ */
+bool rkv_epoch_retire( rkv_epoch epoch, void * garbage_, rkv_epoch_reclaim reclaim, void * user_context ) {
+   if(( epoch == NULL )||( reclaim == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_epoch_private * This = (rkv_epoch_private *)epoch;
+   garbage *           g    = malloc( sizeof( garbage ));
+   if( g == NULL ) {
+      perror( "malloc" );
+      return false;
+   }
+   g->epoch        = atomic_fetch_add( &This->global, 1 ) + 1;
+   g->garbage      = garbage_;
+   g->reclaim      = reclaim;
+   g->user_context = user_context;
+   g->next         = NULL;
+   pthread_mutex_lock( &This->retired_lock );
+   if( This->newest ) {
+      This->newest->next = g;
+   }
+   else {
+      This->oldest = g;
+   }
+   This->newest = g;
+   This->retired_count += 1;
+   pthread_mutex_unlock( &This->retired_lock );
+   return rkv_epoch_collect( epoch );
+}
+
+bool rkv_epoch_collect( rkv_epoch epoch ) {
+   if( epoch == NULL ) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_epoch_private * This   = (rkv_epoch_private *)epoch;
+   uint64_t            active = UINT64_MAX;
+   for( record * r = atomic_load( &This->records ); r; r = r->next ) {
+      const uint64_t e = atomic_load( &r->epoch );
+      if( e &&( e < active )) {
+         active = e;
+      }
+   }
+   pthread_mutex_lock( &This->retired_lock );
+   garbage * reclaimable = NULL;
+   garbage * last        = NULL;
+   while( This->oldest &&( This->oldest->epoch <= active )) {
+      garbage * g = This->oldest;
+      This->oldest = g->next;
+      g->next = NULL;
+      if( last ) {
+         last->next = g;
+      }
+      else {
+         reclaimable = g;
+      }
+      last = g;
+      This->retired_count -= 1;
+   }
+   if( This->oldest == NULL ) {
+      This->newest = NULL;
+   }
+   pthread_mutex_unlock( &This->retired_lock );
+   while( reclaimable ) {
+      garbage * g = reclaimable;
+      reclaimable = g->next;
+      g->reclaim( g->garbage, g->user_context );
+      free( g );
+   }
+   return true;
+}
+
+/**
+ * Attend que les lecteurs entrés avant l'appel soient tous sortis : plus personne ne lit ce
+ * qui a été retiré jusque-là. Un lecteur qui entre pendant l'attente ne la prolonge pas.
+ * L'appelant ne doit pas être lui-même en section critique, il s'attendrait.
+ */
+bool rkv_epoch_synchronize( rkv_epoch epoch ) {
+   if( epoch == NULL ) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_epoch_private * This = (rkv_epoch_private *)epoch;
+   const record *      self = pthread_getspecific( This->key );
+   if( self &&( self->nesting > 0 )) {
+      fprintf( stderr, "%s: inside a read section\n", __func__ );
+      return false;
+   }
+   const uint64_t target = atomic_load( &This->global );
+   for( record * r = atomic_load( &This->records ); r; r = r->next ) {
+      for( uint64_t e = atomic_load( &r->epoch ); e &&( e < target ); e = atomic_load( &r->epoch )) {
+         struct timespec pause = { 0, 50000 };
+         nanosleep( &pause, NULL );
+      }
+   }
+   return rkv_epoch_collect( epoch );
+}
+
+bool rkv_epoch_get_retired( rkv_epoch epoch, unsigned long * count ) {
+   if(( epoch == NULL )||( count == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_epoch_private * This = (rkv_epoch_private *)epoch;
+   pthread_mutex_lock( &This->retired_lock );
+   *count = This->retired_count;
+   pthread_mutex_unlock( &This->retired_lock );
+   return true;
+}
+
+/**
+ * Plus aucun lecteur ne doit être actif : tout ce qui a été retiré est libéré.
+ */
+bool rkv_epoch_delete( rkv_epoch * epoch ) {
+   if(( epoch == NULL )||( *epoch == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_epoch_private * This = *(rkv_epoch_private **)epoch;
+   pthread_key_delete( This->key );
+   while( This->oldest ) {
+      garbage * g = This->oldest;
+      This->oldest = g->next;
+      g->reclaim( g->garbage, g->user_context );
+      free( g );
+   }
+   record * r = atomic_load( &This->records );
+   while( r ) {
+      record * next = r->next;
+      free( r );
+      r = next;
+   }
+   pthread_mutex_destroy( &This->retired_lock );
+   free( This );
+   *epoch = NULL;
+   return true;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stdbool.h>
+
+/**
+ * Récupération mémoire par époques : les lecteurs ne prennent aucun verrou, ils annoncent
+ * seulement l'époque à laquelle ils sont entrés. Ce que l'écrivain retire n'est libéré
+ * qu'une fois sortis tous les lecteurs entrés avant le retrait.
+ */
+typedef struct { unsigned unused; } * rkv_epoch;
+
+typedef void (* rkv_epoch_reclaim)( void * garbage, void * user_context );
+
+bool rkv_epoch_new     ( rkv_epoch * This );
+bool rkv_epoch_enter   ( rkv_epoch   This, void * _Atomic const * published, void ** pinned );
+bool rkv_epoch_get_pinned( rkv_epoch This, void ** pinned );
+bool rkv_epoch_leave   ( rkv_epoch   This );
+bool rkv_epoch_retire  ( rkv_epoch   This, void * garbage, rkv_epoch_reclaim reclaim, void * user_context );
+bool rkv_epoch_collect ( rkv_epoch   This );
+bool rkv_epoch_synchronize( rkv_epoch This );
+bool rkv_epoch_get_retired( rkv_epoch This, unsigned long * count );
+bool rkv_epoch_delete  ( rkv_epoch * This );
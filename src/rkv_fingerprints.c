@@ -0,0 +1,192 @@
+#include "rkv_fingerprints.h"
+#include "rkv_id_private.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define FINGERPRINTS_CAPACITY_MIN  256
+// facteur de remplissage maximal : 7/10
+#define FINGERPRINTS_LOAD_NUM      7
+#define FINGERPRINTS_LOAD_DEN      10
+
+typedef struct {
+   uint64_t origin;
+   uint32_t instance;
+   uint32_t used;
+   uint64_t fingerprint;
+} entry;
+
+typedef struct {
+   entry * entries;
+   size_t  capacity; // puissance de 2
+   size_t  size;
+} rkv_fingerprints_private;
+
+static inline uint64_t mix( uint64_t h ) {
+   h ^= h >> 33;
+   h *= 0xFF51AFD7ED558CCDULL;
+   h ^= h >> 33;
+   h *= 0xC4CEB9FE1A85EC53ULL;
+   h ^= h >> 33;
+   return h;
+}
+
+/**
+ * Huit octets par tour, la fin est complétée par des zéros et la taille entre dans le hachage.
+ */
+uint64_t rkv_fingerprints_hash( const void * bytes, size_t size ) {
+   const unsigned char * p = (const unsigned char *)bytes;
+   uint64_t              h = 0x9E3779B97F4A7C15ULL ^ size;
+   size_t                i = 0;
+   for( ; i + 8 <= size; i += 8 ) {
+      uint64_t word;
+      memcpy( &word, p + i, 8 );
+      h = mix( h ^ word ) + 0x9E3779B97F4A7C15ULL;
+   }
+   if( i < size ) {
+      uint64_t word = 0;
+      memcpy( &word, p + i, size - i );
+      h = mix( h ^ word );
+   }
+   return mix( h );
+}
+
+bool rkv_fingerprints_new( rkv_fingerprints * fingerprints ) {
+   if( fingerprints == NULL ) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_fingerprints_private * This = malloc( sizeof( rkv_fingerprints_private ));
+   if( This == NULL ) {
+      perror( "malloc" );
+      return false;
+   }
+   This->entries  = calloc( FINGERPRINTS_CAPACITY_MIN, sizeof( entry ));
+   This->capacity = FINGERPRINTS_CAPACITY_MIN;
+   This->size     = 0;
+   if( This->entries == NULL ) {
+      perror( "calloc" );
+      free( This );
+      return false;
+   }
+   *fingerprints = (rkv_fingerprints)This;
+   return true;
+}
+
+static entry * find( const rkv_fingerprints_private * This, uint64_t origin, uint32_t instance ) {
+   const size_t mask = This->capacity - 1;
+   for( size_t i = rkv_id_hash( origin, instance ) & mask;; i = ( i + 1 ) & mask ) {
+      entry * e = This->entries + i;
+      if(( ! e->used )||(( e->origin == origin )&&( e->instance == instance ))) {
+         return e;
+      }
+   }
+}
+
+static bool grow( rkv_fingerprints_private * This ) {
+   entry *      previous = This->entries;
+   const size_t count    = This->capacity;
+   This->entries = calloc( 2 * count, sizeof( entry ));
+   if( This->entries == NULL ) {
+      perror( "calloc" );
+      This->entries = previous;
+      return false;
+   }
+   This->capacity = 2 * count;
+   for( size_t i = 0; i < count; ++i ) {
+      if( previous[i].used ) {
+         *find( This, previous[i].origin, previous[i].instance ) = previous[i];
+      }
+   }
+   free( previous );
+   return true;
+}
+
+bool rkv_fingerprints_get( rkv_fingerprints fingerprints, const rkv_key * key, uint64_t * fingerprint ) {
+   if(( fingerprints == NULL )||( key == NULL )||( fingerprint == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   const entry * e = find((rkv_fingerprints_private *)fingerprints, rkv_id_origin( key ), key->instance );
+   if( e->used ) {
+      *fingerprint = e->fingerprint;
+   }
+   return e->used;
+}
+
+bool rkv_fingerprints_put( rkv_fingerprints fingerprints, const rkv_key * key, uint64_t fingerprint ) {
+   if(( fingerprints == NULL )||( key == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_fingerprints_private * This   = (rkv_fingerprints_private *)fingerprints;
+   const uint64_t             origin = rkv_id_origin( key );
+   entry *                    e      = find( This, origin, key->instance );
+   if( ! e->used ) {
+      if(( This->size + 1 ) * FINGERPRINTS_LOAD_DEN > This->capacity * FINGERPRINTS_LOAD_NUM ) {
+         if( ! grow( This )) {
+            return false;
+         }
+         e = find( This, origin, key->instance );
+      }
+      e->origin   = origin;
+      e->instance = key->instance;
+      e->used     = 1;
+      This->size += 1;
+   }
+   e->fingerprint = fingerprint;
+   return true;
+}
+
+/**
+ * Les entrées suivantes de la grappe reculent dans le trou tant que leur position d'origine ne
+ * se trouve pas entre le trou et elles : aucune case n'est marquée supprimée.
+ */
+bool rkv_fingerprints_remove( rkv_fingerprints fingerprints, const rkv_key * key ) {
+   if(( fingerprints == NULL )||( key == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_fingerprints_private * This = (rkv_fingerprints_private *)fingerprints;
+   const size_t               mask = This->capacity - 1;
+   entry *                    e    = find( This, rkv_id_origin( key ), key->instance );
+   if( ! e->used ) {
+      return true;
+   }
+   size_t hole = (size_t)( e - This->entries );
+   for( size_t j = ( hole + 1 ) & mask; This->entries[j].used; j = ( j + 1 ) & mask ) {
+      const size_t home  = rkv_id_hash( This->entries[j].origin, This->entries[j].instance ) & mask;
+      const bool   stays = ( hole <= j )
+         ? (( hole < home )&&( home <= j ))
+         : (( hole < home )||( home <= j ));
+      if( ! stays ) {
+         This->entries[hole] = This->entries[j];
+         hole = j;
+      }
+   }
+   This->entries[hole].used = 0;
+   This->size -= 1;
+   return true;
+}
+
+bool rkv_fingerprints_get_size( rkv_fingerprints fingerprints, size_t * size ) {
+   if(( fingerprints == NULL )||( size == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   *size = ((rkv_fingerprints_private *)fingerprints)->size;
+   return true;
+}
+
+bool rkv_fingerprints_delete( rkv_fingerprints * fingerprints ) {
+   if(( fingerprints == NULL )||( *fingerprints == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_fingerprints_private * This = (rkv_fingerprints_private *)*fingerprints;
+   free( This->entries );
+   free( This );
+   *fingerprints = NULL;
+   return true;
+}
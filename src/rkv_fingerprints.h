@@ -0,0 +1,23 @@
+#pragma once
+
+#include <rkv_id.h>
+
+#include <stdint.h>
+
+/**
+ * Empreinte de la dernière valeur publiée de chaque clé : hachage 64 bits de son encodage
+ * complet, identifiant et type compris. Une entrée dont l'empreinte n'a pas changé n'a pas
+ * besoin d'être republiée. Une clé retirée quitte la table.
+ *
+ * La table n'est pas protégée contre les accès concurrents.
+ */
+typedef struct { unsigned unused; } * rkv_fingerprints;
+
+uint64_t rkv_fingerprints_hash( const void * bytes, size_t size );
+
+bool rkv_fingerprints_new     ( rkv_fingerprints * This );
+bool rkv_fingerprints_get     ( rkv_fingerprints   This, const rkv_key * key, uint64_t * fingerprint );
+bool rkv_fingerprints_put     ( rkv_fingerprints   This, const rkv_key * key, uint64_t fingerprint );
+bool rkv_fingerprints_remove  ( rkv_fingerprints   This, const rkv_key * key );
+bool rkv_fingerprints_get_size( rkv_fingerprints   This, size_t * size );
+bool rkv_fingerprints_delete  ( rkv_fingerprints * This );
@@ -1,19 +1,101 @@
 #include <rkv.h>
+
+#include "rkv_id_private.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-typedef struct {
-   long     host;
-   pid_t    process;
-   unsigned instance;
-} rkv_id_private;
+static atomic_uint    instance_allocator = 1;
+static pthread_once_t host_once          = PTHREAD_ONCE_INIT;
+static uint32_t       host_id            = 0;
 
-static unsigned instance_allocator = 1;
+static void init_host_id( void ) {
+   host_id = (uint32_t)gethostid();
+}
 
-bool rkv_id_new( rkv_id * id ) {
-   if( id == NULL ) {
+bool rkv_key_make( rkv_key * key ) {
+   if( key == NULL ) {
+      fprintf( stderr, "%s: NULL argument\n", __func__ );
+      return false;
+   }
+   pthread_once( &host_once, init_host_id );
+   key->host     = host_id;
+   key->process  = (uint32_t)getpid();
+   key->instance = atomic_fetch_add( &instance_allocator, 1 );
+   key->reserved = 0;
+   return true;
+}
+
+bool rkv_key_encode( const rkv_key * key, net_buff buffer ) {
+   if(( key == NULL )||( buffer == NULL )) {
+      fprintf( stderr, "%s: NULL argument\n", __func__ );
+      return false;
+   }
+   return net_buff_encode_int32 ( buffer, (int32_t)key->host )
+      &&  net_buff_encode_int32 ( buffer, (int32_t)key->process )
+      &&  net_buff_encode_uint32( buffer, key->instance );
+}
+
+bool rkv_id_decode_into( rkv_id_private * This, net_buff buffer ) {
+   int32_t  host     = 0;
+   int32_t  process  = 0;
+   uint32_t instance = 0;
+   if(   net_buff_decode_int32 ( buffer, &host     )
+      && net_buff_decode_int32 ( buffer, &process  )
+      && net_buff_decode_uint32( buffer, &instance ))
+   {
+      This->host     = (uint32_t)host;
+      This->process  = (uint32_t)process;
+      This->instance = instance;
+      This->reserved = 0;
+      return true;
+   }
+   return false;
+}
+
+bool rkv_key_decode( rkv_key * key, net_buff buffer ) {
+   if(( key == NULL )||( buffer == NULL )) {
+      fprintf( stderr, "%s: NULL argument\n", __func__ );
+      return false;
+   }
+   return rkv_id_decode_into( key, buffer );
+}
+
+bool rkv_key_to_string( const rkv_key * key, char * dest, size_t dest_size ) {
+   if(( key == NULL )||( dest == NULL )) {
+      fprintf( stderr, "%s: NULL argument\n", __func__ );
+      return false;
+   }
+   return snprintf( dest, dest_size, "%010u/%010d@%08x", key->instance, (int32_t)key->process, key->host ) > 0;
+}
+
+bool rkv_key_equals( const rkv_key * left, const rkv_key * right ) {
+   return (( rkv_id_origin( left ) ^ rkv_id_origin( right ))|( left->instance ^ right->instance )) == 0;
+}
+
+uint32_t rkv_key_hash( const rkv_key * key ) {
+   return rkv_id_hash( rkv_id_origin( key ), key->instance );
+}
+
+/**
+ * Ordre lexicographique sur (host, process, instance), sans branchement.
+ */
+int rkv_key_compare( const void * l, const void * r ) {
+   const rkv_key * left   = (const rkv_key *)l;
+   const rkv_key * right  = (const rkv_key *)r;
+   const uint64_t  lo     = rkv_id_origin( left );
+   const uint64_t  ro     = rkv_id_origin( right );
+   const int       origin = ( lo > ro ) - ( lo < ro );
+   const int       inst   = ( left->instance > right->instance ) - ( left->instance < right->instance );
+   return 2 * origin + ( origin == 0 ) * inst;
+}
+
+bool rkv_id_from_key( rkv_id * id, const rkv_key * key ) {
+   if(( id == NULL )||( key == NULL )) {
       fprintf( stderr, "%s: NULL argument\n", __func__ );
       return false;
    }
@@ -22,22 +104,32 @@ bool rkv_id_new( rkv_id * id ) {
       perror( "malloc" );
       return false;
    }
-   This->host     = gethostid();
-   This->process  = getpid();
-   This->instance = instance_allocator++;
+   *This = *key;
    *id = (rkv_id)This;
    return true;
 }
 
+bool rkv_id_new( rkv_id * id ) {
+   rkv_key key;
+   return rkv_key_make( &key )
+      &&  rkv_id_from_key( id, &key );
+}
+
+bool rkv_id_get_key( const rkv_id id, rkv_key * key ) {
+   if(( id == NULL )||( key == NULL )) {
+      fprintf( stderr, "%s: NULL argument\n", __func__ );
+      return false;
+   }
+   *key = *(const rkv_id_private *)id;
+   return true;
+}
+
 bool rkv_id_encode( const rkv_id id, net_buff buffer ) {
    if(( id == NULL )||( buffer == NULL )) {
       fprintf( stderr, "%s: NULL argument\n", __func__ );
       return false;
    }
-   rkv_id_private * This = (rkv_id_private *)id;
-   return net_buff_encode_int32 ( buffer, (int32_t)This->host )
-      &&  net_buff_encode_int32 ( buffer, This->process  )
-      &&  net_buff_encode_uint32( buffer, This->instance );
+   return rkv_key_encode((const rkv_id_private *)id, buffer );
 }
 
 bool rkv_id_decode( rkv_id * id, net_buff buffer ) {
@@ -45,22 +137,9 @@ bool rkv_id_decode( rkv_id * id, net_buff buffer ) {
       fprintf( stderr, "%s: NULL argument\n", __func__ );
       return false;
    }
-   int32_t  host     = 0;
-   int32_t  process  = 0;
-   uint32_t instance = 0;
-   if(   net_buff_decode_int32 ( buffer, &host     )
-      && net_buff_decode_int32 ( buffer, &process  )
-      && net_buff_decode_uint32( buffer, &instance ))
-   {
-      rkv_id_private * This = malloc( sizeof( rkv_id_private ));
-      memset( This, 0, sizeof( rkv_id_private ));
-      *id = (rkv_id)This;
-      This->host     = host;
-      This->process  = process;
-      This->instance = instance;
-      return true;
-   }
-   return false;
+   rkv_key key;
+   return rkv_id_decode_into( &key, buffer )
+      &&  rkv_id_from_key( id, &key );
 }
 
 bool rkv_id_to_string( const rkv_id id, char * dest, size_t dest_size ) {
@@ -68,8 +147,7 @@ bool rkv_id_to_string( const rkv_id id, char * dest, size_t dest_size ) {
       fprintf( stderr, "%s: NULL argument\n", __func__ );
       return false;
    }
-   rkv_id_private * This = (rkv_id_private *)id;
-   return snprintf( dest, dest_size, "%010u/%010d@%08lx", This->instance, This->process, This->host ) > 0;
+   return rkv_key_to_string((const rkv_id_private *)id, dest, dest_size );
 }
 
 bool rkv_id_delete( rkv_id * id ) {
@@ -83,16 +161,10 @@ bool rkv_id_delete( rkv_id * id ) {
 }
 
 int rkv_id_compare( const void * l, const void * r ) {
-   const rkv_id_private * const * pl    = (const rkv_id_private * const *)l;
-   const rkv_id_private * const * pr    = (const rkv_id_private * const *)r;
-   const rkv_id_private *         left  = *pl;
-   const rkv_id_private *         right = *pr;
-   int diff = (int)( left->host - right->host );
-   if( diff == 0 ) {
-      diff = (int)( left->process - right->process );
-      if( diff == 0 ) {
-         diff = (int)( left->instance - right->instance );
-      }
+   const rkv_id_private * const * pl = (const rkv_id_private * const *)l;
+   const rkv_id_private * const * pr = (const rkv_id_private * const *)r;
+   if( *pl == *pr ) {
+      return 0;
    }
-   return diff;
+   return rkv_key_compare( *pl, *pr );
 }
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <rkv_id.h>
+
+#include <stdint.h>
+
+/**
+ * Un rkv_id pointe sur un rkv_key.
+ */
+typedef rkv_key rkv_id_private;
+
+/**
+ * Décode un identifiant dans un emplacement fourni par l'appelant, une réserve par exemple.
+ */
+bool rkv_id_decode_into( rkv_id_private * id, net_buff buffer );
+
+/**
+ * Clé compactée sur 96 bits des tables de hachage : origin = host << 32 | process, puis instance.
+ */
+static inline uint64_t rkv_id_origin( const rkv_id_private * id ) {
+   return ((uint64_t)id->host << 32 )| id->process;
+}
+
+static inline uint32_t rkv_id_hash( uint64_t origin, uint32_t instance ) {
+   uint64_t h = origin ^ ((uint64_t)instance * 0x9E3779B97F4A7C15ULL );
+   h ^= h >> 33;
+   h *= 0xFF51AFD7ED558CCDULL;
+   h ^= h >> 33;
+   h *= 0xC4CEB9FE1A85EC53ULL;
+   h ^= h >> 33;
+   return (uint32_t)h;
+}
@@ -0,0 +1,214 @@
+#include "rkv_intern.h"
+#include "rkv_pool.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define INTERN_CAPACITY_MIN  256
+// facteur de remplissage maximal : 7/10
+#define INTERN_LOAD_NUM      7
+#define INTERN_LOAD_DEN      10
+
+/**
+ * L'identifiant est le premier membre : l'adresse de l'exemplaire est celle du rkv_id.
+ */
+typedef struct {
+   rkv_id_private id;
+   uint64_t       origin;
+   uint32_t       hash;
+   unsigned       refcount;
+} interned;
+
+/**
+ * Adressage ouvert à sondage linéaire, les suppressions décalent les suivants vers l'arrière :
+ * il n'y a pas de marque de suppression et une recherche s'arrête à la première position libre.
+ */
+typedef struct {
+   pthread_mutex_t lock;
+   rkv_pool        pool;
+   interned **     slots;
+   size_t          capacity; // puissance de 2
+   size_t          size;
+} rkv_intern_private;
+
+bool rkv_intern_new( rkv_intern * intern, size_t objects_per_slab ) {
+   if( intern == NULL ) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_intern_private * This = malloc( sizeof( rkv_intern_private ));
+   if( This == NULL ) {
+      perror( "malloc" );
+      return false;
+   }
+   This->slots    = calloc( INTERN_CAPACITY_MIN, sizeof( interned * ));
+   This->capacity = INTERN_CAPACITY_MIN;
+   This->size     = 0;
+   This->pool     = NULL;
+   if( This->slots == NULL ) {
+      perror( "calloc" );
+      free( This );
+      return false;
+   }
+   if( ! rkv_pool_new( &This->pool, sizeof( interned ), objects_per_slab )) {
+      free( This->slots );
+      free( This );
+      return false;
+   }
+   pthread_mutex_init( &This->lock, NULL );
+   *intern = (rkv_intern)This;
+   return true;
+}
+
+static size_t find_slot( const rkv_intern_private * This, uint64_t origin, uint32_t instance, uint32_t hash ) {
+   const size_t mask = This->capacity - 1;
+   for( size_t i = hash & mask;; i = ( i + 1 ) & mask ) {
+      const interned * e = This->slots[i];
+      if(( e == NULL )||(( e->origin == origin )&&( e->id.instance == instance ))) {
+         return i;
+      }
+   }
+}
+
+static bool grow( rkv_intern_private * This ) {
+   const size_t capacity = 2 * This->capacity;
+   interned **  slots    = calloc( capacity, sizeof( interned * ));
+   if( slots == NULL ) {
+      perror( "calloc" );
+      return false;
+   }
+   interned **  previous = This->slots;
+   const size_t count    = This->capacity;
+   This->slots    = slots;
+   This->capacity = capacity;
+   for( size_t i = 0; i < count; ++i ) {
+      interned * e = previous[i];
+      if( e ) {
+         This->slots[find_slot( This, e->origin, e->id.instance, e->hash )] = e;
+      }
+   }
+   free( previous );
+   return true;
+}
+
+static bool intern_key( rkv_intern_private * This, const rkv_id_private * key, rkv_id * id ) {
+   const uint64_t origin = rkv_id_origin( key );
+   const uint32_t hash   = rkv_id_hash( origin, key->instance );
+   size_t         slot   = find_slot( This, origin, key->instance, hash );
+   interned *     e      = This->slots[slot];
+   if( e ) {
+      e->refcount += 1;
+      *id = (rkv_id)e;
+      return true;
+   }
+   if(( This->size + 1 ) * INTERN_LOAD_DEN > This->capacity * INTERN_LOAD_NUM ) {
+      if( ! grow( This )) {
+         return false;
+      }
+      slot = find_slot( This, origin, key->instance, hash );
+   }
+   void * object = NULL;
+   if( ! rkv_pool_alloc( This->pool, &object )) {
+      return false;
+   }
+   e = object;
+   e->id       = *key;
+   e->origin   = origin;
+   e->hash     = hash;
+   e->refcount = 1;
+   This->slots[slot] = e;
+   This->size += 1;
+   *id = (rkv_id)e;
+   return true;
+}
+
+bool rkv_intern_decode( rkv_intern intern, net_buff buffer, rkv_id * id ) {
+   if(( intern == NULL )||( buffer == NULL )||( id == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_intern_private * This = (rkv_intern_private *)intern;
+   rkv_id_private       key;
+   if( ! rkv_id_decode_into( &key, buffer )) {
+      return false;
+   }
+   pthread_mutex_lock( &This->lock );
+   const bool ok = intern_key( This, &key, id );
+   pthread_mutex_unlock( &This->lock );
+   return ok;
+}
+
+bool rkv_intern_key( rkv_intern intern, const rkv_key * key, rkv_id * id ) {
+   if(( intern == NULL )||( key == NULL )||( id == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_intern_private * This = (rkv_intern_private *)intern;
+   pthread_mutex_lock( &This->lock );
+   const bool ok = intern_key( This, key, id );
+   pthread_mutex_unlock( &This->lock );
+   return ok;
+}
+
+/**
+ * Suppression par décalage arrière : chaque suivant de la grappe qui n'est pas à sa place
+ * idéale entre la position libérée et la sienne y est ramené.
+ */
+static void remove_slot( rkv_intern_private * This, size_t hole ) {
+   const size_t mask = This->capacity - 1;
+   This->slots[hole] = NULL;
+   for( size_t i = ( hole + 1 ) & mask; This->slots[i]; i = ( i + 1 ) & mask ) {
+      const size_t ideal = This->slots[i]->hash & mask;
+      if((( i - ideal ) & mask ) >= (( i - hole ) & mask )) {
+         This->slots[hole] = This->slots[i];
+         This->slots[i]    = NULL;
+         hole              = i;
+      }
+   }
+}
+
+bool rkv_intern_release( rkv_intern intern, const rkv_id id ) {
+   if(( intern == NULL )||( id == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_intern_private * This = (rkv_intern_private *)intern;
+   interned *           e    = (interned *)id;
+   pthread_mutex_lock( &This->lock );
+   if( --e->refcount == 0 ) {
+      remove_slot( This, find_slot( This, e->origin, e->id.instance, e->hash ));
+      This->size -= 1;
+      rkv_pool_free( This->pool, e );
+   }
+   pthread_mutex_unlock( &This->lock );
+   return true;
+}
+
+bool rkv_intern_get_usage( rkv_intern intern, size_t * in_use, size_t * allocated ) {
+   if(( intern == NULL )||( in_use == NULL )||( allocated == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_intern_private * This   = (rkv_intern_private *)intern;
+   size_t               unused = 0;
+   pthread_mutex_lock( &This->lock );
+   *in_use = This->size;
+   const bool ok = rkv_pool_get_usage( This->pool, &unused, allocated );
+   pthread_mutex_unlock( &This->lock );
+   return ok;
+}
+
+bool rkv_intern_delete( rkv_intern * intern ) {
+   if(( intern == NULL )||( *intern == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_intern_private * This = (rkv_intern_private *)*intern;
+   rkv_pool_delete( &This->pool );
+   pthread_mutex_destroy( &This->lock );
+   free( This->slots );
+   free( This );
+   *intern = NULL;
+   return true;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "rkv_id_private.h"
+
+/**
+ * Table des rkv_id reçus : un identifiant déjà connu est décodé en son exemplaire canonique,
+ * sans allocation. Chaque exemplaire est compté, il est rendu à la réserve quand le dernier
+ * holder qui le référence est libéré. Tant qu'une clé reste dans le cache, son rkv_id garde
+ * donc la même adresse d'un rafraîchissement à l'autre.
+ *
+ * Le décodage et la libération peuvent avoir lieu dans des threads différents.
+ */
+typedef struct { unsigned unused; } * rkv_intern;
+
+bool rkv_intern_new      ( rkv_intern * This, size_t objects_per_slab );
+bool rkv_intern_decode   ( rkv_intern   This, net_buff buffer, rkv_id * id );
+bool rkv_intern_key      ( rkv_intern   This, const rkv_key * key, rkv_id * id );
+bool rkv_intern_release  ( rkv_intern   This, const rkv_id id );
+bool rkv_intern_get_usage( rkv_intern   This, size_t * in_use, size_t * allocated );
+bool rkv_intern_delete   ( rkv_intern * This );
@@ -0,0 +1,555 @@
+#include "rkv_journal.h"
+#include "rkv_fingerprints.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define JOURNAL_RECORD_HEADER (4+8)
+#define JOURNAL_SUFFIX        ".rkvj"
+#define JOURNAL_PATH_MAX      4096
+#define JOURNAL_PENDING_RATIO 16   // au-delà de commit_bytes fois ce ratio en attente, la réception attend l'écriture
+
+/**
+ * Les enregistrements s'accumulent dans pending, le thread d'écriture l'échange contre writing
+ * sous lock puis l'écrit et le synchronise sans le verrou.
+ */
+typedef struct {
+   char *          directory;
+   size_t          segment_bytes;
+   size_t          retained_bytes;
+   size_t          commit_bytes;
+   unsigned        commit_ms;
+   uint64_t        first_segment;
+   uint64_t        segment;
+   int             fd;
+   size_t          segment_size;
+   byte *          pending;
+   size_t          pending_size;
+   size_t          pending_capacity;
+   unsigned long   pending_records;
+   struct timespec pending_since;
+   byte *          writing;
+   size_t          writing_capacity;
+   net_buff        header;
+   bool            stopping;
+   bool            failed;
+   unsigned long   records;
+   unsigned long   commits;
+   unsigned long   pruned;
+   pthread_mutex_t lock;
+   pthread_cond_t  appended;
+   pthread_cond_t  committed;
+   pthread_t       thread;
+} rkv_journal_private;
+
+static bool segment_number( const char * name, uint64_t * segment ) {
+   const size_t length = strlen( name );
+   const size_t suffix = sizeof( JOURNAL_SUFFIX ) - 1;
+   if(( length <= suffix )|| strcmp( name + length - suffix, JOURNAL_SUFFIX )) {
+      return false;
+   }
+   char * end = NULL;
+   *segment = strtoull( name, &end, 10 );
+   return end == name + length - suffix;
+}
+
+static void segment_path( const char * directory, uint64_t segment, char * path ) {
+   snprintf( path, JOURNAL_PATH_MAX, "%s/%016" PRIu64 JOURNAL_SUFFIX, directory, segment );
+}
+
+/**
+ * Numéros des segments de directory, par ordre croissant.
+ */
+static int segment_compare( const void * l, const void * r ) {
+   const uint64_t left  = *(const uint64_t *)l;
+   const uint64_t right = *(const uint64_t *)r;
+   return ( left < right ) ? -1 : ( left > right ) ? 1 : 0;
+}
+
+static bool list_segments( const char * directory, uint64_t ** segments, size_t * count ) {
+   DIR * dir = opendir( directory );
+   if( dir == NULL ) {
+      perror( directory );
+      return false;
+   }
+   size_t capacity = 0;
+   *segments = NULL;
+   *count    = 0;
+   for( struct dirent * e = readdir( dir ); e; e = readdir( dir )) {
+      uint64_t segment = 0;
+      if( ! segment_number( e->d_name, &segment )) {
+         continue;
+      }
+      if( *count == capacity ) {
+         capacity = capacity ? 2 * capacity : 64;
+         uint64_t * larger = realloc( *segments, capacity * sizeof( uint64_t ));
+         if( larger == NULL ) {
+            perror( "realloc" );
+            free( *segments );
+            closedir( dir );
+            return false;
+         }
+         *segments = larger;
+      }
+      (*segments)[(*count)++] = segment;
+   }
+   closedir( dir );
+   if( *count ) {
+      qsort( *segments, *count, sizeof( uint64_t ), segment_compare );
+   }
+   return true;
+}
+
+/**
+ * Le répertoire est synchronisé pour que le nouveau segment survive à un arrêt brutal.
+ */
+static bool open_segment( rkv_journal_private * This ) {
+   char path[JOURNAL_PATH_MAX];
+   segment_path( This->directory, This->segment, path );
+   This->fd = open( path, O_WRONLY|O_CREAT|O_EXCL|O_APPEND, 0644 );
+   if( This->fd < 0 ) {
+      perror( path );
+      return false;
+   }
+   This->segment_size = 0;
+   const int dir = open( This->directory, O_RDONLY );
+   if( dir >= 0 ) {
+      fsync( dir );
+      close( dir );
+   }
+   return true;
+}
+
+/**
+ * Garde les segments les plus récents tant que leur taille cumulée ne dépasse pas
+ * retained_bytes et supprime tous les autres, le segment courant excepté. Un segment déjà
+ * supprimé, par un autre journal du même répertoire, est ignoré.
+ */
+static void prune_segments( rkv_journal_private * This ) {
+   uint64_t *    segments = NULL;
+   size_t        count    = 0;
+   size_t        retained = 0;
+   bool          full     = false;
+   unsigned long pruned   = 0;
+   if( ! list_segments( This->directory, &segments, &count )) {
+      return;
+   }
+   for( size_t i = count; i > 0; --i ) {
+      char        path[JOURNAL_PATH_MAX];
+      struct stat status;
+      if( segments[i-1] >= This->segment ) {
+         continue;
+      }
+      segment_path( This->directory, segments[i-1], path );
+      if( stat( path, &status ) < 0 ) {
+         continue;
+      }
+      full = full ||( retained + (size_t)status.st_size > This->retained_bytes );
+      if( ! full ) {
+         retained += (size_t)status.st_size;
+      }
+      else if( unlink( path ) == 0 ) {
+         ++pruned;
+      }
+      else if( errno != ENOENT ) {
+         perror( path );
+      }
+   }
+   free( segments );
+   pthread_mutex_lock( &This->lock );
+   This->pruned += pruned;
+   pthread_mutex_unlock( &This->lock );
+}
+
+static bool write_all( int fd, const byte * bytes, size_t size ) {
+   while( size > 0 ) {
+      const ssize_t written = write( fd, bytes, size );
+      if( written < 0 ) {
+         if( errno == EINTR ) {
+            continue;
+         }
+         perror( "write" );
+         return false;
+      }
+      bytes += written;
+      size  -= (size_t)written;
+   }
+   return true;
+}
+
+/**
+ * Écrit le lot, le synchronise, puis change de segment si le courant est plein : un
+ * enregistrement n'est jamais coupé entre deux segments.
+ */
+static bool commit( rkv_journal_private * This, size_t size ) {
+   if(   ! write_all( This->fd, This->writing, size )
+      ||( fdatasync( This->fd ) < 0 ))
+   {
+      fprintf( stderr, "%s: unable to write journal segment %" PRIu64 "\n", __func__, This->segment );
+      return false;
+   }
+   This->segment_size += size;
+   if( This->segment_size < This->segment_bytes ) {
+      return true;
+   }
+   close( This->fd );
+   This->fd       = -1;
+   This->segment += 1;
+   if( ! open_segment( This )) {
+      return false;
+   }
+   if( This->retained_bytes ) {
+      prune_segments( This );
+   }
+   return true;
+}
+
+static bool commit_due( const rkv_journal_private * This ) {
+   struct timespec now;
+   clock_gettime( CLOCK_MONOTONIC, &now );
+   const long elapsed_ms = ( now.tv_sec - This->pending_since.tv_sec ) * 1000
+      + ( now.tv_nsec - This->pending_since.tv_nsec ) / 1000000;
+   return ( This->pending_size >= This->commit_bytes )||( elapsed_ms >= (long)This->commit_ms );
+}
+
+static void * journal_writer_thread( void * arg ) {
+   rkv_journal_private * This = (rkv_journal_private *)arg;
+   pthread_mutex_lock( &This->lock );
+   for(;;) {
+      while(( This->pending_size == 0 )&& ! This->stopping ) {
+         pthread_cond_wait( &This->appended, &This->lock );
+      }
+      if( This->pending_size == 0 ) {
+         break;
+      }
+      // regroupement : le premier enregistrement en attente attend au plus commit_ms
+      while( ! This->stopping && ! commit_due( This )) {
+         struct timespec deadline = This->pending_since;
+         deadline.tv_sec  += (time_t)( This->commit_ms / 1000 );
+         deadline.tv_nsec += (long)( This->commit_ms % 1000 ) * 1000000;
+         if( deadline.tv_nsec >= 1000000000 ) {
+            deadline.tv_sec  += 1;
+            deadline.tv_nsec -= 1000000000;
+         }
+         pthread_cond_timedwait( &This->appended, &This->lock, &deadline );
+      }
+      byte * const        written  = This->pending;
+      const size_t        size     = This->pending_size;
+      const size_t        capacity = This->pending_capacity;
+      const unsigned long records  = This->pending_records;
+      This->pending          = This->writing;
+      This->pending_capacity = This->writing_capacity;
+      This->pending_size     = 0;
+      This->pending_records  = 0;
+      This->writing          = written;
+      This->writing_capacity = capacity;
+      const bool failed = This->failed;
+      pthread_mutex_unlock( &This->lock );
+      const bool ok = ( ! failed )&& commit( This, size );
+      pthread_mutex_lock( &This->lock );
+      if( ok ) {
+         This->records += records;
+         This->commits += 1;
+      }
+      else {
+         This->failed = true;
+      }
+      pthread_cond_broadcast( &This->committed );
+   }
+   pthread_mutex_unlock( &This->lock );
+   return NULL;
+}
+
+static void journal_free( rkv_journal_private * This ) {
+   if( This->fd >= 0 ) {
+      close( This->fd );
+   }
+   if( This->header ) {
+      net_buff_delete( &This->header );
+   }
+   free( This->directory );
+   free( This->pending );
+   free( This->writing );
+   free( This );
+}
+
+/**
+ * Le premier segment écrit suit le dernier présent dans le répertoire, qui doit exister.
+ */
+bool rkv_journal_new( rkv_journal * journal, const char * directory, size_t segment_bytes, size_t retained_bytes,
+   size_t commit_bytes, unsigned commit_ms )
+{
+   if(( journal == NULL )||( directory == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   if(( segment_bytes == 0 )||( commit_bytes == 0 )) {
+      fprintf( stderr, "%s: segment and commit sizes must be positive\n", __func__ );
+      return false;
+   }
+   rkv_journal_private * This = calloc( 1, sizeof( rkv_journal_private ));
+   if( This == NULL ) {
+      perror( "calloc" );
+      return false;
+   }
+   This->fd            = -1;
+   This->segment_bytes  = segment_bytes;
+   This->retained_bytes = retained_bytes;
+   This->commit_bytes   = commit_bytes;
+   This->commit_ms      = commit_ms;
+   This->directory      = strdup( directory );
+   uint64_t * segments = NULL;
+   size_t     count    = 0;
+   if(( This->directory == NULL )|| ! net_buff_new( &This->header, JOURNAL_RECORD_HEADER )) {
+      journal_free( This );
+      return false;
+   }
+   if( ! list_segments( directory, &segments, &count )) {
+      journal_free( This );
+      return false;
+   }
+   This->first_segment = count ? segments[count-1] + 1 : 0;
+   This->segment       = This->first_segment;
+   free( segments );
+   if( ! open_segment( This )) {
+      journal_free( This );
+      return false;
+   }
+   // l'échéance du regroupement ne doit pas bouger avec l'heure du système
+   pthread_condattr_t monotonic;
+   pthread_condattr_init( &monotonic );
+   pthread_condattr_setclock( &monotonic, CLOCK_MONOTONIC );
+   pthread_mutex_init( &This->lock, NULL );
+   pthread_cond_init( &This->appended, &monotonic );
+   pthread_cond_init( &This->committed, NULL );
+   pthread_condattr_destroy( &monotonic );
+   if( pthread_create( &This->thread, NULL, journal_writer_thread, This )) {
+      perror( "pthread_create" );
+      pthread_mutex_destroy( &This->lock );
+      pthread_cond_destroy( &This->appended );
+      pthread_cond_destroy( &This->committed );
+      journal_free( This );
+      return false;
+   }
+   *journal = (rkv_journal)This;
+   return true;
+}
+
+/**
+ * Recopie l'enregistrement dans le lot en attente. L'appelant n'attend l'écriture que si
+ * le disque ne suit plus, pour borner la mémoire.
+ */
+bool rkv_journal_append( rkv_journal journal, const byte * record, size_t size ) {
+   if(( journal == NULL )||( record == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_journal_private * This = (rkv_journal_private *)journal;
+   if( size > UINT32_MAX ) {
+      fprintf( stderr, "%s: record of %ld bytes too large\n", __func__, size );
+      return false;
+   }
+   const size_t length = JOURNAL_RECORD_HEADER + size;
+   pthread_mutex_lock( &This->lock );
+   while(( This->pending_size > 0 )
+      &&( This->pending_size + length > JOURNAL_PENDING_RATIO * This->commit_bytes )
+      && ! This->failed )
+   {
+      pthread_cond_wait( &This->committed, &This->lock );
+   }
+   if( This->failed ) {
+      pthread_mutex_unlock( &This->lock );
+      return false;
+   }
+   if( This->pending_size + length > This->pending_capacity ) {
+      size_t capacity = This->pending_capacity ? This->pending_capacity : This->commit_bytes;
+      while( capacity < This->pending_size + length ) {
+         capacity *= 2;
+      }
+      byte * larger = realloc( This->pending, capacity );
+      if( larger == NULL ) {
+         perror( "realloc" );
+         pthread_mutex_unlock( &This->lock );
+         return false;
+      }
+      This->pending          = larger;
+      This->pending_capacity = capacity;
+   }
+   byte * header = NULL;
+   if(   ! net_buff_clear( This->header )
+      || ! net_buff_encode_uint32( This->header, (unsigned)size )
+      || ! net_buff_encode_uint64( This->header, rkv_fingerprints_hash( record, size ))
+      || ! net_buff_get_bytes( This->header, &header ))
+   {
+      pthread_mutex_unlock( &This->lock );
+      return false;
+   }
+   if( This->pending_size == 0 ) {
+      clock_gettime( CLOCK_MONOTONIC, &This->pending_since );
+   }
+   memcpy( This->pending + This->pending_size, header, JOURNAL_RECORD_HEADER );
+   memcpy( This->pending + This->pending_size + JOURNAL_RECORD_HEADER, record, size );
+   This->pending_size    += length;
+   This->pending_records += 1;
+   pthread_cond_signal( &This->appended );
+   pthread_mutex_unlock( &This->lock );
+   return true;
+}
+
+bool rkv_journal_get_stats( rkv_journal journal, unsigned long * records, unsigned long * commits,
+   unsigned long * pruned )
+{
+   if(( journal == NULL )||( records == NULL )||( commits == NULL )||( pruned == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_journal_private * This = (rkv_journal_private *)journal;
+   pthread_mutex_lock( &This->lock );
+   *records = This->records;
+   *commits = This->commits;
+   *pruned  = This->pruned;
+   pthread_mutex_unlock( &This->lock );
+   return true;
+}
+
+/**
+ * Un journal relu depuis son propre répertoire s'arrête aux segments que ce journal écrit.
+ */
+bool rkv_journal_get_limit( rkv_journal journal, const char * directory, uint64_t * segment ) {
+   if(( journal == NULL )||( directory == NULL )||( segment == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   const rkv_journal_private * This = (const rkv_journal_private *)journal;
+   struct stat mine;
+   struct stat other;
+   if(( stat( This->directory, &mine ) < 0 )||( stat( directory, &other ) < 0 )) {
+      perror( directory );
+      return false;
+   }
+   const bool same = ( mine.st_dev == other.st_dev )&&( mine.st_ino == other.st_ino );
+   *segment = same ? This->first_segment : UINT64_MAX;
+   return true;
+}
+
+/**
+ * Les enregistrements en attente sont écrits avant l'arrêt du thread d'écriture.
+ */
+bool rkv_journal_delete( rkv_journal * journal ) {
+   if(( journal == NULL )||( *journal == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_journal_private * This = (rkv_journal_private *)*journal;
+   pthread_mutex_lock( &This->lock );
+   This->stopping = true;
+   pthread_cond_signal( &This->appended );
+   pthread_mutex_unlock( &This->lock );
+   pthread_join( This->thread, NULL );
+   const bool ok = ! This->failed;
+   pthread_mutex_destroy( &This->lock );
+   pthread_cond_destroy( &This->appended );
+   pthread_cond_destroy( &This->committed );
+   journal_free( This );
+   *journal = NULL;
+   return ok;
+}
+
+/**
+ * Un enregistrement tronqué ou altéré termine la lecture du segment : c'est la fin d'un
+ * segment interrompu par un arrêt brutal. Un segment supprimé depuis la liste des segments
+ * l'a été par la rétention : il n'y a plus rien à lire.
+ */
+static bool read_segment( const char * path, net_buff header, rkv_journal_reader reader, void * user_context,
+   size_t * records )
+{
+   struct stat status;
+   const int   fd = open( path, O_RDONLY );
+   if(( fd < 0 )&&( errno == ENOENT )) {
+      return true;
+   }
+   if(( fd < 0 )||( fstat( fd, &status ) < 0 )) {
+      perror( path );
+      if( fd >= 0 ) {
+         close( fd );
+      }
+      return false;
+   }
+   const size_t length = (size_t)status.st_size;
+   if( length == 0 ) {
+      close( fd );
+      return true;
+   }
+   void * base = mmap( NULL, length, PROT_READ, MAP_PRIVATE, fd, 0 );
+   close( fd );
+   if( base == MAP_FAILED ) {
+      perror( path );
+      return false;
+   }
+   madvise( base, length, MADV_SEQUENTIAL );
+   const byte * bytes  = (const byte *)base;
+   size_t       offset = 0;
+   bool         ok     = true;
+   while( ok &&( offset + JOURNAL_RECORD_HEADER <= length )) {
+      unsigned size        = 0;
+      uint64_t fingerprint = 0;
+      if(   ! net_buff_clear( header )
+         || ! net_buff_encode_bytes( header, bytes + offset, JOURNAL_RECORD_HEADER )
+         || ! net_buff_flip( header )
+         || ! net_buff_decode_uint32( header, &size )
+         || ! net_buff_decode_uint64( header, &fingerprint ))
+      {
+         ok = false;
+         break;
+      }
+      const byte * record = bytes + offset + JOURNAL_RECORD_HEADER;
+      if(( size > length - offset - JOURNAL_RECORD_HEADER )||( rkv_fingerprints_hash( record, size ) != fingerprint )) {
+         break;
+      }
+      ok      = reader( record, size, user_context );
+      offset += JOURNAL_RECORD_HEADER + size;
+      *records += 1;
+   }
+   if( ok &&( offset < length )) {
+      fprintf( stderr, "%s: %s truncated after %ld bytes, %ld bytes ignored\n", __func__, path, offset, length - offset );
+   }
+   munmap( base, length );
+   return ok;
+}
+
+bool rkv_journal_read( const char * directory, uint64_t segment, rkv_journal_reader reader, void * user_context,
+   size_t * records )
+{
+   if(( directory == NULL )||( reader == NULL )||( records == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   uint64_t * segments = NULL;
+   size_t     count    = 0;
+   net_buff   header   = NULL;
+   *records = 0;
+   if( ! list_segments( directory, &segments, &count )) {
+      return false;
+   }
+   bool ok = net_buff_new( &header, JOURNAL_RECORD_HEADER );
+   for( size_t i = 0; ok &&( i < count )&&( segments[i] < segment ); ++i ) {
+      char path[JOURNAL_PATH_MAX];
+      segment_path( directory, segments[i], path );
+      ok = read_segment( path, header, reader, user_context, records );
+   }
+   if( header ) {
+      net_buff_delete( &header );
+   }
+   free( segments );
+   return ok;
+}
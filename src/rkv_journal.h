@@ -0,0 +1,32 @@
+#pragma once
+
+#include <net/net_buff.h>
+
+#include <stdint.h>
+
+/**
+ * Journal des transactions reçues, en ajout seul. Chaque enregistrement est préfixé par sa
+ * taille sur 32 bits et son empreinte sur 64 bits, qui détecte un enregistrement tronqué par
+ * un arrêt brutal. Les enregistrements sont écrits par un thread dédié qui les regroupe : un
+ * seul fdatasync() par commit_bytes ou par commit_ms, au premier atteint. Un segment plein
+ * est fermé et le suivant, numéroté à la suite, est créé dans le même répertoire. Avec
+ * retained_bytes, les segments les plus anciens sont alors supprimés au-delà de cette taille.
+ */
+typedef struct { unsigned unused; } * rkv_journal;
+
+typedef bool (* rkv_journal_reader )( const byte * record, size_t size, void * user_context );
+
+bool rkv_journal_new        ( rkv_journal * This, const char * directory, size_t segment_bytes, size_t retained_bytes,
+                              size_t commit_bytes, unsigned commit_ms );
+bool rkv_journal_append     ( rkv_journal   This, const byte * record, size_t size );
+bool rkv_journal_get_stats  ( rkv_journal   This, unsigned long * records, unsigned long * commits,
+                              unsigned long * pruned );
+bool rkv_journal_get_limit  ( rkv_journal   This, const char * directory, uint64_t * segment );
+bool rkv_journal_delete     ( rkv_journal * This );
+
+/**
+ * Lit dans l'ordre les segments de directory numérotés avant segment et passe à reader
+ * chaque enregistrement intact, jusqu'à ce qu'il retourne false.
+ */
+bool rkv_journal_read       ( const char * directory, uint64_t segment, rkv_journal_reader reader, void * user_context,
+                              size_t * records );
@@ -0,0 +1,111 @@
+#include <rkv.h>
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#  define PLAIN_SWAP false
+#else
+#  define PLAIN_SWAP true
+#endif
+
+static void swap( void * value, unsigned width ) {
+   switch( width ) {
+   case 2: { uint16_t v; memcpy( &v, value, 2 ); v = __builtin_bswap16( v ); memcpy( value, &v, 2 ); break; }
+   case 4: { uint32_t v; memcpy( &v, value, 4 ); v = __builtin_bswap32( v ); memcpy( value, &v, 4 ); break; }
+   case 8: { uint64_t v; memcpy( &v, value, 8 ); v = __builtin_bswap64( v ); memcpy( value, &v, 8 ); break; }
+   default: break;
+   }
+}
+
+static bool encode_swapped( net_buff buffer, const unsigned char * src, const rkv_field * field ) {
+   for( size_t i = 0; i < field->count; ++i ) {
+      unsigned char value[8];
+      memcpy( value, src + i * field->width, field->width );
+      swap( value, field->width );
+      if( ! net_buff_encode_bytes( buffer, value, field->width )) {
+         return false;
+      }
+   }
+   return true;
+}
+
+/**
+ * Les champs contigus sont copiés d'un bloc : pour une structure sans bourrage, l'encodage
+ * comme le décodage sont une seule copie sur un hôte little-endian.
+ */
+bool rkv_plain_encode( net_buff buffer, const void * src, const rkv_codec * codec ) {
+   if(( buffer == NULL )||( src == NULL )||( codec == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   const unsigned char * bytes = (const unsigned char *)src;
+   if( codec->layout == NULL ) {
+      return net_buff_encode_bytes( buffer, bytes, codec->payload_size );
+   }
+   size_t run_start = 0;
+   size_t run_end   = 0;
+   for( size_t i = 0; i < codec->layout_count; ++i ) {
+      const rkv_field * field = &codec->layout[i];
+      const size_t      size  = field->width * field->count;
+      if( PLAIN_SWAP &&( field->width > 1 )) {
+         if(( run_end > run_start )&& ! net_buff_encode_bytes( buffer, bytes + run_start, run_end - run_start )) {
+            return false;
+         }
+         run_start = run_end = field->offset + size;
+         if( ! encode_swapped( buffer, bytes + field->offset, field )) {
+            return false;
+         }
+         continue;
+      }
+      if( field->offset != run_end ) {
+         if(( run_end > run_start )&& ! net_buff_encode_bytes( buffer, bytes + run_start, run_end - run_start )) {
+            return false;
+         }
+         run_start = field->offset;
+      }
+      run_end = field->offset + size;
+   }
+   return ( run_end == run_start )
+      ||  net_buff_encode_bytes( buffer, bytes + run_start, run_end - run_start );
+}
+
+bool rkv_plain_decode( void * dest, net_buff buffer, const rkv_codec * codec ) {
+   if(( dest == NULL )||( buffer == NULL )||( codec == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   unsigned char * bytes = (unsigned char *)dest;
+   if( codec->layout == NULL ) {
+      return net_buff_decode_bytes( buffer, bytes, codec->payload_size );
+   }
+   size_t run_start = 0;
+   size_t run_end   = 0;
+   for( size_t i = 0; i < codec->layout_count; ++i ) {
+      const rkv_field * field = &codec->layout[i];
+      const size_t      size  = field->width * field->count;
+      if( PLAIN_SWAP &&( field->width > 1 )) {
+         if(( run_end > run_start )&& ! net_buff_decode_bytes( buffer, bytes + run_start, run_end - run_start )) {
+            return false;
+         }
+         run_start = run_end = field->offset + size;
+         if( ! net_buff_decode_bytes( buffer, bytes + field->offset, size )) {
+            return false;
+         }
+         for( size_t j = 0; j < field->count; ++j ) {
+            swap( bytes + field->offset + j * field->width, field->width );
+         }
+         continue;
+      }
+      if( field->offset != run_end ) {
+         if(( run_end > run_start )&& ! net_buff_decode_bytes( buffer, bytes + run_start, run_end - run_start )) {
+            return false;
+         }
+         run_start = field->offset;
+      }
+      run_end = field->offset + size;
+   }
+   return ( run_end == run_start )
+      ||  net_buff_decode_bytes( buffer, bytes + run_start, run_end - run_start );
+}
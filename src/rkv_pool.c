@@ -0,0 +1,143 @@
+#include "rkv_pool.h"
+
+#include <pthread.h>
+#include <stdalign.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef struct free_object_s {
+   struct free_object_s * next;
+} free_object;
+
+/**
+ * Les objets suivent l'en-tête de la dalle, alignés comme le demanderait malloc().
+ */
+typedef struct slab_s {
+   struct slab_s * next;
+   alignas( max_align_t ) unsigned char objects[];
+} slab;
+
+typedef struct {
+   pthread_mutex_t lock;
+   size_t          object_size;
+   size_t          objects_per_slab;
+   size_t          in_use;
+   size_t          allocated;
+   slab *          slabs;
+   free_object *   free_list;
+} rkv_pool_private;
+
+bool rkv_pool_new( rkv_pool * pool, size_t object_size, size_t objects_per_slab ) {
+   if( pool == NULL ) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   if(( object_size == 0 )||( objects_per_slab == 0 )) {
+      fprintf( stderr, "%s: object size and objects per slab must be positive\n", __func__ );
+      return false;
+   }
+   rkv_pool_private * This = malloc( sizeof( rkv_pool_private ));
+   if( This == NULL ) {
+      perror( "malloc" );
+      return false;
+   }
+   const size_t align = alignof( max_align_t );
+   if( object_size < sizeof( free_object )) {
+      object_size = sizeof( free_object );
+   }
+   This->object_size      = ( object_size + align - 1 ) / align * align;
+   This->objects_per_slab = objects_per_slab;
+   This->in_use           = 0;
+   This->allocated        = 0;
+   This->slabs            = NULL;
+   This->free_list        = NULL;
+   pthread_mutex_init( &This->lock, NULL );
+   *pool = (rkv_pool)This;
+   return true;
+}
+
+/**
+ * Une nouvelle dalle est découpée en objets libres, chaînés dans l'ordre des adresses.
+ */
+static bool add_slab( rkv_pool_private * This ) {
+   slab * s = malloc( sizeof( slab ) + This->objects_per_slab * This->object_size );
+   if( s == NULL ) {
+      perror( "malloc" );
+      return false;
+   }
+   s->next     = This->slabs;
+   This->slabs = s;
+   for( size_t i = This->objects_per_slab; i > 0; --i ) {
+      free_object * object = (free_object *)( s->objects + ( i - 1 ) * This->object_size );
+      object->next    = This->free_list;
+      This->free_list = object;
+   }
+   This->allocated += This->objects_per_slab;
+   return true;
+}
+
+bool rkv_pool_alloc( rkv_pool pool, void ** object ) {
+   if(( pool == NULL )||( object == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_pool_private * This = (rkv_pool_private *)pool;
+   pthread_mutex_lock( &This->lock );
+   if(( This->free_list == NULL )&& ! add_slab( This )) {
+      pthread_mutex_unlock( &This->lock );
+      return false;
+   }
+   free_object * first = This->free_list;
+   This->free_list = first->next;
+   This->in_use   += 1;
+   pthread_mutex_unlock( &This->lock );
+   *object = first;
+   return true;
+}
+
+bool rkv_pool_free( rkv_pool pool, void * object ) {
+   if(( pool == NULL )||( object == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_pool_private * This  = (rkv_pool_private *)pool;
+   free_object *      freed = (free_object *)object;
+   pthread_mutex_lock( &This->lock );
+   freed->next     = This->free_list;
+   This->free_list = freed;
+   This->in_use   -= 1;
+   pthread_mutex_unlock( &This->lock );
+   return true;
+}
+
+bool rkv_pool_get_usage( rkv_pool pool, size_t * in_use, size_t * allocated ) {
+   if(( pool == NULL )||( in_use == NULL )||( allocated == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_pool_private * This = (rkv_pool_private *)pool;
+   pthread_mutex_lock( &This->lock );
+   *in_use    = This->in_use;
+   *allocated = This->allocated;
+   pthread_mutex_unlock( &This->lock );
+   return true;
+}
+
+bool rkv_pool_delete( rkv_pool * pool ) {
+   if(( pool == NULL )||( *pool == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_pool_private * This = (rkv_pool_private *)*pool;
+   slab * s = This->slabs;
+   while( s ) {
+      slab * next = s->next;
+      free( s );
+      s = next;
+   }
+   pthread_mutex_destroy( &This->lock );
+   free( This );
+   *pool = NULL;
+   return true;
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * Réserve d'objets de taille fixe, allouée par dalles de plusieurs objets. Un objet rendu
+ * est chaîné dans la liste des objets libres et réutilisé par l'allocation suivante : en
+ * régime établi, la réception ne fait plus appel à malloc(). Les dalles ne sont rendues
+ * au système que par rkv_pool_delete().
+ *
+ * L'allocation et la restitution peuvent avoir lieu dans des threads différents.
+ */
+typedef struct { unsigned unused; } * rkv_pool;
+
+bool rkv_pool_new      ( rkv_pool * This, size_t object_size, size_t objects_per_slab );
+bool rkv_pool_alloc    ( rkv_pool   This, void ** object );
+bool rkv_pool_free     ( rkv_pool   This, void * object );
+bool rkv_pool_get_usage( rkv_pool   This, size_t * in_use, size_t * allocated );
+bool rkv_pool_delete   ( rkv_pool * This );
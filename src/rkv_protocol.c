@@ -0,0 +1,162 @@
+#include "rkv_protocol.h"
+
+#include <stdio.h>
+
+bool rkv_protocol_decode_kind( net_buff buffer, byte * kind ) {
+   if(( buffer == NULL )||( kind == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   return net_buff_decode_byte( buffer, kind );
+}
+
+bool rkv_protocol_encode_fragment_header( net_buff buffer, const rkv_fragment_header * header ) {
+   if(( buffer == NULL )||( header == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   return net_buff_encode_byte  ( buffer, RKV_DATAGRAM_FRAGMENT )
+      &&  net_buff_encode_int32 ( buffer, header->publisher.host     )
+      &&  net_buff_encode_int32 ( buffer, header->publisher.process  )
+      &&  net_buff_encode_uint32( buffer, header->publisher.instance )
+      &&  net_buff_encode_uint32( buffer, header->datagram )
+      &&  net_buff_encode_uint32( buffer, header->sequence )
+      &&  net_buff_encode_uint16( buffer, header->index    )
+      &&  net_buff_encode_uint16( buffer, header->count    )
+      &&  net_buff_encode_uint32( buffer, header->size     )
+      &&  net_buff_encode_uint32( buffer, header->offset   );
+}
+
+bool rkv_protocol_decode_fragment_header( net_buff buffer, rkv_fragment_header * header ) {
+   if(( buffer == NULL )||( header == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   return net_buff_decode_int32 ( buffer, &header->publisher.host     )
+      &&  net_buff_decode_int32 ( buffer, &header->publisher.process  )
+      &&  net_buff_decode_uint32( buffer, &header->publisher.instance )
+      &&  net_buff_decode_uint32( buffer, &header->datagram )
+      &&  net_buff_decode_uint32( buffer, &header->sequence )
+      &&  net_buff_decode_uint16( buffer, &header->index    )
+      &&  net_buff_decode_uint16( buffer, &header->count    )
+      &&  net_buff_decode_uint32( buffer, &header->size     )
+      &&  net_buff_decode_uint32( buffer, &header->offset   )
+      &&( header->count > 0 )
+      &&( header->index < header->count )
+      &&( header->offset <= header->size );
+}
+
+bool rkv_protocol_encode_nack( net_buff buffer, const rkv_nack * nack ) {
+   if(( buffer == NULL )||( nack == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   return net_buff_encode_byte  ( buffer, RKV_DATAGRAM_NACK )
+      &&  net_buff_encode_int32 ( buffer, nack->publisher.host     )
+      &&  net_buff_encode_int32 ( buffer, nack->publisher.process  )
+      &&  net_buff_encode_uint32( buffer, nack->publisher.instance )
+      &&  net_buff_encode_uint32( buffer, nack->first )
+      &&  net_buff_encode_uint16( buffer, nack->count );
+}
+
+bool rkv_protocol_decode_nack( net_buff buffer, rkv_nack * nack ) {
+   if(( buffer == NULL )||( nack == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   return net_buff_decode_int32 ( buffer, &nack->publisher.host     )
+      &&  net_buff_decode_int32 ( buffer, &nack->publisher.process  )
+      &&  net_buff_decode_uint32( buffer, &nack->publisher.instance )
+      &&  net_buff_decode_uint32( buffer, &nack->first )
+      &&  net_buff_decode_uint16( buffer, &nack->count )
+      &&( nack->count > 0 );
+}
+
+bool rkv_protocol_encode_snapshot_request( net_buff buffer, const rkv_publisher * requester ) {
+   if(( buffer == NULL )||( requester == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   return net_buff_encode_byte  ( buffer, RKV_DATAGRAM_SNAPSHOT_REQUEST )
+      &&  net_buff_encode_int32 ( buffer, requester->host     )
+      &&  net_buff_encode_int32 ( buffer, requester->process  )
+      &&  net_buff_encode_uint32( buffer, requester->instance );
+}
+
+bool rkv_protocol_decode_snapshot_request( net_buff buffer, rkv_publisher * requester ) {
+   if(( buffer == NULL )||( requester == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   return net_buff_decode_int32 ( buffer, &requester->host     )
+      &&  net_buff_decode_int32 ( buffer, &requester->process  )
+      &&  net_buff_decode_uint32( buffer, &requester->instance );
+}
+
+bool rkv_protocol_encode_snapshot_offer( net_buff buffer, const rkv_snapshot_offer * offer ) {
+   if(( buffer == NULL )||( offer == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   return net_buff_encode_byte  ( buffer, RKV_DATAGRAM_SNAPSHOT_OFFER )
+      &&  net_buff_encode_int32 ( buffer, offer->requester.host     )
+      &&  net_buff_encode_int32 ( buffer, offer->requester.process  )
+      &&  net_buff_encode_uint32( buffer, offer->requester.instance )
+      &&  net_buff_encode_uint16( buffer, offer->port );
+}
+
+bool rkv_protocol_decode_snapshot_offer( net_buff buffer, rkv_snapshot_offer * offer ) {
+   if(( buffer == NULL )||( offer == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   return net_buff_decode_int32 ( buffer, &offer->requester.host     )
+      &&  net_buff_decode_int32 ( buffer, &offer->requester.process  )
+      &&  net_buff_decode_uint32( buffer, &offer->requester.instance )
+      &&  net_buff_decode_uint16( buffer, &offer->port )
+      &&( offer->port != 0 );
+}
+
+static bool encode_heartbeat( net_buff buffer, byte kind, const rkv_heartbeat * heartbeat ) {
+   return net_buff_encode_byte  ( buffer, kind )
+      &&  net_buff_encode_int32 ( buffer, heartbeat->publisher.host     )
+      &&  net_buff_encode_int32 ( buffer, heartbeat->publisher.process  )
+      &&  net_buff_encode_uint32( buffer, heartbeat->publisher.instance )
+      &&  net_buff_encode_uint32( buffer, heartbeat->last );
+}
+
+bool rkv_protocol_encode_heartbeat( net_buff buffer, const rkv_heartbeat * heartbeat ) {
+   if(( buffer == NULL )||( heartbeat == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   return encode_heartbeat( buffer, RKV_DATAGRAM_HEARTBEAT, heartbeat );
+}
+
+bool rkv_protocol_encode_tail( net_buff buffer, const rkv_heartbeat * tail ) {
+   if(( buffer == NULL )||( tail == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   return encode_heartbeat( buffer, RKV_DATAGRAM_TAIL, tail );
+}
+
+/**
+ * Décode un battement de cœur comme une annonce de fin de rafale, leur contenu est le même.
+ */
+bool rkv_protocol_decode_heartbeat( net_buff buffer, rkv_heartbeat * heartbeat ) {
+   if(( buffer == NULL )||( heartbeat == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   return net_buff_decode_int32 ( buffer, &heartbeat->publisher.host     )
+      &&  net_buff_decode_int32 ( buffer, &heartbeat->publisher.process  )
+      &&  net_buff_decode_uint32( buffer, &heartbeat->publisher.instance )
+      &&  net_buff_decode_uint32( buffer, &heartbeat->last );
+}
+
+bool rkv_protocol_same_publisher( const rkv_publisher * left, const rkv_publisher * right ) {
+   return ( left->host     == right->host     )
+      &&  ( left->process  == right->process  )
+      &&  ( left->instance == right->instance );
+}
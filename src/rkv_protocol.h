@@ -0,0 +1,106 @@
+#pragma once
+
+#include <net/net_buff.h>
+
+#include <stdint.h>
+
+// IPv4 (20) + UDP (8)
+#define RKV_IP_UDP_OVERHEAD           28
+#define RKV_MTU_MIN                   576
+#define RKV_FRAGMENT_HEADER_SIZE      (1+4+4+4+4+4+2+2+4+4)
+#define RKV_NACK_SIZE                 (1+4+4+4+4+2)
+#define RKV_SNAPSHOT_OFFER_SIZE       (1+4+4+4+2)
+#define RKV_HEARTBEAT_SIZE            (1+4+4+4+4)
+#define RKV_TAIL_SIZE                 RKV_HEARTBEAT_SIZE
+// taille du tampon des datagrammes de contrôle, le plus grand d'entre eux
+#define RKV_CONTROL_SIZE_MAX          RKV_NACK_SIZE
+
+_Static_assert( RKV_NACK_SIZE           <= RKV_CONTROL_SIZE_MAX, "NACK larger than the control buffer" );
+_Static_assert( RKV_SNAPSHOT_OFFER_SIZE <= RKV_CONTROL_SIZE_MAX, "snapshot offer larger than the control buffer" );
+_Static_assert( RKV_HEARTBEAT_SIZE      <= RKV_CONTROL_SIZE_MAX, "heartbeat larger than the control buffer" );
+_Static_assert( RKV_TAIL_SIZE           <= RKV_CONTROL_SIZE_MAX, "tail larger than the control buffer" );
+
+// premier octet de chaque datagramme
+#define RKV_DATAGRAM_FRAGMENT         1
+#define RKV_DATAGRAM_NACK             2
+#define RKV_DATAGRAM_SNAPSHOT_REQUEST 3
+#define RKV_DATAGRAM_SNAPSHOT_OFFER   4
+#define RKV_DATAGRAM_HEARTBEAT        5
+#define RKV_DATAGRAM_TAIL             6
+
+// type réservé de l'entrée, sans valeur, qui retire sa clé : voir rkv_remove()
+#define RKV_TOMBSTONE_TYPE            0xFFFFFFFFU
+// types réservés des marques d'expiration que le récepteur range lui-même dans sa réception,
+// jamais émises : la clé a dépassé la durée de vie de son type, son origine est morte
+#define RKV_EXPIRED_TYPE              0xFFFFFFFEU
+#define RKV_ORPHANED_TYPE             0xFFFFFFFDU
+// premier type réservé
+#define RKV_RESERVED_TYPES            0xFFFFFFF0U
+
+/**
+ * Identité de l'émetteur d'une transaction, même encodage qu'un rkv_id.
+ */
+typedef struct {
+   int32_t  host;
+   int32_t  process;
+   uint32_t instance;
+} rkv_publisher;
+
+/**
+ * En-tête de chaque datagramme : une transaction est découpée en fragments
+ * qui tiennent dans la MTU, le récepteur la réassemble avant de la décoder.
+ */
+typedef struct {
+   rkv_publisher publisher;
+   uint32_t      datagram;       // numéro de datagramme propre à l'émetteur, révèle les pertes
+   uint32_t      sequence;       // numéro de transaction propre à l'émetteur
+   uint16_t      index;          // rang du fragment, de 0 à count-1
+   uint16_t      count;          // nombre de fragments de la transaction
+   uint32_t      size;           // taille totale de la transaction, en octets
+   uint32_t      offset;         // position du fragment dans la transaction
+} rkv_fragment_header;
+
+/**
+ * Demande de réémission adressée par un récepteur à l'émetteur d'un datagramme :
+ * les datagrammes first à first+count-1 de publisher ne sont pas arrivés.
+ */
+typedef struct {
+   rkv_publisher publisher;
+   uint32_t      first;
+   uint16_t      count;
+} rkv_nack;
+
+/**
+ * Réponse d'un pair à la demande d'état initial de requester : il l'attend sur ce port TCP.
+ */
+typedef struct {
+   rkv_publisher  requester;
+   unsigned short port;
+} rkv_snapshot_offer;
+
+/**
+ * Battement de cœur, ou annonce de fin de rafale : last est le numéro du dernier datagramme
+ * émis par publisher, 0 avant le premier. Un récepteur qui ne l'a pas reçu le réclame, alors
+ * qu'aucun datagramme suivant ne révèle sa perte. Seul le battement de cœur atteste que
+ * l'émetteur est vivant.
+ */
+typedef struct {
+   rkv_publisher publisher;
+   uint32_t      last;
+} rkv_heartbeat;
+
+// Les fonctions d'encodage écrivent le type du datagramme, celles de décodage le supposent
+// déjà lu par rkv_protocol_decode_kind().
+bool rkv_protocol_decode_kind           ( net_buff buffer, byte * kind );
+bool rkv_protocol_encode_fragment_header( net_buff buffer, const rkv_fragment_header * header );
+bool rkv_protocol_decode_fragment_header( net_buff buffer, rkv_fragment_header * header );
+bool rkv_protocol_encode_nack           ( net_buff buffer, const rkv_nack * nack );
+bool rkv_protocol_decode_nack           ( net_buff buffer, rkv_nack * nack );
+bool rkv_protocol_encode_snapshot_request( net_buff buffer, const rkv_publisher * requester );
+bool rkv_protocol_decode_snapshot_request( net_buff buffer, rkv_publisher * requester );
+bool rkv_protocol_encode_snapshot_offer ( net_buff buffer, const rkv_snapshot_offer * offer );
+bool rkv_protocol_decode_snapshot_offer ( net_buff buffer, rkv_snapshot_offer * offer );
+bool rkv_protocol_encode_heartbeat      ( net_buff buffer, const rkv_heartbeat * heartbeat );
+bool rkv_protocol_encode_tail           ( net_buff buffer, const rkv_heartbeat * tail );
+bool rkv_protocol_decode_heartbeat      ( net_buff buffer, rkv_heartbeat * heartbeat );
+bool rkv_protocol_same_publisher        ( const rkv_publisher * left, const rkv_publisher * right );
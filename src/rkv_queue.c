@@ -0,0 +1,144 @@
+#include "rkv_queue.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+typedef struct {
+   atomic_size_t sequence;
+   void *        item;
+} cell;
+
+/**
+ * La case d'indice i est libre pour le tour de position p quand sa séquence vaut p, pleine
+ * quand elle vaut p + 1. Le consommateur la libère pour le tour suivant avec p + capacity.
+ */
+typedef struct {
+   cell *        cells;
+   size_t        mask;
+   atomic_size_t push_position;
+   atomic_size_t pop_position;
+   sem_t         free_cells;
+   sem_t         full_cells;
+} rkv_queue_private;
+
+/**
+ * La capacité est arrondie à la puissance de deux supérieure.
+ */
+bool rkv_queue_new( rkv_queue * queue, size_t capacity ) {
+   if( queue == NULL ) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   size_t size = 1;
+   while( size < capacity ) {
+      size *= 2;
+   }
+   if( size > SEM_VALUE_MAX ) {
+      fprintf( stderr, "%s: capacity too large: %ld\n", __func__, capacity );
+      return false;
+   }
+   rkv_queue_private * This = calloc( 1, sizeof( rkv_queue_private ));
+   if( This == NULL ) {
+      perror( "calloc" );
+      return false;
+   }
+   This->cells = calloc( size, sizeof( cell ));
+   if( This->cells == NULL ) {
+      perror( "calloc" );
+      free( This );
+      return false;
+   }
+   This->mask = size - 1;
+   for( size_t i = 0; i < size; ++i ) {
+      atomic_init( &This->cells[i].sequence, i );
+   }
+   atomic_init( &This->push_position, 0 );
+   atomic_init( &This->pop_position, 0 );
+   sem_init( &This->free_cells, 0, (unsigned)size );
+   sem_init( &This->full_cells, 0, 0 );
+   *queue = (rkv_queue)This;
+   return true;
+}
+
+static void wait_for( sem_t * semaphore ) {
+   while(( sem_wait( semaphore ) < 0 )&&( errno == EINTR )) {
+   }
+}
+
+/**
+ * Attend une case libre. Le sémaphore la garantit, mais un consommateur peut ne pas avoir
+ * encore fini de la vider : la boucle le laisse terminer.
+ */
+bool rkv_queue_push( rkv_queue queue, void * item ) {
+   if( queue == NULL ) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_queue_private * This = (rkv_queue_private *)queue;
+   wait_for( &This->free_cells );
+   size_t position = atomic_load_explicit( &This->push_position, memory_order_relaxed );
+   for(;;) {
+      cell *       c        = This->cells + ( position & This->mask );
+      const size_t sequence = atomic_load_explicit( &c->sequence, memory_order_acquire );
+      if( sequence == position ) {
+         if( atomic_compare_exchange_weak_explicit( &This->push_position, &position, position + 1,
+            memory_order_relaxed, memory_order_relaxed ))
+         {
+            c->item = item;
+            atomic_store_explicit( &c->sequence, position + 1, memory_order_release );
+            break;
+         }
+      }
+      else {
+         position = atomic_load_explicit( &This->push_position, memory_order_relaxed );
+      }
+   }
+   sem_post( &This->full_cells );
+   return true;
+}
+
+bool rkv_queue_pop( rkv_queue queue, void ** item ) {
+   if(( queue == NULL )||( item == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_queue_private * This = (rkv_queue_private *)queue;
+   wait_for( &This->full_cells );
+   size_t position = atomic_load_explicit( &This->pop_position, memory_order_relaxed );
+   for(;;) {
+      cell *       c        = This->cells + ( position & This->mask );
+      const size_t sequence = atomic_load_explicit( &c->sequence, memory_order_acquire );
+      if( sequence == position + 1 ) {
+         if( atomic_compare_exchange_weak_explicit( &This->pop_position, &position, position + 1,
+            memory_order_relaxed, memory_order_relaxed ))
+         {
+            *item = c->item;
+            atomic_store_explicit( &c->sequence, position + This->mask + 1, memory_order_release );
+            break;
+         }
+      }
+      else {
+         position = atomic_load_explicit( &This->pop_position, memory_order_relaxed );
+      }
+   }
+   sem_post( &This->free_cells );
+   return true;
+}
+
+bool rkv_queue_delete( rkv_queue * queue ) {
+   if(( queue == NULL )||( *queue == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_queue_private * This = (rkv_queue_private *)*queue;
+   sem_destroy( &This->free_cells );
+   sem_destroy( &This->full_cells );
+   free( This->cells );
+   free( This );
+   *queue = NULL;
+   return true;
+}
@@ -0,0 +1,17 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * File bornée de pointeurs, sans verrou, à plusieurs producteurs et plusieurs consommateurs :
+ * chaque case porte un numéro de séquence qui dit si elle est libre ou pleine pour le tour
+ * courant. Deux sémaphores comptent les cases libres et pleines, pour que push() et pop()
+ * attendent sans consommer de processeur quand la file est pleine ou vide.
+ */
+typedef struct { unsigned unused; } * rkv_queue;
+
+bool rkv_queue_new   ( rkv_queue * This, size_t capacity );
+bool rkv_queue_push  ( rkv_queue   This, void * item );
+bool rkv_queue_pop   ( rkv_queue   This, void ** item );
+bool rkv_queue_delete( rkv_queue * This );
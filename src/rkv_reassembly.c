@@ -0,0 +1,243 @@
+#include "rkv_reassembly.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * Transaction dont tous les fragments ne sont pas encore arrivés.
+ */
+typedef struct partial_s {
+   rkv_publisher      publisher;
+   uint32_t           sequence;
+   uint16_t           count;
+   uint16_t           missing;
+   uint32_t           size;
+   net_buff           data;
+   uint8_t *          received;
+   uint64_t           first_ms;
+   struct partial_s * next;
+} partial;
+
+/**
+ * Les transactions partielles sont chaînées par ordre d'arrivée de leur premier fragment :
+ * la plus ancienne est la première à expirer ou à être évincée quand la mémoire est comptée.
+ */
+typedef struct {
+   size_t    bytes_max;
+   size_t    bytes;
+   size_t    count;
+   unsigned  timeout_ms;
+   partial * oldest;
+   partial * newest;
+} rkv_reassembly_private;
+
+static uint64_t now_ms( void ) {
+   struct timespec ts;
+   clock_gettime( CLOCK_MONOTONIC, &ts );
+   return (uint64_t)ts.tv_sec * 1000U + (uint64_t)ts.tv_nsec / 1000000U;
+}
+
+static void partial_delete( rkv_reassembly_private * This, partial * p ) {
+   This->bytes -= p->size;
+   This->count -= 1;
+   net_buff_delete( &p->data );
+   free( p->received );
+   free( p );
+}
+
+static void drop_oldest( rkv_reassembly_private * This, const char * reason ) {
+   partial * p = This->oldest;
+   fprintf( stderr, "rkv_reassembly: transaction %u from %08x/%d/%u %s, %u/%u fragments missing\n",
+      p->sequence, p->publisher.host, p->publisher.process, p->publisher.instance, reason, p->missing, p->count );
+   This->oldest = p->next;
+   if( This->oldest == NULL ) {
+      This->newest = NULL;
+   }
+   partial_delete( This, p );
+}
+
+static void unlink_partial( rkv_reassembly_private * This, partial * p ) {
+   partial * prev = NULL;
+   for( partial * iter = This->oldest; iter; prev = iter, iter = iter->next ) {
+      if( iter == p ) {
+         if( prev ) {
+            prev->next = p->next;
+         }
+         else {
+            This->oldest = p->next;
+         }
+         if( This->newest == p ) {
+            This->newest = prev;
+         }
+         return;
+      }
+   }
+}
+
+static partial * partial_find( rkv_reassembly_private * This, const rkv_fragment_header * header ) {
+   for( partial * p = This->oldest; p; p = p->next ) {
+      if(( p->sequence == header->sequence )&& rkv_protocol_same_publisher( &p->publisher, &header->publisher )) {
+         return p;
+      }
+   }
+   return NULL;
+}
+
+static partial * partial_new( rkv_reassembly_private * This, const rkv_fragment_header * header ) {
+   if( header->size > This->bytes_max ) {
+      fprintf( stderr, "rkv_reassembly: transaction %u of %u bytes exceeds reassembly memory of %ld bytes, ignored\n",
+         header->sequence, header->size, This->bytes_max );
+      return NULL;
+   }
+   while( This->oldest &&( This->bytes + header->size > This->bytes_max )) {
+      drop_oldest( This, "evicted" );
+   }
+   partial * p = malloc( sizeof( partial ));
+   if( p == NULL ) {
+      perror( "malloc" );
+      return NULL;
+   }
+   memset( p, 0, sizeof( partial ));
+   p->received = calloc(( header->count + 7U ) / 8U, 1 );
+   if(( p->received == NULL )|| ! net_buff_new( &p->data, header->size )) {
+      free( p->received );
+      free( p );
+      return NULL;
+   }
+   p->publisher = header->publisher;
+   p->sequence  = header->sequence;
+   p->count     = header->count;
+   p->missing   = header->count;
+   p->size      = header->size;
+   p->first_ms  = now_ms();
+   if( This->newest ) {
+      This->newest->next = p;
+   }
+   else {
+      This->oldest = p;
+   }
+   This->newest = p;
+   This->bytes += p->size;
+   This->count += 1;
+   return p;
+}
+
+bool rkv_reassembly_new( rkv_reassembly * reassembly, size_t bytes_max, unsigned timeout_ms ) {
+   if( reassembly == NULL ) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_reassembly_private * This = malloc( sizeof( rkv_reassembly_private ));
+   if( This == NULL ) {
+      perror( "malloc" );
+      return false;
+   }
+   memset( This, 0, sizeof( rkv_reassembly_private ));
+   This->bytes_max  = bytes_max;
+   This->timeout_ms = timeout_ms;
+   *reassembly = (rkv_reassembly)This;
+   return true;
+}
+
+/**
+ * Copie le fragment à sa place dans la transaction. Quand c'est le dernier fragment manquant,
+ * la transaction complète est retournée, prête à être décodée, dans *transaction. L'appelant
+ * en devient propriétaire et doit la libérer par net_buff_delete().
+ */
+bool rkv_reassembly_add( rkv_reassembly reassembly, const rkv_fragment_header * header, net_buff fragment, net_buff * transaction ) {
+   if(( reassembly == NULL )||( header == NULL )||( fragment == NULL )||( transaction == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_reassembly_private * This = (rkv_reassembly_private *)reassembly;
+   *transaction = NULL;
+   size_t position = 0;
+   size_t limit    = 0;
+   byte * src      = NULL;
+   byte * dest     = NULL;
+   if(   ! net_buff_get_position( fragment, &position )
+      || ! net_buff_get_limit   ( fragment, &limit    )
+      || ! net_buff_get_bytes   ( fragment, &src      ))
+   {
+      return false;
+   }
+   const size_t length = limit - position;
+   if( header->offset + length > header->size ) {
+      fprintf( stderr, "%s: fragment %u/%u of transaction %u overflows its %u bytes\n", __func__,
+         header->index, header->count, header->sequence, header->size );
+      return false;
+   }
+   partial * p = partial_find( This, header );
+   if( p == NULL ) {
+      p = partial_new( This, header );
+      if( p == NULL ) {
+         return false;
+      }
+   }
+   else if(( p->count != header->count )||( p->size != header->size )) {
+      fprintf( stderr, "%s: fragment %u/%u of transaction %u is inconsistent with previous ones\n", __func__,
+         header->index, header->count, header->sequence );
+      return false;
+   }
+   const uint8_t bit = (uint8_t)( 1U << ( header->index % 8U ));
+   if( p->received[header->index / 8U] & bit ) {
+      return true; // doublon
+   }
+   if( ! net_buff_get_bytes( p->data, &dest )) {
+      return false;
+   }
+   memcpy( dest + header->offset, src + position, length );
+   p->received[header->index / 8U] |= bit;
+   p->missing -= 1;
+   if( p->missing == 0 ) {
+      unlink_partial( This, p );
+      if( net_buff_clear( p->data )&& net_buff_set_limit( p->data, p->size )) {
+         *transaction = p->data;
+         p->data = NULL;
+      }
+      partial_delete( This, p );
+   }
+   return true;
+}
+
+bool rkv_reassembly_expire( rkv_reassembly reassembly ) {
+   if( reassembly == NULL ) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_reassembly_private * This = (rkv_reassembly_private *)reassembly;
+   const uint64_t now = now_ms();
+   while( This->oldest &&(( now - This->oldest->first_ms ) > This->timeout_ms )) {
+      drop_oldest( This, "timed out" );
+   }
+   return true;
+}
+
+bool rkv_reassembly_get_pending( rkv_reassembly reassembly, size_t * count, size_t * bytes ) {
+   if(( reassembly == NULL )||( count == NULL )||( bytes == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_reassembly_private * This = (rkv_reassembly_private *)reassembly;
+   *count = This->count;
+   *bytes = This->bytes;
+   return true;
+}
+
+bool rkv_reassembly_delete( rkv_reassembly * reassembly ) {
+   if(( reassembly == NULL )||( *reassembly == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_reassembly_private * This = *(rkv_reassembly_private **)reassembly;
+   while( This->oldest ) {
+      partial * p = This->oldest;
+      This->oldest = p->next;
+      partial_delete( This, p );
+   }
+   free( This );
+   *reassembly = NULL;
+   return true;
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include "rkv_protocol.h"
+
+typedef struct { unsigned unused; } * rkv_reassembly;
+
+bool rkv_reassembly_new   ( rkv_reassembly * This, size_t bytes_max, unsigned timeout_ms );
+bool rkv_reassembly_add   ( rkv_reassembly   This, const rkv_fragment_header * header, net_buff fragment, net_buff * transaction );
+bool rkv_reassembly_expire( rkv_reassembly   This );
+bool rkv_reassembly_get_pending( rkv_reassembly This, size_t * count, size_t * bytes );
+bool rkv_reassembly_delete( rkv_reassembly * This );
@@ -0,0 +1,427 @@
+#include "rkv_sequencer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// au-delà, l'émetteur est supposé avoir redémarré : inutile de réclamer ce qui manque
+#define SEQUENCER_GAP_MAX 65536
+
+/**
+ * Datagramme arrivé avant ceux qui le précèdent, copié en attendant qu'ils arrivent.
+ */
+typedef struct held_s {
+   uint32_t        datagram;
+   size_t          size;
+   net_buff        data;
+   struct held_s * next;
+} held;
+
+/**
+ * État de la réception des datagrammes d'un émetteur : expected est le prochain numéro à livrer,
+ * held les datagrammes mis de côté, par numéros croissants, tous supérieurs à expected.
+ * announced suit le dernier numéro annoncé par l'émetteur, voir rkv_sequencer_announce() :
+ * quand rien n'est mis de côté, les datagrammes de expected à announced-1 manquent.
+ */
+typedef struct source_s {
+   rkv_publisher      publisher;
+   struct sockaddr_in address;
+   uint32_t           expected;
+   uint32_t           announced;
+   held *             held;
+   uint64_t           gap_ms;  // détection du trou qui précède held, ou announced
+   uint64_t           nack_ms; // dernière demande de réémission
+   struct source_s *  next;
+} source;
+
+/**
+ * Livre dans l'ordre de leur émission les datagrammes de chaque émetteur. Un datagramme en
+ * avance est mis de côté et les manquants sont réclamés à l'émetteur, puis de nouveau toutes
+ * les timeout_ms/4 ms. Une perte en fin de rafale n'est révélée que par l'annonce du dernier
+ * numéro émis, voir rkv_sequencer_announce(). Un trou qui persiste au-delà de timeout_ms, ou qui ferait dépasser
+ * bytes_max aux datagrammes mis de côté, est abandonné : ses datagrammes sont comptés perdus.
+ */
+typedef struct {
+   size_t          bytes_max;
+   size_t          bytes;
+   size_t          held_count;
+   unsigned        timeout_ms;
+   rkv_nack_sender sender;
+   void *          user_context;
+   unsigned long   nacks;
+   unsigned long   lost;
+   source *        sources;
+} rkv_sequencer_private;
+
+static uint64_t now_ms( void ) {
+   struct timespec ts;
+   clock_gettime( CLOCK_MONOTONIC, &ts );
+   return (uint64_t)ts.tv_sec * 1000U + (uint64_t)ts.tv_nsec / 1000000U;
+}
+
+// différence de numéros de datagrammes, correcte au rebouclage près
+static inline int32_t distance( uint32_t from, uint32_t to ) {
+   return (int32_t)( to - from );
+}
+
+bool rkv_sequencer_new( rkv_sequencer * sequencer, size_t bytes_max, unsigned timeout_ms, rkv_nack_sender sender, void * user_context ) {
+   if(( sequencer == NULL )||( sender == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_sequencer_private * This = malloc( sizeof( rkv_sequencer_private ));
+   if( This == NULL ) {
+      perror( "malloc" );
+      return false;
+   }
+   memset( This, 0, sizeof( rkv_sequencer_private ));
+   This->bytes_max    = bytes_max;
+   This->timeout_ms   = timeout_ms;
+   This->sender       = sender;
+   This->user_context = user_context;
+   *sequencer = (rkv_sequencer)This;
+   return true;
+}
+
+static source * source_get( rkv_sequencer_private * This, const rkv_publisher * publisher, bool * created ) {
+   *created = false;
+   for( source * s = This->sources; s; s = s->next ) {
+      if( rkv_protocol_same_publisher( &s->publisher, publisher )) {
+         return s;
+      }
+   }
+   source * s = malloc( sizeof( source ));
+   if( s == NULL ) {
+      perror( "malloc" );
+      return NULL;
+   }
+   memset( s, 0, sizeof( source ));
+   s->publisher  = *publisher;
+   s->next       = This->sources;
+   This->sources = s;
+   *created      = true;
+   return s;
+}
+
+static void held_delete( rkv_sequencer_private * This, held * h ) {
+   This->bytes      -= h->size;
+   This->held_count -= 1;
+   if( h->data ) {
+      net_buff_delete( &h->data );
+   }
+   free( h );
+}
+
+/**
+ * Réclame les datagrammes manquants de from à to-1, par tranches de UINT16_MAX au plus.
+ */
+static void send_nacks( rkv_sequencer_private * This, source * s, uint32_t from, uint32_t to ) {
+   while( distance( from, to ) > 0 ) {
+      const int32_t count = distance( from, to );
+      rkv_nack      nack  = {
+         .publisher = s->publisher,
+         .first     = from,
+         .count     = ( count > UINT16_MAX ) ? UINT16_MAX : (uint16_t)count
+      };
+      if( This->sender( &nack, &s->address, This->user_context )) {
+         This->nacks += 1;
+      }
+      from += nack.count;
+   }
+   s->nack_ms = now_ms();
+}
+
+static void send_all_nacks( rkv_sequencer_private * This, source * s ) {
+   uint32_t from = s->expected;
+   for( held * h = s->held; h; h = h->next ) {
+      send_nacks( This, s, from, h->datagram );
+      from = h->datagram + 1;
+   }
+   send_nacks( This, s, from, s->announced );
+}
+
+/**
+ * Premier numéro qui n'a été ni reçu ni réclamé : celui qui suit le plus grand mis de côté,
+ * ou annoncé.
+ */
+static uint32_t first_unclaimed( const source * s ) {
+   uint32_t first = s->expected;
+   for( const held * h = s->held; h; h = h->next ) {
+      first = h->datagram + 1;
+   }
+   return ( distance( first, s->announced ) > 0 ) ? s->announced : first;
+}
+
+static bool has_gap( const source * s ) {
+   return s->held
+      ? ( s->held->datagram != s->expected )
+      : ( distance( s->expected, s->announced ) > 0 );
+}
+
+/**
+ * Les datagrammes qui précèdent le premier mis de côté, ou le dernier annoncé, sont perdus :
+ * il devient livrable.
+ */
+static void skip_gap( rkv_sequencer_private * This, source * s, const char * reason ) {
+   const uint32_t end = s->held ? s->held->datagram : s->announced;
+   if( distance( s->expected, end ) <= 0 ) {
+      return;
+   }
+   const uint32_t missing = (uint32_t)distance( s->expected, end );
+   fprintf( stderr, "rkv_sequencer: datagrams %u to %u from %08x/%d/%u %s, %u lost\n",
+      s->expected, end - 1, s->publisher.host, s->publisher.process, s->publisher.instance,
+      reason, missing );
+   This->lost += missing;
+   s->expected = end;
+   s->gap_ms   = now_ms();
+}
+
+/**
+ * L'émetteur est supposé avoir redémarré : ce qui est mis de côté est abandonné, next est
+ * le prochain numéro attendu.
+ */
+static void resynchronize( rkv_sequencer_private * This, source * s, int32_t ahead, uint32_t next ) {
+   while( s->held ) {
+      held * h = s->held;
+      s->held = h->next;
+      held_delete( This, h );
+   }
+   fprintf( stderr, "rkv_sequencer: %d datagrams from %08x/%d/%u missing, resynchronized\n",
+      ahead, s->publisher.host, s->publisher.process, s->publisher.instance );
+   This->lost     += (unsigned long)ahead;
+   s->expected     = next;
+   s->announced    = next;
+}
+
+static bool hold( rkv_sequencer_private * This, source * s, uint32_t datagram, net_buff buffer ) {
+   held ** link = &s->held;
+   while( *link &&( distance((*link)->datagram, datagram ) > 0 )) {
+      link = &(*link)->next;
+   }
+   if( *link &&( (*link)->datagram == datagram )) {
+      return true; // doublon
+   }
+   size_t limit = 0;
+   byte * bytes = NULL;
+   if(   ! net_buff_get_limit( buffer, &limit )
+      || ! net_buff_get_bytes( buffer, &bytes ))
+   {
+      return false;
+   }
+   held * h = malloc( sizeof( held ));
+   if( h == NULL ) {
+      perror( "malloc" );
+      return false;
+   }
+   h->datagram = datagram;
+   h->size     = limit;
+   h->data     = NULL;
+   if(   ! net_buff_new( &h->data, limit )
+      || ! net_buff_encode_bytes( h->data, bytes, limit )
+      || ! net_buff_flip( h->data ))
+   {
+      if( h->data ) {
+         net_buff_delete( &h->data );
+      }
+      free( h );
+      return false;
+   }
+   h->next = *link;
+   if( s->held == NULL ) {
+      s->gap_ms = now_ms();
+   }
+   *link = h;
+   This->bytes      += limit;
+   This->held_count += 1;
+   return true;
+}
+
+/**
+ * Classe un datagramme de données dont l'en-tête vient d'être décodé. *deliver est vrai
+ * quand c'est le suivant attendu de son émetteur : l'appelant le traite aussitôt, puis
+ * ceux que cette arrivée rend livrables, par rkv_sequencer_next(). Sinon, c'est un doublon
+ * ignoré, ou il est copié en attendant ceux qui le précèdent, réclamés à l'émetteur.
+ */
+bool rkv_sequencer_add( rkv_sequencer sequencer, const rkv_fragment_header * header, const struct sockaddr_in * from,
+   net_buff datagram, bool * deliver )
+{
+   if(( sequencer == NULL )||( header == NULL )||( from == NULL )||( datagram == NULL )||( deliver == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_sequencer_private * This    = (rkv_sequencer_private *)sequencer;
+   bool                    created = false;
+   source *                s       = source_get( This, &header->publisher, &created );
+   *deliver = false;
+   if( s == NULL ) {
+      return false;
+   }
+   s->address = *from;
+   if( created ) {
+      // premier datagramme reçu de cet émetteur : rien de ce qui précède n'est réclamé
+      s->expected  = header->datagram + 1;
+      s->announced = s->expected;
+      *deliver     = true;
+      return true;
+   }
+   const int32_t ahead = distance( s->expected, header->datagram );
+   if( ahead == 0 ) {
+      s->expected += 1;
+      *deliver     = true;
+      return true;
+   }
+   if( ahead < 0 ) {
+      return true; // doublon, d'une réémission demandée par un autre récepteur par exemple
+   }
+   if( ahead > SEQUENCER_GAP_MAX ) {
+      resynchronize( This, s, ahead, header->datagram + 1 );
+      *deliver = true;
+      return true;
+   }
+   size_t limit = 0;
+   if( ! net_buff_get_limit( datagram, &limit )) {
+      return false;
+   }
+   if( s->held &&( This->bytes + limit > This->bytes_max )) {
+      // plus de place : le premier trou de cet émetteur est abandonné, ses datagrammes
+      // mis de côté deviennent livrables et libèrent la place
+      skip_gap( This, s, "evicted" );
+   }
+   // seuls les numéros qui suivent le plus grand déjà reçu ou annoncé n'ont pas encore été réclamés
+   const uint32_t first_missing = first_unclaimed( s );
+   if( ! hold( This, s, header->datagram, datagram )) {
+      return false;
+   }
+   if( distance( first_missing, header->datagram ) > 0 ) {
+      send_nacks( This, s, first_missing, header->datagram );
+   }
+   return true;
+}
+
+/**
+ * L'émetteur annonce last, le numéro de son dernier datagramme : ceux qui manquent jusque-là sont
+ * réclamés, comme si un datagramme suivant les avait révélés, puis de nouveau ou abandonnés par
+ * rkv_sequencer_expire(). Un émetteur inconnu est attendu à partir de last+1.
+ */
+bool rkv_sequencer_announce( rkv_sequencer sequencer, const rkv_publisher * publisher, const struct sockaddr_in * from,
+   uint32_t last )
+{
+   if(( sequencer == NULL )||( publisher == NULL )||( from == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_sequencer_private * This    = (rkv_sequencer_private *)sequencer;
+   bool                    created = false;
+   source *                s       = source_get( This, publisher, &created );
+   if( s == NULL ) {
+      return false;
+   }
+   s->address = *from;
+   const uint32_t next = last + 1;
+   if( created ) {
+      s->expected  = next;
+      s->announced = next;
+      return true;
+   }
+   const int32_t ahead = distance( s->expected, next );
+   if( ahead > SEQUENCER_GAP_MAX ) {
+      resynchronize( This, s, ahead, next );
+      return true;
+   }
+   const uint32_t first_missing = first_unclaimed( s );
+   if( distance( first_missing, next ) <= 0 ) {
+      return true; // déjà reçu, ou réclamé
+   }
+   if( ! has_gap( s )) {
+      s->gap_ms = now_ms();
+   }
+   s->announced = next;
+   send_nacks( This, s, first_missing, next );
+   return true;
+}
+
+/**
+ * Retourne dans *datagram, positionné au début, le prochain datagramme mis de côté devenu
+ * livrable, NULL s'il n'y en a pas. L'appelant en devient propriétaire et doit le libérer
+ * par net_buff_delete().
+ */
+bool rkv_sequencer_next( rkv_sequencer sequencer, net_buff * datagram ) {
+   if(( sequencer == NULL )||( datagram == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_sequencer_private * This = (rkv_sequencer_private *)sequencer;
+   *datagram = NULL;
+   for( source * s = This->sources; s; s = s->next ) {
+      held * h = s->held;
+      if( h &&( h->datagram == s->expected )) {
+         s->held      = h->next;
+         s->expected += 1;
+         s->gap_ms    = now_ms();
+         *datagram    = h->data;
+         h->data      = NULL;
+         held_delete( This, h );
+         return true;
+      }
+   }
+   return true;
+}
+
+/**
+ * Abandonne les trous plus anciens que timeout_ms et réclame de nouveau les autres.
+ */
+bool rkv_sequencer_expire( rkv_sequencer sequencer ) {
+   if( sequencer == NULL ) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_sequencer_private * This     = (rkv_sequencer_private *)sequencer;
+   const uint64_t          now      = now_ms();
+   const uint64_t          interval = ( This->timeout_ms >= 4 ) ? This->timeout_ms / 4 : 1;
+   for( source * s = This->sources; s; s = s->next ) {
+      if( ! has_gap( s )) {
+         continue;
+      }
+      if( now - s->gap_ms >= This->timeout_ms ) {
+         skip_gap( This, s, "timed out" );
+      }
+      else if( now - s->nack_ms >= interval ) {
+         send_all_nacks( This, s );
+      }
+   }
+   return true;
+}
+
+bool rkv_sequencer_get_stats( rkv_sequencer sequencer, size_t * held_count, unsigned long * nacks, unsigned long * lost ) {
+   if(( sequencer == NULL )||( held_count == NULL )||( nacks == NULL )||( lost == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   const rkv_sequencer_private * This = (const rkv_sequencer_private *)sequencer;
+   *held_count = This->held_count;
+   *nacks      = This->nacks;
+   *lost       = This->lost;
+   return true;
+}
+
+bool rkv_sequencer_delete( rkv_sequencer * sequencer ) {
+   if(( sequencer == NULL )||( *sequencer == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_sequencer_private * This = (rkv_sequencer_private *)*sequencer;
+   while( This->sources ) {
+      source * s = This->sources;
+      This->sources = s->next;
+      while( s->held ) {
+         held * h = s->held;
+         s->held = h->next;
+         held_delete( This, h );
+      }
+      free( s );
+   }
+   free( This );
+   *sequencer = NULL;
+   return true;
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "rkv_protocol.h"
+
+#include <netinet/in.h>
+
+typedef struct { unsigned unused; } * rkv_sequencer;
+
+/**
+ * Envoie une demande de réémission à l'adresse d'où viennent les datagrammes de nack->publisher.
+ */
+typedef bool (* rkv_nack_sender )( const rkv_nack * nack, const struct sockaddr_in * publisher, void * user_context );
+
+bool rkv_sequencer_new      ( rkv_sequencer * This, size_t bytes_max, unsigned timeout_ms, rkv_nack_sender sender, void * user_context );
+bool rkv_sequencer_add      ( rkv_sequencer   This, const rkv_fragment_header * header, const struct sockaddr_in * from,
+                              net_buff datagram, bool * deliver );
+bool rkv_sequencer_announce ( rkv_sequencer   This, const rkv_publisher * publisher, const struct sockaddr_in * from,
+                              uint32_t last );
+bool rkv_sequencer_next     ( rkv_sequencer   This, net_buff * datagram );
+bool rkv_sequencer_expire   ( rkv_sequencer   This );
+bool rkv_sequencer_get_stats( rkv_sequencer   This, size_t * held, unsigned long * nacks, unsigned long * lost );
+bool rkv_sequencer_delete   ( rkv_sequencer * This );
@@ -0,0 +1,351 @@
+#include "rkv_snapshot.h"
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define SNAPSHOT_HEADER_SIZE  (4+4+8+8)
+#define SNAPSHOT_INDEX_SIZE   (4+4+4+4+4+8+4)
+#define SNAPSHOT_WRITE_BUFFER (1024*1024)
+
+typedef struct {
+   rkv_key  key;
+   unsigned type;
+   uint64_t offset;
+   uint32_t size;
+} index_entry;
+
+typedef struct {
+   FILE *        file;
+   char *        path;
+   char *        temporary;
+   uint64_t      offset;
+   index_entry * index;
+   size_t        count;
+   size_t        capacity;
+} rkv_snapshot_writer_private;
+
+typedef struct {
+   byte *        base;   // projection en lecture seule
+   size_t        length;
+   index_entry * index;
+   size_t        count;
+} rkv_snapshot_file_private;
+
+static bool encode_header( net_buff buffer, uint64_t count, uint64_t index ) {
+   return net_buff_encode_uint32( buffer, RKV_SNAPSHOT_MAGIC )
+      &&  net_buff_encode_uint32( buffer, RKV_SNAPSHOT_VERSION )
+      &&  net_buff_encode_uint64( buffer, count )
+      &&  net_buff_encode_uint64( buffer, index );
+}
+
+static bool write_buffer( FILE * file, net_buff buffer ) {
+   size_t size  = 0;
+   byte * bytes = NULL;
+   if(   ! net_buff_flip( buffer )
+      || ! net_buff_get_limit( buffer, &size )
+      || ! net_buff_get_bytes( buffer, &bytes ))
+   {
+      return false;
+   }
+   if( fwrite( bytes, 1, size, file ) != size ) {
+      perror( "fwrite" );
+      return false;
+   }
+   return net_buff_clear( buffer );
+}
+
+static void writer_free( rkv_snapshot_writer_private * This ) {
+   if( This->file ) {
+      fclose( This->file );
+   }
+   free( This->path );
+   free( This->temporary );
+   free( This->index );
+   free( This );
+}
+
+/**
+ * L'en-tête n'est connu qu'à la fin : sa place est réservée, il est écrit par rkv_snapshot_writer_commit().
+ */
+bool rkv_snapshot_writer_new( rkv_snapshot_writer * writer, const char * path ) {
+   if(( writer == NULL )||( path == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_snapshot_writer_private * This = calloc( 1, sizeof( rkv_snapshot_writer_private ));
+   if( This == NULL ) {
+      perror( "calloc" );
+      return false;
+   }
+   const size_t length = strlen( path );
+   This->path      = strdup( path );
+   This->temporary = malloc( length + sizeof( ".tmp" ));
+   if(( This->path == NULL )||( This->temporary == NULL )) {
+      perror( "malloc" );
+      writer_free( This );
+      return false;
+   }
+   snprintf( This->temporary, length + sizeof( ".tmp" ), "%s.tmp", path );
+   This->file = fopen( This->temporary, "wb" );
+   if( This->file == NULL ) {
+      perror( This->temporary );
+      writer_free( This );
+      return false;
+   }
+   const byte header[SNAPSHOT_HEADER_SIZE] = { 0 };
+   if(   setvbuf( This->file, NULL, _IOFBF, SNAPSHOT_WRITE_BUFFER )
+      ||( fwrite( header, 1, sizeof( header ), This->file ) != sizeof( header )))
+   {
+      perror( This->temporary );
+      unlink( This->temporary );
+      writer_free( This );
+      return false;
+   }
+   This->offset = SNAPSHOT_HEADER_SIZE;
+   *writer = (rkv_snapshot_writer)This;
+   return true;
+}
+
+bool rkv_snapshot_writer_add( rkv_snapshot_writer writer, const rkv_key * key, unsigned type, const byte * entry, size_t size ) {
+   if(( writer == NULL )||( key == NULL )||( entry == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_snapshot_writer_private * This = (rkv_snapshot_writer_private *)writer;
+   if( size > UINT32_MAX ) {
+      fprintf( stderr, "%s: entry of %ld bytes too large\n", __func__, size );
+      return false;
+   }
+   if( This->count == This->capacity ) {
+      const size_t  capacity = This->capacity ? 2 * This->capacity : 1024;
+      index_entry * index    = realloc( This->index, capacity * sizeof( index_entry ));
+      if( index == NULL ) {
+         perror( "realloc" );
+         return false;
+      }
+      This->index    = index;
+      This->capacity = capacity;
+   }
+   if( fwrite( entry, 1, size, This->file ) != size ) {
+      perror( "fwrite" );
+      return false;
+   }
+   index_entry * e = This->index + This->count++;
+   e->key    = *key;
+   e->type   = type;
+   e->offset = This->offset;
+   e->size   = (uint32_t)size;
+   This->offset += size;
+   return true;
+}
+
+/**
+ * Écrit l'index puis l'en-tête, force l'écriture sur disque et donne au fichier son nom définitif.
+ */
+bool rkv_snapshot_writer_commit( rkv_snapshot_writer * writer ) {
+   if(( writer == NULL )||( *writer == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_snapshot_writer_private * This   = (rkv_snapshot_writer_private *)*writer;
+   net_buff                      buffer = NULL;
+   bool                          ok     = net_buff_new( &buffer, 1024 * SNAPSHOT_INDEX_SIZE );
+   for( size_t i = 0; ok &&( i < This->count ); ++i ) {
+      const index_entry * e = This->index + i;
+      ok = net_buff_encode_uint32( buffer, e->key.host )
+         && net_buff_encode_uint32( buffer, e->key.process )
+         && net_buff_encode_uint32( buffer, e->key.instance )
+         && net_buff_encode_uint32( buffer, e->key.reserved )
+         && net_buff_encode_uint32( buffer, e->type )
+         && net_buff_encode_uint64( buffer, e->offset )
+         && net_buff_encode_uint32( buffer, e->size )
+         &&(( i % 1024 != 1023 )|| write_buffer( This->file, buffer ));
+   }
+   ok = ok
+      && write_buffer( This->file, buffer )
+      &&( fseek( This->file, 0, SEEK_SET ) == 0 )
+      && encode_header( buffer, This->count, This->offset )
+      && write_buffer( This->file, buffer )
+      &&( fflush( This->file ) == 0 )
+      &&( fsync( fileno( This->file )) == 0 );
+   if( buffer ) {
+      net_buff_delete( &buffer );
+   }
+   if( fclose( This->file )) {
+      ok = false;
+   }
+   This->file = NULL;
+   if( ok && rename( This->temporary, This->path )) {
+      perror( This->path );
+      ok = false;
+   }
+   if( ! ok ) {
+      fprintf( stderr, "%s: unable to write snapshot %s\n", __func__, This->path );
+      unlink( This->temporary );
+   }
+   writer_free( This );
+   *writer = NULL;
+   return ok;
+}
+
+bool rkv_snapshot_writer_abort( rkv_snapshot_writer * writer ) {
+   if(( writer == NULL )||( *writer == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_snapshot_writer_private * This = (rkv_snapshot_writer_private *)*writer;
+   fclose( This->file );
+   This->file = NULL;
+   unlink( This->temporary );
+   writer_free( This );
+   *writer = NULL;
+   return true;
+}
+
+static void file_free( rkv_snapshot_file_private * This ) {
+   if( This->base ) {
+      munmap( This->base, This->length );
+   }
+   free( This->index );
+   free( This );
+}
+
+/**
+ * Copie dans un net_buff les octets projetés de offset à offset+size, pour les décoder.
+ */
+static bool view( const rkv_snapshot_file_private * This, uint64_t offset, size_t size, net_buff * buffer ) {
+   *buffer = NULL;
+   if(   ! net_buff_new( buffer, size )
+      || ! net_buff_encode_bytes( *buffer, This->base + offset, size )
+      || ! net_buff_flip( *buffer ))
+   {
+      if( *buffer ) {
+         net_buff_delete( buffer );
+      }
+      return false;
+   }
+   return true;
+}
+
+static bool decode_index( rkv_snapshot_file_private * This, uint64_t index ) {
+   net_buff buffer = NULL;
+   if( ! view( This, index, This->count * SNAPSHOT_INDEX_SIZE, &buffer )) {
+      return false;
+   }
+   bool ok = true;
+   for( size_t i = 0; ok &&( i < This->count ); ++i ) {
+      index_entry * e = This->index + i;
+      ok = net_buff_decode_uint32( buffer, &e->key.host )
+         && net_buff_decode_uint32( buffer, &e->key.process )
+         && net_buff_decode_uint32( buffer, &e->key.instance )
+         && net_buff_decode_uint32( buffer, &e->key.reserved )
+         && net_buff_decode_uint32( buffer, &e->type )
+         && net_buff_decode_uint64( buffer, &e->offset )
+         && net_buff_decode_uint32( buffer, &e->size )
+         &&( e->offset >= SNAPSHOT_HEADER_SIZE )
+         &&( e->offset + e->size <= index );
+   }
+   net_buff_delete( &buffer );
+   return ok;
+}
+
+/**
+ * Projette le fichier en mémoire et en décode l'index. Les entrées restent dans le fichier
+ * jusqu'à rkv_snapshot_file_close().
+ */
+bool rkv_snapshot_file_open( rkv_snapshot_file * file, const char * path, size_t * count ) {
+   if(( file == NULL )||( path == NULL )||( count == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_snapshot_file_private * This = calloc( 1, sizeof( rkv_snapshot_file_private ));
+   if( This == NULL ) {
+      perror( "calloc" );
+      return false;
+   }
+   struct stat status;
+   const int   fd = open( path, O_RDONLY );
+   if(( fd < 0 )||( fstat( fd, &status ) < 0 )) {
+      perror( path );
+      if( fd >= 0 ) {
+         close( fd );
+      }
+      free( This );
+      return false;
+   }
+   This->length = (size_t)status.st_size;
+   if( This->length >= SNAPSHOT_HEADER_SIZE ) {
+      void * base = mmap( NULL, This->length, PROT_READ, MAP_PRIVATE, fd, 0 );
+      This->base = ( base == MAP_FAILED ) ? NULL : (byte *)base;
+   }
+   close( fd );
+   net_buff header  = NULL;
+   uint32_t magic   = 0;
+   uint32_t version = 0;
+   uint64_t entries = 0;
+   uint64_t index   = 0;
+   bool     ok      = ( This->base != NULL )
+      && view( This, 0, SNAPSHOT_HEADER_SIZE, &header )
+      && net_buff_decode_uint32( header, &magic )
+      && net_buff_decode_uint32( header, &version )
+      && net_buff_decode_uint64( header, &entries )
+      && net_buff_decode_uint64( header, &index )
+      &&( magic == RKV_SNAPSHOT_MAGIC )
+      &&( version == RKV_SNAPSHOT_VERSION )
+      &&( index >= SNAPSHOT_HEADER_SIZE )
+      &&( index <= This->length )
+      &&( entries <= ( This->length - index ) / SNAPSHOT_INDEX_SIZE )
+      &&( index + entries * SNAPSHOT_INDEX_SIZE == This->length );
+   if( header ) {
+      net_buff_delete( &header );
+   }
+   if( ok ) {
+      This->count = (size_t)entries;
+      This->index = calloc( This->count ? This->count : 1, sizeof( index_entry ));
+      ok = ( This->index != NULL )&& decode_index( This, index );
+   }
+   if( ! ok ) {
+      fprintf( stderr, "%s: %s is not a version %u snapshot, or is corrupted\n", __func__, path, RKV_SNAPSHOT_VERSION );
+      file_free( This );
+      return false;
+   }
+   *count = This->count;
+   *file  = (rkv_snapshot_file)This;
+   return true;
+}
+
+bool rkv_snapshot_file_get_entry( rkv_snapshot_file file, size_t index, rkv_key * key, unsigned * type, const byte ** entry,
+   size_t * size )
+{
+   if(( file == NULL )||( key == NULL )||( type == NULL )||( entry == NULL )||( size == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   const rkv_snapshot_file_private * This = (const rkv_snapshot_file_private *)file;
+   if( index >= This->count ) {
+      fprintf( stderr, "%s: index out of range: %ld\n", __func__, index );
+      return false;
+   }
+   const index_entry * e = This->index + index;
+   *key   = e->key;
+   *type  = e->type;
+   *entry = This->base + e->offset;
+   *size  = e->size;
+   return true;
+}
+
+bool rkv_snapshot_file_close( rkv_snapshot_file * file ) {
+   if(( file == NULL )||( *file == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   file_free((rkv_snapshot_file_private *)*file );
+   *file = NULL;
+   return true;
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <rkv_id.h>
+
+#include <net/net_buff.h>
+
+/**
+ * Fichier d'instantané : un en-tête, les entrées encodées comme dans une transaction, puis
+ * l'index des entrées, clé, type, position et taille.
+ *
+ *   magic u32, version u32, count u64, index u64
+ *   entrées...
+ *   index : count * ( host u32, process u32, instance u32, reserved u32, type u32, offset u64, size u32 )
+ *
+ * Le fichier est écrit sous un nom temporaire puis renommé : un instantané est complet ou absent.
+ * Il est relu par projection en mémoire, les entrées ne sont pas copiées.
+ */
+#define RKV_SNAPSHOT_MAGIC   0x524B5653U // "RKVS"
+#define RKV_SNAPSHOT_VERSION 2U // 2 : chaque entrée porte la taille de sa valeur
+
+typedef struct { unsigned unused; } * rkv_snapshot_writer;
+typedef struct { unsigned unused; } * rkv_snapshot_file;
+
+bool rkv_snapshot_writer_new   ( rkv_snapshot_writer * This, const char * path );
+bool rkv_snapshot_writer_add   ( rkv_snapshot_writer   This, const rkv_key * key, unsigned type, const byte * entry, size_t size );
+bool rkv_snapshot_writer_commit( rkv_snapshot_writer * This );
+bool rkv_snapshot_writer_abort ( rkv_snapshot_writer * This );
+
+bool rkv_snapshot_file_open     ( rkv_snapshot_file * This, const char * path, size_t * count );
+bool rkv_snapshot_file_get_entry( rkv_snapshot_file   This, size_t index, rkv_key * key, unsigned * type,
+                                  const byte ** entry, size_t * size );
+bool rkv_snapshot_file_close    ( rkv_snapshot_file * This );
@@ -0,0 +1,974 @@
+#include "rkv_store.h"
+#include "rkv_id_private.h"
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PAGE_SHIFT           8
+#define PAGE_SLOTS           (1U << PAGE_SHIFT)
+#define MEMBERS_MIN          16
+// facteur de remplissage maximal : 7/10
+#define STORE_LOAD_NUM       7
+#define STORE_LOAD_DEN       10
+// regroupements des alvéoles : par type, par origine
+#define BY_TYPE              0
+#define BY_ORIGIN            1
+#define GROUPINGS            2
+
+/**
+ * Une alvéole libre a un holder.id nul. La clé est celle de rkv_id_origin() et rkv_id_hash().
+ * member[g] est la position de l'alvéole dans la liste de son groupe selon le regroupement g.
+ */
+typedef struct {
+   uint64_t        origin;
+   uint32_t        instance;
+   uint32_t        hash;
+   rkv_data_holder holder;
+   uint32_t        member[GROUPINGS];
+} rkv_store_slot;
+
+/**
+ * Les compteurs de références des pages et des index triés ne sont manipulés que par l'écrivain.
+ */
+typedef struct {
+   unsigned       refcount;
+   rkv_store_slot slots[PAGE_SLOTS];
+} page;
+
+/**
+ * L'ordre déterministe de rkv_foreach() et rkv_get_ids() est celui de rkv_id_compare().
+ * Il est calculé à la demande par le premier lecteur qui en a besoin et reste partagé
+ * par les versions suivantes tant qu'aucune clé n'est ajoutée.
+ */
+typedef struct {
+   unsigned refcount;
+   size_t   count;
+   uint32_t index[];
+} order;
+
+/**
+ * Indices des alvéoles d'un même groupe, un type ou une origine, dans l'ordre de leur arrivée :
+ * rkv_store_foreach_type() parcourt un tableau contigu. La liste est partagée entre versions
+ * tant qu'aucune clé n'entre dans le groupe ou n'en sort ; celle que seul le brouillon
+ * référence lui appartient.
+ */
+typedef struct {
+   unsigned refcount;
+   uint64_t group;
+   size_t   count;
+   size_t   capacity;
+   uint32_t index[];
+} members;
+
+typedef struct {
+   members ** lists;    // triées par groupe
+   size_t     count;
+} grouping;
+
+typedef struct {
+   size_t           capacity; // puissance de 2, multiple de PAGE_SLOTS
+   size_t           size;
+   page **          pages;
+   _Atomic(order *) sorted;
+   grouping         groups[GROUPINGS];
+} version;
+
+typedef struct {
+   void * _Atomic current;
+   version *      draft;
+   bool *         owned;     // pages de draft déjà copiées
+   rkv_epoch      epoch;
+   size_t         capacity_min; // celle de la création, voir rkv_store_compact()
+} rkv_store_private;
+
+static inline rkv_store_slot * slot_at( const version * v, size_t index ) {
+   return v->pages[index >> PAGE_SHIFT]->slots + ( index & ( PAGE_SLOTS - 1 ));
+}
+
+static inline uint64_t group_of( const rkv_store_slot * slot, size_t g ) {
+   return ( g == BY_TYPE ) ? slot->holder.type : slot->origin;
+}
+
+static size_t find_index( const version * v, uint64_t origin, uint32_t instance, uint32_t hash ) {
+   const size_t mask = v->capacity - 1;
+   for( size_t i = hash & mask;; i = ( i + 1 ) & mask ) {
+      const rkv_store_slot * slot = slot_at( v, i );
+      if(( slot->holder.id == NULL )
+         ||(( slot->origin == origin )&&( slot->instance == instance )))
+      {
+         return i;
+      }
+   }
+}
+
+static void order_release( order * o ) {
+   if( o &&( --o->refcount == 0 )) {
+      free( o );
+   }
+}
+
+static void page_release( page * p ) {
+   if( p &&( --p->refcount == 0 )) {
+      free( p );
+   }
+}
+
+static void members_release( members * m ) {
+   if( m &&( --m->refcount == 0 )) {
+      free( m );
+   }
+}
+
+static void version_reclaim( void * garbage, void * user_context ) {
+   version *    v      = (version *)garbage;
+   const size_t npages = v->capacity / PAGE_SLOTS;
+   for( size_t i = 0; i < npages; ++i ) {
+      page_release( v->pages[i] );
+   }
+   for( size_t g = 0; g < GROUPINGS; ++g ) {
+      for( size_t i = 0; i < v->groups[g].count; ++i ) {
+         members_release( v->groups[g].lists[i] );
+      }
+      free( v->groups[g].lists );
+   }
+   order_release( atomic_load( &v->sorted ));
+   free( v->pages );
+   free( v );
+   (void)user_context;
+}
+
+static members * members_new( uint64_t group, size_t capacity ) {
+   members * m = malloc( sizeof( members ) + capacity * sizeof( uint32_t ));
+   if( m == NULL ) {
+      perror( "malloc" );
+      return NULL;
+   }
+   m->refcount = 1;
+   m->group    = group;
+   m->count    = 0;
+   m->capacity = capacity;
+   return m;
+}
+
+static version * version_new( size_t capacity ) {
+   version * v = malloc( sizeof( version ));
+   if( v == NULL ) {
+      perror( "malloc" );
+      return NULL;
+   }
+   v->capacity = capacity;
+   v->size     = 0;
+   memset( v->groups, 0, sizeof( v->groups ));
+   atomic_init( &v->sorted, NULL );
+   v->pages = calloc( capacity / PAGE_SLOTS, sizeof( page * ));
+   if( v->pages == NULL ) {
+      perror( "calloc" );
+      free( v );
+      return NULL;
+   }
+   for( size_t i = 0; i < capacity / PAGE_SLOTS; ++i ) {
+      v->pages[i] = calloc( 1, sizeof( page ));
+      if( v->pages[i] == NULL ) {
+         perror( "calloc" );
+         version_reclaim( v, NULL );
+         return NULL;
+      }
+      v->pages[i]->refcount = 1;
+   }
+   return v;
+}
+
+/**
+ * Retourne la version épinglée par le thread courant. Hors section de lecture,
+ * la version publiée est épinglée le temps de l'appel et *entered vaut true.
+ */
+static version * reader_version( rkv_store_private * This, bool * entered ) {
+   void * pinned = NULL;
+   *entered = false;
+   if( rkv_epoch_get_pinned( This->epoch, &pinned )) {
+      return pinned;
+   }
+   if( rkv_epoch_enter( This->epoch, &This->current, &pinned )) {
+      *entered = true;
+      return pinned;
+   }
+   return NULL;
+}
+
+static void reader_done( rkv_store_private * This, bool entered ) {
+   if( entered ) {
+      rkv_epoch_leave( This->epoch );
+   }
+}
+
+bool rkv_store_new( rkv_store * store, size_t capacity ) {
+   if( store == NULL ) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_store_private * This = malloc( sizeof( rkv_store_private ));
+   if( This == NULL ) {
+      perror( "malloc" );
+      return false;
+   }
+   memset( This, 0, sizeof( rkv_store_private ));
+   size_t pow2 = PAGE_SLOTS;
+   while( pow2 < capacity ) {
+      pow2 *= 2;
+   }
+   version * v = version_new( pow2 );
+   if( v == NULL ) {
+      free( This );
+      return false;
+   }
+   atomic_init( &This->current, v );
+   This->capacity_min = pow2;
+   if( ! rkv_epoch_new( &This->epoch )) {
+      version_reclaim( v, NULL );
+      free( This );
+      return false;
+   }
+   *store = (rkv_store)This;
+   return true;
+}
+
+/**
+ * Entre une section de lecture : jusqu'au rkv_store_read_end() correspondant, le thread lit
+ * la même version et les valeurs qu'il en obtient restent valides, quels que soient les
+ * rafraîchissements concurrents.
+ */
+bool rkv_store_read_begin( rkv_store store ) {
+   if( store == NULL ) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_store_private * This   = (rkv_store_private *)store;
+   void *              pinned = NULL;
+   return rkv_epoch_enter( This->epoch, &This->current, &pinned );
+}
+
+bool rkv_store_read_end( rkv_store store ) {
+   if( store == NULL ) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   return rkv_epoch_leave(((rkv_store_private *)store)->epoch );
+}
+
+bool rkv_store_get( rkv_store store, const rkv_key * key, const rkv_data_holder ** holder ) {
+   if(( store == NULL )||( key == NULL )||( holder == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_store_private *    This    = (rkv_store_private *)store;
+   bool                   entered = false;
+   const version *        v       = reader_version( This, &entered );
+   if( v == NULL ) {
+      return false;
+   }
+   const uint64_t         origin  = rkv_id_origin( key );
+   const rkv_store_slot * slot    = slot_at( v, find_index( v, origin, key->instance, rkv_id_hash( origin, key->instance )));
+   const bool             found   = ( slot->holder.id != NULL );
+   if( found ) {
+      *holder = &slot->holder;
+   }
+   reader_done( This, entered );
+   return found;
+}
+
+bool rkv_store_get_size( rkv_store store, size_t * size ) {
+   if(( store == NULL )||( size == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_store_private * This    = (rkv_store_private *)store;
+   bool                entered = false;
+   const version *     v       = reader_version( This, &entered );
+   if( v == NULL ) {
+      return false;
+   }
+   *size = v->size;
+   reader_done( This, entered );
+   return true;
+}
+
+typedef struct {
+   const rkv_store_slot * slot;
+   uint32_t               index;
+} sort_item;
+
+static int sort_item_compare( const void * l, const void * r ) {
+   const sort_item * left  = (const sort_item *)l;
+   const sort_item * right = (const sort_item *)r;
+   return rkv_id_compare( &left->slot->holder.id, &right->slot->holder.id );
+}
+
+static order * sort_on_demand( version * v ) {
+   order * o = atomic_load( &v->sorted );
+   if( o ) {
+      return o;
+   }
+   sort_item * items = malloc(( v->size ? v->size : 1 ) * sizeof( sort_item ));
+   o = malloc( sizeof( order ) + ( v->size ? v->size : 1 ) * sizeof( uint32_t ));
+   if(( items == NULL )||( o == NULL )) {
+      perror( "malloc" );
+      free( items );
+      free( o );
+      return NULL;
+   }
+   size_t count = 0;
+   for( size_t i = 0; ( i < v->capacity )&&( count < v->size ); ++i ) {
+      const rkv_store_slot * slot = slot_at( v, i );
+      if( slot->holder.id ) {
+         items[count].slot  = slot;
+         items[count].index = (uint32_t)i;
+         ++count;
+      }
+   }
+   qsort( items, count, sizeof( sort_item ), sort_item_compare );
+   o->refcount = 1;
+   o->count    = count;
+   for( size_t i = 0; i < count; ++i ) {
+      o->index[i] = items[i].index;
+   }
+   free( items );
+   order * expected = NULL;
+   if( ! atomic_compare_exchange_strong( &v->sorted, &expected, o )) {
+      free( o ); // un autre lecteur l'a calculé en même temps
+      o = expected;
+   }
+   return o;
+}
+
+/**
+ * Rang dans o de la première clé qui suit after, par dichotomie.
+ */
+static size_t first_after( const version * v, const order * o, const rkv_key * after ) {
+   size_t low  = 0;
+   size_t high = o->count;
+   while( low < high ) {
+      const size_t    middle = low + ( high - low ) / 2;
+      const rkv_key * key    = (const rkv_key *)slot_at( v, o->index[middle] )->holder.id;
+      if( rkv_key_compare( key, after ) <= 0 ) {
+         low = middle + 1;
+      }
+      else {
+         high = middle;
+      }
+   }
+   return low;
+}
+
+static bool foreach_from( rkv_store_private * This, const rkv_key * after, rkv_store_iterator iterator,
+   void * user_context )
+{
+   bool      entered = false;
+   version * v       = reader_version( This, &entered );
+   if( v == NULL ) {
+      return false;
+   }
+   const order * o = sort_on_demand( v );
+   if( o ) {
+      for( size_t i = after ? first_after( v, o, after ) : 0; i < o->count; ++i ) {
+         if( ! iterator( i, &slot_at( v, o->index[i] )->holder, user_context )) {
+            break;
+         }
+      }
+   }
+   reader_done( This, entered );
+   return o != NULL;
+}
+
+bool rkv_store_foreach( rkv_store store, rkv_store_iterator iterator, void * user_context ) {
+   if(( store == NULL )||( iterator == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   return foreach_from( (rkv_store_private *)store, NULL, iterator, user_context );
+}
+
+/**
+ * Comme rkv_store_foreach(), à partir de la clé qui suit after dans l'ordre de rkv_key_compare() :
+ * un parcours peut être repris dans une autre version, after n'y étant plus forcément.
+ */
+bool rkv_store_foreach_from( rkv_store store, const rkv_key * after, rkv_store_iterator iterator, void * user_context ) {
+   if(( store == NULL )||( after == NULL )||( iterator == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   return foreach_from( (rkv_store_private *)store, after, iterator, user_context );
+}
+
+/**
+ * Position de group dans les listes du regroupement g, ou de son insertion s'il n'y est pas.
+ */
+static size_t find_group( const version * v, size_t g, uint64_t group, bool * found ) {
+   const grouping * lists = v->groups + g;
+   size_t           low   = 0;
+   size_t           high  = lists->count;
+   while( low < high ) {
+      const size_t middle = low + ( high - low ) / 2;
+      if( lists->lists[middle]->group < group ) {
+         low = middle + 1;
+      }
+      else {
+         high = middle;
+      }
+   }
+   *found = ( low < lists->count )&&( lists->lists[low]->group == group );
+   return low;
+}
+
+bool rkv_store_foreach_type( rkv_store store, unsigned type, rkv_store_iterator iterator, void * user_context ) {
+   if(( store == NULL )||( iterator == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_store_private * This    = (rkv_store_private *)store;
+   bool                entered = false;
+   const version *     v       = reader_version( This, &entered );
+   if( v == NULL ) {
+      return false;
+   }
+   bool         found = false;
+   const size_t t     = find_group( v, BY_TYPE, type, &found );
+   if( found ) {
+      const members * m = v->groups[BY_TYPE].lists[t];
+      for( size_t i = 0; i < m->count; ++i ) {
+         if( ! iterator( i, &slot_at( v, m->index[i] )->holder, user_context )) {
+            break;
+         }
+      }
+   }
+   reader_done( This, entered );
+   return true;
+}
+
+bool rkv_store_count_type( rkv_store store, unsigned type, size_t * count ) {
+   if(( store == NULL )||( count == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_store_private * This    = (rkv_store_private *)store;
+   bool                entered = false;
+   const version *     v       = reader_version( This, &entered );
+   if( v == NULL ) {
+      return false;
+   }
+   bool         found = false;
+   const size_t t     = find_group( v, BY_TYPE, type, &found );
+   *count = found ? v->groups[BY_TYPE].lists[t]->count : 0;
+   reader_done( This, entered );
+   return true;
+}
+
+/**
+ * Le brouillon partage toutes les pages, les listes de membres et l'index trié de la version
+ * publiée.
+ */
+bool rkv_store_update_begin( rkv_store store ) {
+   if( store == NULL ) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_store_private * This    = (rkv_store_private *)store;
+   const version *     current = atomic_load( &This->current );
+   const size_t        npages  = current->capacity / PAGE_SLOTS;
+   if( This->draft ) {
+      fprintf( stderr, "%s: update already in progress\n", __func__ );
+      return false;
+   }
+   version *  draft = malloc( sizeof( version ));
+   page **    pages = malloc( npages * sizeof( page * ));
+   bool *     owned = calloc( npages, sizeof( bool ));
+   members ** lists[GROUPINGS];
+   bool       ok    = ( draft != NULL )&&( pages != NULL )&&( owned != NULL );
+   for( size_t g = 0; g < GROUPINGS; ++g ) {
+      lists[g] = malloc(( current->groups[g].count ? current->groups[g].count : 1 ) * sizeof( members * ));
+      ok       = ok &&( lists[g] != NULL );
+   }
+   if( ! ok ) {
+      perror( "malloc" );
+      free( draft );
+      free( pages );
+      free( owned );
+      for( size_t g = 0; g < GROUPINGS; ++g ) {
+         free( lists[g] );
+      }
+      return false;
+   }
+   memcpy( pages, current->pages, npages * sizeof( page * ));
+   for( size_t i = 0; i < npages; ++i ) {
+      pages[i]->refcount += 1;
+   }
+   for( size_t g = 0; g < GROUPINGS; ++g ) {
+      for( size_t i = 0; i < current->groups[g].count; ++i ) {
+         lists[g][i] = current->groups[g].lists[i];
+         lists[g][i]->refcount += 1;
+      }
+      draft->groups[g].lists = lists[g];
+      draft->groups[g].count = current->groups[g].count;
+   }
+   draft->capacity = current->capacity;
+   draft->size     = current->size;
+   draft->pages    = pages;
+   order * sorted = atomic_load( &current->sorted );
+   if( sorted ) {
+      sorted->refcount += 1;
+   }
+   atomic_init( &draft->sorted, sorted );
+   This->draft = draft;
+   This->owned = owned;
+   return true;
+}
+
+static void draft_forget_order( version * draft ) {
+   order_release( atomic_load( &draft->sorted ));
+   atomic_store( &draft->sorted, NULL );
+}
+
+/**
+ * Les alvéoles changent de place : chaque liste est reconstruite, dans le même ordre, à la taille
+ * de ses membres. Les listes vides disparaissent.
+ */
+static bool copy_members( version * resized, const version * draft, size_t g ) {
+   const grouping * lists = draft->groups + g;
+   grouping *       into  = resized->groups + g;
+   into->lists = malloc(( lists->count ? lists->count : 1 ) * sizeof( members * ));
+   if( into->lists == NULL ) {
+      perror( "malloc" );
+      return false;
+   }
+   for( size_t t = 0; t < lists->count; ++t ) {
+      const members * from     = lists->lists[t];
+      size_t          capacity = MEMBERS_MIN;
+      if( from->count == 0 ) {
+         continue;
+      }
+      while( capacity < from->count ) {
+         capacity *= 2;
+      }
+      members * to = members_new( from->group, capacity );
+      if( to == NULL ) {
+         return false;
+      }
+      into->lists[into->count++] = to;
+      for( size_t i = 0; i < from->count; ++i ) {
+         const rkv_store_slot * slot  = slot_at( draft, from->index[i] );
+         const size_t           index = find_index( resized, slot->origin, slot->instance, slot->hash );
+         slot_at( resized, index )->member[g] = (uint32_t)i;
+         to->index[to->count++] = (uint32_t)index;
+      }
+   }
+   return true;
+}
+
+static bool draft_resize( rkv_store_private * This, size_t capacity ) {
+   version * resized = version_new( capacity );
+   bool *    owned   = malloc(( capacity / PAGE_SLOTS ) * sizeof( bool ));
+   if(( resized == NULL )||( owned == NULL )) {
+      if( resized ) {
+         version_reclaim( resized, NULL );
+      }
+      free( owned );
+      return false;
+   }
+   version * draft = This->draft;
+   for( size_t i = 0; i < draft->capacity; ++i ) {
+      const rkv_store_slot * slot = slot_at( draft, i );
+      if( slot->holder.id ) {
+         *slot_at( resized, find_index( resized, slot->origin, slot->instance, slot->hash )) = *slot;
+      }
+   }
+   if( ! copy_members( resized, draft, BY_TYPE )|| ! copy_members( resized, draft, BY_ORIGIN )) {
+      version_reclaim( resized, NULL );
+      free( owned );
+      return false;
+   }
+   for( size_t i = 0; i < capacity / PAGE_SLOTS; ++i ) {
+      owned[i] = true;
+   }
+   resized->size = draft->size;
+   version_reclaim( draft, NULL );
+   free( This->owned );
+   This->draft = resized;
+   This->owned = owned;
+   return true;
+}
+
+static rkv_store_slot * draft_slot_for_write( rkv_store_private * This, size_t index ) {
+   version *    draft = This->draft;
+   const size_t p     = index >> PAGE_SHIFT;
+   if( ! This->owned[p] ) {
+      page * copy = malloc( sizeof( page ));
+      if( copy == NULL ) {
+         perror( "malloc" );
+         return NULL;
+      }
+      memcpy( copy->slots, draft->pages[p]->slots, sizeof( copy->slots ));
+      copy->refcount = 1;
+      page_release( draft->pages[p] );
+      draft->pages[p] = copy;
+      This->owned[p]  = true;
+   }
+   return slot_at( draft, index );
+}
+
+/**
+ * Liste des membres de group dans le brouillon, selon le regroupement g, modifiable et assez
+ * grande pour reserve membres de plus : une liste partagée avec une version publiée est d'abord
+ * copiée.
+ */
+static members * draft_members( version * draft, size_t g, uint64_t group, size_t reserve ) {
+   grouping *   lists = draft->groups + g;
+   bool         found = false;
+   const size_t t     = find_group( draft, g, group, &found );
+   if( ! found ) {
+      members ** grown = realloc( lists->lists, ( lists->count + 1 ) * sizeof( members * ));
+      if( grown == NULL ) {
+         perror( "realloc" );
+         return NULL;
+      }
+      lists->lists = grown;
+      members * m = members_new( group, MEMBERS_MIN );
+      if( m == NULL ) {
+         return NULL;
+      }
+      memmove( grown + t + 1, grown + t, ( lists->count - t ) * sizeof( members * ));
+      grown[t] = m;
+      lists->count += 1;
+   }
+   members *    m        = lists->lists[t];
+   const size_t needed   = m->count + reserve;
+   size_t       capacity = m->capacity;
+   if(( m->refcount == 1 )&&( needed <= capacity )) {
+      return m;
+   }
+   while( capacity < needed ) {
+      capacity *= 2;
+   }
+   if( m->refcount == 1 ) {
+      members * larger = realloc( m, sizeof( members ) + capacity * sizeof( uint32_t ));
+      if( larger == NULL ) {
+         perror( "realloc" );
+         return NULL;
+      }
+      larger->capacity = capacity;
+      lists->lists[t]  = larger;
+      return larger;
+   }
+   members * copy = members_new( group, capacity );
+   if( copy == NULL ) {
+      return NULL;
+   }
+   memcpy( copy->index, m->index, m->count * sizeof( uint32_t ));
+   copy->count = m->count;
+   members_release( m );
+   lists->lists[t] = copy;
+   return copy;
+}
+
+/**
+ * Retire l'alvéole index de la liste de son groupe selon g : la dernière de la liste prend sa
+ * place.
+ */
+static bool draft_leave( rkv_store_private * This, rkv_store_slot * slot, size_t index, size_t g ) {
+   members * m = draft_members( This->draft, g, group_of( slot, g ), 0 );
+   if( m == NULL ) {
+      return false;
+   }
+   const uint32_t last = m->index[m->count - 1];
+   if( last != index ) {
+      rkv_store_slot * moved = draft_slot_for_write( This, last );
+      if( moved == NULL ) {
+         return false;
+      }
+      moved->member[g]          = slot->member[g];
+      m->index[slot->member[g]] = last;
+   }
+   m->count -= 1;
+   return true;
+}
+
+/**
+ * Ajoute ou remplace dans le brouillon. Le holder remplacé est recopié dans *replaced :
+ * l'appelant doit retirer son id et sa valeur via rkv_store_update_end(), des lecteurs
+ * pouvant encore les lire dans une version antérieure.
+ */
+bool rkv_store_put( rkv_store store, const rkv_data_holder * holder, rkv_data_holder * replaced, bool * has_replaced ) {
+   if(( store == NULL )||( holder == NULL )||( holder->id == NULL )||( replaced == NULL )||( has_replaced == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_store_private * This = (rkv_store_private *)store;
+   if( This->draft == NULL ) {
+      fprintf( stderr, "%s: no update in progress\n", __func__ );
+      return false;
+   }
+   if(( This->draft->size + 1 ) * STORE_LOAD_DEN > This->draft->capacity * STORE_LOAD_NUM ) {
+      if( ! draft_resize( This, 2 * This->draft->capacity )) {
+         return false;
+      }
+   }
+   const rkv_id_private * key    = (const rkv_id_private *)holder->id;
+   const uint64_t         origin = rkv_id_origin( key );
+   const uint32_t         hash   = rkv_id_hash( origin, key->instance );
+   const size_t           index  = find_index( This->draft, origin, key->instance, hash );
+   rkv_store_slot *       slot   = draft_slot_for_write( This, index );
+   if( slot == NULL ) {
+      return false;
+   }
+   // une clé qui change de type quitte la liste de l'ancien pour celle du nouveau, seule une
+   // nouvelle clé rejoint celle de son origine
+   const bool known  = ( slot->holder.id != NULL );
+   const bool joins  = ( ! known )||( slot->holder.type != holder->type );
+   members *  joined = joins ? draft_members( This->draft, BY_TYPE, holder->type, 1 ) : NULL;
+   members *  born   = known ? NULL : draft_members( This->draft, BY_ORIGIN, origin, 1 );
+   if(( joins &&(( joined == NULL )||( known && ! draft_leave( This, slot, index, BY_TYPE ))))
+      ||( ! known &&( born == NULL )))
+   {
+      return false;
+   }
+   if( joins ) {
+      slot->member[BY_TYPE] = (uint32_t)joined->count;
+      joined->index[joined->count++] = (uint32_t)index;
+   }
+   if( ! known ) {
+      slot->member[BY_ORIGIN] = (uint32_t)born->count;
+      born->index[born->count++] = (uint32_t)index;
+   }
+   *has_replaced = known;
+   if( *has_replaced ) {
+      *replaced = slot->holder;
+   }
+   else {
+      slot->origin   = origin;
+      slot->instance = key->instance;
+      slot->hash     = hash;
+      This->draft->size += 1;
+      draft_forget_order( This->draft );
+   }
+   slot->holder = *holder;
+   return true;
+}
+
+/**
+ * Prépare le retrait de l'alvéole index : les pages de sa grappe, jusqu'à la première alvéole
+ * libre, et celles des derniers membres de son type et de son origine sont copiées, les listes
+ * des groupes de la grappe rendues modifiables. Le retrait lui-même n'alloue plus rien et ne
+ * peut plus échouer.
+ */
+static bool draft_prepare_removal( rkv_store_private * This, size_t index ) {
+   version *    draft = This->draft;
+   const size_t mask  = draft->capacity - 1;
+   for( size_t j = index; slot_at( draft, j )->holder.id; j = ( j + 1 ) & mask ) {
+      if( draft_slot_for_write( This, j ) == NULL ) {
+         return false;
+      }
+      for( size_t g = 0; g < GROUPINGS; ++g ) {
+         if( draft_members( draft, g, group_of( slot_at( draft, j ), g ), 0 ) == NULL ) {
+            return false;
+         }
+      }
+   }
+   for( size_t g = 0; g < GROUPINGS; ++g ) {
+      const members * m = draft_members( draft, g, group_of( slot_at( draft, index ), g ), 0 );
+      if(( m == NULL )||( draft_slot_for_write( This, m->index[m->count - 1] ) == NULL )) {
+         return false;
+      }
+   }
+   return true;
+}
+
+/**
+ * Retire une clé du brouillon, sans marquer l'alvéole : les suivantes de la même grappe reculent
+ * dans le trou tant que leur position d'origine ne se trouve pas entre le trou et elles, la
+ * recherche reste celle de l'adressage ouvert linéaire. Le holder retiré est recopié dans
+ * *removed, à retirer par l'appelant comme un holder remplacé, voir rkv_store_put().
+ */
+bool rkv_store_remove( rkv_store store, const rkv_key * key, rkv_data_holder * removed, bool * has_removed ) {
+   if(( store == NULL )||( key == NULL )||( removed == NULL )||( has_removed == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_store_private * This = (rkv_store_private *)store;
+   if( This->draft == NULL ) {
+      fprintf( stderr, "%s: no update in progress\n", __func__ );
+      return false;
+   }
+   version *      draft  = This->draft;
+   const size_t   mask   = draft->capacity - 1;
+   const uint64_t origin = rkv_id_origin( key );
+   const size_t   index  = find_index( draft, origin, key->instance, rkv_id_hash( origin, key->instance ));
+   *has_removed = ( slot_at( draft, index )->holder.id != NULL );
+   if( ! *has_removed ) {
+      return true;
+   }
+   if( ! draft_prepare_removal( This, index )) {
+      return false;
+   }
+   rkv_store_slot * slot = slot_at( draft, index );
+   *removed = slot->holder;
+   for( size_t g = 0; g < GROUPINGS; ++g ) {
+      draft_leave( This, slot, index, g );
+   }
+   size_t hole = index;
+   for( size_t j = ( index + 1 ) & mask; slot_at( draft, j )->holder.id; j = ( j + 1 ) & mask ) {
+      rkv_store_slot * next  = slot_at( draft, j );
+      const size_t     home  = next->hash & mask;
+      const bool       stays = ( hole <= j )
+         ? (( hole < home )&&( home <= j ))
+         : (( hole < home )||( home <= j ));
+      if( ! stays ) {
+         for( size_t g = 0; g < GROUPINGS; ++g ) {
+            draft_members( draft, g, group_of( next, g ), 0 )->index[next->member[g]] = (uint32_t)hole;
+         }
+         *slot_at( draft, hole ) = *next;
+         hole = j;
+      }
+   }
+   memset( slot_at( draft, hole ), 0, sizeof( rkv_store_slot ));
+   draft->size -= 1;
+   draft_forget_order( draft );
+   return true;
+}
+
+/**
+ * Retire du brouillon les clés créées par le processus d'origin, dont seuls host et process
+ * comptent : la liste de l'origine les donne sans parcourir la table, la dernière d'abord pour
+ * qu'aucune autre ne bouge dans la liste. removed reçoit chaque holder retiré, à retirer par
+ * l'appelant comme celui de rkv_store_remove().
+ */
+bool rkv_store_remove_origin( rkv_store store, const rkv_key * origin, rkv_store_iterator removed, void * user_context ) {
+   if(( store == NULL )||( origin == NULL )||( removed == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_store_private * This = (rkv_store_private *)store;
+   if( This->draft == NULL ) {
+      fprintf( stderr, "%s: no update in progress\n", __func__ );
+      return false;
+   }
+   const uint64_t group = rkv_id_origin( origin );
+   for( size_t i = 0;; ++i ) {
+      bool         found = false;
+      const size_t t     = find_group( This->draft, BY_ORIGIN, group, &found );
+      if( ! found ||( This->draft->groups[BY_ORIGIN].lists[t]->count == 0 )) {
+         return true;
+      }
+      const members * m           = This->draft->groups[BY_ORIGIN].lists[t];
+      const rkv_key   key         = *(const rkv_key *)slot_at( This->draft, m->index[m->count - 1] )->holder.id;
+      rkv_data_holder holder;
+      bool            has_removed = false;
+      if( ! rkv_store_remove( store, &key, &holder, &has_removed )) {
+         return false;
+      }
+      if( ! removed( i, &holder, user_context )) {
+         return true;
+      }
+   }
+}
+
+/**
+ * Publie le brouillon. La version précédente et garbage, ce que l'appelant a remplacé,
+ * sont libérés quand plus aucun lecteur ne peut les atteindre.
+ */
+bool rkv_store_update_end( rkv_store store, void * garbage, rkv_epoch_reclaim reclaim, void * user_context ) {
+   if( store == NULL ) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_store_private * This = (rkv_store_private *)store;
+   if( This->draft == NULL ) {
+      fprintf( stderr, "%s: no update in progress\n", __func__ );
+      return false;
+   }
+   version * previous = atomic_exchange( &This->current, This->draft );
+   This->draft = NULL;
+   free( This->owned );
+   This->owned = NULL;
+   bool ok = rkv_epoch_retire( This->epoch, previous, version_reclaim, NULL );
+   if( reclaim ) {
+      ok = rkv_epoch_retire( This->epoch, garbage, reclaim, user_context ) && ok;
+   }
+   return ok;
+}
+
+/**
+ * Hors mise à jour, par l'écrivain. Une table remplie à moins du quart de son facteur maximal
+ * est reconstruite à la plus petite capacité qui la remplit au plus à la moitié de ce facteur,
+ * sans descendre sous celle de la création : entre la croissance et la compaction, la marge
+ * évite qu'une table oscille. La nouvelle version est publiée comme par rkv_store_update_end().
+ */
+bool rkv_store_compact( rkv_store store, bool * compacted ) {
+   if(( store == NULL )||( compacted == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_store_private * This     = (rkv_store_private *)store;
+   const version *     current  = atomic_load( &This->current );
+   size_t              capacity = current->capacity;
+   *compacted = false;
+   if( This->draft ) {
+      fprintf( stderr, "%s: update in progress\n", __func__ );
+      return false;
+   }
+   if(( capacity == This->capacity_min )
+      ||( current->size * STORE_LOAD_DEN * 4 >= capacity * STORE_LOAD_NUM ))
+   {
+      return true;
+   }
+   while(( capacity / 2 >= This->capacity_min )
+      &&( current->size * STORE_LOAD_DEN * 2 <= ( capacity / 2 ) * STORE_LOAD_NUM ))
+   {
+      capacity /= 2;
+   }
+   if( ! rkv_store_update_begin( store )) {
+      return false;
+   }
+   *compacted = draft_resize( This, capacity );
+   return rkv_store_update_end( store, NULL, NULL, NULL ) && *compacted;
+}
+
+bool rkv_store_get_capacity( rkv_store store, size_t * capacity ) {
+   if(( store == NULL )||( capacity == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_store_private * This    = (rkv_store_private *)store;
+   bool                entered = false;
+   const version *     v       = reader_version( This, &entered );
+   if( v == NULL ) {
+      return false;
+   }
+   *capacity = v->capacity;
+   reader_done( This, entered );
+   return true;
+}
+
+bool rkv_store_get_versions( rkv_store store, unsigned long * retired ) {
+   if(( store == NULL )||( retired == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   return rkv_epoch_get_retired(((rkv_store_private *)store)->epoch, retired );
+}
+
+bool rkv_store_delete( rkv_store * store ) {
+   if(( store == NULL )||( *store == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_store_private * This = *(rkv_store_private **)store;
+   if( This->draft ) {
+      version_reclaim( This->draft, NULL );
+      free( This->owned );
+   }
+   rkv_epoch_delete( &This->epoch );
+   version_reclaim( atomic_load( &This->current ), NULL );
+   free( This );
+   *store = NULL;
+   return true;
+}
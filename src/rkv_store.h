@@ -0,0 +1,54 @@
+#pragma once
+
+#include <rkv.h>
+
+#include "rkv_epoch.h"
+
+#include <stdint.h>
+
+typedef struct {
+   rkv_id       id;
+   const void * payload;
+   unsigned     type;
+   uint32_t     publisher_rank; // émetteur de la transaction reçue, 0 hors du multicast, voir merge_received()
+   uint32_t     sequence;       // numéro de cette transaction chez son émetteur
+   bool         lazy;    // payload désigne une valeur d'instantané pas forcément décodée, voir rkv_snapshot_load()
+} rkv_data_holder;
+
+/**
+ * Table de hachage à adressage ouvert indexée par l'identité (host, process, instance)
+ * d'un rkv_id. Les rkv_data_holder sont stockés dans les alvéoles de la table.
+ *
+ * La table est versionnée : les lecteurs lisent sans verrou la version publiée, l'unique
+ * écrivain prépare la suivante entre rkv_store_update_begin() et rkv_store_update_end().
+ * Les pages d'alvéoles non modifiées sont partagées entre versions, les autres sont copiées.
+ *
+ * Chaque version range aussi les alvéoles de chaque type dans une liste, mise à jour à chaque
+ * ajout et à chaque changement de type : parcourir ou compter un type ne coûte que ses entrées.
+ * De même, celles de chaque origine, le processus qui a créé la clé : retirer toutes les clés
+ * d'une origine ne coûte que ses entrées.
+ *
+ * Une clé retirée libère son alvéole, rkv_store_compact() réduit la table quand elle s'est vidée.
+ */
+typedef struct { unsigned unused; } * rkv_store;
+
+typedef bool (* rkv_store_iterator)( size_t index, const rkv_data_holder * holder, void * user_context );
+
+bool rkv_store_new       ( rkv_store * This, size_t capacity );
+bool rkv_store_read_begin( rkv_store   This );
+bool rkv_store_read_end  ( rkv_store   This );
+bool rkv_store_get       ( rkv_store   This, const rkv_key * key, const rkv_data_holder ** holder );
+bool rkv_store_get_size  ( rkv_store   This, size_t * size );
+bool rkv_store_foreach   ( rkv_store   This, rkv_store_iterator iterator, void * user_context );
+bool rkv_store_foreach_from( rkv_store This, const rkv_key * after, rkv_store_iterator iterator, void * user_context );
+bool rkv_store_foreach_type( rkv_store This, unsigned type, rkv_store_iterator iterator, void * user_context );
+bool rkv_store_count_type( rkv_store This, unsigned type, size_t * count );
+bool rkv_store_update_begin( rkv_store This );
+bool rkv_store_put       ( rkv_store   This, const rkv_data_holder * holder, rkv_data_holder * replaced, bool * has_replaced );
+bool rkv_store_remove    ( rkv_store   This, const rkv_key * key, rkv_data_holder * removed, bool * has_removed );
+bool rkv_store_remove_origin( rkv_store This, const rkv_key * origin, rkv_store_iterator removed, void * user_context );
+bool rkv_store_update_end( rkv_store   This, void * garbage, rkv_epoch_reclaim reclaim, void * user_context );
+bool rkv_store_compact   ( rkv_store   This, bool * compacted );
+bool rkv_store_get_capacity( rkv_store This, size_t * capacity );
+bool rkv_store_get_versions( rkv_store This, unsigned long * retired );
+bool rkv_store_delete    ( rkv_store * This );
@@ -0,0 +1,362 @@
+#include "rkv_timers.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LEVEL_SHIFT      6
+#define LEVEL_SLOTS      (1U << LEVEL_SHIFT)
+#define LEVEL_MASK       (LEVEL_SLOTS - 1)
+#define LEVELS           4
+#define DUE              (LEVELS * LEVEL_SLOTS) // case des échéances tombées, voir rkv_timers_advance()
+#define BUCKETS          (DUE + 1)
+#define NONE             UINT32_MAX
+#define TIMERS_SLOTS_MIN 64
+
+typedef struct {
+   rkv_key  key;
+   uint64_t deadline; // en tops
+   uint32_t bucket;
+   uint32_t prev;
+   uint32_t next;
+} timer;
+
+/**
+ * Les échéances sont rangées à la suite et chaînées dans leur case, bucket permet de les délier
+ * en O(1) ; une échéance retirée est remplacée par la dernière. Comme dans rkv_conflation, slots
+ * est une table à adressage ouvert de capacité puissance de 2, remplie au plus à moitié : chaque
+ * case vaut 0 si elle est libre, sinon l'indice de l'échéance plus un.
+ *
+ * Le niveau l range les échéances à moins de LEVEL_SLOTS^(l+1) tops, dans la case des bits
+ * l * LEVEL_SHIFT et suivants de leur top : quand le top courant entre dans cette case, elle se
+ * vide dans les niveaux inférieurs.
+ */
+typedef struct {
+   timer *  timers;
+   size_t   count;
+   size_t   allocated;
+   size_t * slots;
+   size_t   mask;
+   uint32_t heads[BUCKETS];
+   uint64_t now;     // en tops
+   unsigned tick_ms;
+} rkv_timers_private;
+
+bool rkv_timers_new( rkv_timers * timers, unsigned tick_ms, uint64_t now ) {
+   if( timers == NULL ) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   if( tick_ms == 0 ) {
+      fprintf( stderr, "%s: tick must be positive\n", __func__ );
+      return false;
+   }
+   rkv_timers_private * This = calloc( 1, sizeof( rkv_timers_private ));
+   if( This == NULL ) {
+      perror( "calloc" );
+      return false;
+   }
+   This->slots = calloc( TIMERS_SLOTS_MIN, sizeof( size_t ));
+   if( This->slots == NULL ) {
+      perror( "calloc" );
+      free( This );
+      return false;
+   }
+   for( size_t b = 0; b < BUCKETS; ++b ) {
+      This->heads[b] = NONE;
+   }
+   This->mask    = TIMERS_SLOTS_MIN - 1;
+   This->tick_ms = tick_ms;
+   This->now     = now / tick_ms;
+   *timers = (rkv_timers)This;
+   return true;
+}
+
+static size_t * find_slot( const rkv_timers_private * This, const rkv_key * key ) {
+   size_t i = rkv_key_hash( key ) & This->mask;
+   while( This->slots[i] && ! rkv_key_equals( &This->timers[This->slots[i] - 1].key, key )) {
+      i = ( i + 1 ) & This->mask;
+   }
+   return This->slots + i;
+}
+
+static bool grow_slots( rkv_timers_private * This ) {
+   const size_t capacity = 2 * ( This->mask + 1 );
+   size_t *     slots    = calloc( capacity, sizeof( size_t ));
+   if( slots == NULL ) {
+      perror( "calloc" );
+      return false;
+   }
+   free( This->slots );
+   This->slots = slots;
+   This->mask  = capacity - 1;
+   for( size_t t = 0; t < This->count; ++t ) {
+      *find_slot( This, &This->timers[t].key ) = t + 1;
+   }
+   return true;
+}
+
+/**
+ * Comme rkv_fingerprints_remove() : les suivantes de la grappe reculent dans le trou tant que
+ * leur position d'origine ne se trouve pas entre le trou et elles.
+ */
+static void forget_slot( rkv_timers_private * This, size_t * slot ) {
+   size_t hole = (size_t)( slot - This->slots );
+   for( size_t j = ( hole + 1 ) & This->mask; This->slots[j]; j = ( j + 1 ) & This->mask ) {
+      const size_t home  = rkv_key_hash( &This->timers[This->slots[j] - 1].key ) & This->mask;
+      const bool   stays = ( hole <= j )
+         ? (( hole < home )&&( home <= j ))
+         : (( hole < home )||( home <= j ));
+      if( ! stays ) {
+         This->slots[hole] = This->slots[j];
+         hole = j;
+      }
+   }
+   This->slots[hole] = 0;
+}
+
+/**
+ * Case de l'échéance deadline, vue du top courant. Une échéance passée tombe au top suivant,
+ * une échéance au-delà de la roue attend dans sa dernière case, d'où elle sera replacée.
+ */
+static uint32_t bucket_of( const rkv_timers_private * This, uint64_t deadline ) {
+   const uint64_t horizon = ( 1ULL << ( LEVEL_SHIFT * LEVELS )) - 1;
+   uint64_t       due     = ( deadline > This->now ) ? deadline : This->now + 1;
+   if( due - This->now > horizon ) {
+      due = This->now + horizon;
+   }
+   unsigned level = 0;
+   while( due - This->now >= ( 1ULL << ( LEVEL_SHIFT * ( level + 1 )))) {
+      ++level;
+   }
+   return level * LEVEL_SLOTS + (uint32_t)(( due >> ( LEVEL_SHIFT * level )) & LEVEL_MASK );
+}
+
+static void attach( rkv_timers_private * This, uint32_t t, uint32_t bucket ) {
+   timer * e = This->timers + t;
+   e->bucket = bucket;
+   e->prev   = NONE;
+   e->next   = This->heads[bucket];
+   if( e->next != NONE ) {
+      This->timers[e->next].prev = t;
+   }
+   This->heads[bucket] = t;
+}
+
+static void detach( rkv_timers_private * This, uint32_t t ) {
+   const timer * e = This->timers + t;
+   if( e->prev != NONE ) {
+      This->timers[e->prev].next = e->next;
+   }
+   else {
+      This->heads[e->bucket] = e->next;
+   }
+   if( e->next != NONE ) {
+      This->timers[e->next].prev = e->prev;
+   }
+}
+
+/**
+ * La dernière échéance prend la place de t : son index et ses voisines sont mis à jour.
+ */
+static void remove_at( rkv_timers_private * This, uint32_t t ) {
+   detach( This, t );
+   forget_slot( This, find_slot( This, &This->timers[t].key ));
+   This->count -= 1;
+   if( t == This->count ) {
+      return;
+   }
+   timer * e = This->timers + t;
+   *e = This->timers[This->count];
+   *find_slot( This, &e->key ) = (size_t)t + 1;
+   if( e->prev != NONE ) {
+      This->timers[e->prev].next = t;
+   }
+   else {
+      This->heads[e->bucket] = t;
+   }
+   if( e->next != NONE ) {
+      This->timers[e->next].prev = t;
+   }
+}
+
+/**
+ * Arme l'échéance de key, ou la déplace si elle l'était déjà.
+ */
+bool rkv_timers_arm( rkv_timers timers, const rkv_key * key, uint64_t deadline ) {
+   if(( timers == NULL )||( key == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_timers_private * This = (rkv_timers_private *)timers;
+   if(( 2 *( This->count + 1 ) > This->mask + 1 )&& ! grow_slots( This )) {
+      return false;
+   }
+   size_t * slot = find_slot( This, key );
+   uint32_t t    = 0;
+   if( *slot ) {
+      t = (uint32_t)( *slot - 1 );
+      detach( This, t );
+   }
+   else {
+      if( This->count == This->allocated ) {
+         const size_t allocated = This->allocated ? 2 * This->allocated : TIMERS_SLOTS_MIN / 2;
+         timer *      grown     = realloc( This->timers, allocated * sizeof( timer ));
+         if( grown == NULL ) {
+            perror( "realloc" );
+            return false;
+         }
+         This->timers    = grown;
+         This->allocated = allocated;
+      }
+      t = (uint32_t)This->count;
+      This->timers[t].key = *key;
+      This->count += 1;
+      *slot = This->count;
+   }
+   This->timers[t].deadline = ( deadline + This->tick_ms - 1 ) / This->tick_ms;
+   attach( This, t, bucket_of( This, This->timers[t].deadline ));
+   return true;
+}
+
+bool rkv_timers_cancel( rkv_timers timers, const rkv_key * key ) {
+   if(( timers == NULL )||( key == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_timers_private * This = (rkv_timers_private *)timers;
+   if( This->count == 0 ) {
+      return true;
+   }
+   const size_t * slot = find_slot( This, key );
+   if( *slot ) {
+      remove_at( This, (uint32_t)( *slot - 1 ));
+   }
+   return true;
+}
+
+/**
+ * Vrai si l'échéance de key est armée, *deadline reçoit son top en millisecondes.
+ */
+bool rkv_timers_get( rkv_timers timers, const rkv_key * key, uint64_t * deadline ) {
+   if(( timers == NULL )||( key == NULL )||( deadline == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   const rkv_timers_private * This = (const rkv_timers_private *)timers;
+   if( This->count == 0 ) {
+      return false;
+   }
+   const size_t * slot = find_slot( This, key );
+   if( *slot ) {
+      *deadline = This->timers[*slot - 1].deadline * This->tick_ms;
+   }
+   return *slot != 0;
+}
+
+/**
+ * Vide une case : chaque échéance est replacée par rapport au top courant, celles qui sont
+ * tombées rejoignent DUE.
+ */
+static void scatter( rkv_timers_private * This, uint32_t bucket ) {
+   uint32_t t = This->heads[bucket];
+   This->heads[bucket] = NONE;
+   while( t != NONE ) {
+      const uint32_t next = This->timers[t].next;
+      attach( This, t, ( This->timers[t].deadline <= This->now ) ? DUE : bucket_of( This, This->timers[t].deadline ));
+      t = next;
+   }
+}
+
+/**
+ * Avance top par top jusqu'à now. À chaque top, les cases des niveaux supérieurs dont le tour
+ * commence se vident, de la plus haute à la plus basse, puis celle du niveau 0 : expired est
+ * appelé pour chaque échéance tombée, après son retrait. Il peut armer ou désarmer des clés.
+ * Sans échéance, la roue saute directement à now.
+ */
+bool rkv_timers_advance( rkv_timers timers, uint64_t now, rkv_timers_expired expired, void * user_context ) {
+   if(( timers == NULL )||( expired == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_timers_private * This   = (rkv_timers_private *)timers;
+   const uint64_t       target = now / This->tick_ms;
+   while( This->now < target ) {
+      if( This->count == 0 ) {
+         This->now = target;
+         break;
+      }
+      This->now += 1;
+      unsigned levels = 1;
+      while(( levels < LEVELS )&&(( This->now & (( 1ULL << ( LEVEL_SHIFT * levels )) - 1 )) == 0 )) {
+         ++levels;
+      }
+      for( unsigned level = levels - 1; level > 0; --level ) {
+         scatter( This, level * LEVEL_SLOTS + (uint32_t)(( This->now >> ( LEVEL_SHIFT * level )) & LEVEL_MASK ));
+      }
+      scatter( This, (uint32_t)( This->now & LEVEL_MASK ));
+      while( This->heads[DUE] != NONE ) {
+         const uint32_t t   = This->heads[DUE];
+         const rkv_key  key = This->timers[t].key;
+         remove_at( This, t );
+         expired( &key, user_context );
+      }
+   }
+   return true;
+}
+
+/**
+ * Vrai s'il reste une échéance, *deadline reçoit le premier top où la roue peut en voir tomber
+ * une : pour le niveau 0 celui de la case, pour les autres le début du tour de la case, qui peut
+ * précéder les échéances qu'elle range. Il suffit d'avancer jusque-là pour ne pas en manquer.
+ */
+bool rkv_timers_next( rkv_timers timers, uint64_t * deadline ) {
+   if(( timers == NULL )||( deadline == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   const rkv_timers_private * This = (const rkv_timers_private *)timers;
+   if( This->count == 0 ) {
+      return false;
+   }
+   uint64_t next = UINT64_MAX;
+   for( unsigned level = 0; level < LEVELS; ++level ) {
+      const unsigned shift = LEVEL_SHIFT * level;
+      for( uint64_t i = 1; i <= LEVEL_SLOTS; ++i ) {
+         const uint64_t block = ( This->now >> shift ) + i;
+         if( This->heads[level * LEVEL_SLOTS + (uint32_t)( block & LEVEL_MASK )] != NONE ) {
+            if(( block << shift ) < next ) {
+               next = block << shift;
+            }
+            break;
+         }
+      }
+   }
+   if( This->heads[DUE] != NONE ) {
+      next = This->now;
+   }
+   *deadline = next * This->tick_ms;
+   return true;
+}
+
+bool rkv_timers_get_count( rkv_timers timers, size_t * count ) {
+   if(( timers == NULL )||( count == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   *count = ((const rkv_timers_private *)timers)->count;
+   return true;
+}
+
+bool rkv_timers_delete( rkv_timers * timers ) {
+   if(( timers == NULL )||( *timers == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_timers_private * This = (rkv_timers_private *)*timers;
+   free( This->timers );
+   free( This->slots );
+   free( This );
+   *timers = NULL;
+   return true;
+}
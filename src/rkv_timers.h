@@ -0,0 +1,28 @@
+#pragma once
+
+#include <rkv_id.h>
+
+#include <stdint.h>
+
+/**
+ * Échéances indexées par clé, rangées dans une roue hiérarchique : chaque niveau a ses cases,
+ * chaque case d'un niveau couvre autant de tops que tout le niveau inférieur. Armer, réarmer et
+ * désarmer une clé coûtent O(1) ; avancer ne coûte que les tops écoulés et les échéances qui
+ * tombent ou descendent d'un niveau, jamais un parcours de toutes les échéances.
+ *
+ * Les temps sont en millisecondes, arrondis au top : une échéance ne tombe jamais en avance.
+ *
+ * La table n'est pas protégée contre les accès concurrents.
+ */
+typedef struct { unsigned unused; } * rkv_timers;
+
+typedef void (* rkv_timers_expired)( const rkv_key * key, void * user_context );
+
+bool rkv_timers_new      ( rkv_timers * This, unsigned tick_ms, uint64_t now );
+bool rkv_timers_arm      ( rkv_timers   This, const rkv_key * key, uint64_t deadline );
+bool rkv_timers_cancel   ( rkv_timers   This, const rkv_key * key );
+bool rkv_timers_get      ( rkv_timers   This, const rkv_key * key, uint64_t * deadline );
+bool rkv_timers_advance  ( rkv_timers   This, uint64_t now, rkv_timers_expired expired, void * user_context );
+bool rkv_timers_next     ( rkv_timers   This, uint64_t * deadline );
+bool rkv_timers_get_count( rkv_timers   This, size_t * count );
+bool rkv_timers_delete   ( rkv_timers * This );
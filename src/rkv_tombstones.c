@@ -0,0 +1,236 @@
+#include "rkv_tombstones.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TOMBSTONES_SLOTS_MIN 64
+
+typedef struct {
+   rkv_id   id;
+   uint64_t expiry;
+   uint64_t generation;
+   uint32_t publisher_rank; // 0 : n'écarte plus rien
+   uint32_t sequence;
+} tombstone;
+
+/**
+ * Comme rkv_conflation : slots est une table à adressage ouvert de capacité puissance de 2,
+ * remplie au plus à moitié, chaque case vaut 0 si elle est libre, sinon l'indice de l'entrée plus
+ * un. La purge tasse les entrées et reconstruit slots à la taille de ce qui reste.
+ */
+typedef struct {
+   tombstone * entries;
+   size_t      count;
+   size_t      allocated;
+   size_t *    slots;
+   size_t      mask;
+} rkv_tombstones_private;
+
+bool rkv_tombstones_new( rkv_tombstones * tombstones ) {
+   if( tombstones == NULL ) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_tombstones_private * This = calloc( 1, sizeof( rkv_tombstones_private ));
+   if( This == NULL ) {
+      perror( "calloc" );
+      return false;
+   }
+   This->slots = calloc( TOMBSTONES_SLOTS_MIN, sizeof( size_t ));
+   if( This->slots == NULL ) {
+      perror( "calloc" );
+      free( This );
+      return false;
+   }
+   This->mask  = TOMBSTONES_SLOTS_MIN - 1;
+   *tombstones = (rkv_tombstones)This;
+   return true;
+}
+
+static size_t * find_slot( const rkv_tombstones_private * This, const rkv_key * key ) {
+   size_t i = rkv_key_hash( key ) & This->mask;
+   while( This->slots[i] && ! rkv_key_equals((const rkv_key *)This->entries[This->slots[i] - 1].id, key )) {
+      i = ( i + 1 ) & This->mask;
+   }
+   return This->slots + i;
+}
+
+static bool rebuild_slots( rkv_tombstones_private * This, size_t capacity ) {
+   size_t * slots = calloc( capacity, sizeof( size_t ));
+   if( slots == NULL ) {
+      perror( "calloc" );
+      return false;
+   }
+   free( This->slots );
+   This->slots = slots;
+   This->mask  = capacity - 1;
+   for( size_t e = 0; e < This->count; ++e ) {
+      *find_slot( This, (const rkv_key *)This->entries[e].id ) = e + 1;
+   }
+   return true;
+}
+
+bool rkv_tombstones_put( rkv_tombstones tombstones, rkv_id id, uint64_t expiry, uint64_t generation,
+   uint32_t publisher_rank, uint32_t sequence, bool * known )
+{
+   if(( tombstones == NULL )||( id == NULL )||( known == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_tombstones_private * This = (rkv_tombstones_private *)tombstones;
+   if(( 2 *( This->count + 1 ) > This->mask + 1 )&& ! rebuild_slots( This, 2 *( This->mask + 1 ))) {
+      return false;
+   }
+   size_t * slot = find_slot( This, (const rkv_key *)id );
+   *known = ( *slot != 0 );
+   if( ! *known ) {
+      if( This->count == This->allocated ) {
+         const size_t allocated = This->allocated ? 2 * This->allocated : TOMBSTONES_SLOTS_MIN / 2;
+         tombstone *  entries   = realloc( This->entries, allocated * sizeof( tombstone ));
+         if( entries == NULL ) {
+            perror( "realloc" );
+            return false;
+         }
+         This->entries   = entries;
+         This->allocated = allocated;
+      }
+      This->entries[This->count].id = id;
+      This->count += 1;
+      *slot = This->count;
+   }
+   This->entries[*slot - 1].expiry         = expiry;
+   This->entries[*slot - 1].generation     = generation;
+   This->entries[*slot - 1].publisher_rank = publisher_rank;
+   This->entries[*slot - 1].sequence       = sequence;
+   return true;
+}
+
+/**
+ * Une table vide répond sans hacher la clé : c'est le cas de chaque entrée fusionnée quand
+ * aucune clé n'a été retirée récemment. Une pierre tombale neutralisée n'est plus trouvée.
+ */
+bool rkv_tombstones_get( rkv_tombstones tombstones, const rkv_key * key, uint32_t * publisher_rank, uint32_t * sequence ) {
+   if(( tombstones == NULL )||( key == NULL )||( publisher_rank == NULL )||( sequence == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   const rkv_tombstones_private * This = (const rkv_tombstones_private *)tombstones;
+   if( This->count == 0 ) {
+      return false;
+   }
+   const size_t * slot = find_slot( This, key );
+   if(( *slot == 0 )||( This->entries[*slot - 1].publisher_rank == 0 )) {
+      return false;
+   }
+   *publisher_rank = This->entries[*slot - 1].publisher_rank;
+   *sequence       = This->entries[*slot - 1].sequence;
+   return true;
+}
+
+/**
+ * La pierre tombale reste jusqu'à la purge, qui rend sa référence : elle n'écarte plus rien et
+ * son échéance est passée, seule la génération où elle a été posée la retient encore.
+ */
+bool rkv_tombstones_clear( rkv_tombstones tombstones, const rkv_key * key ) {
+   if(( tombstones == NULL )||( key == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_tombstones_private * This = (rkv_tombstones_private *)tombstones;
+   if( This->count == 0 ) {
+      return true;
+   }
+   const size_t * slot = find_slot( This, key );
+   if( *slot ) {
+      This->entries[*slot - 1].expiry         = 0;
+      This->entries[*slot - 1].publisher_rank = 0;
+   }
+   return true;
+}
+
+static bool expired( const tombstone * t, uint64_t now, uint64_t generation ) {
+   return ( t->expiry <= now )&&( t->generation < generation );
+}
+
+/**
+ * Une pierre tombale part quand son échéance est passée et qu'elle a été posée avant la
+ * génération courante. Le nouvel index est alloué avant de toucher aux entrées : un échec
+ * laisse la table intacte. Les survivantes sont tassées en tête, dans leur ordre.
+ */
+bool rkv_tombstones_purge( rkv_tombstones tombstones, uint64_t now, uint64_t generation, rkv_tombstones_release release,
+   void * user_context )
+{
+   if(( tombstones == NULL )||( release == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_tombstones_private * This = (rkv_tombstones_private *)tombstones;
+   size_t                   kept = 0;
+   for( size_t e = 0; e < This->count; ++e ) {
+      if( ! expired( This->entries + e, now, generation )) {
+         ++kept;
+      }
+   }
+   if( kept == This->count ) {
+      return true;
+   }
+   size_t capacity = TOMBSTONES_SLOTS_MIN;
+   while( capacity < 2 * kept ) {
+      capacity *= 2;
+   }
+   size_t * slots = calloc( capacity, sizeof( size_t ));
+   if( slots == NULL ) {
+      perror( "calloc" );
+      return false;
+   }
+   kept = 0;
+   for( size_t e = 0; e < This->count; ++e ) {
+      if( expired( This->entries + e, now, generation )) {
+         release( This->entries[e].id, user_context );
+      }
+      else {
+         This->entries[kept++] = This->entries[e];
+      }
+   }
+   This->count = kept;
+   free( This->slots );
+   This->slots = slots;
+   This->mask  = capacity - 1;
+   for( size_t e = 0; e < This->count; ++e ) {
+      *find_slot( This, (const rkv_key *)This->entries[e].id ) = e + 1;
+   }
+   if( capacity / 2 < This->allocated ) {
+      tombstone * entries = realloc( This->entries, ( capacity / 2 ) * sizeof( tombstone ));
+      if( entries ) {
+         This->entries   = entries;
+         This->allocated = capacity / 2;
+      }
+   }
+   return true;
+}
+
+bool rkv_tombstones_get_count( rkv_tombstones tombstones, size_t * count ) {
+   if(( tombstones == NULL )||( count == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   *count = ((const rkv_tombstones_private *)tombstones)->count;
+   return true;
+}
+
+/**
+ * Les identifiants encore retenus doivent avoir été rendus par une purge complète.
+ */
+bool rkv_tombstones_delete( rkv_tombstones * tombstones ) {
+   if(( tombstones == NULL )||( *tombstones == NULL )) {
+      fprintf( stderr, "%s: null argument\n", __func__ );
+      return false;
+   }
+   rkv_tombstones_private * This = (rkv_tombstones_private *)*tombstones;
+   free( This->entries );
+   free( This->slots );
+   free( This );
+   *tombstones = NULL;
+   return true;
+}
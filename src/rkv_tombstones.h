@@ -0,0 +1,32 @@
+#pragma once
+
+#include <rkv_id.h>
+
+#include <stdint.h>
+
+/**
+ * Clés retirées récemment : tant que sa pierre tombale est là, une clé retirée ignore les mises
+ * à jour plus anciennes que son retrait, qui arrivent en retard ou dans le désordre. Chacune
+ * retient l'émetteur, par son rang, et le numéro de la transaction du retrait : seule une mise à
+ * jour du même émetteur peut lui être comparée. rkv_tombstones_clear() la neutralise quand une
+ * mise à jour plus récente recrée la clé. Chaque pierre tombale garde une référence sur
+ * l'identifiant internalisé de sa clé, rendue par rkv_tombstones_purge() une fois passées son
+ * échéance et la génération où elle a été posée.
+ *
+ * Les entrées sont rangées à la suite, l'index à adressage ouvert est reconstruit par la purge.
+ *
+ * La table n'est pas protégée contre les accès concurrents.
+ */
+typedef struct { unsigned unused; } * rkv_tombstones;
+
+typedef void (* rkv_tombstones_release)( rkv_id id, void * user_context );
+
+bool rkv_tombstones_new      ( rkv_tombstones * This );
+bool rkv_tombstones_put      ( rkv_tombstones   This, rkv_id id, uint64_t expiry, uint64_t generation,
+                               uint32_t publisher_rank, uint32_t sequence, bool * known );
+bool rkv_tombstones_get      ( rkv_tombstones   This, const rkv_key * key, uint32_t * publisher_rank, uint32_t * sequence );
+bool rkv_tombstones_clear    ( rkv_tombstones   This, const rkv_key * key );
+bool rkv_tombstones_purge    ( rkv_tombstones   This, uint64_t now, uint64_t generation, rkv_tombstones_release release,
+                               void * user_context );
+bool rkv_tombstones_get_count( rkv_tombstones   This, size_t * count );
+bool rkv_tombstones_delete   ( rkv_tombstones * This );
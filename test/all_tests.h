@@ -2,4 +2,6 @@
 
 #include <tst/tests_report.h>
 
-void rkv_test( struct tests_report * report );
+void rkv_test          ( struct tests_report * report );
+void rkv_perf_test     ( struct tests_report * report );
+void rkv_sequencer_test( struct tests_report * report );
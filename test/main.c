@@ -4,6 +4,8 @@
 
 int main( int argc, char * argv[] ) {
    return tests_run( argc, argv,
-      "rkv_test", rkv_test,
+      "rkv_test"          , rkv_test,
+      "rkv_perf_test"     , rkv_perf_test,
+      "rkv_sequencer_test", rkv_sequencer_test,
       NULL );
 }
@@ -0,0 +1,395 @@
+#include "all_tests.h"
+#include "../src/rkv_codecs.h"
+#include <rkv.h>
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define PERF_DATAGRAM_COUNT 20000
+#define PERF_TIMEOUT_MS     2000
+#define DISPATCH_CODECS     16
+#define DISPATCH_LOOKUPS    (4*1000*1000)
+#define PLAIN_VALUES        (1000*1000)
+#define DECODE_COST_NS      20000
+#define PIPELINE_WORKERS    4
+
+static const unsigned COUNTER_TYPE_ID = 1;
+
+static bool counter_encode( net_buff buffer, const void * src, utils_map codecs ) {
+   return net_buff_encode_uint32( buffer, *(const unsigned *)src );
+   (void)codecs;
+}
+
+static bool counter_decode( void * dest, net_buff buffer, utils_map codecs ) {
+   unsigned ** pp = (unsigned **)dest;
+   if( *pp == NULL ) {
+      *pp = malloc( sizeof( unsigned ));
+      if( *pp == NULL ) {
+         perror( "malloc" );
+         return false;
+      }
+   }
+   return net_buff_decode_uint32( buffer, *pp );
+   (void)codecs;
+}
+
+static void counter_releaser( void * data, utils_map codecs ) {
+   free( data );
+   (void)codecs;
+}
+
+static double now_ms( void ) {
+   struct timespec ts;
+   clock_gettime( CLOCK_MONOTONIC, &ts );
+   return (double)ts.tv_sec * 1000.0 + (double)ts.tv_nsec / 1.0E6;
+}
+
+/**
+ * Un cache émetteur publie PERF_DATAGRAM_COUNT transactions d'une entrée, donc autant de datagrammes,
+ * aussi vite que possible sur la boucle locale. Le cache récepteur compte ce qu'il a effectivement reçu.
+ */
+static double measure_receive_rate( struct tests_report * report, size_t recv_batch_size, unsigned long * received,
+   unsigned long * calls )
+{
+   rkv_codec counter_codec = {
+      COUNTER_TYPE_ID,
+      counter_encode,
+      counter_decode,
+      counter_releaser,
+      sizeof( unsigned ),
+      NULL,
+      NULL,
+      0U
+   };
+   const rkv_codec * const codecs[] = { &counter_codec };
+   rkv_options options = rkv_options_Default;
+   options.recv_batch_size = recv_batch_size;
+   rkv       receiver = NULL;
+   rkv       sender   = NULL;
+   rkv_id    id       = NULL;
+   rkv_stats stats;
+   *received = 0;
+   *calls    = 0;
+   if(   ! ASSERT( report, rkv_new_with_options( &receiver, "239.0.0.67", 2417, codecs, 1, &options ))
+      || ! ASSERT( report, rkv_new( &sender, "239.0.0.67", 2417, codecs, 1 ))
+      || ! ASSERT( report, rkv_id_new( &id )))
+   {
+      return 0.0;
+   }
+   const double start = now_ms();
+   for( unsigned i = 0; i < PERF_DATAGRAM_COUNT; ++i ) {
+      rkv_put( sender, "perf", id, COUNTER_TYPE_ID, &i );
+      rkv_publish( sender, "perf" );
+   }
+   double last_progress = now_ms();
+   double end           = last_progress;
+   while(( now_ms() - last_progress ) < PERF_TIMEOUT_MS ) {
+      if( ! rkv_get_stats( receiver, &stats )) {
+         break;
+      }
+      if( stats.datagrams_received > *received ) {
+         *received     = stats.datagrams_received;
+         *calls        = stats.receive_calls;
+         last_progress = now_ms();
+         end           = last_progress;
+      }
+      if( *received >= PERF_DATAGRAM_COUNT ) {
+         break;
+      }
+      struct timespec pause = { 0, 1000000 };
+      nanosleep( &pause, NULL );
+   }
+   ASSERT( report, rkv_refresh( receiver ));
+   ASSERT( report, rkv_delete( &sender ));
+   ASSERT( report, rkv_delete( &receiver ));
+   ASSERT( report, rkv_id_delete( &id ));
+   return ( end > start ) ? 1000.0 * (double)*received / ( end - start ) : 0.0;
+}
+
+static atomic_ulong slow_decoded;
+
+/**
+ * Un codec dont le décodage coûte DECODE_COST_NS, comme celui d'un type imbriqué.
+ */
+static bool slow_decode( void * dest, net_buff buffer, utils_map codecs ) {
+   const double until = now_ms() + DECODE_COST_NS / 1.0E6;
+   while( now_ms() < until ) {
+   }
+   atomic_fetch_add( &slow_decoded, 1 );
+   return counter_decode( dest, buffer, codecs );
+}
+
+/**
+ * L'émetteur, qui n'est pas abonné et ne réémet rien, publie PERF_DATAGRAM_COUNT datagrammes
+ * d'une entrée aussi vite que possible. Le récepteur décode dans son thread de réception ou
+ * avec des threads de décodage : ce qui n'est pas décodé a été perdu par le noyau, faute d'avoir
+ * été lu à temps. Le débit est celui des valeurs décodées. Avec filtered, le récepteur est abonné
+ * à un autre type : il saute les valeurs au lieu de les décoder, le débit est celui des valeurs sautées.
+ * Le gain des threads de décodage se lit dans le nombre de valeurs décodées, pas dans le débit :
+ * sur un seul cœur, ils ne décodent pas plus vite, mais le thread de réception vide la socket
+ * pendant qu'ils décodent, decode_queue_depth transactions d'avance. L'ordonnanceur en décide
+ * autant que la file : l'écart n'est qu'affiché, pas vérifié. L'ordre l'est : la valeur lue
+ * après chaque rafraîchissement ne recule jamais, ordered dit si c'est le cas.
+ */
+static double measure_pipeline( struct tests_report * report, size_t workers, bool filtered, unsigned long * decoded,
+   bool * ordered )
+{
+   rkv_codec slow_codec = {
+      COUNTER_TYPE_ID,
+      counter_encode,
+      slow_decode,
+      counter_releaser,
+      sizeof( unsigned ),
+      NULL,
+      NULL,
+      0U
+   };
+   const rkv_codec * const codecs[] = { &slow_codec };
+   rkv_options receiver_options = rkv_options_Default;
+   rkv_options sender_options   = rkv_options_Default;
+   receiver_options.decode_workers = workers;
+   sender_options.subscribe        = false;
+   sender_options.replay_datagrams = 0;
+   rkv    receiver = NULL;
+   rkv    sender   = NULL;
+   rkv_id id       = NULL;
+   atomic_store( &slow_decoded, 0 );
+   *decoded = 0;
+   *ordered = true;
+   if(   ! ASSERT( report, rkv_new_with_options( &receiver, "239.0.0.82", 2434, codecs, 1, &receiver_options ))
+      || ! ASSERT( report, rkv_new_with_options( &sender, "239.0.0.82", 2434, codecs, 1, &sender_options ))
+      || ! ASSERT( report, rkv_id_new( &id )))
+   {
+      return 0.0;
+   }
+   const unsigned other_type = COUNTER_TYPE_ID + 1;
+   if( filtered ) {
+      ASSERT( report, rkv_subscribe_types( receiver, &other_type, 1 ));
+   }
+   const double start = now_ms();
+   for( unsigned i = 0; i < PERF_DATAGRAM_COUNT; ++i ) {
+      rkv_put( sender, "pipeline", id, COUNTER_TYPE_ID, &i );
+      rkv_publish( sender, "pipeline" );
+   }
+   double   last_progress = now_ms();
+   double   end           = last_progress;
+   unsigned last_value    = 0;
+   while(( now_ms() - last_progress ) < PERF_TIMEOUT_MS ) {
+      unsigned long count = atomic_load( &slow_decoded );
+      rkv_stats     stats;
+      const void *  value = NULL;
+      if( rkv_refresh( receiver )&& rkv_get( receiver, id, &value )) {
+         *ordered   = *ordered &&( *(const unsigned *)value >= last_value );
+         last_value = *(const unsigned *)value;
+      }
+      if( filtered && rkv_get_stats( receiver, &stats )) {
+         count += stats.entries_skipped;
+      }
+      if( count > *decoded ) {
+         *decoded      = count;
+         last_progress = now_ms();
+         end           = last_progress;
+      }
+      if( *decoded >= PERF_DATAGRAM_COUNT ) {
+         break;
+      }
+      struct timespec pause = { 0, 1000000 };
+      nanosleep( &pause, NULL );
+   }
+   ASSERT( report, rkv_refresh( receiver ));
+   ASSERT( report, rkv_delete( &sender ));
+   ASSERT( report, rkv_delete( &receiver ));
+   ASSERT( report, rkv_id_delete( &id ));
+   return ( end > start ) ? 1000.0 * (double)*decoded / ( end - start ) : 0.0;
+}
+
+/**
+ * Coût de la recherche du codec d'une entrée, à l'encodage comme au décodage : la utils_map
+ * consultée jusque-là par entrée et la table de dispatch construite par rkv_new().
+ */
+static void measure_dispatch( struct tests_report * report ) {
+   rkv_codec         array[DISPATCH_CODECS];
+   const rkv_codec * codecs[DISPATCH_CODECS];
+   for( unsigned i = 0; i < DISPATCH_CODECS; ++i ) {
+      array[i]              = rkv_codec_Zero;
+      array[i].type         = 100 + 7 * i;
+      array[i].payload_size = sizeof( unsigned );
+      codecs[i]     = &array[i];
+   }
+   rkv_codecs dispatch = NULL;
+   utils_map  map      = NULL;
+   if(   ! ASSERT( report, rkv_codecs_new( &dispatch, codecs, DISPATCH_CODECS, 1, 0 ))
+      || ! ASSERT( report, rkv_codecs_get_map( dispatch, &map )))
+   {
+      return;
+   }
+   bool   found = true;
+   double start = now_ms();
+   for( unsigned i = 0; i < DISPATCH_LOOKUPS; ++i ) {
+      const unsigned    type  = array[i % DISPATCH_CODECS].type;
+      rkv_codec_entry * entry = NULL;
+      found = utils_map_get( map, &type, (map_value *)&entry ) && found &&( entry->codec.type == type );
+   }
+   const double map_ns = 1.0E6 * ( now_ms() - start ) / DISPATCH_LOOKUPS;
+   ASSERT( report, found );
+   start = now_ms();
+   for( unsigned i = 0; i < DISPATCH_LOOKUPS; ++i ) {
+      const unsigned    type  = array[i % DISPATCH_CODECS].type;
+      rkv_codec_entry * entry = NULL;
+      found = rkv_codecs_get( dispatch, type, &entry ) && found &&( entry->codec.type == type );
+   }
+   const double dispatch_ns = 1.0E6 * ( now_ms() - start ) / DISPATCH_LOOKUPS;
+   ASSERT( report, found );
+   rkv_codec_entry * entry = NULL;
+   ASSERT( report, ! rkv_codecs_get( dispatch, 99, &entry ));
+   ASSERT( report, rkv_codecs_delete( &dispatch ));
+   fprintf( stderr, "codec dispatch: utils_map %.1f ns/entry, dispatch table %.1f ns/entry\n", map_ns, dispatch_ns );
+}
+
+typedef struct {
+   uint32_t sequence;
+   uint16_t flags;
+   uint16_t origin;
+   double   value;
+} sample;
+
+static const rkv_field sample_layout[] = {
+   { offsetof( sample, sequence ), 4, 1 },
+   { offsetof( sample, flags    ), 2, 1 },
+   { offsetof( sample, origin   ), 2, 1 },
+   { offsetof( sample, value    ), 8, 1 },
+};
+
+static bool sample_encode( net_buff buffer, const void * src, utils_map codecs ) {
+   const sample * s = (const sample *)src;
+   uint64_t       value;
+   memcpy( &value, &s->value, sizeof( value ));
+   return net_buff_encode_uint32( buffer, s->sequence )
+      &&  net_buff_encode_uint16( buffer, s->flags )
+      &&  net_buff_encode_uint16( buffer, s->origin )
+      &&  net_buff_encode_uint64( buffer, value );
+   (void)codecs;
+}
+
+static bool sample_decode( void * dest, net_buff buffer, utils_map codecs ) {
+   sample ** pp = (sample **)dest;
+   sample    s;
+   uint64_t  value;
+   if(   ! net_buff_decode_uint32( buffer, &s.sequence )
+      || ! net_buff_decode_uint16( buffer, &s.flags )
+      || ! net_buff_decode_uint16( buffer, &s.origin )
+      || ! net_buff_decode_uint64( buffer, &value ))
+   {
+      return false;
+   }
+   memcpy( &s.value, &value, sizeof( value ));
+   if( *pp == NULL ) {
+      *pp = malloc( sizeof( sample ));
+      if( *pp == NULL ) {
+         perror( "malloc" );
+         return false;
+      }
+   }
+   **pp = s;
+   return true;
+   (void)codecs;
+}
+
+/**
+ * Un aller-retour encodage, décodage d'une petite valeur de taille fixe : codec écrit à la main,
+ * avec un malloc et un free par valeur comme le faisait le cache, puis codec plain data décodé
+ * dans un emplacement déjà alloué.
+ */
+static void measure_plain( struct tests_report * report ) {
+   const rkv_codec plain = {
+      .type         = 1,
+      .payload_size = sizeof( sample ),
+      .layout       = sample_layout,
+      .layout_count = sizeof( sample_layout ) / sizeof( sample_layout[0] )
+   };
+   net_buff buffer = NULL;
+   if( ! ASSERT( report, net_buff_new( &buffer, 64 ))) {
+      return;
+   }
+   sample in   = { 0, 0x0102, 0x0304, 3.25 };
+   sample slot = { 0, 0, 0, 0.0 };
+   bool   ok   = true;
+   double start = now_ms();
+   for( uint32_t i = 0; i < PLAIN_VALUES; ++i ) {
+      sample * out = NULL;
+      in.sequence = i;
+      ok = net_buff_clear( buffer ) && sample_encode( buffer, &in, NULL ) && net_buff_flip( buffer )
+         && sample_decode( &out, buffer, NULL ) &&( out->sequence == i ) && ok;
+      free( out );
+   }
+   const double custom_ns = 1.0E6 * ( now_ms() - start ) / PLAIN_VALUES;
+   ASSERT( report, ok );
+   start = now_ms();
+   for( uint32_t i = 0; i < PLAIN_VALUES; ++i ) {
+      in.sequence = i;
+      ok = net_buff_clear( buffer ) && rkv_plain_encode( buffer, &in, &plain ) && net_buff_flip( buffer )
+         && rkv_plain_decode( &slot, buffer, &plain ) &&( slot.sequence == i ) && ok;
+   }
+   const double plain_ns = 1.0E6 * ( now_ms() - start ) / PLAIN_VALUES;
+   ASSERT( report, ok );
+   ASSERT( report, memcmp( &in, &slot, sizeof( sample )) == 0 );
+   ASSERT( report, net_buff_delete( &buffer ));
+   fprintf( stderr, "fixed-size value: hand-written codec %.1f ns/value, plain data codec %.1f ns/value\n", custom_ns, plain_ns );
+}
+
+void rkv_perf_test( struct tests_report * report ) {
+   tests_chapter( report, "rkv plain data codec" );
+   measure_plain( report );
+
+   tests_chapter( report, "rkv codec dispatch per entry" );
+   measure_dispatch( report );
+
+   tests_chapter( report, "rkv receive rate, one datagram per syscall" );
+   unsigned long single_count = 0;
+   unsigned long single_calls = 0;
+   const double  single_rate  = measure_receive_rate( report, 1, &single_count, &single_calls );
+   ASSERT( report, single_count > 0 );
+   ASSERT( report, single_calls == single_count ); // un datagramme par appel compté
+
+   tests_chapter( report, "rkv receive rate, recvmmsg batches" );
+   unsigned long batch_count = 0;
+   unsigned long batch_calls = 0;
+   const double  batch_rate  = measure_receive_rate( report, rkv_options_Default.recv_batch_size, &batch_count, &batch_calls );
+   ASSERT( report, batch_count > 0 );
+   // sous le flot, recvmmsg() draine plusieurs datagrammes par appel
+   ASSERT( report, batch_calls < batch_count );
+
+   fprintf( stderr, "recvmsg : %lu/%d datagrams in %lu calls, %.0f datagrams/s\n", single_count, PERF_DATAGRAM_COUNT,
+      single_calls, single_rate );
+   fprintf( stderr, "recvmmsg: %lu/%d datagrams in %lu calls, %.0f datagrams/s\n", batch_count , PERF_DATAGRAM_COUNT,
+      batch_calls, batch_rate  );
+
+   tests_chapter( report, "rkv sustained rate, decoding in the receive thread" );
+   unsigned long inline_count = 0;
+   bool          ordered      = false;
+   const double  inline_rate  = measure_pipeline( report, 0, false, &inline_count, &ordered );
+   ASSERT( report, inline_count > 0 );
+   ASSERT( report, ordered );
+
+   tests_chapter( report, "rkv sustained rate, decode workers" );
+   unsigned long pipeline_count = 0;
+   const double  pipeline_rate  = measure_pipeline( report, PIPELINE_WORKERS, false, &pipeline_count, &ordered );
+   ASSERT( report, pipeline_count > 0 );
+   ASSERT( report, ordered );
+
+   tests_chapter( report, "rkv sustained rate, unsubscribed type" );
+   unsigned long filtered_count = 0;
+   const double  filtered_rate  = measure_pipeline( report, 0, true, &filtered_count, &ordered );
+   ASSERT( report, filtered_count > 0 );
+
+   fprintf( stderr, "%d ns decode, receive thread: %lu/%d decoded, %.0f values/s\n", DECODE_COST_NS, inline_count,
+      PERF_DATAGRAM_COUNT, inline_rate );
+   fprintf( stderr, "%d ns decode, %d workers    : %lu/%d decoded, %.0f values/s\n", DECODE_COST_NS, PIPELINE_WORKERS,
+      pipeline_count, PERF_DATAGRAM_COUNT, pipeline_rate );
+   fprintf( stderr, "%d ns decode, unsubscribed : %lu/%d skipped, %.0f values/s\n", DECODE_COST_NS, filtered_count,
+      PERF_DATAGRAM_COUNT, filtered_rate );
+}
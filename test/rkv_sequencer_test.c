@@ -0,0 +1,144 @@
+#include "all_tests.h"
+#include "../src/rkv_sequencer.h"
+
+#include <string.h>
+#include <time.h>
+
+#define SEQUENCER_TIMEOUT_MS 50
+#define NACKS_MAX            8
+
+typedef struct {
+   rkv_nack nacks[NACKS_MAX];
+   size_t   count;
+} nacks_sent;
+
+static bool record_nack( const rkv_nack * nack, const struct sockaddr_in * publisher, void * user_context ) {
+   nacks_sent * sent = (nacks_sent *)user_context;
+   if( sent->count < NACKS_MAX ) {
+      sent->nacks[sent->count++] = *nack;
+   }
+   return true;
+   (void)publisher;
+}
+
+static const rkv_publisher publisher = { 1, 2, 3 };
+
+/**
+ * Présente au sequencer le datagramme numéro datagram, dont le seul octet de données est son numéro.
+ */
+static bool add( rkv_sequencer sequencer, uint32_t datagram, bool * deliver ) {
+   struct sockaddr_in  from;
+   rkv_fragment_header header = {
+      .publisher = publisher,
+      .datagram  = datagram,
+      .sequence  = datagram,
+      .index     = 0,
+      .count     = 1,
+      .size      = 1,
+      .offset    = 0
+   };
+   net_buff buffer = NULL;
+   memset( &from, 0, sizeof( from ));
+   const bool ok = net_buff_new( &buffer, 16 )
+      &&  net_buff_encode_byte( buffer, (byte)datagram )
+      &&  net_buff_flip( buffer )
+      &&  rkv_sequencer_add( sequencer, &header, &from, buffer, deliver );
+   if( buffer ) {
+      net_buff_delete( &buffer );
+   }
+   return ok;
+}
+
+static bool announce( rkv_sequencer sequencer, uint32_t last ) {
+   struct sockaddr_in from;
+   memset( &from, 0, sizeof( from ));
+   return rkv_sequencer_announce( sequencer, &publisher, &from, last );
+}
+
+static bool next_is( rkv_sequencer sequencer, uint32_t datagram ) {
+   net_buff held  = NULL;
+   byte     value = 0;
+   if( ! rkv_sequencer_next( sequencer, &held )||( held == NULL )) {
+      return false;
+   }
+   const bool ok = net_buff_decode_byte( held, &value )&&( value == (byte)datagram );
+   net_buff_delete( &held );
+   return ok;
+}
+
+static bool nothing_next( rkv_sequencer sequencer ) {
+   net_buff held = NULL;
+   return rkv_sequencer_next( sequencer, &held )&&( held == NULL );
+}
+
+void rkv_sequencer_test( struct tests_report * report ) {
+   rkv_sequencer sequencer = NULL;
+   nacks_sent    sent;
+   bool          deliver   = false;
+   memset( &sent, 0, sizeof( sent ));
+
+   tests_chapter( report, "rkv sequencer in order" );
+   ASSERT( report, rkv_sequencer_new( &sequencer, 1024*1024, SEQUENCER_TIMEOUT_MS, record_nack, &sent ));
+   ASSERT( report, add( sequencer, 1, &deliver )&& deliver );
+   ASSERT( report, add( sequencer, 2, &deliver )&& deliver );
+   ASSERT( report, nothing_next( sequencer ));
+   ASSERT( report, sent.count == 0 );
+
+   tests_chapter( report, "rkv sequencer gap" );
+   ASSERT( report, add( sequencer, 5, &deliver )&& ! deliver );
+   ASSERT( report, sent.count == 1 );
+   ASSERT( report,( sent.nacks[0].first == 3 )&&( sent.nacks[0].count == 2 ));
+   ASSERT( report, rkv_protocol_same_publisher( &sent.nacks[0].publisher, &publisher ));
+   ASSERT( report, add( sequencer, 4, &deliver )&& ! deliver );
+   ASSERT( report, add( sequencer, 5, &deliver )&& ! deliver );
+   ASSERT( report, sent.count == 1 ); // ni le datagramme du trou ni le doublon ne sont réclamés
+   ASSERT( report, nothing_next( sequencer ));
+   ASSERT( report, add( sequencer, 3, &deliver )&& deliver );
+   ASSERT( report, next_is( sequencer, 4 ));
+   ASSERT( report, next_is( sequencer, 5 ));
+   ASSERT( report, nothing_next( sequencer ));
+   ASSERT( report, add( sequencer, 3, &deliver )&& ! deliver );
+
+   tests_chapter( report, "rkv sequencer lost" );
+   ASSERT( report, add( sequencer, 7, &deliver )&& ! deliver );
+   ASSERT( report,( sent.count == 2 )&&( sent.nacks[1].first == 6 )&&( sent.nacks[1].count == 1 ));
+   struct timespec pause = { 0, ( 2 * SEQUENCER_TIMEOUT_MS ) * 1000000L };
+   nanosleep( &pause, NULL );
+   ASSERT( report, rkv_sequencer_expire( sequencer ));
+   ASSERT( report, next_is( sequencer, 7 ));
+   ASSERT( report, add( sequencer, 8, &deliver )&& deliver );
+   size_t        held  = 0;
+   unsigned long nacks = 0;
+   unsigned long lost  = 0;
+   ASSERT( report, rkv_sequencer_get_stats( sequencer, &held, &nacks, &lost ));
+   ASSERT( report,( held == 0 )&&( nacks == 2 )&&( lost == 1 ));
+
+   tests_chapter( report, "rkv sequencer tail" );
+   // le datagramme 9, dernier de sa rafale, est perdu : seule l'annonce de l'émetteur le révèle
+   ASSERT( report, announce( sequencer, 9 ));
+   ASSERT( report,( sent.count == 3 )&&( sent.nacks[2].first == 9 )&&( sent.nacks[2].count == 1 ));
+   ASSERT( report, announce( sequencer, 9 ));
+   ASSERT( report, sent.count == 3 ); // déjà réclamé
+   ASSERT( report, add( sequencer, 9, &deliver )&& deliver );
+   ASSERT( report, nothing_next( sequencer ));
+   ASSERT( report, announce( sequencer, 9 ));
+   ASSERT( report, sent.count == 3 ); // déjà reçu
+
+   tests_chapter( report, "rkv sequencer tail lost" );
+   ASSERT( report, announce( sequencer, 11 ));
+   ASSERT( report,( sent.count == 4 )&&( sent.nacks[3].first == 10 )&&( sent.nacks[3].count == 2 ));
+   ASSERT( report, add( sequencer, 11, &deliver )&& ! deliver );
+   ASSERT( report, sent.count == 4 );
+   nanosleep( &pause, NULL );
+   ASSERT( report, rkv_sequencer_expire( sequencer ));
+   ASSERT( report, next_is( sequencer, 11 ));
+   ASSERT( report, announce( sequencer, 12 ));
+   ASSERT( report,( sent.count == 5 )&&( sent.nacks[4].first == 12 )&&( sent.nacks[4].count == 1 ));
+   nanosleep( &pause, NULL );
+   ASSERT( report, rkv_sequencer_expire( sequencer ));
+   ASSERT( report, nothing_next( sequencer ));
+   ASSERT( report, add( sequencer, 13, &deliver )&& deliver );
+   ASSERT( report, rkv_sequencer_get_stats( sequencer, &held, &nacks, &lost ));
+   ASSERT( report,( held == 0 )&&( nacks == 5 )&&( lost == 3 ));
+   ASSERT( report, rkv_sequencer_delete( &sequencer ));
+}
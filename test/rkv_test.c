@@ -2,10 +2,15 @@
 #include <rkv.h>
 #include <utils/utils_time.h>
 
+#include <dirent.h>
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
 
 typedef struct {
    unsigned char  day;
@@ -17,50 +22,14 @@ typedef struct {
 
 static const unsigned DATE_TYPE_ID = 1;
 
-static bool date_encode( net_buff buffer, const void * src, utils_map codecs ) {
-   const date * d = (const date *)src;
-   (void)codecs;
-   return net_buff_encode_byte  ( buffer, d->day )
-      &&  net_buff_encode_byte  ( buffer, d->month )
-      &&  net_buff_encode_uint16( buffer, d->year );
-}
-
-static bool date_decode( void * dest, net_buff buffer, utils_map codecs ) {
-   if( dest == NULL ) {
-      fprintf( stderr, "%s: null argument\n", __func__ );
-      return false;
-   }
-   date d;
-   if(   net_buff_decode_byte  ( buffer, &d.day   )
-      && net_buff_decode_byte  ( buffer, &d.month )
-      && net_buff_decode_uint16( buffer, &d.year  ))
-   {
-      date * p = *(date **)dest;
-      if( p == NULL ) {
-         p = malloc( sizeof( date ));
-         if( p == NULL ) {
-            perror( "malloc" );
-            return false;
-         }
-         if( RKV_DBG_MEMORY ) {
-            fprintf( stderr, "%s: %p = malloc( sizeof( date ))\n", __func__, (void *)p );
-         }
-         *((date **)dest) = p;
-      }
-      *p = d;
-      return true;
-   }
-   return false;
-   (void)codecs;
-}
-
-static void date_releaser( void * data, utils_map codecs ) {
-   if( RKV_DBG_MEMORY ) {
-      fprintf( stderr, "%s: free( %p )\n", __func__, data );
-   }
-   free( data );
-   (void)codecs;
-}
+/**
+ * La date est un type de taille fixe : rkv l'encode et la décode seul, d'après sa description.
+ */
+static const rkv_field date_layout[] = {
+   { offsetof( date, day   ), 1, 1 },
+   { offsetof( date, month ), 1, 1 },
+   { offsetof( date, year  ), 2, 1 },
+};
 
 static int date_compare( const date * left, const date * right ) {
    if(( left == NULL )&&( right == NULL )) {
@@ -90,14 +59,26 @@ typedef struct {
 
 static const unsigned PERSON_TYPE_ID = 2;
 
+/**
+ * Le codec des dates est résolu une fois pour toutes, quand rkv_new() appelle person_bind().
+ */
+static rkv_codec person_date_codec;
+
+static bool person_bind( utils_map codecs ) {
+   const rkv_codec * date_codec = NULL;
+   if( utils_map_get( codecs, &DATE_TYPE_ID, (map_value *)&date_codec )&& date_codec ) {
+      person_date_codec = *date_codec;
+      return true;
+   }
+   return false;
+}
+
 static bool person_encode( net_buff buffer, const void * src, utils_map codecs ) {
    const person * p = (const person *)src;
-   rkv_codec * date_codec = NULL;
    return net_buff_encode_string( buffer, p->forname )
       &&  net_buff_encode_string( buffer, p->name )
-      &&  utils_map_get( codecs, &DATE_TYPE_ID, (map_value *)&date_codec )
-      &&  date_codec
-      &&  date_codec->encoder( buffer, &p->birthday, codecs );
+      &&  rkv_plain_encode( buffer, &p->birthday, &person_date_codec );
+   (void)codecs;
 }
 
 static bool person_decode( void * dest, net_buff buffer, utils_map codecs ) {
@@ -106,14 +87,10 @@ static bool person_decode( void * dest, net_buff buffer, utils_map codecs ) {
       fprintf( stderr, "%s: null argument\n", __func__ );
       return false;
    }
-   person      p;
-   date *      birthday   = &p.birthday;
-   rkv_codec * date_codec = NULL;
+   person p;
    if(   net_buff_decode_string( buffer, p.forname, sizeof( p.forname ))
       && net_buff_decode_string( buffer, p.name   , sizeof( p.name ))
-      && utils_map_get( codecs, &DATE_TYPE_ID, (map_value *)&date_codec )
-      && date_codec
-      && date_codec->factory( &birthday, buffer, codecs ))
+      && rkv_plain_decode( &p.birthday, buffer, &person_date_codec ))
    {
       person * pp = *ppp;
       if( pp == NULL ) {
@@ -131,6 +108,7 @@ static bool person_decode( void * dest, net_buff buffer, utils_map codecs ) {
       return true;
    }
    return false;
+   (void)codecs;
 }
 
 static void person_releaser( void * data, utils_map codecs ) {
@@ -225,20 +203,1551 @@ static bool dump( size_t index, rkv_id id, unsigned type, const void * data, voi
    return true;
 }
 
+#define LARGE_TRANSACTION_COUNT 6000
+
+/**
+ * 6000 dates font environ 120 ko : la transaction est fragmentée à l'émission
+ * et ne doit être visible qu'une fois complètement réassemblée.
+ */
+static void large_transaction( struct tests_report * report, const rkv_codec * const codecs[], size_t codec_count ) {
+   tests_chapter( report, "rkv transaction larger than 64 KiB" );
+   rkv    cache = NULL;
+   rkv_id ids  [LARGE_TRANSACTION_COUNT];
+   date   dates[LARGE_TRANSACTION_COUNT];
+   ASSERT( report, rkv_new( &cache, "239.0.0.68", 2418, codecs, codec_count ));
+   for( unsigned i = 0; i < LARGE_TRANSACTION_COUNT; ++i ) {
+      dates[i].day   = (unsigned char)( 1 + i % 28 );
+      dates[i].month = (unsigned char)( 1 + i % 12 );
+      dates[i].year  = (unsigned short)( 1900 + i % 200 );
+      ASSERT( report, rkv_id_new( &ids[i] ));
+      ASSERT( report, rkv_put( cache, "large", ids[i], DATE_TYPE_ID, &dates[i] ));
+   }
+   ASSERT( report, rkv_publish( cache, "large" ));
+   const void * data = NULL;
+   bool received = false;
+   for( unsigned retry = 0; ( retry < 2000 )&& ! received; ++retry ) {
+      struct timespec pause = { 0, 1000000 };
+      nanosleep( &pause, NULL );
+      ASSERT( report, rkv_refresh( cache ));
+      received = rkv_get( cache, ids[LARGE_TRANSACTION_COUNT-1], &data );
+   }
+   ASSERT( report, received );
+   bool all_equals = true;
+   for( unsigned i = 0; i < LARGE_TRANSACTION_COUNT; ++i ) {
+      all_equals = all_equals
+         && rkv_get( cache, ids[i], &data )
+         &&( date_compare((const date *)data, &dates[i] ) == 0 );
+   }
+   ASSERT( report, all_equals );
+   ASSERT( report, rkv_delete( &cache ));
+   for( unsigned i = 0; i < LARGE_TRANSACTION_COUNT; ++i ) {
+      rkv_id_delete( &ids[i] );
+   }
+}
+
+#define READER_COUNT   4
+#define UPDATE_COUNT 200
+
+typedef struct {
+   rkv           cache;
+   rkv_id        id;
+   atomic_bool * stop;
+   unsigned long reads;
+   bool          consistent;
+} reader_context;
+
+static void * reader( void * arg ) {
+   reader_context * ctxt = (reader_context *)arg;
+   while( ! atomic_load( ctxt->stop )) {
+      const void * data = NULL;
+      rkv_read_begin( ctxt->cache );
+      if( rkv_get( ctxt->cache, ctxt->id, &data )) {
+         const date * d = (const date *)data;
+         ctxt->consistent = ctxt->consistent &&( d->day == d->month );
+         ctxt->reads     += 1;
+      }
+      rkv_read_end( ctxt->cache );
+   }
+   return NULL;
+}
+
+/**
+ * Des lecteurs lisent sans verrou pendant que le thread principal rafraîchit :
+ * chaque date publiée a day == month, une valeur libérée trop tôt le contredirait.
+ * Les identifiants et les dates remplacés sont recyclés : les réserves ne grossissent
+ * pas avec le nombre de mises à jour. L'identifiant reçu garde la même adresse.
+ */
+static void concurrent_readers( struct tests_report * report, const rkv_codec * const codecs[], size_t codec_count ) {
+   tests_chapter( report, "rkv concurrent readers" );
+   rkv            cache = NULL;
+   rkv_id         id    = NULL;
+   rkv_id         canonical = NULL;
+   bool           stable    = true;
+   atomic_bool    stop  = false;
+   pthread_t      threads [READER_COUNT];
+   reader_context contexts[READER_COUNT];
+   rkv_options options = rkv_options_Default;
+   options.pool_slab_objects = 16;
+   ASSERT( report, rkv_new_with_options( &cache, "239.0.0.69", 2419, codecs, codec_count, &options ));
+   ASSERT( report, rkv_id_new( &id ));
+   for( unsigned i = 0; i < READER_COUNT; ++i ) {
+      contexts[i].cache      = cache;
+      contexts[i].id         = id;
+      contexts[i].stop       = &stop;
+      contexts[i].reads      = 0;
+      contexts[i].consistent = true;
+      ASSERT( report, pthread_create( &threads[i], NULL, reader, &contexts[i] ) == 0 );
+   }
+   for( unsigned i = 0; i < UPDATE_COUNT; ++i ) {
+      const date d = { (unsigned char)( 1 + i % 12 ), (unsigned char)( 1 + i % 12 ), (unsigned short)( 2000 + i )};
+      ASSERT( report, rkv_put( cache, "update", id, DATE_TYPE_ID, &d ));
+      ASSERT( report, rkv_publish( cache, "update" ));
+      struct timespec pause = { 0, 500000 };
+      nanosleep( &pause, NULL );
+      ASSERT( report, rkv_refresh( cache ));
+      rkv_id received = NULL;
+      size_t size     = 1;
+      if( rkv_get_ids( cache, &received, &size )&&( size == 1 )) {
+         canonical = canonical ? canonical : received;
+         stable    = stable &&( received == canonical );
+      }
+   }
+   atomic_store( &stop, true );
+   unsigned long reads      = 0;
+   bool          consistent = true;
+   for( unsigned i = 0; i < READER_COUNT; ++i ) {
+      pthread_join( threads[i], NULL );
+      reads     += contexts[i].reads;
+      consistent = consistent && contexts[i].consistent;
+   }
+   ASSERT( report, reads > 0 );
+   ASSERT( report, consistent );
+   rkv_stats stats;
+   ASSERT( report, rkv_get_stats( cache, &stats ));
+   ASSERT( report, canonical != NULL );
+   ASSERT( report, stable );
+   ASSERT( report, stats.ids_in_use == 1 );
+   ASSERT( report, stats.ids_allocated      < UPDATE_COUNT );
+   ASSERT( report, stats.payloads_allocated < UPDATE_COUNT );
+   ASSERT( report, rkv_delete( &cache ));
+   ASSERT( report, rkv_id_delete( &id ));
+}
+
+#define RECYCLE_UPDATES 50
+
+/**
+ * Les personnes n'ont pas de réserve : avec payload_recycle_max, chaque mise à jour est décodée
+ * dans une valeur remplacée auparavant, sans allocation.
+ */
+static void recycled_payloads( struct tests_report * report, const rkv_codec * const codecs[], size_t codec_count ) {
+   tests_chapter( report, "rkv recycled payloads" );
+   rkv         cache   = NULL;
+   rkv_key     key;
+   rkv_options options = rkv_options_Default;
+   options.payload_recycle_max = 8;
+   ASSERT( report, rkv_key_make( &key ));
+   ASSERT( report, rkv_new_with_options( &cache, "239.0.0.71", 2421, codecs, codec_count, &options ));
+   bool all_received = true;
+   for( unsigned i = 0; i < RECYCLE_UPDATES; ++i ) {
+      person p = eve;
+      p.birthday.year = (unsigned short)( 2000 + i );
+      ASSERT( report, rkv_put_key( cache, "recycle", &key, PERSON_TYPE_ID, &p ));
+      ASSERT( report, rkv_publish( cache, "recycle" ));
+      bool received = false;
+      for( unsigned retry = 0; ( retry < 200 )&& ! received; ++retry ) {
+         struct timespec pause = { 0, 500000 };
+         nanosleep( &pause, NULL );
+         const void * data = NULL;
+         ASSERT( report, rkv_refresh( cache ));
+         received = rkv_get_key( cache, &key, &data ) &&( person_compare( data, &p ) == 0 );
+      }
+      all_received = all_received && received;
+   }
+   ASSERT( report, all_received );
+   rkv_stats stats;
+   ASSERT( report, rkv_get_stats( cache, &stats ));
+   ASSERT( report, stats.payloads_reused > 0 );
+   ASSERT( report, stats.payloads_recycled <= options.payload_recycle_max );
+   ASSERT( report, rkv_delete( &cache ));
+}
+
+#define CHANGED_KEYS 10
+
+/**
+ * Seules les valeurs modifiées sont republiées, sauf toutes les full_publish_period publications.
+ */
+static void changes_only( struct tests_report * report, const rkv_codec * const codecs[], size_t codec_count ) {
+   tests_chapter( report, "rkv publish changes only" );
+   rkv               cache   = NULL;
+   rkv_key           keys[CHANGED_KEYS];
+   date              dates[CHANGED_KEYS];
+   rkv_publish_stats stats;
+   rkv_options       options = rkv_options_Default;
+   options.publish_changes_only = true;
+   options.full_publish_period  = 4;
+   ASSERT( report, rkv_new_with_options( &cache, "239.0.0.72", 2422, codecs, codec_count, &options ));
+   for( unsigned i = 0; i < CHANGED_KEYS; ++i ) {
+      ASSERT( report, rkv_key_make( keys + i ));
+      dates[i].day   = (unsigned char)( 1 + i );
+      dates[i].month = 1;
+      dates[i].year  = 2024;
+   }
+   for( unsigned i = 0; i < CHANGED_KEYS; ++i ) {
+      ASSERT( report, rkv_put_key( cache, "changes", keys + i, DATE_TYPE_ID, dates + i ));
+   }
+   ASSERT( report, rkv_publish_with_stats( cache, "changes", &stats ));
+   ASSERT( report,( stats.sent == CHANGED_KEYS )&&( stats.suppressed == 0 )&& ! stats.full );
+   for( unsigned i = 0; i < CHANGED_KEYS; ++i ) {
+      ASSERT( report, rkv_put_key( cache, "changes", keys + i, DATE_TYPE_ID, dates + i ));
+   }
+   ASSERT( report, rkv_publish_with_stats( cache, "changes", &stats ));
+   ASSERT( report,( stats.sent == 0 )&&( stats.suppressed == CHANGED_KEYS ));
+   dates[3].year = 2025;
+   for( unsigned i = 0; i < CHANGED_KEYS; ++i ) {
+      ASSERT( report, rkv_put_key( cache, "changes", keys + i, DATE_TYPE_ID, dates + i ));
+   }
+   ASSERT( report, rkv_publish_with_stats( cache, "changes", &stats ));
+   ASSERT( report,( stats.sent == 1 )&&( stats.suppressed == CHANGED_KEYS - 1 ));
+   bool received = false;
+   for( unsigned retry = 0; ( retry < 2000 )&& ! received; ++retry ) {
+      struct timespec pause = { 0, 500000 };
+      nanosleep( &pause, NULL );
+      const void * data = NULL;
+      ASSERT( report, rkv_refresh( cache ));
+      received = rkv_get_key( cache, keys + 3, &data ) &&( date_compare( data, dates + 3 ) == 0 );
+   }
+   ASSERT( report, received );
+   for( unsigned i = 0; i < CHANGED_KEYS; ++i ) {
+      ASSERT( report, rkv_put_key( cache, "changes", keys + i, DATE_TYPE_ID, dates + i ));
+   }
+   ASSERT( report, rkv_publish_with_stats( cache, "changes", &stats ));
+   ASSERT( report,( stats.sent == CHANGED_KEYS )&&( stats.suppressed == 0 )&& stats.full );
+   rkv_stats totals;
+   ASSERT( report, rkv_get_stats( cache, &totals ));
+   ASSERT( report, totals.entries_sent == 2 * CHANGED_KEYS + 1 );
+   ASSERT( report, totals.entries_suppressed == 2 * CHANGED_KEYS - 1 );
+   ASSERT( report, rkv_delete( &cache ));
+}
+
+#define BOOTSTRAP_KEYS 100
+#define CHUNKED_KEYS   20000
+
+static bool all_dates_received( rkv cache, const rkv_key keys[], const date dates[] ) {
+   for( unsigned i = 0; i < BOOTSTRAP_KEYS; ++i ) {
+      const void * data = NULL;
+      if( ! rkv_get_key( cache, keys + i, &data )||( date_compare( data, dates + i ) != 0 )) {
+         return false;
+      }
+   }
+   return true;
+}
+
+/**
+ * Un cache qui démarre reçoit d'un pair l'état courant, sans attendre qu'il soit republié.
+ */
+static void late_joiner( struct tests_report * report, const rkv_codec * const codecs[], size_t codec_count ) {
+   tests_chapter( report, "rkv bootstrap" );
+   rkv         server  = NULL;
+   rkv         joiner  = NULL;
+   rkv_key     keys[BOOTSTRAP_KEYS];
+   date        dates[BOOTSTRAP_KEYS];
+   rkv_options options = rkv_options_Default;
+   options.bootstrap_server = true;
+   ASSERT( report, rkv_new_with_options( &server, "239.0.0.73", 2423, codecs, codec_count, &options ));
+   for( unsigned i = 0; i < BOOTSTRAP_KEYS; ++i ) {
+      ASSERT( report, rkv_key_make( keys + i ));
+      dates[i].day   = (unsigned char)( 1 + i % 28 );
+      dates[i].month = (unsigned char)( 1 + i % 12 );
+      dates[i].year  = (unsigned short)( 1900 + i );
+      ASSERT( report, rkv_put_key( server, "bootstrap", keys + i, DATE_TYPE_ID, dates + i ));
+   }
+   ASSERT( report, rkv_publish( server, "bootstrap" ));
+   bool received = false;
+   for( unsigned retry = 0; ( retry < 2000 )&& ! received; ++retry ) {
+      struct timespec pause = { 0, 500000 };
+      nanosleep( &pause, NULL );
+      ASSERT( report, rkv_refresh( server ));
+      received = all_dates_received( server, keys, dates );
+   }
+   ASSERT( report, received );
+   options.bootstrap_server     = false;
+   options.bootstrap_timeout_ms = 2000;
+   ASSERT( report, rkv_new_with_options( &joiner, "239.0.0.73", 2423, codecs, codec_count, &options ));
+   ASSERT( report, all_dates_received( joiner, keys, dates ));
+   rkv_stats stats;
+   ASSERT( report, rkv_get_stats( joiner, &stats ));
+   ASSERT( report, stats.bootstrap_entries == BOOTSTRAP_KEYS );
+   ASSERT( report, rkv_get_stats( server, &stats ));
+   ASSERT( report, stats.snapshots_served == 1 );
+
+   tests_chapter( report, "rkv bootstrap then updates" );
+   dates[7].year = 2100;
+   ASSERT( report, rkv_put_key( server, "bootstrap", keys + 7, DATE_TYPE_ID, dates + 7 ));
+   ASSERT( report, rkv_publish( server, "bootstrap" ));
+   received = false;
+   for( unsigned retry = 0; ( retry < 2000 )&& ! received; ++retry ) {
+      struct timespec pause = { 0, 500000 };
+      nanosleep( &pause, NULL );
+      ASSERT( report, rkv_refresh( joiner ));
+      received = all_dates_received( joiner, keys, dates );
+   }
+   ASSERT( report, received );
+   ASSERT( report, rkv_delete( &joiner ));
+
+   tests_chapter( report, "rkv bootstrap in chunks" );
+   date more = { 1, 1, 2000 };
+   bool put  = true;
+   for( unsigned t = 0; t < CHUNKED_KEYS / 1000; ++t ) {
+      for( unsigned i = 0; i < 1000; ++i ) {
+         rkv_key key;
+         put = put
+            && rkv_key_make( &key )
+            && rkv_put_key( server, "chunks", &key, DATE_TYPE_ID, &more );
+      }
+      ASSERT( report, put && rkv_publish( server, "chunks" ));
+   }
+   size_t count = 0;
+   for( unsigned retry = 0; ( retry < 2000 )&&( count < BOOTSTRAP_KEYS + CHUNKED_KEYS ); ++retry ) {
+      struct timespec pause = { 0, 500000 };
+      nanosleep( &pause, NULL );
+      ASSERT( report, rkv_refresh( server ));
+      ASSERT( report, rkv_count_type( server, DATE_TYPE_ID, &count ));
+   }
+   ASSERT( report, count == BOOTSTRAP_KEYS + CHUNKED_KEYS );
+   // plusieurs blocs, chacun encodé dans sa propre section de lecture
+   ASSERT( report, rkv_new_with_options( &joiner, "239.0.0.73", 2423, codecs, codec_count, &options ));
+   ASSERT( report, rkv_get_stats( joiner, &stats ));
+   ASSERT( report, stats.bootstrap_entries == BOOTSTRAP_KEYS + CHUNKED_KEYS );
+   ASSERT( report, all_dates_received( joiner, keys, dates ));
+   ASSERT( report, rkv_delete( &joiner ));
+   ASSERT( report, rkv_delete( &server ));
+}
+
+/**
+ * Un cache qui redémarre recharge son état d'un fichier, les valeurs ne sont décodées qu'à leur
+ * première lecture et un cache rechargé peut à son tour enregistrer son état sans les décoder.
+ */
+static void warm_restart( struct tests_report * report, const rkv_codec * const codecs[], size_t codec_count ) {
+   tests_chapter( report, "rkv snapshot save" );
+   rkv     saved    = NULL;
+   rkv     loaded   = NULL;
+   rkv     reloaded = NULL;
+   rkv_key keys[BOOTSTRAP_KEYS];
+   rkv_key aubin_key;
+   date    dates[BOOTSTRAP_KEYS];
+   char    path[64];
+   char    path2[64];
+   snprintf( path , sizeof( path  ), "/tmp/rkv_test-%d.snapshot"  , getpid());
+   snprintf( path2, sizeof( path2 ), "/tmp/rkv_test-%d-2.snapshot", getpid());
+   ASSERT( report, rkv_new( &saved, "239.0.0.74", 2424, codecs, codec_count ));
+   for( unsigned i = 0; i < BOOTSTRAP_KEYS; ++i ) {
+      ASSERT( report, rkv_key_make( keys + i ));
+      dates[i].day   = (unsigned char)( 1 + i % 28 );
+      dates[i].month = (unsigned char)( 1 + i % 12 );
+      dates[i].year  = (unsigned short)( 2000 + i );
+      ASSERT( report, rkv_put_key( saved, "snapshot", keys + i, DATE_TYPE_ID, dates + i ));
+   }
+   ASSERT( report, rkv_key_make( &aubin_key ));
+   ASSERT( report, rkv_put_key( saved, "snapshot", &aubin_key, PERSON_TYPE_ID, &aubin ));
+   ASSERT( report, rkv_publish( saved, "snapshot" ));
+   bool received = false;
+   for( unsigned retry = 0; ( retry < 2000 )&& ! received; ++retry ) {
+      struct timespec pause = { 0, 500000 };
+      nanosleep( &pause, NULL );
+      ASSERT( report, rkv_refresh( saved ));
+      received = all_dates_received( saved, keys, dates );
+   }
+   ASSERT( report, received );
+   ASSERT( report, rkv_snapshot_save( saved, path ));
+   ASSERT( report, rkv_delete( &saved ));
+
+   tests_chapter( report, "rkv snapshot load" );
+   rkv_stats stats;
+   ASSERT( report, rkv_new( &loaded, "239.0.0.75", 2425, codecs, codec_count ));
+   ASSERT( report, rkv_snapshot_load( loaded, path ));
+   ASSERT( report, rkv_get_stats( loaded, &stats ));
+   ASSERT( report, stats.snapshot_entries == BOOTSTRAP_KEYS + 1 );
+   ASSERT( report, stats.snapshot_decoded == 0 );
+   const void * data = NULL;
+   ASSERT( report, rkv_get_key( loaded, keys + 3, &data ));
+   ASSERT( report, date_compare( data, dates + 3 ) == 0 );
+   ASSERT( report, rkv_get_key( loaded, keys + 3, &data ));
+   ASSERT( report, rkv_get_stats( loaded, &stats ));
+   ASSERT( report, stats.snapshot_decoded == 1 );
+
+   tests_chapter( report, "rkv snapshot of a loaded snapshot" );
+   ASSERT( report, rkv_snapshot_save( loaded, path2 ));
+   ASSERT( report, rkv_new( &reloaded, "239.0.0.76", 2426, codecs, codec_count ));
+   ASSERT( report, rkv_snapshot_load( reloaded, path2 ));
+   ASSERT( report, all_dates_received( reloaded, keys, dates ));
+   ASSERT( report, rkv_get_key( reloaded, &aubin_key, &data ));
+   ASSERT( report, person_compare( data, &aubin ) == 0 );
+   ASSERT( report, rkv_get_stats( reloaded, &stats ));
+   ASSERT( report, stats.snapshot_decoded == BOOTSTRAP_KEYS + 1 );
+   ASSERT( report, rkv_get_stats( loaded, &stats ));
+   ASSERT( report, stats.snapshot_decoded == 1 );
+   ASSERT( report, rkv_delete( &reloaded ));
+   ASSERT( report, rkv_delete( &loaded ));
+
+   tests_chapter( report, "rkv snapshot entry not matching its index" );
+   // le type de la première entrée, après l'en-tête de 24 octets et la clé de 12, change
+   FILE * file = fopen( path, "r+b" );
+   ASSERT( report, file != NULL );
+   if( file ) {
+      ASSERT( report, fseek( file, 24+12+3, SEEK_SET ) == 0 );
+      const int type_byte = fgetc( file );
+      ASSERT( report, fseek( file, 24+12+3, SEEK_SET ) == 0 );
+      ASSERT( report, fputc( type_byte ^ 0xFF, file ) != EOF );
+      ASSERT( report, fclose( file ) == 0 );
+   }
+   ASSERT( report, rkv_new( &reloaded, "239.0.0.76", 2426, codecs, codec_count ));
+   ASSERT( report, rkv_snapshot_load( reloaded, path ));
+   unsigned unreadable = 0;
+   for( unsigned i = 0; i < BOOTSTRAP_KEYS; ++i ) {
+      unreadable += rkv_get_key( reloaded, keys + i, &data ) ? 0 : 1;
+   }
+   unreadable += rkv_get_key( reloaded, &aubin_key, &data ) ? 0 : 1;
+   ASSERT( report, unreadable == 1 );
+   ASSERT( report, rkv_get_stats( reloaded, &stats ));
+   ASSERT( report, stats.snapshot_decoded == BOOTSTRAP_KEYS );
+   ASSERT( report, rkv_delete( &reloaded ));
+   unlink( path );
+   unlink( path2 );
+}
+
+#define JOURNAL_TRANSACTIONS 10
+
+static size_t remove_journal( const char * directory ) {
+   size_t segments = 0;
+   DIR *  dir      = opendir( directory );
+   for( struct dirent * e = dir ? readdir( dir ) : NULL; e; e = readdir( dir )) {
+      char path[512];
+      snprintf( path, sizeof( path ), "%s/%s", directory, e->d_name );
+      if( strstr( e->d_name, ".rkvj" )&&( unlink( path ) == 0 )) {
+         ++segments;
+      }
+   }
+   if( dir ) {
+      closedir( dir );
+   }
+   rmdir( directory );
+   return segments;
+}
+
+/**
+ * Taille des segments du répertoire, le dernier excepté : celui qu'écrivait le journal.
+ */
+static size_t closed_segments_bytes( const char * directory ) {
+   size_t size        = 0;
+   size_t last        = 0;
+   char   newest[256] = "";
+   DIR *  dir         = opendir( directory );
+   for( struct dirent * e = dir ? readdir( dir ) : NULL; e; e = readdir( dir )) {
+      char        path[512];
+      struct stat status;
+      snprintf( path, sizeof( path ), "%s/%s", directory, e->d_name );
+      if( strstr( e->d_name, ".rkvj" )&&( stat( path, &status ) == 0 )) {
+         size += (size_t)status.st_size;
+         if( strcmp( e->d_name, newest ) > 0 ) {
+            snprintf( newest, sizeof( newest ), "%s", e->d_name );
+            last = (size_t)status.st_size;
+         }
+      }
+   }
+   if( dir ) {
+      closedir( dir );
+   }
+   return size - last;
+}
+
+/**
+ * Les transactions reçues sont journalisées par lots et le journal, réparti sur plusieurs
+ * segments, reconstruit l'état d'un autre cache, même terminé par un enregistrement tronqué.
+ * La rétention par taille supprime les segments les plus anciens.
+ */
+static void journal( struct tests_report * report, const rkv_codec * const codecs[], size_t codec_count ) {
+   tests_chapter( report, "rkv journal" );
+   rkv         journaled = NULL;
+   rkv         replayed  = NULL;
+   rkv_key     keys[BOOTSTRAP_KEYS];
+   date        dates[BOOTSTRAP_KEYS];
+   char        directory[64];
+   rkv_options options = rkv_options_Default;
+   snprintf( directory, sizeof( directory ), "/tmp/rkv_journal-%d", getpid());
+   ASSERT( report, mkdir( directory, 0755 ) == 0 );
+   options.journal_directory     = directory;
+   options.journal_segment_bytes = 1024;
+   options.journal_commit_ms     = 5;
+   ASSERT( report, rkv_new_with_options( &journaled, "239.0.0.77", 2427, codecs, codec_count, &options ));
+   for( unsigned i = 0; i < BOOTSTRAP_KEYS; ++i ) {
+      ASSERT( report, rkv_key_make( keys + i ));
+      dates[i].day   = (unsigned char)( 1 + i % 28 );
+      dates[i].month = (unsigned char)( 1 + i % 12 );
+      dates[i].year  = (unsigned short)( 1800 + i );
+   }
+   for( unsigned t = 0; t < JOURNAL_TRANSACTIONS; ++t ) {
+      for( unsigned i = t; i < BOOTSTRAP_KEYS; i += JOURNAL_TRANSACTIONS ) {
+         ASSERT( report, rkv_put_key( journaled, "journal", keys + i, DATE_TYPE_ID, dates + i ));
+      }
+      ASSERT( report, rkv_publish( journaled, "journal" ));
+   }
+   dates[5].year = 2200;
+   ASSERT( report, rkv_put_key( journaled, "journal", keys + 5, DATE_TYPE_ID, dates + 5 ));
+   ASSERT( report, rkv_publish( journaled, "journal" ));
+   rkv_stats stats = { 0 };
+   for( unsigned retry = 0; ( retry < 2000 )&&( stats.journal_records < JOURNAL_TRANSACTIONS + 1 ); ++retry ) {
+      struct timespec pause = { 0, 500000 };
+      nanosleep( &pause, NULL );
+      ASSERT( report, rkv_get_stats( journaled, &stats ));
+   }
+   ASSERT( report, stats.journal_records == JOURNAL_TRANSACTIONS + 1 );
+   ASSERT( report, stats.journal_commits >= 1 );
+   ASSERT( report, stats.journal_commits <= stats.journal_records );
+   ASSERT( report, rkv_delete( &journaled ));
+
+   tests_chapter( report, "rkv journal replay" );
+   ASSERT( report, rkv_new( &replayed, "239.0.0.78", 2428, codecs, codec_count ));
+   ASSERT( report, rkv_journal_replay( replayed, directory ));
+   ASSERT( report, all_dates_received( replayed, keys, dates ));
+   ASSERT( report, rkv_get_stats( replayed, &stats ));
+   ASSERT( report, stats.journal_replayed == JOURNAL_TRANSACTIONS + 1 );
+   ASSERT( report, rkv_delete( &replayed ));
+
+   tests_chapter( report, "rkv journal truncated" );
+   char  last[128];
+   snprintf( last, sizeof( last ), "%s/9999999999999999.rkvj", directory );
+   FILE * torn = fopen( last, "wb" );
+   ASSERT( report, torn != NULL );
+   if( torn ) {
+      fputs( "torn", torn );
+      fclose( torn );
+   }
+   ASSERT( report, rkv_new( &replayed, "239.0.0.78", 2428, codecs, codec_count ));
+   ASSERT( report, rkv_journal_replay( replayed, directory ));
+   ASSERT( report, all_dates_received( replayed, keys, dates ));
+   ASSERT( report, rkv_delete( &replayed ));
+   ASSERT( report, remove_journal( directory ) > 2 );
+
+   tests_chapter( report, "rkv journal retention" );
+   ASSERT( report, mkdir( directory, 0755 ) == 0 );
+   options.journal_retain_bytes = 2048;
+   ASSERT( report, rkv_new_with_options( &journaled, "239.0.0.77", 2427, codecs, codec_count, &options ));
+   for( unsigned t = 0; t < 4*JOURNAL_TRANSACTIONS; ++t ) {
+      for( unsigned i = t % JOURNAL_TRANSACTIONS; i < BOOTSTRAP_KEYS; i += JOURNAL_TRANSACTIONS ) {
+         ASSERT( report, rkv_put_key( journaled, "journal", keys + i, DATE_TYPE_ID, dates + i ));
+      }
+      ASSERT( report, rkv_publish( journaled, "journal" ));
+   }
+   memset( &stats, 0, sizeof( stats ));
+   for( unsigned retry = 0; ( retry < 2000 )&&( stats.journal_records < 4*JOURNAL_TRANSACTIONS ); ++retry ) {
+      struct timespec pause = { 0, 500000 };
+      nanosleep( &pause, NULL );
+      ASSERT( report, rkv_get_stats( journaled, &stats ));
+   }
+   ASSERT( report, stats.journal_records == 4*JOURNAL_TRANSACTIONS );
+   ASSERT( report, stats.journal_pruned > 0 );
+   ASSERT( report, rkv_delete( &journaled ));
+   ASSERT( report, rkv_new( &replayed, "239.0.0.78", 2428, codecs, codec_count ));
+   ASSERT( report, rkv_journal_replay( replayed, directory ));
+   ASSERT( report, rkv_get_stats( replayed, &stats ));
+   ASSERT( report, stats.journal_replayed < 4*JOURNAL_TRANSACTIONS );
+   ASSERT( report, rkv_delete( &replayed ));
+   ASSERT( report, closed_segments_bytes( directory ) <= 2048 );
+   remove_journal( directory );
+}
+
+#define SHARD_COUNT 4
+
+static bool count_entries( size_t index, const rkv_id id, unsigned type, const void * data, void * user_context ) {
+   size_t * count = (size_t *)user_context;
+   if( index == *count ) {
+      *count += 1;
+   }
+   return true;
+   (void)id;
+   (void)type;
+   (void)data;
+}
+
+/**
+ * Un cache réparti se lit comme un seul cache, un récepteur abonné à une partie des groupes
+ * ne reçoit que les clés qui y sont publiées.
+ */
+static void sharded( struct tests_report * report, const rkv_codec * const codecs[], size_t codec_count ) {
+   tests_chapter( report, "rkv sharded" );
+   const char * const groups[SHARD_COUNT]     = { "239.0.0.79", "239.0.0.79", "239.0.0.80", "239.0.0.80" };
+   const bool         subscribed[SHARD_COUNT] = { true, false, true, false };
+   rkv                publisher = NULL;
+   rkv                partial   = NULL;
+   rkv_key            keys[BOOTSTRAP_KEYS];
+   date               dates[BOOTSTRAP_KEYS];
+   ASSERT( report, rkv_new_sharded( &publisher, groups, 2429, SHARD_COUNT, NULL, codecs, codec_count, &rkv_options_Default ));
+   ASSERT( report, rkv_new_sharded( &partial, groups, 2429, SHARD_COUNT, subscribed, codecs, codec_count, &rkv_options_Default ));
+   size_t count = 0;
+   ASSERT( report, rkv_get_shard_count( publisher, &count ));
+   ASSERT( report, count == SHARD_COUNT );
+   for( unsigned i = 0; i < BOOTSTRAP_KEYS; ++i ) {
+      ASSERT( report, rkv_key_make( keys + i ));
+      dates[i].day   = (unsigned char)( 1 + i % 28 );
+      dates[i].month = (unsigned char)( 1 + i % 12 );
+      dates[i].year  = (unsigned short)( 1700 + i );
+      ASSERT( report, rkv_put_key( publisher, "sharded", keys + i, DATE_TYPE_ID, dates + i ));
+   }
+   rkv_publish_stats published;
+   ASSERT( report, rkv_publish_with_stats( publisher, "sharded", &published ));
+   ASSERT( report, published.sent == BOOTSTRAP_KEYS );
+   bool received = false;
+   for( unsigned retry = 0; ( retry < 2000 )&& ! received; ++retry ) {
+      struct timespec pause = { 0, 500000 };
+      nanosleep( &pause, NULL );
+      ASSERT( report, rkv_refresh( publisher ));
+      received = all_dates_received( publisher, keys, dates );
+   }
+   ASSERT( report, received );
+   count = 0;
+   ASSERT( report, rkv_foreach( publisher, count_entries, &count ));
+   ASSERT( report, count == BOOTSTRAP_KEYS );
+   size_t total = 0;
+   ASSERT( report, rkv_get_ids( publisher, NULL, &total ));
+   ASSERT( report, total == BOOTSTRAP_KEYS );
+   size_t per_shard[SHARD_COUNT] = { 0 };
+   for( unsigned i = 0; i < SHARD_COUNT; ++i ) {
+      rkv shard = NULL;
+      ASSERT( report, rkv_get_shard( publisher, i, &shard ));
+      ASSERT( report, rkv_get_ids( shard, NULL, per_shard + i ));
+      ASSERT( report, per_shard[i] > 0 );
+   }
+   ASSERT( report, per_shard[0] + per_shard[1] + per_shard[2] + per_shard[3] == BOOTSTRAP_KEYS );
+
+   tests_chapter( report, "rkv sharded subscription" );
+   size_t expected = 0;
+   bool   all       = false;
+   for( unsigned i = 0; i < BOOTSTRAP_KEYS; ++i ) {
+      size_t shard = 0;
+      ASSERT( report, rkv_get_shard_of( partial, keys + i, &shard ));
+      expected += subscribed[shard] ? 1 : 0;
+   }
+   for( unsigned retry = 0; ( retry < 2000 )&& ! all; ++retry ) {
+      struct timespec pause = { 0, 500000 };
+      nanosleep( &pause, NULL );
+      ASSERT( report, rkv_refresh( partial ));
+      ASSERT( report, rkv_get_ids( partial, NULL, &total ));
+      all = ( total == expected );
+   }
+   ASSERT( report, all );
+   bool exact = true;
+   for( unsigned i = 0; i < BOOTSTRAP_KEYS; ++i ) {
+      size_t       shard = 0;
+      const void * data  = NULL;
+      rkv_get_shard_of( partial, keys + i, &shard );
+      exact = exact &&( rkv_get_key( partial, keys + i, &data ) == subscribed[shard] );
+   }
+   ASSERT( report, exact );
+   ASSERT( report, rkv_delete( &partial ));
+   ASSERT( report, rkv_delete( &publisher ));
+}
+
+#define PIPELINE_ROUNDS 50
+
+/**
+ * Décodées en parallèle, les transactions d'un émetteur sont fusionnées dans leur ordre
+ * d'émission : chaque clé finit avec la valeur de la dernière.
+ */
+static void decode_workers( struct tests_report * report, const rkv_codec * const codecs[], size_t codec_count ) {
+   tests_chapter( report, "rkv decode workers" );
+   rkv         cache = NULL;
+   rkv_key     keys[BOOTSTRAP_KEYS];
+   rkv_key     single;
+   date        dates[BOOTSTRAP_KEYS];
+   date        last  = { 1, 1, 0 };
+   rkv_options options = rkv_options_Default;
+   options.decode_workers     = 4;
+   options.decode_queue_depth = 8;
+   ASSERT( report, rkv_new_with_options( &cache, "239.0.0.81", 2433, codecs, codec_count, &options ));
+   ASSERT( report, rkv_key_make( &single ));
+   for( unsigned i = 0; i < BOOTSTRAP_KEYS; ++i ) {
+      ASSERT( report, rkv_key_make( keys + i ));
+      dates[i].day   = (unsigned char)( 1 + i % 28 );
+      dates[i].month = (unsigned char)( 1 + i % 12 );
+   }
+   for( unsigned r = 0; r < PIPELINE_ROUNDS; ++r ) {
+      for( unsigned i = 0; i < BOOTSTRAP_KEYS; ++i ) {
+         dates[i].year = (unsigned short)( 1000 + r );
+         ASSERT( report, rkv_put_key( cache, "pipeline", keys + i, DATE_TYPE_ID, dates + i ));
+      }
+      ASSERT( report, rkv_publish( cache, "pipeline" ));
+      last.year = (unsigned short)( 1000 + r );
+      ASSERT( report, rkv_put_key( cache, "single", &single, DATE_TYPE_ID, &last ));
+      ASSERT( report, rkv_publish( cache, "single" ));
+   }
+   bool received = false;
+   for( unsigned retry = 0; ( retry < 2000 )&& ! received; ++retry ) {
+      struct timespec pause = { 0, 500000 };
+      const void *    data  = NULL;
+      nanosleep( &pause, NULL );
+      ASSERT( report, rkv_refresh( cache ));
+      received = all_dates_received( cache, keys, dates )
+         && rkv_get_key( cache, &single, &data )
+         &&( date_compare( data, &last ) == 0 );
+   }
+   ASSERT( report, received );
+   rkv_stats stats;
+   ASSERT( report, rkv_get_stats( cache, &stats ));
+   ASSERT( report, stats.datagrams_lost == 0 );
+   ASSERT( report, rkv_delete( &cache ));
+}
+
+#define TAIL_KEYS    60
+#define SLOW_TYPE_ID 4
+
+static bool slow_person_decode( void * dest, net_buff buffer, utils_map codecs ) {
+   struct timespec pause = { 0, 200000000 };
+   nanosleep( &pause, NULL );
+   return person_decode( dest, buffer, codecs );
+}
+
+/**
+ * Le thread de décodage est occupé, sa file pleine : la socket du cache, minuscule, déborde et
+ * perd la fin de la rafale qui suit. Aucun datagramme ultérieur ne révèle cette perte, seule
+ * l'annonce du dernier numéro émis, une fois la rafale finie, permet de la réclamer. Le cache
+ * reçoit ce qu'il publie : deux caches d'un même processus partagent leur port, une demande de
+ * réémission pourrait parvenir à celui qui l'a émise.
+ */
+static void tail_loss( struct tests_report * report, const rkv_codec * const codecs[], size_t codec_count ) {
+   tests_chapter( report, "rkv tail loss" );
+   rkv       cache = NULL;
+   rkv_codec slow  = *codecs[0];
+   rkv_key   slow_key;
+   rkv_key   keys[TAIL_KEYS];
+   date      dates[TAIL_KEYS];
+   slow.type    = SLOW_TYPE_ID;
+   slow.factory = slow_person_decode;
+   const rkv_codec * const all_codecs[] = { codecs[0], codecs[1], &slow };
+   rkv_options options = rkv_options_Default;
+   options.decode_workers     = 1;
+   options.decode_queue_depth = 1;
+   options.recv_buffer_bytes  = 16*1024;
+   ASSERT( report, rkv_new_with_options( &cache, "239.0.0.92", 2444, all_codecs, 3, &options ));
+   ASSERT( report, rkv_key_make( &slow_key ));
+   ASSERT( report, rkv_put_key( cache, "slow", &slow_key, SLOW_TYPE_ID, &eve ));
+   ASSERT( report, rkv_publish( cache, "slow" ));
+   for( unsigned i = 0; i < TAIL_KEYS; ++i ) {
+      ASSERT( report, rkv_key_make( keys + i ));
+      dates[i].day   = (unsigned char)( 1 + i );
+      dates[i].month = 1;
+      dates[i].year  = 2000;
+      ASSERT( report, rkv_put_key( cache, "tail", keys + i, DATE_TYPE_ID, dates + i ));
+      ASSERT( report, rkv_publish( cache, "tail" ));
+   }
+   // l'annonce suit la rafale de reassembly_timeout_ms/4 à reassembly_timeout_ms/2
+   bool received = false;
+   for( unsigned retry = 0; ( retry < 1000 )&& ! received; ++retry ) {
+      struct timespec pause = { 0, 5000000 };
+      nanosleep( &pause, NULL );
+      ASSERT( report, rkv_refresh( cache ));
+      received = true;
+      for( unsigned i = 0; ( i < TAIL_KEYS )&& received; ++i ) {
+         const void * data = NULL;
+         received = rkv_get_key( cache, keys + i, &data )&&( date_compare( data, dates + i ) == 0 );
+      }
+   }
+   ASSERT( report, received );
+   rkv_stats stats;
+   ASSERT( report, rkv_get_stats( cache, &stats ));
+   ASSERT( report, stats.nacks_sent > 0 );
+   ASSERT( report, stats.datagrams_lost == 0 );
+   ASSERT( report, rkv_delete( &cache ));
+   (void)codec_count;
+}
+
+#define LISTENER_PUBLISHES 50
+
+typedef struct {
+   atomic_uint calls;
+   atomic_uint ended;
+   pthread_t   thread;
+} listener_calls;
+
+static void slow_listener( rkv cache, void * user_context ) {
+   listener_calls * lc    = user_context;
+   struct timespec  pause = { 0, 20000000 };
+   lc->thread = pthread_self();
+   atomic_fetch_add( &lc->calls, 1 );
+   nanosleep( &pause, NULL );
+   atomic_fetch_add( &lc->ended, 1 );
+   (void)cache;
+}
+
+static bool wait_date( struct tests_report * report, rkv cache, const rkv_key * key, const date * expected ) {
+   bool received = false;
+   for( unsigned retry = 0; ( retry < 2000 )&& ! received; ++retry ) {
+      struct timespec pause = { 0, 500000 };
+      const void *    data  = NULL;
+      nanosleep( &pause, NULL );
+      ASSERT( report, rkv_refresh( cache ));
+      received = rkv_get_key( cache, key, &data )&&( date_compare( data, expected ) == 0 );
+   }
+   return received;
+}
+
+/**
+ * Un listener lent est appelé une fois pour toutes les réceptions survenues pendant son appel
+ * précédent, plus du tout une fois retiré : le retrait attend la fin de l'appel en cours. Sans
+ * thread dédié, rkv_dispatch() l'appelle depuis le thread de l'application.
+ */
+static void listeners( struct tests_report * report, const rkv_codec * const codecs[], size_t codec_count ) {
+   tests_chapter( report, "rkv listeners coalesced" );
+   rkv            cache = NULL;
+   rkv_key        key;
+   date           value = { 1, 1, 0 };
+   listener_calls lc;
+   rkv_options    options = rkv_options_Default;
+   options.recv_batch_size = 1; // une notification par datagramme
+   atomic_init( &lc.calls, 0 );
+   atomic_init( &lc.ended, 0 );
+   ASSERT( report, rkv_key_make( &key ));
+   ASSERT( report, rkv_new_with_options( &cache, "239.0.0.83", 2435, codecs, codec_count, &options ));
+   ASSERT( report, rkv_add_listener( cache, slow_listener, &lc ));
+   for( unsigned i = 0; i < LISTENER_PUBLISHES; ++i ) {
+      value.year = (unsigned short)( 2000 + i );
+      ASSERT( report, rkv_put_key( cache, "listeners", &key, DATE_TYPE_ID, &value ));
+      ASSERT( report, rkv_publish( cache, "listeners" ));
+   }
+   ASSERT( report, wait_date( report, cache, &key, &value ));
+   struct timespec settle = { 0, 100000000 };
+   nanosleep( &settle, NULL );
+   rkv_stats stats;
+   ASSERT( report, rkv_get_stats( cache, &stats ));
+   const unsigned calls = atomic_load( &lc.calls );
+   ASSERT( report, calls > 0 );
+   ASSERT( report, calls < LISTENER_PUBLISHES );
+   ASSERT( report, stats.notifications == calls );
+   ASSERT( report, stats.notifications_coalesced > 0 );
+
+   tests_chapter( report, "rkv listeners removed" );
+   value.year = 2999;
+   ASSERT( report, rkv_put_key( cache, "listeners", &key, DATE_TYPE_ID, &value ));
+   ASSERT( report, rkv_publish( cache, "listeners" ));
+   for( unsigned retry = 0; ( retry < 2000 )&&( atomic_load( &lc.calls ) == atomic_load( &lc.ended )); ++retry ) {
+      struct timespec pause = { 0, 500000 };
+      nanosleep( &pause, NULL );
+   }
+   ASSERT( report, atomic_load( &lc.calls ) > atomic_load( &lc.ended ));
+   ASSERT( report, rkv_remove_listener( cache, slow_listener, &lc ));
+   ASSERT( report, atomic_load( &lc.ended ) == atomic_load( &lc.calls ));
+   const unsigned removed = atomic_load( &lc.calls );
+   value.year = 3000;
+   ASSERT( report, rkv_put_key( cache, "listeners", &key, DATE_TYPE_ID, &value ));
+   ASSERT( report, rkv_publish( cache, "listeners" ));
+   ASSERT( report, wait_date( report, cache, &key, &value ));
+   nanosleep( &settle, NULL );
+   ASSERT( report, atomic_load( &lc.calls ) == removed );
+   ASSERT( report, rkv_delete( &cache ));
+
+   tests_chapter( report, "rkv listeners dispatched" );
+   options                 = rkv_options_Default;
+   options.listener_thread = false;
+   atomic_store( &lc.calls, 0 );
+   ASSERT( report, rkv_new_with_options( &cache, "239.0.0.84", 2436, codecs, codec_count, &options ));
+   ASSERT( report, rkv_add_listener( cache, slow_listener, &lc ));
+   value.year = 4000;
+   ASSERT( report, rkv_put_key( cache, "listeners", &key, DATE_TYPE_ID, &value ));
+   ASSERT( report, rkv_publish( cache, "listeners" ));
+   bool notified = false;
+   for( unsigned retry = 0; ( retry < 2000 )&& ! notified; ++retry ) {
+      struct timespec pause = { 0, 500000 };
+      nanosleep( &pause, NULL );
+      ASSERT( report, rkv_dispatch( cache, &notified ));
+   }
+   ASSERT( report, notified );
+   ASSERT( report, atomic_load( &lc.calls ) == 1 );
+   ASSERT( report, pthread_equal( lc.thread, pthread_self()));
+   ASSERT( report, rkv_dispatch( cache, &notified ));
+   ASSERT( report, ! notified );
+   ASSERT( report, rkv_delete( &cache ));
+}
+
+#define SUBSCRIPTION_KEYS 10
+
+static const unsigned UNKNOWN_TYPE_ID = 3;
+
+/**
+ * Un récepteur abonné aux seules dates saute les personnes, ainsi que les entrées d'un type dont
+ * il n'a pas le codec, sans perdre le reste de la transaction. Abonné à une origine, il saute
+ * les clés créées par un autre processus.
+ */
+static void subscription( struct tests_report * report, const rkv_codec * const codecs[], size_t codec_count ) {
+   tests_chapter( report, "rkv subscribe types" );
+   rkv       sender   = NULL;
+   rkv       receiver = NULL;
+   rkv_codec unknown  = *codecs[1];
+   unknown.type = UNKNOWN_TYPE_ID;
+   const rkv_codec * const sender_codecs[] = { codecs[0], codecs[1], &unknown };
+   rkv_key   keys[3*SUBSCRIPTION_KEYS];
+   date      last = { 1, 1, 1 };
+   ASSERT( report, rkv_new( &sender, "239.0.0.85", 2437, sender_codecs, sizeof( sender_codecs ) / sizeof( sender_codecs[0] )));
+   ASSERT( report, rkv_new( &receiver, "239.0.0.85", 2437, codecs, codec_count ));
+   const unsigned dates_only[] = { DATE_TYPE_ID };
+   ASSERT( report, rkv_subscribe_types( receiver, dates_only, 1 ));
+   for( unsigned i = 0; i < 3*SUBSCRIPTION_KEYS; ++i ) {
+      ASSERT( report, rkv_key_make( keys + i ));
+      if( i < SUBSCRIPTION_KEYS ) {
+         ASSERT( report, rkv_put_key( sender, "subscription", keys + i, PERSON_TYPE_ID, &eve ));
+      }
+      else if( i < 2*SUBSCRIPTION_KEYS ) {
+         ASSERT( report, rkv_put_key( sender, "subscription", keys + i, UNKNOWN_TYPE_ID, &aubin_bd ));
+      }
+      else {
+         ASSERT( report, rkv_put_key( sender, "subscription", keys + i, DATE_TYPE_ID, &last ));
+      }
+   }
+   ASSERT( report, rkv_publish( sender, "subscription" ));
+   ASSERT( report, wait_date( report, receiver, keys + 3*SUBSCRIPTION_KEYS - 1, &last ));
+   size_t count = 0;
+   ASSERT( report, rkv_foreach( receiver, count_entries, &count ));
+   ASSERT( report, count == SUBSCRIPTION_KEYS );
+   rkv_stats stats;
+   ASSERT( report, rkv_get_stats( receiver, &stats ));
+   ASSERT( report, stats.entries_skipped == 2*SUBSCRIPTION_KEYS );
+   ASSERT( report, rkv_get_stats( sender, &stats ));
+   ASSERT( report, stats.entries_skipped == 0 );
+
+   tests_chapter( report, "rkv subscribe origins" );
+   rkv_key foreign = { .host = 1, .process = 2, .instance = 3, .reserved = 0 };
+   rkv_key local;
+   ASSERT( report, rkv_key_make( &local ));
+   ASSERT( report, rkv_subscribe_types( receiver, NULL, 0 ));
+   ASSERT( report, rkv_subscribe_origins( receiver, &local, 1 ));
+   last.year = 2;
+   ASSERT( report, rkv_put_key( sender, "origins", &foreign, DATE_TYPE_ID, &last ));
+   ASSERT( report, rkv_put_key( sender, "origins", &local, DATE_TYPE_ID, &last ));
+   ASSERT( report, rkv_publish( sender, "origins" ));
+   ASSERT( report, wait_date( report, receiver, &local, &last ));
+   const void * data = NULL;
+   ASSERT( report, ! rkv_get_key( receiver, &foreign, &data ));
+   ASSERT( report, wait_date( report, sender, &foreign, &last ));
+   ASSERT( report, rkv_delete( &receiver ));
+   ASSERT( report, rkv_delete( &sender ));
+}
+
+#define TXN_THREADS      4
+#define TXN_PER_THREAD   20
+#define TXN_KEYS         10
+
+typedef struct {
+   rkv     cache;
+   rkv_key keys[TXN_KEYS];
+   date    dates[TXN_KEYS];
+   bool    ok;
+} txn_writer;
+
+/**
+ * Chaque thread remplit et publie ses transactions avec son propre rkv_txn, sans verrou.
+ */
+static void * write_transactions( void * arg ) {
+   txn_writer * writer = (txn_writer *)arg;
+   rkv_txn      txn    = NULL;
+   writer->ok = rkv_txn_begin( writer->cache, TXN_KEYS, &txn );
+   for( unsigned t = 0; writer->ok &&( t < TXN_PER_THREAD ); ++t ) {
+      for( unsigned i = 0; writer->ok &&( i < TXN_KEYS ); ++i ) {
+         writer->dates[i].year = (unsigned short)( 1000 + t );
+         writer->ok = rkv_txn_put( txn, writer->keys + i, DATE_TYPE_ID, writer->dates + i );
+      }
+      writer->ok = writer->ok && rkv_txn_publish( txn, NULL );
+   }
+   if( txn ) {
+      rkv_txn_delete( &txn );
+   }
+   return NULL;
+}
+
+/**
+ * Plusieurs threads publient en même temps sur un même cache. Dans une transaction, la dernière
+ * écriture d'une clé l'emporte, une transaction abandonnée n'est pas publiée.
+ */
+static void transaction_handles( struct tests_report * report, const rkv_codec * const codecs[], size_t codec_count ) {
+   tests_chapter( report, "rkv txn concurrent writers" );
+   rkv        cache = NULL;
+   txn_writer writers[TXN_THREADS];
+   pthread_t  threads[TXN_THREADS];
+   ASSERT( report, rkv_new( &cache, "239.0.0.86", 2438, codecs, codec_count ));
+   for( unsigned w = 0; w < TXN_THREADS; ++w ) {
+      writers[w].cache = cache;
+      for( unsigned i = 0; i < TXN_KEYS; ++i ) {
+         ASSERT( report, rkv_key_make( writers[w].keys + i ));
+         writers[w].dates[i].day   = (unsigned char)( 1 + w );
+         writers[w].dates[i].month = (unsigned char)( 1 + i );
+      }
+   }
+   for( unsigned w = 0; w < TXN_THREADS; ++w ) {
+      ASSERT( report, pthread_create( &threads[w], NULL, write_transactions, writers + w ) == 0 );
+   }
+   for( unsigned w = 0; w < TXN_THREADS; ++w ) {
+      pthread_join( threads[w], NULL );
+      ASSERT( report, writers[w].ok );
+   }
+   for( unsigned w = 0; w < TXN_THREADS; ++w ) {
+      ASSERT( report, wait_date( report, cache, writers[w].keys + TXN_KEYS - 1, writers[w].dates + TXN_KEYS - 1 ));
+      for( unsigned i = 0; i < TXN_KEYS; ++i ) {
+         const void * data = NULL;
+         ASSERT( report, rkv_get_key( cache, writers[w].keys + i, &data )&&( date_compare( data, writers[w].dates + i ) == 0 ));
+      }
+   }
+
+   tests_chapter( report, "rkv txn last put wins, abort" );
+   rkv_txn           txn     = NULL;
+   rkv_key           key;
+   rkv_key           aborted;
+   date              first   = { 1, 2, 3 };
+   date              second  = { 4, 5, 6 };
+   rkv_publish_stats stats;
+   ASSERT( report, rkv_key_make( &key ));
+   ASSERT( report, rkv_key_make( &aborted ));
+   ASSERT( report, rkv_txn_begin( cache, 0, &txn ));
+   ASSERT( report, rkv_txn_put( txn, &aborted, DATE_TYPE_ID, &first ));
+   ASSERT( report, rkv_txn_abort( txn ));
+   ASSERT( report, rkv_txn_put( txn, &key, DATE_TYPE_ID, &first ));
+   ASSERT( report, rkv_txn_put( txn, &key, DATE_TYPE_ID, &second ));
+   ASSERT( report, rkv_txn_publish( txn, &stats ));
+   ASSERT( report, stats.sent == 1 );
+   ASSERT( report, wait_date( report, cache, &key, &second ));
+   const void * data = NULL;
+   ASSERT( report, ! rkv_get_key( cache, &aborted, &data ));
+   ASSERT( report, rkv_txn_delete( &txn ));
+   ASSERT( report, rkv_delete( &cache ));
+}
+
+#define AUTO_KEYS   100
+#define AUTO_ROUNDS 50
+#define PACED_KEYS  1000
+
+/**
+ * Les écritures successives d'une clé se remplacent tant qu'elles ne sont pas publiées, les
+ * entrées en attente sont rangées dans peu de datagrammes, dont le débit est limité. Le
+ * dernier vidage a lieu à la destruction du cache.
+ */
+static void auto_publish( struct tests_report * report, const rkv_codec * const codecs[], size_t codec_count ) {
+   tests_chapter( report, "rkv auto publish conflated and paced" );
+   rkv         cache   = NULL;
+   rkv_key     keys[AUTO_KEYS];
+   date        dates[AUTO_KEYS];
+   rkv_options options = rkv_options_Default;
+   options.auto_publish_ms    = 20;
+   options.pacing_bytes_per_s = 256*1024;
+   options.pacing_burst_bytes = 1500;
+   ASSERT( report, rkv_new_with_options( &cache, "239.0.0.87", 2439, codecs, codec_count, &options ));
+   for( unsigned i = 0; i < AUTO_KEYS; ++i ) {
+      ASSERT( report, rkv_key_make( keys + i ));
+      dates[i].day   = (unsigned char)( 1 + i % 28 );
+      dates[i].month = (unsigned char)( 1 + i % 12 );
+   }
+   for( unsigned r = 0; r < AUTO_ROUNDS; ++r ) {
+      for( unsigned i = 0; i < AUTO_KEYS; ++i ) {
+         dates[i].year = (unsigned short)( 2000 + r );
+         ASSERT( report, rkv_auto_put( cache, keys + i, DATE_TYPE_ID, dates + i ));
+      }
+   }
+   for( unsigned i = 0; i < AUTO_KEYS; ++i ) {
+      ASSERT( report, wait_date( report, cache, keys + i, dates + i ));
+   }
+   rkv_stats stats;
+   ASSERT( report, rkv_get_stats( cache, &stats ));
+   ASSERT( report, stats.entries_conflated > 0 );
+   ASSERT( report, stats.entries_sent + stats.entries_conflated == AUTO_KEYS*AUTO_ROUNDS );
+   ASSERT( report, stats.datagrams_paced > 0 );
+
+   tests_chapter( report, "rkv auto publish on delete" );
+   rkv  sender = NULL;
+   date last   = { 9, 9, 2099 };
+   options                 = rkv_options_Default;
+   options.auto_publish_ms = 60000;
+   ASSERT( report, rkv_new_with_options( &sender, "239.0.0.87", 2439, codecs, codec_count, &options ));
+   ASSERT( report, rkv_auto_put( sender, keys, DATE_TYPE_ID, &last ));
+   ASSERT( report, rkv_delete( &sender ));
+   ASSERT( report, wait_date( report, cache, keys, &last ));
+   ASSERT( report, rkv_delete( &cache ));
+   ASSERT( report, rkv_new( &cache, "239.0.0.87", 2439, codecs, codec_count ));
+   ASSERT( report, ! rkv_auto_put( cache, keys, DATE_TYPE_ID, &last ));
+   ASSERT( report, rkv_delete( &cache ));
+
+   tests_chapter( report, "rkv publish during a paced auto publish" );
+   static rkv_key paced_keys[PACED_KEYS];
+   static date    paced_dates[PACED_KEYS];
+   date           explicit = { 1, 1, 1999 };
+   options                    = rkv_options_Default;
+   options.auto_publish_ms    = 1;
+   options.pacing_bytes_per_s = 20*1024;
+   options.pacing_burst_bytes = 1500;
+   ASSERT( report, rkv_new_with_options( &cache, "239.0.0.93", 2445, codecs, codec_count, &options ));
+   for( unsigned i = 0; i < PACED_KEYS; ++i ) {
+      paced_dates[i].day   = (unsigned char)( 1 + i % 28 );
+      paced_dates[i].month = (unsigned char)( 1 + i % 12 );
+      paced_dates[i].year  = (unsigned short)( 1000 + i );
+      ASSERT( report, rkv_key_make( paced_keys + i ));
+      ASSERT( report, rkv_auto_put( cache, paced_keys + i, DATE_TYPE_ID, paced_dates + i ));
+   }
+   // le vidage, d'une trentaine de Ko à 20 Ko/s, attend au moins une fois avant que la
+   // publication explicite ne commence, qui ne doit pas attendre sa fin
+   stats.datagrams_paced = 0;
+   for( unsigned retry = 0; ( retry < 2000 )&&( stats.datagrams_paced == 0 ); ++retry ) {
+      struct timespec pause = { 0, 500000 };
+      nanosleep( &pause, NULL );
+      ASSERT( report, rkv_get_stats( cache, &stats ));
+   }
+   ASSERT( report, stats.datagrams_paced > 0 );
+   struct timespec before;
+   struct timespec after;
+   clock_gettime( CLOCK_MONOTONIC, &before );
+   ASSERT( report, rkv_put_key( cache, "explicit", keys, DATE_TYPE_ID, &explicit ));
+   ASSERT( report, rkv_publish( cache, "explicit" ));
+   clock_gettime( CLOCK_MONOTONIC, &after );
+   const long elapsed_ms = ( after.tv_sec - before.tv_sec )*1000 + ( after.tv_nsec - before.tv_nsec ) / 1000000;
+   ASSERT( report, elapsed_ms < 250 );
+   ASSERT( report, wait_date( report, cache, keys, &explicit ));
+   ASSERT( report, wait_date( report, cache, paced_keys + PACED_KEYS - 1, paced_dates + PACED_KEYS - 1 ));
+   ASSERT( report, rkv_get_stats( cache, &stats ));
+   ASSERT( report, stats.datagrams_paced > 1 );
+   ASSERT( report, rkv_delete( &cache ));
+}
+
+#define CHANGES_KEYS 3
+
+typedef struct {
+   unsigned calls;
+   size_t   added;
+   size_t   updated;
+   size_t   removed;
+   size_t   expired;
+} changes_count;
+
+static void count_changes( rkv cache, rkv_changes changes, void * user_context ) {
+   changes_count * cc    = user_context;
+   size_t          count = 0;
+   rkv_change      change;
+   cc->calls += 1;
+   rkv_changes_get_count( changes, &count );
+   for( size_t i = 0; i < count; ++i ) {
+      if( rkv_changes_get( changes, i, &change )) {
+         cc->added   += ( change.kind == RKV_ADDED   );
+         cc->updated += ( change.kind == RKV_UPDATED );
+         cc->removed += ( change.kind == RKV_REMOVED );
+         cc->expired += ( change.kind == RKV_EXPIRED );
+      }
+   }
+   (void)cache;
+}
+
+/**
+ * Un rafraîchissement rend les clés qu'il a ajoutées ou mises à jour, et seulement celles-là.
+ * Le listener de changements est appelé par rkv_refresh(), pas quand rien n'a changé.
+ */
+static void change_sets( struct tests_report * report, const rkv_codec * const codecs[], size_t codec_count ) {
+   tests_chapter( report, "rkv changes listener" );
+   rkv           cache = NULL;
+   rkv_key       keys[CHANGES_KEYS+1];
+   date          value = { 1, 2, 2003 };
+   changes_count cc    = { 0, 0, 0, 0, 0 };
+   ASSERT( report, rkv_new( &cache, "239.0.0.88", 2440, codecs, codec_count ));
+   ASSERT( report, rkv_add_changes_listener( cache, count_changes, &cc ));
+   for( unsigned i = 0; i < CHANGES_KEYS + 1; ++i ) {
+      ASSERT( report, rkv_key_make( keys + i ));
+   }
+   for( unsigned i = 0; i < CHANGES_KEYS; ++i ) {
+      ASSERT( report, rkv_put_key( cache, "changes", keys + i, DATE_TYPE_ID, &value ));
+   }
+   ASSERT( report, rkv_publish( cache, "changes" ));
+   ASSERT( report, wait_date( report, cache, keys + CHANGES_KEYS - 1, &value ));
+   ASSERT( report, cc.calls == 1 );
+   ASSERT( report, cc.added == CHANGES_KEYS );
+   ASSERT( report, cc.updated == 0 );
+
+   tests_chapter( report, "rkv refresh with changes" );
+   rkv_changes changes = NULL;
+   size_t      count   = 0;
+   rkv_change  change;
+   date        next    = { 3, 4, 2005 };
+   ASSERT( report, rkv_changes_new( &changes ));
+   ASSERT( report, rkv_refresh_with_changes( cache, changes ));
+   ASSERT( report, rkv_changes_get_count( changes, &count ));
+   ASSERT( report, count == 0 );
+   ASSERT( report, cc.calls == 1 );
+   ASSERT( report, rkv_put_key( cache, "changes", keys, DATE_TYPE_ID, &next ));
+   ASSERT( report, rkv_put_key( cache, "changes", keys + CHANGES_KEYS, PERSON_TYPE_ID, &eve ));
+   ASSERT( report, rkv_publish( cache, "changes" ));
+   for( unsigned retry = 0; ( retry < 2000 )&&( count == 0 ); ++retry ) {
+      struct timespec pause = { 0, 500000 };
+      nanosleep( &pause, NULL );
+      ASSERT( report, rkv_refresh_with_changes( cache, changes ));
+      ASSERT( report, rkv_changes_get_count( changes, &count ));
+   }
+   ASSERT( report, count == 2 );
+   for( size_t i = 0; i < count; ++i ) {
+      rkv_key key;
+      ASSERT( report, rkv_changes_get( changes, i, &change ));
+      ASSERT( report, rkv_id_get_key( change.id, &key ));
+      if( rkv_key_equals( &key, keys )) {
+         ASSERT( report, change.kind == RKV_UPDATED );
+         ASSERT( report, change.type == DATE_TYPE_ID );
+      }
+      else {
+         ASSERT( report, rkv_key_equals( &key, keys + CHANGES_KEYS ));
+         ASSERT( report, change.kind == RKV_ADDED );
+         ASSERT( report, change.type == PERSON_TYPE_ID );
+      }
+   }
+   ASSERT( report, cc.calls == 2 );
+   ASSERT( report, cc.added == CHANGES_KEYS + 1 );
+   ASSERT( report, cc.updated == 1 );
+   ASSERT( report, rkv_remove_changes_listener( cache, count_changes, &cc ));
+   next.year = 2006;
+   ASSERT( report, rkv_put_key( cache, "changes", keys, DATE_TYPE_ID, &next ));
+   ASSERT( report, rkv_publish( cache, "changes" ));
+   ASSERT( report, wait_date( report, cache, keys, &next ));
+   ASSERT( report, cc.calls == 2 );
+   ASSERT( report, rkv_changes_delete( &changes ));
+   ASSERT( report, rkv_delete( &cache ));
+}
+
+#define TYPED_DATES   300
+#define TYPED_PERSONS 20
+
+static bool count_dates( size_t index, const rkv_id id, unsigned type, const void * data, void * user_context ) {
+   size_t * count = (size_t *)user_context;
+   if(( type == DATE_TYPE_ID )&&( index == *count )) {
+      *count += 1;
+   }
+   return true;
+   (void)id;
+   (void)data;
+}
+
+static bool wait_type_count( struct tests_report * report, rkv cache, unsigned type, size_t expected ) {
+   size_t count = 0;
+   for( unsigned retry = 0; ( retry < 2000 )&&( count != expected ); ++retry ) {
+      struct timespec pause = { 0, 500000 };
+      nanosleep( &pause, NULL );
+      ASSERT( report, rkv_refresh( cache ));
+      ASSERT( report, rkv_count_type( cache, type, &count ));
+   }
+   return count == expected;
+}
+
+/**
+ * Le parcours d'un type ne voit que ses entrées, y compris après l'agrandissement de la table.
+ * Une clé qui change de type passe d'une liste à l'autre.
+ */
+static void typed_iteration( struct tests_report * report, const rkv_codec * const codecs[], size_t codec_count ) {
+   tests_chapter( report, "rkv foreach type" );
+   rkv     cache = NULL;
+   rkv_key keys[TYPED_DATES+TYPED_PERSONS];
+   date    value = { 5, 6, 2007 };
+   size_t  count = 0;
+   ASSERT( report, rkv_new( &cache, "239.0.0.89", 2441, codecs, codec_count ));
+   for( unsigned i = 0; i < TYPED_DATES + TYPED_PERSONS; ++i ) {
+      ASSERT( report, rkv_key_make( keys + i ));
+      if( i < TYPED_DATES ) {
+         ASSERT( report, rkv_put_key( cache, "typed", keys + i, DATE_TYPE_ID, &value ));
+      }
+      else {
+         ASSERT( report, rkv_put_key( cache, "typed", keys + i, PERSON_TYPE_ID, &eve ));
+      }
+   }
+   ASSERT( report, rkv_publish( cache, "typed" ));
+   ASSERT( report, wait_type_count( report, cache, DATE_TYPE_ID, TYPED_DATES ));
+   ASSERT( report, rkv_count_type( cache, PERSON_TYPE_ID, &count ));
+   ASSERT( report, count == TYPED_PERSONS );
+   ASSERT( report, rkv_count_type( cache, UNKNOWN_TYPE_ID, &count ));
+   ASSERT( report, count == 0 );
+   count = 0;
+   ASSERT( report, rkv_foreach_type( cache, DATE_TYPE_ID, count_dates, &count ));
+   ASSERT( report, count == TYPED_DATES );
+   count = 0;
+   ASSERT( report, rkv_foreach_type( cache, PERSON_TYPE_ID, count_entries, &count ));
+   ASSERT( report, count == TYPED_PERSONS );
+
+   tests_chapter( report, "rkv foreach type after a type change" );
+   ASSERT( report, rkv_put_key( cache, "typed", keys, PERSON_TYPE_ID, &eve ));
+   ASSERT( report, rkv_publish( cache, "typed" ));
+   ASSERT( report, wait_type_count( report, cache, DATE_TYPE_ID, TYPED_DATES - 1 ));
+   ASSERT( report, rkv_count_type( cache, PERSON_TYPE_ID, &count ));
+   ASSERT( report, count == TYPED_PERSONS + 1 );
+   count = 0;
+   ASSERT( report, rkv_foreach_type( cache, DATE_TYPE_ID, count_dates, &count ));
+   ASSERT( report, count == TYPED_DATES - 1 );
+   ASSERT( report, rkv_foreach( cache, count_entries, &count ));
+   ASSERT( report, count == TYPED_DATES + TYPED_PERSONS );
+   ASSERT( report, rkv_delete( &cache ));
+}
+
+#define KEY_THREAD_COUNT 4
+#define KEYS_PER_THREAD  1000
+
+#define REMOVAL_DATES 2000
+#define REMOVAL_KEPT  10
+
+static bool wait_stats( struct tests_report * report, rkv cache, rkv_stats * stats, size_t tombstones, unsigned long compactions ) {
+   bool done = false;
+   for( unsigned retry = 0; ( retry < 2000 )&& ! done; ++retry ) {
+      struct timespec pause = { 0, 1000000 };
+      nanosleep( &pause, NULL );
+      ASSERT( report, rkv_refresh( cache ));
+      ASSERT( report, rkv_get_stats( cache, stats ));
+      done = ( stats->tombstones == tombstones )&&( stats->compactions >= compactions );
+   }
+   return done;
+}
+
+/**
+ * Les clés retirées quittent le cache au rafraîchissement, qui les rend comme RKV_REMOVED. Une
+ * mise à jour publiée après le retrait recrée la clé, même de valeur identique à celle d'avant
+ * le retrait avec publish_changes_only. La table se réduit quand la plupart des clés sont
+ * parties.
+ */
+static void removal( struct tests_report * report, const rkv_codec * const codecs[], size_t codec_count ) {
+   tests_chapter( report, "rkv remove" );
+   rkv           cache   = NULL;
+   rkv_txn       txn     = NULL;
+   rkv_options   options = rkv_options_Default;
+   rkv_stats     stats;
+   rkv_key       keys[REMOVAL_DATES+2];
+   rkv_key       never;
+   date          value   = { 8, 9, 2010 };
+   const void *  data    = NULL;
+   changes_count cc      = { 0, 0, 0, 0, 0 };
+   options.tombstone_ms         = 300;
+   options.compaction_ms        = 20;
+   options.publish_changes_only = true;
+   ASSERT( report, rkv_new_with_options( &cache, "239.0.0.90", 2442, codecs, codec_count, &options ));
+   ASSERT( report, rkv_add_changes_listener( cache, count_changes, &cc ));
+   ASSERT( report, rkv_key_make( &never ));
+   for( unsigned i = 0; i < REMOVAL_DATES + 2; ++i ) {
+      ASSERT( report, rkv_key_make( keys + i ));
+   }
+   for( unsigned i = 0; i < REMOVAL_DATES; ++i ) {
+      ASSERT( report, rkv_put_key( cache, "removal", keys + i, DATE_TYPE_ID, &value ));
+   }
+   ASSERT( report, rkv_put_key( cache, "removal", keys + REMOVAL_DATES, PERSON_TYPE_ID, &eve ));
+   ASSERT( report, rkv_put_key( cache, "removal", keys + REMOVAL_DATES + 1, PERSON_TYPE_ID, &muriel ));
+   ASSERT( report, rkv_publish( cache, "removal" ));
+   ASSERT( report, wait_type_count( report, cache, DATE_TYPE_ID, REMOVAL_DATES ));
+   ASSERT( report, wait_type_count( report, cache, PERSON_TYPE_ID, 2 ));
+   ASSERT( report, rkv_get_stats( cache, &stats ));
+   const size_t slots = stats.slots_allocated;
+   ASSERT( report, slots * 7 >= REMOVAL_DATES * 10 );
+
+   for( unsigned i = REMOVAL_KEPT; i < REMOVAL_DATES; ++i ) {
+      ASSERT( report, rkv_remove_key( cache, "removal", keys + i ));
+   }
+   ASSERT( report, rkv_put_key( cache, "removal", &never, DATE_TYPE_ID, &value ));
+   ASSERT( report, rkv_remove_key( cache, "removal", &never )); // le retrait remplace l'écriture
+   ASSERT( report, rkv_publish( cache, "removal" ));
+   ASSERT( report, rkv_txn_begin( cache, 0, &txn ));
+   ASSERT( report, rkv_txn_remove( txn, keys + REMOVAL_DATES ));
+   ASSERT( report, rkv_txn_publish( txn, NULL ));
+   ASSERT( report, wait_type_count( report, cache, DATE_TYPE_ID, REMOVAL_KEPT ));
+   ASSERT( report, wait_type_count( report, cache, PERSON_TYPE_ID, 1 ));
+   ASSERT( report, cc.added == REMOVAL_DATES + 2 );
+   ASSERT( report, cc.removed == REMOVAL_DATES - REMOVAL_KEPT + 1 );
+   ASSERT( report, rkv_get_key( cache, keys, &data ));
+   ASSERT( report, ! rkv_get_key( cache, keys + REMOVAL_KEPT, &data ));
+   ASSERT( report, ! rkv_get_key( cache, keys + REMOVAL_DATES, &data ));
+   ASSERT( report, ! rkv_get_key( cache, &never, &data ));
+   ASSERT( report, rkv_get_stats( cache, &stats ));
+   ASSERT( report, stats.entries_removed == REMOVAL_DATES - REMOVAL_KEPT + 1 );
+
+   tests_chapter( report, "rkv remove then put" );
+   ASSERT( report, rkv_txn_put( txn, keys + REMOVAL_KEPT, DATE_TYPE_ID, &value ));
+   ASSERT( report, rkv_txn_publish( txn, NULL ));
+   ASSERT( report, wait_date( report, cache, keys + REMOVAL_KEPT, &value ));
+   ASSERT( report, rkv_get_stats( cache, &stats ));
+   ASSERT( report, stats.updates_shadowed == 0 );
+   ASSERT( report, rkv_txn_remove( txn, keys + REMOVAL_KEPT ));
+   ASSERT( report, rkv_txn_publish( txn, NULL ));
+   ASSERT( report, wait_type_count( report, cache, DATE_TYPE_ID, REMOVAL_KEPT ));
+   ASSERT( report, ! rkv_get_key( cache, keys + REMOVAL_KEPT, &data ));
+
+   tests_chapter( report, "rkv remove compaction" );
+   ASSERT( report, wait_stats( report, cache, &stats, 0, 1 ));
+   ASSERT( report, stats.slots_allocated < slots );
+   ASSERT( report, stats.ids_in_use == REMOVAL_KEPT + 1 );
+   size_t count = 0;
+   ASSERT( report, rkv_foreach_type( cache, DATE_TYPE_ID, count_dates, &count ));
+   ASSERT( report, count == REMOVAL_KEPT );
+   ASSERT( report, rkv_txn_put( txn, keys + REMOVAL_KEPT, DATE_TYPE_ID, &value ));
+   ASSERT( report, rkv_txn_publish( txn, NULL ));
+   ASSERT( report, wait_date( report, cache, keys + REMOVAL_KEPT, &value ));
+   ASSERT( report, rkv_txn_delete( &txn ));
+   ASSERT( report, rkv_delete( &cache ));
+}
+
+#define LIVENESS_DATES 100
+
+static bool wait_liveness( struct tests_report * report, rkv cache, rkv_stats * stats, size_t alive, unsigned long expired ) {
+   bool done = false;
+   for( unsigned retry = 0; ( retry < 3000 )&& ! done; ++retry ) {
+      struct timespec pause = { 0, 1000000 };
+      nanosleep( &pause, NULL );
+      ASSERT( report, rkv_refresh( cache ));
+      ASSERT( report, rkv_get_stats( cache, stats ));
+      done = ( stats->publishers_alive == alive )&&( stats->entries_expired == expired );
+   }
+   return done;
+}
+
+/**
+ * Les valeurs d'un type à durée de vie expirent sans mise à jour, les autres restent tant que le
+ * processus qui a créé leurs clés émet des battements de cœur. Quand le cache émetteur disparaît,
+ * le cache récepteur les retire toutes et les rend comme RKV_EXPIRED.
+ */
+static void liveness( struct tests_report * report, const rkv_codec * const codecs[], size_t codec_count ) {
+   tests_chapter( report, "rkv heartbeats" );
+   rkv           publisher = NULL;
+   rkv           receiver  = NULL;
+   rkv_options   options   = rkv_options_Default;
+   rkv_stats     stats;
+   rkv_key       keys[LIVENESS_DATES+2];
+   date          value     = { 1, 4, 2011 };
+   const void *  data      = NULL;
+   changes_count cc        = { 0, 0, 0, 0, 0 };
+   options.heartbeat_ms = 50;
+   ASSERT( report, rkv_new_with_options( &publisher, "239.0.0.91", 2443, codecs, codec_count, &options ));
+   options.heartbeat_ms         = 0; // seul publisher signale que ce processus est vivant
+   options.publisher_timeout_ms = 300;
+   options.compaction_ms        = 20;
+   ASSERT( report, rkv_new_with_options( &receiver, "239.0.0.91", 2443, codecs, codec_count, &options ));
+   ASSERT( report, rkv_add_changes_listener( receiver, count_changes, &cc ));
+   ASSERT( report, ! rkv_set_type_ttl( receiver, 0xFFFFFFFEU, 100 ));
+   ASSERT( report, rkv_set_type_ttl( receiver, PERSON_TYPE_ID, 200 ));
+   for( unsigned i = 0; i < LIVENESS_DATES + 2; ++i ) {
+      ASSERT( report, rkv_key_make( keys + i ));
+   }
+   ASSERT( report, ! rkv_put_key( publisher, "liveness", keys, 0xFFFFFFFEU, &value ));
+   for( unsigned i = 0; i < LIVENESS_DATES; ++i ) {
+      ASSERT( report, rkv_put_key( publisher, "liveness", keys + i, DATE_TYPE_ID, &value ));
+   }
+   ASSERT( report, rkv_put_key( publisher, "liveness", keys + LIVENESS_DATES, PERSON_TYPE_ID, &eve ));
+   ASSERT( report, rkv_put_key( publisher, "liveness", keys + LIVENESS_DATES + 1, PERSON_TYPE_ID, &muriel ));
+   ASSERT( report, rkv_publish( publisher, "liveness" ));
+   ASSERT( report, wait_type_count( report, receiver, DATE_TYPE_ID, LIVENESS_DATES ));
+   ASSERT( report, wait_liveness( report, receiver, &stats, 1, 0 ));
+   ASSERT( report, stats.heartbeats_sent == 0 );
+   ASSERT( report, rkv_get_stats( publisher, &stats ));
+   ASSERT( report, stats.heartbeats_sent > 0 );
+   ASSERT( report, stats.publishers_alive == 0 ); // publisher_timeout_ms vaut 0
+
+   tests_chapter( report, "rkv type TTL" );
+   ASSERT( report, wait_liveness( report, receiver, &stats, 1, 2 ));
+   ASSERT( report, cc.expired == 2 );
+   ASSERT( report, stats.entries_removed == 0 );
+   size_t count = 0;
+   ASSERT( report, rkv_count_type( receiver, PERSON_TYPE_ID, &count ));
+   ASSERT( report, count == 0 );
+   ASSERT( report, ! rkv_get_key( receiver, keys + LIVENESS_DATES, &data ));
+   ASSERT( report, rkv_get_key( receiver, keys, &data ));
+   ASSERT( report, rkv_set_type_ttl( receiver, PERSON_TYPE_ID, 0 ));
+   ASSERT( report, rkv_put_key( publisher, "liveness", keys + LIVENESS_DATES, PERSON_TYPE_ID, &eve ));
+   ASSERT( report, rkv_publish( publisher, "liveness" ));
+   ASSERT( report, wait_type_count( report, receiver, PERSON_TYPE_ID, 1 ));
+
+   tests_chapter( report, "rkv publisher timeout" );
+   ASSERT( report, rkv_delete( &publisher ));
+   ASSERT( report, wait_liveness( report, receiver, &stats, 0, LIVENESS_DATES + 3 ));
+   ASSERT( report, stats.publishers_expired == 1 );
+   ASSERT( report, cc.expired == LIVENESS_DATES + 3 );
+   ASSERT( report, cc.removed == 0 );
+   ASSERT( report, rkv_count_type( receiver, DATE_TYPE_ID, &count ));
+   ASSERT( report, count == 0 );
+   ASSERT( report, rkv_count_type( receiver, PERSON_TYPE_ID, &count ));
+   ASSERT( report, count == 0 );
+   ASSERT( report, wait_stats( report, receiver, &stats, 0, 0 ));
+   ASSERT( report, stats.ids_in_use == 0 );
+   ASSERT( report, rkv_delete( &receiver ));
+}
+
+static void * make_keys( void * arg ) {
+   rkv_key * keys = (rkv_key *)arg;
+   for( unsigned i = 0; i < KEYS_PER_THREAD; ++i ) {
+      rkv_key_make( &keys[i] );
+   }
+   return NULL;
+}
+
+/**
+ * Les clés par valeur sont générées sans doublon par plusieurs threads, rangées dans un tableau
+ * et utilisées directement par rkv_put_key() et rkv_get_key().
+ */
+static void value_keys( struct tests_report * report, const rkv_codec * const codecs[], size_t codec_count ) {
+   tests_chapter( report, "rkv key" );
+   static rkv_key keys[KEY_THREAD_COUNT*KEYS_PER_THREAD];
+   pthread_t      threads[KEY_THREAD_COUNT];
+   for( unsigned i = 0; i < KEY_THREAD_COUNT; ++i ) {
+      ASSERT( report, pthread_create( &threads[i], NULL, make_keys, &keys[i*KEYS_PER_THREAD] ) == 0 );
+   }
+   for( unsigned i = 0; i < KEY_THREAD_COUNT; ++i ) {
+      pthread_join( threads[i], NULL );
+   }
+   const size_t count = sizeof( keys ) / sizeof( keys[0] );
+   qsort( keys, count, sizeof( rkv_key ), rkv_key_compare );
+   bool unique = true;
+   for( size_t i = 1; i < count; ++i ) {
+      unique = unique &&( rkv_key_compare( &keys[i-1], &keys[i] ) < 0 ) && ! rkv_key_equals( &keys[i-1], &keys[i] );
+   }
+   ASSERT( report, unique );
+   ASSERT( report, sizeof( rkv_key ) == 16 );
+
+   rkv_id  id   = NULL;
+   rkv_key copy;
+   ASSERT( report, rkv_id_from_key( &id, &keys[0] ));
+   ASSERT( report, rkv_id_get_key( id, &copy ));
+   ASSERT( report, rkv_key_equals( &copy, &keys[0] ));
+   ASSERT( report, rkv_key_hash( &copy ) == rkv_key_hash( &keys[0] ));
+   ASSERT( report, rkv_id_delete( &id ));
+
+   tests_chapter( report, "rkv put and get by key" );
+   rkv        cache = NULL;
+   const date d     = { 14, 7, 1789 };
+   ASSERT( report, rkv_new( &cache, "239.0.0.70", 2420, codecs, codec_count ));
+   for( unsigned i = 0; i < 16; ++i ) {
+      ASSERT( report, rkv_put_key( cache, "keys", &keys[i], DATE_TYPE_ID, &d ));
+   }
+   ASSERT( report, rkv_publish( cache, "keys" ));
+   const void * data     = NULL;
+   bool         received = false;
+   for( unsigned retry = 0; ( retry < 500 )&& ! received; ++retry ) {
+      struct timespec pause = { 0, 1000000 };
+      nanosleep( &pause, NULL );
+      ASSERT( report, rkv_refresh( cache ));
+      received = rkv_get_key( cache, &keys[15], &data );
+   }
+   ASSERT( report, received );
+   bool all_equals = true;
+   for( unsigned i = 0; i < 16; ++i ) {
+      all_equals = all_equals
+         && rkv_get_key( cache, &keys[i], &data )
+         &&( date_compare((const date *)data, &d ) == 0 );
+   }
+   ASSERT( report, all_equals );
+   ASSERT( report, rkv_delete( &cache ));
+}
+
 void rkv_test( struct tests_report * report ) {
    const char * trnsctn_name = "Ma transaction";
    rkv This = NULL;
    rkv_codec date_codec = {
-      DATE_TYPE_ID,
-      date_encode,
-      date_decode,
-      date_releaser
+      .type         = DATE_TYPE_ID,
+      .payload_size = sizeof( date ),
+      .layout       = date_layout,
+      .layout_count = sizeof( date_layout ) / sizeof( date_layout[0] )
    };
    rkv_codec person_codec = {
       PERSON_TYPE_ID,
       person_encode,
       person_decode,
-      person_releaser
+      person_releaser,
+      0U,
+      person_bind,
+      NULL,
+      0U
    };
    tests_chapter( report, "rkv id new" );
    ASSERT( report, rkv_id_new( &eve_id ));
@@ -270,8 +1779,36 @@ void rkv_test( struct tests_report * report ) {
    tests_chapter( report, "rkv foreach" );
    rkv_foreach( This, dump, report );
 
+   tests_chapter( report, "rkv pools" );
+   rkv_stats stats;
+   ASSERT( report, rkv_get_stats( This, &stats ));
+   ASSERT( report, stats.ids_in_use == 4 );
+   ASSERT( report, stats.ids_allocated >= stats.ids_in_use );
+   ASSERT( report, stats.payloads_in_use == 1 ); // seules les dates sont de taille fixe
+   ASSERT( report, stats.payloads_allocated >= stats.payloads_in_use );
+
    tests_chapter( report, "rkv delete" );
    ASSERT( report, rkv_delete( &This ));
+
+   large_transaction( report, codecs, sizeof(codecs)/sizeof(codecs[0] ));
+   concurrent_readers( report, codecs, sizeof(codecs)/sizeof(codecs[0] ));
+   value_keys( report, codecs, sizeof(codecs)/sizeof(codecs[0] ));
+   recycled_payloads( report, codecs, sizeof(codecs)/sizeof(codecs[0] ));
+   changes_only( report, codecs, sizeof(codecs)/sizeof(codecs[0] ));
+   late_joiner( report, codecs, sizeof(codecs)/sizeof(codecs[0] ));
+   warm_restart( report, codecs, sizeof(codecs)/sizeof(codecs[0] ));
+   journal( report, codecs, sizeof(codecs)/sizeof(codecs[0] ));
+   sharded( report, codecs, sizeof(codecs)/sizeof(codecs[0] ));
+   decode_workers( report, codecs, sizeof(codecs)/sizeof(codecs[0] ));
+   tail_loss( report, codecs, sizeof(codecs)/sizeof(codecs[0] ));
+   listeners( report, codecs, sizeof(codecs)/sizeof(codecs[0] ));
+   subscription( report, codecs, sizeof(codecs)/sizeof(codecs[0] ));
+   transaction_handles( report, codecs, sizeof(codecs)/sizeof(codecs[0] ));
+   auto_publish( report, codecs, sizeof(codecs)/sizeof(codecs[0] ));
+   change_sets( report, codecs, sizeof(codecs)/sizeof(codecs[0] ));
+   typed_iteration( report, codecs, sizeof(codecs)/sizeof(codecs[0] ));
+   removal( report, codecs, sizeof(codecs)/sizeof(codecs[0] ));
+   liveness( report, codecs, sizeof(codecs)/sizeof(codecs[0] ));
    ASSERT( report, rkv_id_delete( &eve_id ));
    ASSERT( report, rkv_id_delete( &muriel_id ));
    ASSERT( report, rkv_id_delete( &aubin_id ));